@@ -4,6 +4,11 @@
 #include "utils.h"
 #include "matrix4x4.h"
 #include "glutils.h"
+#include "mymath.h"
+#include "textureregistry.h"
+#include <chrono>
+#include <set>
+#include <algorithm>
 
 Rasterizer::Rasterizer(const int width, const int height, const float fov_y, const Vector3 view_from, const Vector3 view_at)
 {
@@ -30,37 +35,304 @@ struct GLMaterial
 };
 #pragma pack( pop )
 
+/* std430 layout of the Object record of the vertex shaders, one per surface */
+struct GLObject
+{
+	Vector3 aabb_min; // bounds in model space
+	GLint material_index;
+	Vector3 aabb_max;
+	GLint pad;
+};
+
+/* command of glMultiDrawElementsIndirect, see the OpenGL specification */
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/* std140 layout of the FrameData uniform block of the vertex shaders, the matrices are row-major */
+struct GLFrameData
+{
+	GLfloat MVP[16];
+	GLfloat MVN[16];
+	GLfloat light_position[3];
+	GLfloat pad0;
+	GLfloat view_from[3];
+	GLfloat pad1;
+	GLfloat previous_MVP[16]; // of the frame the depth pyramid of the culling comes from
+};
+
 void Rasterizer::initMaterials() {
 
+	// only the texture slots sampled by the shaders are decoded, all of them at once on the pool
+	for (const auto & material : materials_) {
+		for (int slot = 0; slot < NO_TEXTURES; ++slot) {
+			if (texture_slots_ & (1 << slot)) {
+				material->RequestTexture(slot, &texture_pool_);
+			}
+		}
+	}
+
 	GLMaterial * gl_materials = new GLMaterial[materials_.size()];
 	int m = 0;
+	// textures still decoded on the pool are waited for only here, right before their upload
+	int no_waits = 0;
+	double t_wait = 0.0;
+	// materials sharing a texture share its GPU copy too
+	std::map<Texture *, int> uploaded_textures;
+	material_textures_.assign(materials_.size(), -1);
+	int no_compressed = 0;
+	size_t compressed_bytes = 0;
+	size_t uncompressed_bytes = 0;
 	for (const auto & material : materials_) {
+		if (!material->texture_ready(Material::kDiffuseMapSlot)) {
+			const auto t0 = std::chrono::steady_clock::now();
+			material->texture(Material::kDiffuseMapSlot);
+			t_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			++no_waits;
+		}
 		Texture * tex_diffuse = material->texture(Material::kDiffuseMapSlot);
-		if (tex_diffuse) {
-			GLuint id = 0;
-			CreateBindlessTexture(id, gl_materials[m].tex_diffuse_handle, tex_diffuse->width(), tex_diffuse->height(), tex_diffuse->data());
+		std::map<Texture *, int>::const_iterator uploaded = uploaded_textures.find(tex_diffuse);
+		if (tex_diffuse && (uploaded != uploaded_textures.end())) {
+			material_textures_[m] = uploaded->second;
+			gl_materials[m].diffuse = Color3f{ 1.0f, 1.0f, 1.0f }; // white diffuse color
+		}
+		else if (tex_diffuse && virtual_texturing_) {
+			// split into tiles streamed on demand, only the tail tile is uploaded here
+			material_textures_[m] = virtual_textures_.Add(tex_diffuse);
 			gl_materials[m].diffuse = Color3f{ 1.0f, 1.0f, 1.0f }; // white diffuse color
+			uploaded_textures[tex_diffuse] = material_textures_[m];
+		}
+		else if (tex_diffuse && use_texture_arrays_) {
+			// uploaded into its array by Build below once the sizes of all textures are known
+			material_textures_[m] = texture_arrays_.Add(tex_diffuse);
+			gl_materials[m].diffuse = Color3f{ 1.0f, 1.0f, 1.0f }; // white diffuse color
+			uploaded_textures[tex_diffuse] = material_textures_[m];
+		}
+		else if (tex_diffuse) {
+			// only the stand-in is uploaded here, the full chains follow below as long as they fit into the budget
+			if (tex_diffuse->block_format() != BlockFormat::NONE) {
+				// block compressed mip chain baked into the scene cache
+				compressed_bytes += TextureResidency::ChainBytes(tex_diffuse, 0, tex_diffuse->block_format());
+				uncompressed_bytes += TextureResidency::ChainBytes(tex_diffuse, 0, BlockFormat::NONE);
+				++no_compressed;
+			}
+			material_textures_[m] = texture_residency_.Add(tex_diffuse);
+			gl_materials[m].diffuse = Color3f{ 1.0f, 1.0f, 1.0f }; // white diffuse color
+			uploaded_textures[tex_diffuse] = material_textures_[m];
+		}
+		else if (virtual_texturing_ || use_texture_arrays_) {
+			gl_materials[m].diffuse = material->diffuse();
 		}
 		else {
-			GLuint id = 0;
-			GLubyte data[] = { 255, 255, 255, 255 }; // opaque white
-			CreateBindlessTexture(id, gl_materials[m].tex_diffuse_handle, 1, 1, data); // white texture
+			if (white_texture_ == 0) {
+				GLubyte data[] = { 255, 255, 255, 255 }; // opaque white
+				CreateBindlessTexture(white_texture_, white_handle_, 1, 1, data); // white texture
+			}
+			gl_materials[m].tex_diffuse_handle = white_handle_;
 			gl_materials[m].diffuse = material->diffuse();
-		}		
+		}
+		if ((material_textures_[m] >= 0) && !virtual_texturing_ && !use_texture_arrays_) {
+			texture_residency_.Touch(material_textures_[m], 0);
+		}
 		gl_materials[m].specular = material->specular(); // white specular color
 		gl_materials[m].ambient = material->ambient(); // white ambient color
 		gl_materials[m].shininess = material->shininess;
 		
 		m++;
 	}
+	texture_residency_.Update(0);
+	if (use_texture_arrays_) {
+		texture_arrays_.Build();
+	}
+	for (size_t i = 0; i < materials_.size(); ++i) {
+		if (virtual_texturing_) {
+			// the shaders read the id of the virtual texture from the lower half of the handle
+			gl_materials[i].tex_diffuse_handle = (material_textures_[i] >= 0) ? material_textures_[i] : VT_NO_TILE;
+		}
+		else if (use_texture_arrays_) {
+			// array in the lower half of the handle and layer in the upper one
+			gl_materials[i].tex_diffuse_handle = (material_textures_[i] >= 0) ? (GLuint64(texture_arrays_.layer(material_textures_[i])) << 32) |
+				texture_arrays_.array(material_textures_[i]) : TEXTURE_ARRAY_NONE;
+		}
+		else if (material_textures_[i] >= 0) {
+			gl_materials[i].tex_diffuse_handle = texture_residency_.handle(material_textures_[i]);
+		}
+	}
+
 	ssbo_materials = 0;
 	glGenBuffers(1, &ssbo_materials);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_materials);
 	const GLsizeiptr gl_materials_size = sizeof(GLMaterial) * materials_.size();
-	glBufferData(GL_SHADER_STORAGE_BUFFER, gl_materials_size, gl_materials, GL_STATIC_DRAW);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gl_materials_size, gl_materials, GL_DYNAMIC_DRAW); // handles change with the residency
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo_materials);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	SAFE_DELETE_ARRAY(gl_materials);
+
+	printf("Waited %s for %d texture(s) still being decoded.\n", TimeToString(t_wait).c_str(), no_waits);
+	printf("%zu diffuse texture(s) uploaded for %zu material(s).\n", uploaded_textures.size(), materials_.size());
+	if (no_compressed > 0) {
+		printf("%d of them block compressed (%0.1f MB instead of %0.1f MB of RGBA8 mip chains).\n", no_compressed,
+			compressed_bytes / sqr(1024.0f), uncompressed_bytes / sqr(1024.0f));
+	}
+	if (virtual_texturing_) {
+		printf("%zu virtual texture(s) in %0.1f MB tile cache instead of %0.1f MB of RGBA8 mip chains.\n", virtual_textures_.no_textures(),
+			virtual_textures_.cache_bytes() / sqr(1024.0f), virtual_textures_.full_bytes() / sqr(1024.0f));
+	}
+	if (use_texture_arrays_) {
+		printf("%zu texture(s) packed into %zu array(s) (%0.1f MB), %zu stored from a coarser mip level and %zu resampled.\n",
+			texture_arrays_.no_textures(), texture_arrays_.no_arrays(), texture_arrays_.bytes() / sqr(1024.0f),
+			texture_arrays_.no_reduced(), texture_arrays_.no_resampled());
+	}
+	if (texture_residency_.budget() > 0) {
+		printf("%0.1f MB of textures resident within the budget of %0.1f MB.\n", texture_residency_.resident_bytes() / sqr(1024.0f),
+			texture_residency_.budget() / sqr(1024.0f));
+	}
+
+	// lazy texture slots nobody asked for, the decoding time is estimated from the rate of the decoded textures
+	std::set<std::string> skipped_files;
+	for (const auto & material : materials_) {
+		for (int slot = 0; slot < NO_TEXTURES; ++slot) {
+			if (!material->texture_requested(slot) && !material->texture_file(slot).empty()) {
+				skipped_files.insert(material->texture_file(slot));
+			}
+		}
+	}
+	long long skipped_bytes = 0;
+	for (const std::string & file_name : skipped_files) {
+		skipped_bytes += max(0LL, GetFileSize64(file_name.c_str()));
+	}
+	const TextureRegistry & textures = TextureRegistry::instance();
+	const double skipped_time = (textures.decoded_bytes() > 0) ?
+		textures.decode_time() * skipped_bytes / textures.decoded_bytes() : 0.0;
+	printf("Skipped %zu texture(s) not sampled by the shaders (%0.1f MB of image files, about %s of decoding).\n",
+		skipped_files.size(), skipped_bytes / sqr(1024.0f), TimeToString(skipped_time).c_str());
+}
+
+void Rasterizer::set_texture_budget(const size_t budget) {
+	texture_residency_.set_budget(budget);
+}
+
+void Rasterizer::set_virtual_texturing(const bool enabled) {
+	virtual_texturing_ = enabled;
+}
+
+void Rasterizer::set_texture_arrays(const bool enabled) {
+	use_texture_arrays_ = enabled;
+}
+
+bool Rasterizer::texture_arrays() const {
+	return use_texture_arrays_;
+}
+
+int Rasterizer::texture_binds() const {
+	return texture_binds_;
+}
+
+void Rasterizer::set_gpu_culling(const bool enabled) {
+	use_gpu_culling_ = enabled;
+	use_cpu_culling_ = use_cpu_culling_ && !enabled;
+	use_occlusion_culling_ = use_occlusion_culling_ && use_cpu_culling_;
+}
+
+void Rasterizer::set_cpu_culling(const bool enabled) {
+	use_cpu_culling_ = enabled;
+	use_gpu_culling_ = use_gpu_culling_ && !enabled;
+	use_occlusion_culling_ = use_occlusion_culling_ && enabled;
+}
+
+void Rasterizer::set_occlusion_culling(const bool enabled) {
+	if (enabled) {
+		set_cpu_culling(true);
+	}
+	use_occlusion_culling_ = enabled;
+}
+
+void Rasterizer::set_headless(const bool enabled) {
+	headless_ = enabled;
+}
+
+void Rasterizer::set_capture(const std::string & prefix, const CaptureFormat format, const bool depth, const int latency) {
+	capture_prefix_ = prefix;
+	capture_format_ = format;
+	capture_depth_ = depth;
+	capture_latency_ = latency;
+}
+
+FrameCapture::Stats Rasterizer::capture_stats() const {
+	return frame_capture_.stats();
+}
+
+void Rasterizer::set_profiling(const bool enabled) {
+	profiling_ = enabled;
+}
+
+const GpuProfiler & Rasterizer::profiler() const {
+	return profiler_;
+}
+
+bool Rasterizer::feedbackPass() {
+	// the same frame uniform block as the main pass, lod_bias is set once by InitDevice
+	glUseProgram(feedback_program);
+
+	virtual_textures_.Bind(0, 1, 2);
+	virtual_textures_.BeginFeedback();
+	drawScene();
+	const bool ready = virtual_textures_.EndFeedback(feedback_ids_);
+	glViewport(0, 0, camera.width_, camera.height_);
+
+	return ready;
+}
+
+void Rasterizer::updateVirtualTextures(const int frame) {
+	if (feedbackPass()) {
+		virtual_textures_.ProcessFeedback(feedback_ids_, frame);
+	}
+	virtual_textures_.Update(frame);
+	virtual_textures_.Bind(0, 1, 2);
+}
+
+void Rasterizer::updateTextureResidency(const int frame) {
+	// the surfaces drawn by the single draw call, all of them unless the CPU culling knows the visible ones, the ones
+	// kept by the GPU culling are read back a ring region late by retireCulledCommands
+	const size_t no_drawn = use_cpu_culling_ ? visible_surfaces_.size() : (culled_commands_buffer_ != 0) ? 0 : surfaces_.size();
+	for (size_t i = 0; i < no_drawn; ++i) {
+		const Surface * surface = surfaces_[use_cpu_culling_ ? visible_surfaces_[i] : i];
+		const int m = surface->get_material()->materialIndex;
+		if (material_textures_[m] >= 0) {
+			texture_residency_.Touch(material_textures_[m], frame);
+		}
+	}
+
+	if (texture_residency_.Update(frame) > 0) {
+		// handles of the evicted textures are replaced by their stand-ins before the next draw samples them
+		for (size_t i = 0; i < materials_.size(); ++i) {
+			if (material_textures_[i] >= 0) {
+				const GLuint64 handle = texture_residency_.handle(material_textures_[i]);
+				glNamedBufferSubData(ssbo_materials, i * sizeof(GLMaterial) + offsetof(GLMaterial, tex_diffuse_handle), sizeof(GLuint64), &handle);
+			}
+		}
+	}
+}
+
+void Rasterizer::retireCulledCommands(const int region, const int frame) {
+	if (!culled_commands_valid_[region]) return;
+
+	// the region has passed its fence, the read does not wait for the GPU
+	glGetNamedBufferSubData(culled_commands_buffer_, region * culled_commands_.size() * sizeof(GLuint),
+		culled_commands_.size() * sizeof(GLuint), culled_commands_.data());
+	const GLuint draw_count = min(culled_commands_[0], static_cast<GLuint>(no_draws));
+	for (GLuint i = 0; i < draw_count; ++i) {
+		const int m = surfaces_[culled_commands_[1 + i * 5 + 4]]->get_material()->materialIndex; // baseInstance
+		if (material_textures_[m] >= 0) {
+			texture_residency_.Touch(material_textures_[m], frame);
+		}
+	}
+	culled_commands_valid_[region] = false;
 }
 
 int Rasterizer::initFrameBuffer() {
@@ -93,13 +365,13 @@ int Rasterizer::initFrameBuffer() {
 
 	glGenFramebuffers(1, &fboDownsample);
 	glBindFramebuffer(GL_FRAMEBUFFER, fboDownsample);
-	// Color downsample renderbuffer.
+	// Color downsample renderbuffer, the resolve of the color attachment 0 of fbo of the same format.
 	glGenTextures(1, &rboDownsampleColor);
 	glBindTexture(GL_TEXTURE_2D, rboDownsampleColor);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, camera.width_, camera.height_, 0, GL_RGB, GL_FLOAT, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, camera.width_, camera.height_, 0, GL_RGBA, GL_FLOAT, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, rboDownsampleColor, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rboDownsampleColor, 0);
 	// Position downsample renderbuffer.
 	glGenTextures(1, &rboDownsamplePosition);
 	glBindTexture(GL_TEXTURE_2D, rboDownsamplePosition);
@@ -107,13 +379,40 @@ int Rasterizer::initFrameBuffer() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, rboDownsamplePosition, 0);
+	// Depth downsample texture, one sample of each pixel of fbo.
+	glGenTextures(1, &rboDownsampleDepth);
+	glBindTexture(GL_TEXTURE_2D, rboDownsampleDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, camera.width_, camera.height_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, rboDownsampleDepth, 0);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) return -1;
 
+	if (!capture_prefix_.empty() && (frame_capture_.Init(camera.width_, camera.height_, capture_prefix_, capture_format_,
+		capture_depth_, capture_latency_) != 0)) return -1;
+	if (profiling_ && (profiler_.Init() != 0)) return -1;
+
+	if (virtual_texturing_ && (virtual_textures_.Init(camera.width_, camera.height_) != 0)) return -1;
+
 	return S_OK;
 }
 
 void Rasterizer::loadScene(const std::string file_name) {
-	const int no_surfaces = LoadOBJ("../../data/6887_allied_avenger_gi.obj", surfaces_, materials_);
+	const char * obj_file_name = file_name.c_str();
+	int no_surfaces = scene_cache_.Load(obj_file_name, surfaces_, materials_);
+	bool save_cache = false;
+	if (no_surfaces < 0) {
+		// textures are decoded on the pool while the geometry is parsed and uploaded
+		ObjLoaderContext context;
+		context.texture_pool = &texture_pool_;
+		context.texture_slots = texture_slots_;
+		no_surfaces = LoadOBJParallel(obj_file_name, surfaces_, materials_, context);
+		save_cache = (no_surfaces >= 0);
+
+		const TextureRegistry & textures = TextureRegistry::instance();
+		printf("%zu texture(s), %zu reference(s) shared by content (%0.1f MB of image files not decoded again).\n",
+			textures.no_textures(), textures.no_shared(), textures.shared_bytes() / sqr(1024.0f));
+	}
 	no_triangles = 0;
 
 	for (auto surface : surfaces_)
@@ -122,9 +421,49 @@ void Rasterizer::loadScene(const std::string file_name) {
 	}
 
 	this->initBuffers();
+
+	if (save_cache) {
+		SceneCache::Save(obj_file_name, surfaces_, materials_); // waits for all textures
+	}
 }
 
-int Rasterizer::InitDevice() {
+/* compiles the shader from the sources concatenated in the given order, adds the texture slots sampled by them */
+static GLuint CompileShader(const GLenum type, const std::vector<const char *> & file_names, int & texture_slots) {
+	std::vector<const char *> sources;
+	for (const char * file_name : file_names) {
+		const char * source = LoadShader(file_name);
+		if (source) {
+			texture_slots |= Material::SampledTextureSlots(source);
+			sources.push_back(source);
+		}
+	}
+
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, static_cast<GLsizei>(sources.size()), sources.data(), nullptr);
+	glCompileShader(shader);
+	for (const char * source : sources) {
+		delete[] source;
+	}
+	CheckShader(shader);
+
+	return shader;
+}
+
+int Rasterizer::createContext() {
+	if (headless_) {
+		// the same versions as the window, the pbuffer stands in for its back buffer
+		const int minor = (virtual_texturing_ || use_texture_arrays_) ? 5 : 6;
+		if (headless_context_.Create(camera.width_, camera.height_, 4, minor, 8) != 0) {
+			if ((minor == 5) || (headless_context_.Create(camera.width_, camera.height_, 4, 5, 8) != 0)) {
+				return EXIT_FAILURE;
+			}
+			use_texture_arrays_ = true;
+		}
+		printf("Headless %s context.\n", headless_context_.platform());
+
+		return (gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress)) ? S_OK : EXIT_FAILURE;
+	}
+
 	glfwSetErrorCallback(glfw_callback);
 
 	if (!glfwInit())
@@ -133,13 +472,20 @@ int Rasterizer::InitDevice() {
 	}
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, (virtual_texturing_ || use_texture_arrays_) ? 5 : 6); // the virtual textures and texture arrays need neither GL 4.6 nor bindless textures
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 8);
 	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 	glfwWindowHint(GLFW_DOUBLEBUFFER, GL_TRUE);
 
 	window = glfwCreateWindow(camera.width_, camera.height_, "PG2 OpenGL", nullptr, nullptr);
+	if (!window && !virtual_texturing_ && !use_texture_arrays_)
+	{
+		// drivers without GL 4.6 (e.g. Mesa llvmpipe) lack the bindless textures too
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		window = glfwCreateWindow(camera.width_, camera.height_, "PG2 OpenGL", nullptr, nullptr);
+		use_texture_arrays_ = (window != nullptr);
+	}
 	if (!window)
 	{
 		glfwTerminate();
@@ -157,6 +503,14 @@ int Rasterizer::InitDevice() {
 		}
 	}
 
+	return S_OK;
+}
+
+int Rasterizer::InitDevice() {
+	if (createContext() != S_OK) {
+		return EXIT_FAILURE;
+	}
+
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(gl_callback, nullptr);
 
@@ -165,6 +519,13 @@ int Rasterizer::InitDevice() {
 	printf(" (%s)\n", glGetString(GL_VENDOR));
 	printf("GLSL %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+	if (!virtual_texturing_ && !use_texture_arrays_ && !GLAD_GL_ARB_bindless_texture) {
+		use_texture_arrays_ = true;
+	}
+	if (use_texture_arrays_) {
+		printf("Texture arrays instead of the bindless textures.\n");
+	}
+
 	//check_gl();
 
 	//glEnable(GL_MULTISAMPLE);
@@ -174,20 +535,42 @@ int Rasterizer::InitDevice() {
 	// GL_LOWER_LEFT (OpenGL) or GL_UPPER_LEFT (DirectX, Windows) and GL_NEGATIVE_ONE_TO_ONE or GL_ZERO_TO_ONE
 	glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
 	
-	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	const char * vertex_shader_source = LoadShader("basic_shader.vert");
-	glShaderSource(vertex_shader, 1, &vertex_shader_source, nullptr);
-	glCompileShader(vertex_shader);
-	SAFE_DELETE_ARRAY(vertex_shader_source);
-	CheckShader(vertex_shader);
+	if (virtual_texturing_) {
+		// both fragment shaders share the page table lookup of vt_common.glsl
+		texture_slots_ = 0;
+		vertex_shader = CompileShader(GL_VERTEX_SHADER, { "compat_shader.vert" }, texture_slots_);
+		fragment_shader = CompileShader(GL_FRAGMENT_SHADER, { "vt_common.glsl", "vt_shader.frag" }, texture_slots_);
+		GLuint feedback_shader = CompileShader(GL_FRAGMENT_SHADER, { "vt_common.glsl", "vt_feedback.frag" }, texture_slots_);
+		feedback_program = glCreateProgram();
+		glAttachShader(feedback_program, vertex_shader);
+		glAttachShader(feedback_program, feedback_shader);
+		glLinkProgram(feedback_program);
+		glDeleteShader(feedback_shader);
+		glProgramUniform1f(feedback_program, glGetUniformLocation(feedback_program, "lod_bias"), virtual_textures_.feedback_lod_bias());
+	}
+	else if (use_texture_arrays_) {
+		texture_slots_ = 0;
+		vertex_shader = CompileShader(GL_VERTEX_SHADER, { "compat_shader.vert" }, texture_slots_);
+		fragment_shader = CompileShader(GL_FRAGMENT_SHADER, { "array_shader.frag" }, texture_slots_);
+	}
+	else {
+		vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+		const char * vertex_shader_source = LoadShader("basic_shader.vert");
+		glShaderSource(vertex_shader, 1, &vertex_shader_source, nullptr);
+		glCompileShader(vertex_shader);
+		texture_slots_ = (vertex_shader_source) ? Material::SampledTextureSlots(vertex_shader_source) : 0;
+		SAFE_DELETE_ARRAY(vertex_shader_source);
+		CheckShader(vertex_shader);
 
-	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	const char * fragment_shader_source = LoadShader("basic_shader.frag");
-	glShaderSource(fragment_shader, 1, &fragment_shader_source, nullptr);
-	glCompileShader(fragment_shader);
-	SAFE_DELETE_ARRAY(fragment_shader_source);
+		fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+		const char * fragment_shader_source = LoadShader("basic_shader.frag");
+		glShaderSource(fragment_shader, 1, &fragment_shader_source, nullptr);
+		glCompileShader(fragment_shader);
+		texture_slots_ |= (fragment_shader_source) ? Material::SampledTextureSlots(fragment_shader_source) : 0;
+		SAFE_DELETE_ARRAY(fragment_shader_source);
 
-	CheckShader(fragment_shader);
+		CheckShader(fragment_shader);
+	}
 
 	shader_program = glCreateProgram();
 	glAttachShader(shader_program, vertex_shader);
@@ -199,39 +582,71 @@ int Rasterizer::InitDevice() {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
+	if (uniform_ring_.Init(sizeof(GLFrameData)) != 0) {
+		return EXIT_FAILURE;
+	}
+
 	return S_OK;
 }
 
 int Rasterizer::initBuffers() {
-	const int no_vertices = no_triangles * 3;
-	Vertex* vertices = new Vertex[no_vertices];
+	int no_vertices = 0;
+	for (auto surface : surfaces_)
+	{
+		no_vertices += surface->no_vertices();
+	}
+
+	// the scene loaded from the cache is uploaded straight from its mapped arrays, their layout is the same as below
+	const bool cached = (scene_cache_.vertices() != nullptr) && (scene_cache_.no_vertices() == static_cast<size_t>(no_vertices)) &&
+		(scene_cache_.no_triangles() == static_cast<size_t>(no_triangles));
+	Vertex* vertices = (cached) ? nullptr : new Vertex[no_vertices];
+	Triangle3ui* indices = (cached) ? nullptr : new Triangle3ui[no_triangles];
 
 	const int vertex_stride = sizeof(Vertex);
 
-	int k = 0;
-	for (auto surface : surfaces_)
+	// every surface is drawn by its own command of the single multi-draw, its object comes through baseInstance
+	no_draws = static_cast<int>(surfaces_.size());
+	std::vector<DrawElementsIndirectCommand> commands(no_draws);
+	std::vector<GLObject> objects(no_draws);
+
+	int k = 0; // first vertex of the current surface
+	int t = 0;
+	for (int s = 0; s < no_draws; ++s)
 	{
-		// triangles loop
-		for (int i = 0; i < surface->no_triangles(); ++i)
-		{
-			Triangle & triangle = surface->get_triangle(i);
+		Surface * surface = surfaces_[s];
+		commands[s] = DrawElementsIndirectCommand{ static_cast<GLuint>(surface->no_triangles() * 3), 1, static_cast<GLuint>(t * 3), k, static_cast<GLuint>(s) };
+		objects[s].material_index = surface->get_material()->materialIndex;
+		objects[s].aabb_min = surface->get_aabb_min();
+		objects[s].aabb_max = surface->get_aabb_max();
+
+		if (!cached) {
 			// vertices loop
-			for (int j = 0; j < 3; ++j, ++k)
+			for (int i = 0; i < surface->no_vertices(); ++i)
 			{
-				vertices[k] = triangle.vertex(j);
-				vertices[k].materialIndex = surface->get_material()->materialIndex;
+				vertices[k + i] = surface->get_vertices()[i];
 			} // end of vertices loop
 
-		} // end of triangles loop
+			// triangles loop, indices stay relative to the surface and the command adds its base vertex
+			for (int i = 0; i < surface->no_triangles(); ++i)
+			{
+				indices[t + i] = surface->get_indices()[i];
+			} // end of triangles loop
+		}
 
+		k += surface->no_vertices();
+		t += surface->no_triangles();
 	} // end of surfaces loop
+
+	printf("Mesh: %d triangles, %d unique vertices (%0.1f MB) and %d indices (%0.1f MB), non-indexed vertices would take %0.1f MB.\n",
+		no_triangles, no_vertices, no_vertices * sizeof(Vertex) / sqr(1024.0), no_triangles * 3,
+		no_triangles * sizeof(Triangle3ui) / sqr(1024.0), no_triangles * 3 * sizeof(Vertex) / sqr(1024.0));
 	
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
 	glGenBuffers(1, &vbo); // generate vertex buffer object (one of OpenGL objects) and get the unique ID corresponding to that buffer
 	glBindBuffer(GL_ARRAY_BUFFER, vbo); // bind the newly created buffer to the GL_ARRAY_BUFFER target
-	glBufferData(GL_ARRAY_BUFFER, no_vertices * sizeof(Vertex), vertices, GL_STATIC_DRAW); // copies the previously defined vertex data into the buffer's memory
+	glBufferData(GL_ARRAY_BUFFER, no_vertices * sizeof(Vertex), (cached) ? scene_cache_.vertices() : vertices, GL_STATIC_DRAW); // copies the previously defined vertex data into the buffer's memory
 																			   // vertex position
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertex_stride, 0);
 	glEnableVertexAttribArray(0);
@@ -248,74 +663,508 @@ int Rasterizer::initBuffers() {
 	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, vertex_stride, (void*)(11 * sizeof(float)));
 	glEnableVertexAttribArray(4);
 
-	glVertexAttribIPointer(5, 1, GL_INT, vertex_stride, (void*) (14 * sizeof(float)));
-	glEnableVertexAttribArray(5);
+	glGenBuffers(1, &ebo); // element buffer object stays bound to the vao
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, no_triangles * sizeof(Triangle3ui), (cached) ? scene_cache_.triangles() : indices, GL_STATIC_DRAW);
+
+	glCreateBuffers(1, &indirect_buffer);
+	glNamedBufferStorage(indirect_buffer, no_draws * sizeof(DrawElementsIndirectCommand), commands.data(), 0);
+	glCreateBuffers(1, &ssbo_objects);
+	glNamedBufferStorage(ssbo_objects, no_draws * sizeof(GLObject), objects.data(), 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo_objects);
+	printf("%d draw command(s) submitted by a single multi-draw.\n", no_draws);
+	if (use_gpu_culling_ && (gpu_culling_.Init(indirect_buffer, no_draws, camera.width_, camera.height_) != 0)) {
+		printf("GPU culling is not supported, all commands are drawn.\n");
+		use_gpu_culling_ = false;
+	}
+	else if (use_gpu_culling_) {
+		printf("The commands are culled by the frustum and the depth pyramid of the previous frame on the GPU.\n");
+		if ((texture_residency_.budget() > 0) && !virtual_texturing_ && !use_texture_arrays_) {
+			// the residency keeps the textures of the kept commands, each region holds the draw count followed by the commands
+			culled_commands_.assign(1 + 5 * static_cast<size_t>(no_draws), 0);
+			glCreateBuffers(1, &culled_commands_buffer_);
+			glNamedBufferStorage(culled_commands_buffer_, UNIFORM_RING_SIZE * culled_commands_.size() * sizeof(GLuint), nullptr, 0);
+			std::fill(culled_commands_valid_, culled_commands_valid_ + UNIFORM_RING_SIZE, false);
+		}
+	}
+	if (use_cpu_culling_) {
+		// each frame in flight has its own region of the visible commands, written through the persistent mapping
+		surface_bvh_.Build(surfaces_);
+		surface_commands_.resize(no_draws * 5);
+		memcpy(surface_commands_.data(), commands.data(), no_draws * sizeof(DrawElementsIndirectCommand));
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = UNIFORM_RING_SIZE * max(1, no_draws) * sizeof(DrawElementsIndirectCommand);
+		glCreateBuffers(1, &visible_commands_buffer_);
+		glNamedBufferStorage(visible_commands_buffer_, size, nullptr, flags);
+		mapped_visible_commands_ = static_cast<GLuint *>(glMapNamedBufferRange(visible_commands_buffer_, 0, size, flags));
+		printf("The surfaces are culled by the frustum on the CPU, %d BVH node(s) of %d children over %d surface(s).\n",
+			surface_bvh_.no_nodes(), BVH_WIDTH, surface_bvh_.no_boxes());
+	}
+	if (use_occlusion_culling_) {
+		occlusion_culler_.Init(surfaces_, max(1, camera.width_ / 4), max(1, camera.height_ / 4));
+		printf("The surfaces are culled by the occluders rasterized into a %d x %d px depth buffer on the CPU.\n",
+			occlusion_culler_.width(), occlusion_culler_.height());
+	}
 
 	/*glPointSize(10.0f);
 	glLineWidth(2.0f);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);*/
+	delete[] indices;
 	delete[] vertices;
 	return S_OK;
 }
 
 int Rasterizer::realeaseDevice() {
+	if (submit_timings_.no_frames > 0) {
+		const SubmitTimings & t = submit_timings_;
+		const double n = t.no_frames;
+		printf("Submit of %d frame(s) took %s per frame on the CPU (%s ring wait, %s uniforms, %s culling, %s textures, %s draws), the slowest one %s, %zu ring stall(s).\n",
+			t.no_frames, TimeToString((t.wait + t.uniforms + t.culling + t.textures + t.draws) / n).c_str(), TimeToString(t.wait / n).c_str(),
+			TimeToString(t.uniforms / n).c_str(), TimeToString(t.culling / n).c_str(), TimeToString(t.textures / n).c_str(), TimeToString(t.draws / n).c_str(),
+			TimeToString(t.max_frame).c_str(), uniform_ring_.no_stalls());
+		submit_timings_ = SubmitTimings();
+	}
+	if (use_gpu_culling_) {
+		const GpuCulling::Stats stats = gpu_culling_.stats();
+		printf("GPU culling of %u frame(s): %u command(s) tested, %u culled by the frustum and %u by the depth pyramid (%0.1f %% drawn).\n",
+			stats.no_frames, stats.total_submitted, stats.total_frustum_culled, stats.total_occlusion_culled,
+			100.0 * (stats.total_submitted - stats.total_frustum_culled - stats.total_occlusion_culled) / max(1u, stats.total_submitted));
+	}
+	if (cpu_culling_totals_.no_frames > 0) {
+		const CpuCullingTotals & t = cpu_culling_totals_;
+		const double n = t.no_frames;
+		printf("CPU culling of %d frame(s): %0.1f of %d surface(s) drawn per frame (%0.1f %%), %0.1f BVH node(s) and %0.1f box(es) tested per frame.\n",
+			t.no_frames, t.no_visible / n, no_draws, 100.0 * t.no_visible / (n * max(1, no_draws)), t.no_nodes / n, t.no_boxes / n);
+		if (use_occlusion_culling_) {
+			printf("Occlusion culling: %0.1f surface(s) per frame hidden behind %0.1f occluder triangle(s).\n", t.no_occluded / n, t.no_occluders / n);
+		}
+		cpu_culling_totals_ = CpuCullingTotals();
+	}
+	if ((texture_residency_.budget() > 0) && (texture_residency_.no_textures() > 0)) {
+		printf("Textures: %0.1f MB resident within the budget of %0.1f MB, %zu eviction(s), %zu re-upload(s) (%0.1f MB).\n",
+			texture_residency_.resident_bytes() / sqr(1024.0f), texture_residency_.budget() / sqr(1024.0f), texture_residency_.no_evictions(),
+			texture_residency_.no_reuploads(), texture_residency_.reupload_bytes() / sqr(1024.0f));
+	}
+	if (frame_capture_.is_initialized()) {
+		frame_capture_.Release();
+		const FrameCapture::Stats s = frame_capture_.stats();
+		const double n = max(1, s.no_frames);
+		printf("Capture of %d frame(s): %d of %d image(s) written, %s per frame on the render thread (%d GPU and %d encoding stall(s), %s), %s of encoding per frame.\n",
+			s.no_frames, s.no_images - s.no_failed, s.no_images, TimeToString(s.capture_time / n).c_str(), s.no_stalls, s.no_encode_stalls,
+			TimeToString(s.stall_time).c_str(), TimeToString(s.encode_time / n).c_str());
+	}
+	if (profiler_.is_initialized()) {
+		profiler_.Release();
+		profiler_.Print();
+	}
+	gpu_culling_.Release();
+	if (visible_commands_buffer_ != 0) {
+		glUnmapNamedBuffer(visible_commands_buffer_);
+		glDeleteBuffers(1, &visible_commands_buffer_);
+		visible_commands_buffer_ = 0;
+		mapped_visible_commands_ = nullptr;
+	}
+	glDeleteBuffers(1, &culled_commands_buffer_);
+	culled_commands_buffer_ = 0;
+	uniform_ring_.Release();
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
 	glDeleteProgram(shader_program);
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &ssbo_materials);
+	glDeleteBuffers(1, &ssbo_objects);
+	glDeleteBuffers(1, &indirect_buffer);
+	glDeleteProgram(feedback_program);
+	virtual_textures_.Release();
+	texture_arrays_.Release();
+	texture_residency_.Release();
+	if (white_texture_ != 0) {
+		glMakeTextureHandleNonResidentARB(white_handle_);
+		glDeleteTextures(1, &white_texture_);
+	}
 
-	glfwTerminate();
+	if (headless_) {
+		headless_context_.Release();
+	}
+	else {
+		glfwTerminate();
+	}
 	return S_OK;
 }
 
 
 int Rasterizer::RenderFrame() {
 	glBindVertexArray(vao);
+
+	int frame = 0;
+
 	while (!glfwWindowShouldClose(window))
 	{
-		glUseProgram(shader_program);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		glDrawBuffer(GL_COLOR_ATTACHMENT0);
-		Vector3 lightPoss = Vector3(50, 0, 120);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		drawFrame(++frame);
 
-		Matrix4x4 model;
-		model.set(0, 0, 1);
-		model.set(1, 1, 1);
-		model.set(2, 2, 1);
-		model.set(3, 3, 1);
+		glfwSwapBuffers(window);
+		glfwSwapInterval(1);
+		glfwPollEvents();
 
-		Matrix4x4 mvp = camera.projectionMatrix * camera.viewMatrix * model;
-		Matrix4x4 mvn = model *camera.viewMatrix;
+		if (profiler_.is_initialized() && (frame % GPU_PROFILER_WINDOW == 0)) {
+			profiler_.Print();
+		}
+	}
 
-		SetMatrix4x4(shader_program, mvp.data(), "MVP");
-		SetMatrix4x4(shader_program, mvn.data(), "MVN");
-		
-		const GLint possLocation = glGetUniformLocation(shader_program, "lightPossition");
-		glUniform3f(possLocation ,lightPoss.x, lightPoss.y, lightPoss.z);
+	realeaseDevice();
+	return S_OK;
+}
 
-		const GLint viewFrom = glGetUniformLocation(shader_program, "viewFrom");
-		glUniform3f(viewFrom, camera.view_from().x, camera.view_from().y, camera.view_from().z);
+int Rasterizer::RenderFrames(const int no_frames, const CameraPath * path) {
+	glBindVertexArray(vao);
 
-		glDrawArrays(GL_TRIANGLES, 0, no_triangles * 3);
+	const auto t0 = std::chrono::steady_clock::now();
+	for (int frame = 1; frame <= no_frames; ++frame) {
+		if (path) {
+			path->Apply(path->duration() * (frame - 1) / max(1, no_frames - 1), camera);
+		}
+		drawFrame(frame);
 
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo); // bind custom FBO for reading
-		glReadBuffer(GL_COLOR_ATTACHMENT0); // select it‘s first color buffer for reading
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // bind default FBO (0) for writing
-		glDrawBuffer(GL_BACK_LEFT); // select it‘s left back buffer for writing
-		glBlitFramebuffer(0, 0, camera.width_, camera.height_, 0, 0, camera.width_, camera.height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		if (window) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+	}
+	glFinish();
+	if (frame_capture_.is_initialized()) {
+		frame_capture_.Flush();
+	}
+	const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
 
+	const GLenum error = glGetError();
+	printf("Rendered %d frame(s) of %d x %d px in %s (%s per frame), GL error 0x%x.\n", no_frames, camera.width_, camera.height_,
+		TimeToString(t).c_str(), TimeToString(t / max(1, no_frames)).c_str(), error);
 
-		//glUseProgram(shader_program_downsample);
+	realeaseDevice();
 
+	return (error == GL_NO_ERROR) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
+int Rasterizer::BenchmarkPath(const int no_frames, const CameraPath * path, FrameLog & log) {
+	glBindVertexArray(vao);
+	if (window) {
+		glfwSwapInterval(0); // the frame rate is not capped by the display
+	}
 
-		glfwSwapBuffers(window);
-		glfwSwapInterval(1);
-		glfwPollEvents();
+	// the first frame uploads the textures and compiles the pipeline state, it is not recorded
+	if (path) {
+		path->Apply(0.0f, camera);
 	}
+	drawFrame(1);
+	glFinish();
 
+	glGenQueries(UNIFORM_RING_SIZE, frame_time_queries_);
+	glGenQueries(UNIFORM_RING_SIZE, frame_primitives_queries_);
+	glCreateBuffers(1, &frame_draw_counts_buffer_);
+	glNamedBufferStorage(frame_draw_counts_buffer_, UNIFORM_RING_SIZE * sizeof(GLuint), nullptr, 0);
+	std::fill(frame_records_, frame_records_ + UNIFORM_RING_SIZE, -1);
+	frame_log_ = &log;
+
+	const size_t first = log.records().size();
+	auto previous_start = std::chrono::steady_clock::now();
+	for (int frame = 1; frame <= no_frames; ++frame) {
+		const float time = (path) ? path->duration() * (frame - 1) / max(1, no_frames - 1) : 0.0f;
+		if (path) {
+			path->Apply(time, camera);
+		}
+		const auto start = std::chrono::steady_clock::now();
+		if (frame > 1) {
+			log.record(log.records().size() - 1).frame_time = std::chrono::duration<double>(start - previous_start).count();
+		}
+		previous_start = start;
+
+		drawFrame(frame + 1);
+		log.record(log.records().size() - 1).frame = frame;
+		log.record(log.records().size() - 1).time = time;
+
+		if (window) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+	}
+	glFinish();
+	if (log.records().size() > first) {
+		log.record(log.records().size() - 1).frame_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - previous_start).count();
+	}
+	for (int region = 0; region < UNIFORM_RING_SIZE; ++region) {
+		retireFrameRecord(region);
+	}
+
+	frame_log_ = nullptr;
+	glDeleteQueries(UNIFORM_RING_SIZE, frame_time_queries_);
+	glDeleteQueries(UNIFORM_RING_SIZE, frame_primitives_queries_);
+	glDeleteBuffers(1, &frame_draw_counts_buffer_);
+	frame_draw_counts_buffer_ = 0;
+
+	const GLenum error = glGetError();
 	realeaseDevice();
-	return S_OK;
+
+	return (error == GL_NO_ERROR) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void Rasterizer::retireFrameRecord(const int region) {
+	if (frame_records_[region] < 0) return;
+
+	FrameLog::Record & record = frame_log_->record(frame_records_[region]);
+	GLuint64 elapsed = 0;
+	GLuint64 primitives = 0;
+	glGetQueryObjectui64v(frame_time_queries_[region], GL_QUERY_RESULT, &elapsed);
+	glGetQueryObjectui64v(frame_primitives_queries_[region], GL_QUERY_RESULT, &primitives);
+	record.gpu_time = elapsed * 1e-9;
+	record.triangles = static_cast<long long>(primitives);
+	if (use_gpu_culling_) {
+		GLuint draw_count = 0;
+		glGetNamedBufferSubData(frame_draw_counts_buffer_, region * sizeof(GLuint), sizeof(GLuint), &draw_count);
+		record.draw_commands = static_cast<int>(draw_count);
+	}
+	frame_records_[region] = -1;
+}
+
+void Rasterizer::drawScene() {
+	if (use_gpu_culling_) {
+		// the count of the visible commands stays on the GPU
+		gpu_culling_.Draw();
+		return;
+	}
+	if (use_cpu_culling_) {
+		// the commands of the visible surfaces written by cullSurfaces into the region of this frame
+		const size_t offset = uniform_ring_.current() * no_draws * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visible_commands_buffer_);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void *>(offset),
+			static_cast<GLsizei>(visible_surfaces_.size()), 0);
+		return;
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, no_draws, 0);
+}
+
+void Rasterizer::cullSurfaces(const Matrix4x4 & mvp) {
+	surface_bvh_.Cull(mvp, visible_surfaces_);
+	if (use_occlusion_culling_) {
+		occlusion_culler_.RenderOccluders(mvp);
+		occlusion_culler_.Cull(visible_surfaces_);
+	}
+	// the surfaces keep their order of the scene, the depth ties of the coplanar ones would be resolved differently otherwise
+	std::sort(visible_surfaces_.begin(), visible_surfaces_.end());
+
+	// the region was released by the fence waited for by the ring
+	GLuint * commands = mapped_visible_commands_ + uniform_ring_.current() * no_draws * 5;
+	for (size_t i = 0; i < visible_surfaces_.size(); ++i) {
+		memcpy(commands + i * 5, &surface_commands_[visible_surfaces_[i] * 5], sizeof(DrawElementsIndirectCommand));
+	}
+
+	CpuCullingTotals & t = cpu_culling_totals_;
+	const SurfaceBvh::Stats stats = surface_bvh_.stats();
+	++t.no_frames;
+	t.no_visible += visible_surfaces_.size();
+	t.no_nodes += stats.no_nodes;
+	t.no_boxes += stats.no_boxes;
+	if (use_occlusion_culling_) {
+		const OcclusionCuller::Stats occlusion_stats = occlusion_culler_.stats();
+		t.no_occluded += occlusion_stats.no_occluded;
+		t.no_occluders += occlusion_stats.no_occluders;
+	}
+}
+
+double Rasterizer::BenchmarkFrames(const int no_frames, const bool pipelined) {
+	glBindVertexArray(vao);
+
+	// the first frame uploads the textures and compiles the pipeline state, it is not measured
+	drawFrame(1);
+	glFinish();
+
+	const auto t0 = std::chrono::steady_clock::now();
+	for (int frame = 2; frame <= no_frames + 1; ++frame) {
+		drawFrame(frame);
+		if (!pipelined) {
+			glFinish();
+		}
+	}
+	glFinish();
+	if (frame_capture_.is_initialized()) {
+		frame_capture_.Flush();
+	}
+	const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	realeaseDevice();
+
+	return t / max(1, no_frames);
+}
+
+void Rasterizer::drawFrame(const int frame) {
+	// vertex shader invocations of the first frame, post-transform cache reuses shared vertices (the result is waited
+	// for, so not while profiling or logging the frames)
+	GLuint query_vs_invocations = 0;
+	const bool count_vs_invocations = (frame == 1) && (GLAD_GL_VERSION_4_6 || GLAD_GL_ARB_pipeline_statistics_query) &&
+		!profiler_.is_initialized() && !frame_log_;
+
+	// the scopes do nothing unless the profiler is initialized
+	profiler_.BeginFrame(frame);
+	profiler_.Begin("frame");
+
+	// per-frame data of all passes go to the next region of the ring, the GPU is waited for only if it lags behind
+	const auto t0 = std::chrono::steady_clock::now();
+	profiler_.Begin("ring wait", false);
+	GLFrameData * frame_data = static_cast<GLFrameData *>(uniform_ring_.Begin());
+	profiler_.End();
+	const auto t1 = std::chrono::steady_clock::now();
+
+	// the queries of the frame which used the region before have passed its fence, their results are ready
+	const int region = uniform_ring_.current();
+	if (frame_log_) {
+		retireFrameRecord(region);
+		glBeginQuery(GL_TIME_ELAPSED, frame_time_queries_[region]);
+	}
+	if (culled_commands_buffer_ != 0) {
+		retireCulledCommands(region, frame);
+	}
+
+	Vector3 lightPoss = Vector3(50, 0, 120);
+
+	Matrix4x4 model;
+	model.set(0, 0, 1);
+	model.set(1, 1, 1);
+	model.set(2, 2, 1);
+	model.set(3, 3, 1);
+
+	Matrix4x4 mvp = camera.projectionMatrix * camera.viewMatrix * model;
+	Matrix4x4 mvn = model *camera.viewMatrix;
+
+	memcpy(frame_data->MVP, mvp.data(), sizeof(frame_data->MVP));
+	memcpy(frame_data->MVN, mvn.data(), sizeof(frame_data->MVN));
+	const Vector3 view_from = camera.view_from();
+	const GLfloat light_position[] = { lightPoss.x, lightPoss.y, lightPoss.z };
+	const GLfloat view_from_data[] = { view_from.x, view_from.y, view_from.z };
+	memcpy(frame_data->light_position, light_position, sizeof(light_position));
+	memcpy(frame_data->view_from, view_from_data, sizeof(view_from_data));
+	memcpy(frame_data->previous_MVP, previous_mvp_.data(), sizeof(frame_data->previous_MVP));
+	uniform_ring_.Bind(0);
+	const auto t2 = std::chrono::steady_clock::now();
+
+	// before any pass draws the visible commands
+	profiler_.Begin("culling");
+	if (use_gpu_culling_) {
+		gpu_culling_.Cull();
+		if (frame_log_) {
+			gpu_culling_.CopyDrawCount(frame_draw_counts_buffer_, region * sizeof(GLuint));
+		}
+		if (culled_commands_buffer_ != 0) {
+			const GLintptr offset = region * culled_commands_.size() * sizeof(GLuint);
+			gpu_culling_.CopyDrawCount(culled_commands_buffer_, offset);
+			gpu_culling_.CopyVisibleCommands(culled_commands_buffer_, offset + sizeof(GLuint));
+			culled_commands_valid_[region] = true;
+		}
+	}
+	else if (use_cpu_culling_) {
+		cullSurfaces(mvp);
+	}
+	profiler_.End();
+	const auto t2_culling = std::chrono::steady_clock::now();
+
+	profiler_.Begin("textures");
+	if (virtual_texturing_) {
+		updateVirtualTextures(frame);
+		texture_binds_ = 1; // the tile cache
+	}
+	else if (use_texture_arrays_) {
+		// all arrays by a single call, the draw samples any of them
+		texture_binds_ = texture_arrays_.Bind(0);
+	}
+	else {
+		updateTextureResidency(frame);
+		texture_binds_ = 0;
+	}
+
+	profiler_.End();
+	const auto t3 = std::chrono::steady_clock::now();
+
+	profiler_.Begin("scene");
+	glUseProgram(shader_program);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	if (count_vs_invocations) {
+		glGenQueries(1, &query_vs_invocations);
+		glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS, query_vs_invocations);
+	}
+	if (frame_log_) {
+		glBeginQuery(GL_PRIMITIVES_GENERATED, frame_primitives_queries_[region]);
+	}
+	drawScene();
+	if (frame_log_) {
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+	}
+	if (count_vs_invocations) {
+		glEndQuery(GL_VERTEX_SHADER_INVOCATIONS);
+		GLuint64 vs_invocations = 0;
+		glGetQueryObjectui64v(query_vs_invocations, GL_QUERY_RESULT, &vs_invocations);
+		printf("Vertex shader invocations: %llu (%0.2f per triangle, non-indexed draw needs %d).\n",
+			static_cast<unsigned long long>(vs_invocations), vs_invocations / double(max(1, no_triangles)), no_triangles * 3);
+		glDeleteQueries(1, &query_vs_invocations);
+	}
+	profiler_.End();
+
+	profiler_.Begin("resolve");
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo); // bind custom FBO for reading
+	glReadBuffer(GL_COLOR_ATTACHMENT0); // select it‘s first color buffer for reading
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // bind default FBO (0) for writing
+	glDrawBuffer(GL_BACK_LEFT); // select it‘s left back buffer for writing
+	glBlitFramebuffer(0, 0, camera.width_, camera.height_, 0, 0, camera.width_, camera.height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	profiler_.End();
+
+	// the resolved frame is read back into the pixel buffers of the capture and mapped a few frames later
+	if (frame_capture_.is_initialized()) {
+		profiler_.Begin("capture");
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboDownsample);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glBlitFramebuffer(0, 0, camera.width_, camera.height_, 0, 0, camera.width_, camera.height_,
+			GL_COLOR_BUFFER_BIT | (capture_depth_ ? GL_DEPTH_BUFFER_BIT : 0), GL_NEAREST);
+		frame_capture_.Capture(fboDownsample, frame);
+		profiler_.End();
+	}
+
+	// the depth of this frame culls the occluded objects of the next one
+	if (use_gpu_culling_) {
+		profiler_.Begin("depth pyramid");
+		gpu_culling_.BuildDepthPyramid(fbo);
+		previous_mvp_ = mvp;
+		profiler_.End();
+	}
+
+	// the region may be written again once the GPU passes the fence
+	if (frame_log_) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	uniform_ring_.End();
+	profiler_.End();
+	profiler_.EndFrame();
+	const auto t4 = std::chrono::steady_clock::now();
+
+	SubmitTimings & t = submit_timings_;
+	++t.no_frames;
+	t.wait += std::chrono::duration<double>(t1 - t0).count();
+	t.uniforms += std::chrono::duration<double>(t2 - t1).count();
+	t.culling += std::chrono::duration<double>(t2_culling - t2).count();
+	t.textures += std::chrono::duration<double>(t3 - t2_culling).count();
+	t.draws += std::chrono::duration<double>(t4 - t3).count();
+	t.max_frame = max(t.max_frame, std::chrono::duration<double>(t4 - t0).count());
+
+	if (frame_log_) {
+		// the draw count of the GPU culling, the GPU time and the triangles are known once the region is reused
+		const int draw_commands = (use_gpu_culling_) ? -1 : (use_cpu_culling_) ? static_cast<int>(visible_surfaces_.size()) : no_draws;
+		frame_records_[region] = static_cast<int>(frame_log_->Add(FrameLog::Record{ frame, 0.0f,
+			std::chrono::duration<double>(t4 - t0).count(), -1.0, 0.0, draw_commands, -1 }));
+	}
+
+	//glUseProgram(shader_program_downsample);
 }
@@ -5,6 +5,25 @@
 
 #include "surface.h"
 #include "camera.h"
+#include "scenecache.h"
+#include "threadpool.h"
+#include "textureresidency.h"
+#include "virtualtexture.h"
+#include "texturearrays.h"
+#include "uniformring.h"
+#include "gpuculling.h"
+#include "surfacebvh.h"
+#include "occlusionculler.h"
+#include "headlesscontext.h"
+#include "camerapath.h"
+#include "framecapture.h"
+#include "framelog.h"
+#include "gpuprofiler.h"
+
+/*! \def DEFAULT_SCENE
+\brief OBJ file of the scene loaded by the tutorials and the benchmarks unless another one is given (relative to the working directory).
+*/
+#define DEFAULT_SCENE "../../data/6887_allied_avenger_gi.obj"
 
 class Rasterizer
 {
@@ -23,27 +42,182 @@ public:
 
 	int RenderFrame();
 
+	/* budget of the resident textures (bytes), 0 means unlimited */
+	void set_texture_budget(const size_t budget);
+
+	/* samples the diffuse textures through the virtual texture cache instead of the bindless handles (GL 4.5 is enough),
+	has to be set before InitDevice */
+	void set_virtual_texturing(const bool enabled);
+
+	/* samples the diffuse textures from texture arrays instead of the bindless handles (GL 4.5 is enough), InitDevice
+	switches to them on its own if the driver lacks GL 4.6 or GL_ARB_bindless_texture */
+	void set_texture_arrays(const bool enabled);
+	bool texture_arrays() const;
+
+	/* draws the given number of frames, each one finished before the next one starts unless pipelined, and releases
+	the device, returns the mean frame time (s) including the writing of the captured frames */
+	double BenchmarkFrames(const int no_frames, const bool pipelined = false);
+
+	/* number of textures bound by the last frame, the bindless handles need none */
+	int texture_binds() const;
+
+	/* culls the draw commands by the compute shaders (on by default), has to be set before loadScene, initBuffers
+	turns it off if the driver cannot source the draw count from a buffer */
+	void set_gpu_culling(const bool enabled);
+
+	/* culls the surfaces by the frustum on the CPU instead of the GPU, only the commands of the visible ones are
+	submitted and only their textures are kept resident, has to be set before loadScene and turns the GPU culling off */
+	void set_cpu_culling(const bool enabled);
+
+	/* removes the surfaces hidden behind the largest triangles of the scene rasterized by OcclusionCuller from those
+	found by the CPU frustum culling, has to be set before loadScene and turns the CPU culling on */
+	void set_occlusion_culling(const bool enabled);
+
+	/* renders into a pbuffer of HeadlessContext instead of a window, so no display is needed (e.g. Mesa llvmpipe in CI),
+	has to be set before InitDevice */
+	void set_headless(const bool enabled);
+
+	/* draws the given number of frames without the window loop and releases the device, the camera follows the path
+	over its whole duration (if any) or stays still, returns EXIT_SUCCESS if no GL error occurred */
+	int RenderFrames(const int no_frames, const CameraPath * path = nullptr);
+
+	/* writes every frame to the image files prefix + frame number by FrameCapture, depth adds the depth images and
+	latency 0 reads each frame synchronously, has to be set before initFrameBuffer */
+	void set_capture(const std::string & prefix, const CaptureFormat format, const bool depth = false, const int latency = FRAME_CAPTURE_LATENCY);
+	FrameCapture::Stats capture_stats() const;
+
+	/* draws a warm-up frame and no_frames frames along the path (if any) without waiting for the GPU, appends their CPU
+	and GPU times, draw commands and triangles to the log and releases the device, the window (if any) is not synchronized
+	to the display, returns EXIT_SUCCESS if no GL error occurred */
+	int BenchmarkPath(const int no_frames, const CameraPath * path, FrameLog & log);
+
+	/* times the passes of drawFrame on the CPU and the GPU by GpuProfiler, the window loop prints their statistics every
+	GPU_PROFILER_WINDOW frames, has to be set before initFrameBuffer */
+	void set_profiling(const bool enabled);
+	const GpuProfiler & profiler() const;
+
 private:
+	friend class RasterizerChecks; // checks of tutorials.cpp
+
+	/* creates the window (or the headless context) with the GL context and loads the GL functions */
+	int createContext();
+
+	/* marks the textures of the drawn materials as used and rewrites the handles changed by the residency manager */
+	void updateTextureResidency(const int frame);
+
+	/* renders the low resolution feedback pass of the virtual textures, returns true if feedback_ids_ hold the feedback
+	read VT_FEEDBACK_LATENCY frames ago */
+	bool feedbackPass();
+
+	/* requests the tiles of the feedback pass, uploads the streamed ones and binds the virtual texture cache */
+	void updateVirtualTextures(const int frame);
+
+	/* updates the textures and renders the frame into the default framebuffer */
+	void drawFrame(const int frame);
+
+	/* submits the draw commands of all visible surfaces by a single multi-draw with the bound program and framebuffer */
+	void drawScene();
+
+	/* finds the surfaces inside the frustum of the MVP (and not occluded) and writes their commands into the region of
+	the current frame */
+	void cullSurfaces(const Matrix4x4 & mvp);
+
+	/* completes the record of the frame which used the given ring region by the results of its queries */
+	void retireFrameRecord(const int region);
+
+	/* marks the textures of the surfaces kept by the GPU culling of the frame which used the given ring region as used */
+	void retireCulledCommands(const int region, const int frame);
+
 	GLuint fragment_shader{ 0 };
 	GLuint shader_program{ 0 };
+	GLuint feedback_program{ 0 }; // feedback pass of the virtual textures
 	GLuint vertex_shader{ 0 };
 	GLuint ssbo_materials{ 0 };
+	GLuint ssbo_objects{ 0 }; // per-surface data indexed by the baseInstance of the commands, see GLObject
+	GLuint indirect_buffer{ 0 }; // DrawElementsIndirectCommand of each surface
+	int no_draws{ 0 };
 	GLuint vao{ 0 };
 	GLuint vbo{ 0 };
+	GLuint ebo{ 0 };
 	GLuint fbo{ 0 };
 	GLuint fboDownsample{ 0 };
 	GLuint rboColor { 0 };
 	GLuint rboPosition { 0 };
 	GLuint rboDownsampleColor { 0 };
 	GLuint rboDownsamplePosition { 0 };
+	GLuint rboDownsampleDepth { 0 };
 	GLuint rboDepth { 0 };
-	GLFWwindow* window;
+	GLFWwindow* window{ nullptr };
+	bool headless_{ false };
+	HeadlessContext headless_context_; // instead of the window
 	int no_triangles;
+	int texture_slots_{ 0 }; // material texture slots sampled by the shaders, see Material::SampledTextureSlots
 
 
 	Camera camera;
 	std::vector<Surface *> surfaces_;
 	std::vector<Material *> materials_;
+	SceneCache scene_cache_; // keeps textures loaded from the cache mapped
+	ThreadPool texture_pool_; // decodes textures of the scene loaded from the OBJ file
+	TextureResidency texture_residency_; // keeps the diffuse textures resident within the budget
+	std::vector<int> material_textures_; // residency, virtual texture or texture array ids of the diffuse textures of the materials, -1 for none
+	bool virtual_texturing_{ false };
+	VirtualTextureCache virtual_textures_;
+	std::vector<unsigned int> feedback_ids_; // tiles requested by the feedback pass read VT_FEEDBACK_LATENCY frames ago
+	bool use_texture_arrays_{ false };
+	TextureArrays texture_arrays_;
+	int texture_binds_{ 0 };
+
+	UniformRing uniform_ring_; // per-frame uniform block, see GLFrameData
+	bool use_gpu_culling_{ true };
+	GpuCulling gpu_culling_;
+	Matrix4x4 previous_mvp_; // MVP of the frame the depth pyramid of gpu_culling_ comes from
+	bool use_cpu_culling_{ false };
+	SurfaceBvh surface_bvh_; // over the bounds of surfaces_
+	std::vector<int> visible_surfaces_; // found by the last cullSurfaces
+	bool use_occlusion_culling_{ false };
+	OcclusionCuller occlusion_culler_; // quarter resolution buffer of the largest triangles
+	std::vector<GLuint> surface_commands_; // DrawElementsIndirectCommand of each surface, copied for the visible ones
+	GLuint visible_commands_buffer_{ 0 }; // UNIFORM_RING_SIZE regions of no_draws commands following the fences of uniform_ring_
+	GLuint * mapped_visible_commands_{ nullptr };
+	GLuint culled_commands_buffer_{ 0 }; // draw count and no_draws commands kept by the GPU culling in each region, read by the texture residency
+	bool culled_commands_valid_[UNIFORM_RING_SIZE]{};
+	std::vector<GLuint> culled_commands_; // region read back
+	struct CpuCullingTotals
+	{
+		int no_frames{ 0 };
+		size_t no_visible{ 0 }; // surfaces drawn
+		size_t no_nodes{ 0 }; // BVH nodes visited
+		size_t no_boxes{ 0 }; // boxes tested
+		size_t no_occluded{ 0 }; // surfaces inside the frustum removed by the occlusion culling
+		size_t no_occluders{ 0 }; // triangles rasterized by the occlusion culling
+	} cpu_culling_totals_;
+
+	/* CPU time spent by drawFrame in its parts summed over all frames (s) */
+	struct SubmitTimings
+	{
+		int no_frames{ 0 };
+		double wait{ 0.0 }; // for the ring region still read by the GPU
+		double uniforms{ 0.0 }; // writing the per-frame uniform block
+		double culling{ 0.0 }; // dispatching the culling
+		double textures{ 0.0 }; // residency, virtual texture or texture array updates
+		double draws{ 0.0 }; // issuing the draw calls and the blit
+		double max_frame{ 0.0 }; // the slowest frame
+	} submit_timings_;
+	std::string capture_prefix_; // empty if the frames are not captured
+	CaptureFormat capture_format_{ CaptureFormat::PNG };
+	bool capture_depth_{ false };
+	int capture_latency_{ FRAME_CAPTURE_LATENCY };
+	FrameCapture frame_capture_; // reads the resolved attachments of fboDownsample
+	FrameLog * frame_log_{ nullptr }; // records the frames of BenchmarkPath
+	GLuint frame_time_queries_[UNIFORM_RING_SIZE]{}; // GL_TIME_ELAPSED of the frame of each region of uniform_ring_
+	GLuint frame_primitives_queries_[UNIFORM_RING_SIZE]{}; // GL_PRIMITIVES_GENERATED of its scene pass
+	GLuint frame_draw_counts_buffer_{ 0 }; // draw count of the GPU culling of each region
+	int frame_records_[UNIFORM_RING_SIZE]{}; // index of the record of each region in frame_log_, -1 if none
+	bool profiling_{ false };
+	GpuProfiler profiler_; // scopes of the passes of drawFrame
+	GLuint white_texture_{ 0 }; // shared by the materials without a diffuse texture
+	GLuint64 white_handle_{ 0 };
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#version 450 core
+// texture array variant of basic_shader.frag for the drivers without bindless textures, see TextureArrays
+
+// must match TEXTURE_ARRAYS_MAX and TEXTURE_ARRAY_NONE of texturearrays.h
+#define TEXTURE_ARRAYS_MAX 8
+#define TEXTURE_ARRAY_NONE 0xffffffffu
+
+in vec3 unified_normal;
+in vec2 texcoord;
+in float normalLightDot;
+in vec3 lr;
+in vec3 directionVector;
+
+out vec4 FragColor;
+
+flat in int material_index;
+
+struct Material
+{
+	vec3 diffuse;
+	vec3 specular;
+	vec3 ambient;
+	int shininess;
+	uvec2 tex_diffuse; // array in x (TEXTURE_ARRAY_NONE for none) and layer in y
+};
+
+layout ( std430, binding = 0 ) readonly buffer Materials
+{
+	Material materials[]; // only the last member can be unsized array
+};
+
+layout ( binding = 0 ) uniform sampler2DArray texture_arrays[TEXTURE_ARRAYS_MAX];
+
+// sampler arrays may be indexed only by dynamically uniform expressions which the material of a fragment is not,
+// hence the constant indices and the derivatives computed outside of the non-uniform control flow
+vec3 ArraySample( uint array, uint layer, vec2 uv, vec2 duvdx, vec2 duvdy )
+{
+	vec3 position = vec3( uv, float( layer ) );
+
+	switch ( array )
+	{
+	case 0u: return textureGrad( texture_arrays[0], position, duvdx, duvdy ).rgb;
+	case 1u: return textureGrad( texture_arrays[1], position, duvdx, duvdy ).rgb;
+	case 2u: return textureGrad( texture_arrays[2], position, duvdx, duvdy ).rgb;
+	case 3u: return textureGrad( texture_arrays[3], position, duvdx, duvdy ).rgb;
+	case 4u: return textureGrad( texture_arrays[4], position, duvdx, duvdy ).rgb;
+	case 5u: return textureGrad( texture_arrays[5], position, duvdx, duvdy ).rgb;
+	case 6u: return textureGrad( texture_arrays[6], position, duvdx, duvdy ).rgb;
+	case 7u: return textureGrad( texture_arrays[7], position, duvdx, duvdy ).rgb;
+	}
+
+	return vec3( 1.0f ); // white texture
+}
+
+void main( void )
+{
+	vec2 duvdx = dFdx( texcoord );
+	vec2 duvdy = dFdy( texcoord );
+	uvec2 tex_diffuse = materials[material_index].tex_diffuse;
+
+	vec3 texel = ArraySample( tex_diffuse.x, tex_diffuse.y, texcoord, duvdx, duvdy );
+
+	vec4 ambientPart = vec4(materials[material_index].ambient.rgb, 1.0f);
+
+	vec4 diffusePart =  vec4(materials[material_index].diffuse.rgb * texel, 1.0f ) * normalLightDot;
+
+	vec4 specularPart =  vec4(materials[material_index].specular.rgb * pow(clamp(dot(-directionVector, lr), 0.0f, 1.0f), materials[material_index].shininess), 1.0f);
+
+	FragColor = ambientPart + diffusePart + specularPart;
+}
@@ -3,12 +3,30 @@ layout ( location = 0 ) in vec4 in_position_ms;
 layout ( location = 1 ) in vec3 in_normal_ms;
 layout ( location = 2 ) in vec3 in_color;
 layout ( location = 3 ) in vec2 in_texcoord;
-layout ( location = 4 ) in vec3 in_tangent;layout ( location = 5 ) in int in_material_index;
+layout ( location = 4 ) in vec3 in_tangent;
 
-uniform mat4 MVP;
-uniform mat4 MVN;
-uniform vec3 lightPossition;
-uniform vec3 viewFrom;
+// written into the uniform ring once per frame, must match GLFrameData in Rasterizer.cpp
+layout ( std140, binding = 0, row_major ) uniform FrameData
+{
+	mat4 MVP;
+	mat4 MVN;
+	vec3 lightPossition;
+	vec3 viewFrom;
+	mat4 previousMVP; // of the frame the depth pyramid comes from, read by culling.comp
+};
+
+struct Object
+{
+	vec3 aabb_min; // bounds in model space
+	int material_index;
+	vec3 aabb_max;
+	int pad;
+};
+
+layout ( std430, binding = 3 ) readonly buffer Objects
+{
+	Object objects[]; // one per draw command, must match GLObject in Rasterizer.cpp
+};
 
 out vec3 unified_normal;
 out vec3 directionVector;
@@ -32,7 +50,7 @@ void main( void )
 	}
 	
 	texcoord = vec2( in_texcoord.x, 1.0f - in_texcoord.y ); // 3ds max fix
-	material_index = in_material_index;
+	material_index = objects[gl_BaseInstance].material_index; // gl_DrawID counts the visible commands only
 
 	vec3 vectorToLight_MS = normalize(lightPossition - in_position_ms.xyz);
 	vec3 vectorToLight_ES = normalize((MVN * vec4(vectorToLight_MS.x, vectorToLight_MS.y, vectorToLight_MS.z, 0.0f)).xyz);
@@ -0,0 +1,1730 @@
+#include "pch.h"
+#include "benchmarks.h"
+#include "objloader.h"
+#include "mappedfile.h"
+#include "fastparse.h"
+#include "utils.h"
+#include "mymath.h"
+#include "textureregistry.h"
+#include "texturebaker.h"
+#include "simd.h"
+#include "pixelformat.h"
+#include "Rasterizer.h"
+#include "surfacebvh.h"
+#include "camerapath.h"
+#include "occlusionculler.h"
+#include "softwarerasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cfloat>
+
+/* hash of all surface names, materials and vertex positions, normals and colors */
+static unsigned long long SurfacesDigest( std::vector<Surface *> & surfaces )
+{
+	unsigned long long digest = 0;
+
+	for ( Surface * surface : surfaces )
+	{
+		const std::string name = surface->get_name();
+		digest = QuickHash( reinterpret_cast<const BYTE *>( name.c_str() ), name.size(), digest );
+
+		const int material_index = ( surface->get_material() ) ? surface->get_material()->materialIndex : -1;
+		digest = QuickHash( reinterpret_cast<const BYTE *>( &material_index ), sizeof( material_index ), digest );
+
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			for ( int j = 0; j < 3; ++j )
+			{
+				const Vertex vertex = surface->get_triangle( i ).vertex( j );
+				// texture coords of vertices without vt index and the padding are not initialized
+				digest = QuickHash( reinterpret_cast<const BYTE *>( &vertex ), 3 * sizeof( Vector3 ), digest );
+			}
+		}
+	}
+
+	return digest;
+}
+
+static double SecondsSince( const std::chrono::steady_clock::time_point t0 )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+}
+
+int BenchmarkOBJLoading( const char * file_name, const int max_threads )
+{
+	const int threads = ( max_threads > 0 ) ? max_threads : max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+
+	std::vector<Surface *> surfaces;
+	std::vector<Material *> materials;
+
+	auto t0 = std::chrono::steady_clock::now();
+	if ( LoadOBJMapped( file_name, surfaces, materials ) < 0 )
+	{
+		return EXIT_FAILURE;
+	}
+	const double t_serial = SecondsSince( t0 );
+	const unsigned long long reference = SurfacesDigest( surfaces );
+	SafeDeleteVectorItems( surfaces );
+	surfaces.clear();
+	SafeDeleteVectorItems( materials );
+	materials.clear();
+
+	// powers of two followed by all threads
+	std::vector<int> thread_counts;
+	for ( int no_threads = 1; no_threads < threads; no_threads *= 2 )
+	{
+		thread_counts.push_back( no_threads );
+	}
+	thread_counts.push_back( threads );
+
+	std::vector<double> times;
+	std::vector<bool> identical;
+
+	for ( const int no_threads : thread_counts )
+	{
+		t0 = std::chrono::steady_clock::now();
+		LoadOBJParallel( file_name, surfaces, materials, no_threads );
+		times.push_back( SecondsSince( t0 ) );
+		identical.push_back( SurfacesDigest( surfaces ) == reference );
+
+		SafeDeleteVectorItems( surfaces );
+		surfaces.clear();
+		SafeDeleteVectorItems( materials );
+		materials.clear();
+	}
+
+	printf( "\nOBJ loading of '%s'\n", file_name );
+	printf( "serial (LoadOBJMapped): %s\n", TimeToString( t_serial ).c_str() );
+	printf( "threads\ttime\tspeedup\tefficiency\toutput\n" );
+	for ( size_t i = 0; i < times.size(); ++i )
+	{
+		printf( "%d\t%s\t%0.2fx\t%0.0f %%\t\t%s\n", thread_counts[i], TimeToString( times[i] ).c_str(),
+			times[0] / times[i], 100.0 * times[0] / ( times[i] * thread_counts[i] ),
+			identical[i] ? "identical" : "DIFFERENT" );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* null terminated copies of the lines of one record type, i.e. what the strtok based loader works with */
+struct ParsingLines
+{
+	std::vector<char> buffer;
+	std::vector<size_t> offsets; // first byte of each line in the buffer
+	size_t bytes{ 0 }; // total length of the lines without terminators
+
+	void Append( const char * line, const char * line_end )
+	{
+		offsets.push_back( buffer.size() );
+		buffer.insert( buffer.end(), line, line_end );
+		buffer.push_back( 0 );
+		bytes += line_end - line;
+	}
+
+	const char * line( const size_t i ) const { return &buffer[offsets[i]]; }
+	const char * line_end( const size_t i ) const { return &buffer[( ( i + 1 < offsets.size() ) ? offsets[i + 1] : buffer.size() ) - 1]; }
+	size_t size() const { return offsets.size(); }
+};
+
+/* the original sscanf based face parser, returns the number of corners or zero for unsupported faces */
+static int LegacyParseFace( const char * line, int corners[4][3] )
+{
+	int no_slashes = 0;
+	for ( int i = 0; i < int( strlen( line ) ); ++i )
+	{
+		if ( line[i] == '/' )
+		{
+			++no_slashes;
+		}
+	}
+
+	memset( corners, 0, sizeof( int ) * 4 * 3 );
+	const bool no_texture_coords = strstr( line, "//" ) != NULL;
+	const int no_corners = ( no_slashes == 2 * 3 ) ? 3 : ( ( no_slashes == 2 * 4 ) ? 4 : 0 );
+
+	if ( no_texture_coords )
+	{
+		sscanf( line, "%*s %d//%d %d//%d %d//%d %d//%d",
+			&corners[0][0], &corners[0][2], &corners[1][0], &corners[1][2],
+			&corners[2][0], &corners[2][2], &corners[3][0], &corners[3][2] );
+	}
+	else
+	{
+		sscanf( line, "%*s %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+			&corners[0][0], &corners[0][1], &corners[0][2], &corners[1][0], &corners[1][1], &corners[1][2],
+			&corners[2][0], &corners[2][1], &corners[2][2], &corners[3][0], &corners[3][1], &corners[3][2] );
+	}
+
+	return no_corners;
+}
+
+/* best time of several repetitions of the given parsing pass */
+static double BestOf( const int repetitions, const std::function<void()> & pass )
+{
+	double best = 0;
+
+	for ( int i = 0; i < repetitions; ++i )
+	{
+		const auto t0 = std::chrono::steady_clock::now();
+		pass();
+		const double t = SecondsSince( t0 );
+		best = ( i == 0 ) ? t : min( best, t );
+	}
+
+	return best;
+}
+
+static void PrintParsingRow( const char * kernel, const size_t no_lines, const size_t bytes,
+	const double t_legacy, const double t_fast, const size_t mismatches )
+{
+	printf( "%-12s%10zu\t%8.1f\t%8.1f\t%8.2f\t%8.2f\t%6.2fx\t%zu\n", kernel, no_lines,
+		bytes / ( t_legacy * 1e6 ), bytes / ( t_fast * 1e6 ), no_lines / ( t_legacy * 1e6 ), no_lines / ( t_fast * 1e6 ),
+		t_legacy / t_fast, mismatches );
+}
+
+int BenchmarkOBJParsing( const char * file_name )
+{
+	const int repetitions = 5;
+
+	MappedFile file;
+	if ( file.Open( file_name ) != 0 )
+	{
+		printf( "File %s not found.\n", file_name );
+
+		return EXIT_FAILURE;
+	}
+
+	const char * begin = file.data();
+	const char * end = begin + file.size();
+
+	// split the records by type first so that only the parsing itself is measured
+	ParsingLines attributes;
+	ParsingLines faces;
+
+	for ( const char * line = begin; line < end; )
+	{
+		const char * line_end = FindNewline( line, end );
+
+		if ( ( line_end - line > 1 ) && ( line[0] == 'v' ) )
+		{
+			attributes.Append( line, line_end );
+		}
+		else if ( ( line_end - line > 1 ) && ( line[0] == 'f' ) )
+		{
+			faces.Append( line, line_end );
+		}
+
+		line = ( line_end < end ) ? line_end + 1 : end;
+	}
+
+	std::vector<float> legacy_values( attributes.size() * 3, 0.0f );
+	std::vector<float> fast_values( attributes.size() * 3, 0.0f );
+
+	const double t_attributes_legacy = BestOf( repetitions, [&]() {
+		for ( size_t i = 0; i < attributes.size(); ++i )
+		{
+			float * value = &legacy_values[i * 3];
+			sscanf( attributes.line( i ), "%*s %f %f %f", &value[0], &value[1], &value[2] );
+		}
+	} );
+
+	const double t_attributes_fast = BestOf( repetitions, [&]() {
+		for ( size_t i = 0; i < attributes.size(); ++i )
+		{
+			float * value = &fast_values[i * 3];
+			const char * line_end = attributes.line_end( i );
+			const char * p = FindSeparator( attributes.line( i ), line_end );
+			for ( int j = 0; j < 3; ++j )
+			{
+				p = ParseFloat( p, line_end, value[j] );
+			}
+		}
+	} );
+
+	size_t attribute_mismatches = 0;
+	for ( size_t i = 0; i < legacy_values.size(); ++i )
+	{
+		if ( legacy_values[i] != fast_values[i] ) ++attribute_mismatches;
+	}
+
+	std::vector<int> legacy_indices( faces.size() * 4 * 3, 0 );
+	std::vector<int> fast_indices( faces.size() * 4 * 3, 0 );
+
+	const double t_faces_legacy = BestOf( repetitions, [&]() {
+		for ( size_t i = 0; i < faces.size(); ++i )
+		{
+			LegacyParseFace( faces.line( i ), reinterpret_cast<int( *)[3]>( &legacy_indices[i * 4 * 3] ) );
+		}
+	} );
+
+	const double t_faces_fast = BestOf( repetitions, [&]() {
+		for ( size_t i = 0; i < faces.size(); ++i )
+		{
+			int * item = &fast_indices[i * 4 * 3];
+			const char * line_end = faces.line_end( i );
+			const char * p = SkipBlanks( faces.line( i ) + 1, line_end );
+			for ( int j = 0; ( j < 4 ) && ( p < line_end ) && ( IsDigit( *p ) || ( *p == '-' ) ); ++j, item += 3 )
+			{
+				p = SkipBlanks( ParseFaceItem( p, line_end, item ), line_end );
+			}
+		}
+	} );
+
+	size_t face_mismatches = 0;
+	for ( size_t i = 0; i < legacy_indices.size(); ++i )
+	{
+		if ( legacy_indices[i] != fast_indices[i] ) ++face_mismatches;
+	}
+
+	size_t legacy_lines = 0;
+	size_t fast_lines = 0;
+
+	const double t_lines_legacy = BestOf( repetitions, [&]() {
+		legacy_lines = 0;
+		for ( const char * p = begin; p < end; ++p )
+		{
+			if ( *p == '\n' ) ++legacy_lines;
+		}
+	} );
+
+	const double t_lines_fast = BestOf( repetitions, [&]() {
+		fast_lines = 0;
+		for ( const char * p = FindNewline( begin, end ); p < end; p = FindNewline( p + 1, end ) )
+		{
+			++fast_lines;
+		}
+	} );
+
+	printf( "\nOBJ parsing of '%s' (%0.1f MB, best of %d runs)\n", file_name, file.size() / ( 1024.0 * 1024.0 ), repetitions );
+	printf( "kernel           lines\tsscanf MB/s\t  fast MB/s\tsscanf Ml/s\t  fast Ml/s\tspeedup\tmismatches\n" );
+	PrintParsingRow( "v/vn/vt", attributes.size(), attributes.bytes, t_attributes_legacy, t_attributes_fast, attribute_mismatches );
+	PrintParsingRow( "f", faces.size(), faces.bytes, t_faces_legacy, t_faces_fast, face_mismatches );
+	PrintParsingRow( "newlines", fast_lines, file.size(), t_lines_legacy, t_lines_fast, legacy_lines - fast_lines );
+
+	return EXIT_SUCCESS;
+}
+
+/* number of vertex shader invocations of the indexed draw with the FIFO post-transform cache of the given size */
+static size_t SimulateVertexCache( std::vector<Surface *> & surfaces, const int cache_size )
+{
+	size_t invocations = 0;
+
+	for ( Surface * surface : surfaces )
+	{
+		std::vector<unsigned int> cache( cache_size, ~0u );
+		int next = 0; // the oldest entry
+
+		const unsigned int * indices = &surface->get_indices()[0].v0;
+		for ( int i = 0; i < surface->no_triangles() * 3; ++i )
+		{
+			if ( std::find( cache.begin(), cache.end(), indices[i] ) == cache.end() )
+			{
+				cache[next] = indices[i];
+				next = ( next + 1 ) % cache_size;
+				++invocations;
+			}
+		}
+	}
+
+	return invocations;
+}
+
+int BenchmarkIndexedMesh( const char * file_name )
+{
+	std::vector<Surface *> surfaces;
+	std::vector<Material *> materials;
+
+	// only the geometry is measured, the textures keep their file names and are never decoded
+	ObjLoaderContext context;
+	context.texture_slots = 0;
+	if ( LoadOBJParallel( file_name, surfaces, materials, context ) < 0 )
+	{
+		SafeDeleteVectorItems( surfaces );
+		SafeDeleteVectorItems( materials );
+		return EXIT_FAILURE;
+	}
+
+	size_t no_triangles = 0;
+	size_t no_vertices = 0;
+	for ( Surface * surface : surfaces )
+	{
+		no_triangles += surface->no_triangles();
+		no_vertices += surface->no_vertices();
+	}
+
+	const size_t expanded_bytes = no_triangles * 3 * sizeof( Vertex );
+	const size_t indexed_bytes = no_vertices * sizeof( Vertex ) + no_triangles * sizeof( Triangle3ui );
+
+	printf( "\nIndexed mesh of '%s'\n", file_name );
+	printf( "%zu triangles, %zu unique vertices (%0.2f corners per vertex)\n", no_triangles, no_vertices,
+		no_triangles * 3.0 / max<size_t>( 1, no_vertices ) );
+	printf( "memory\tnon-indexed %0.1f MB\tindexed %0.1f MB (VBO %0.1f MB + EBO %0.1f MB)\t%0.2fx less\n",
+		expanded_bytes / sqr( 1024.0 ), indexed_bytes / sqr( 1024.0 ), no_vertices * sizeof( Vertex ) / sqr( 1024.0 ),
+		no_triangles * sizeof( Triangle3ui ) / sqr( 1024.0 ), expanded_bytes / double( max<size_t>( 1, indexed_bytes ) ) );
+
+	// the real post-transform caches differ between vendors, FIFO of 16 and 32 entries brackets most of them
+	printf( "VS invocations\tnon-indexed %zu", no_triangles * 3 );
+	for ( const int cache_size : { 16, 32 } )
+	{
+		const size_t invocations = SimulateVertexCache( surfaces, cache_size );
+		printf( "\tFIFO %d: %zu (ACMR %0.2f, %0.2fx less)", cache_size, invocations,
+			invocations / double( max<size_t>( 1, no_triangles ) ), no_triangles * 3.0 / max<size_t>( 1, invocations ) );
+	}
+	printf( "\n" );
+
+	SafeDeleteVectorItems( surfaces );
+	surfaces.clear();
+	SafeDeleteVectorItems( materials );
+	materials.clear();
+
+	return EXIT_SUCCESS;
+}
+
+/* hash of all material names, parameters and texture contents */
+static unsigned long long MaterialsDigest( std::vector<Material *> & materials )
+{
+	unsigned long long digest = 0;
+
+	for ( Material * material : materials )
+	{
+		const std::string name = material->name();
+		digest = QuickHash( reinterpret_cast<const BYTE *>( name.c_str() ), name.size(), digest );
+
+		const float parameters[] = { material->ambient_.r, material->ambient_.g, material->ambient_.b,
+			material->diffuse_.r, material->diffuse_.g, material->diffuse_.b,
+			material->specular_.r, material->specular_.g, material->specular_.b,
+			material->emission_.r, material->emission_.g, material->emission_.b,
+			material->shininess, material->roughness_, material->metallicness, material->reflectivity, material->ior };
+		digest = QuickHash( reinterpret_cast<const BYTE *>( parameters ), sizeof( parameters ), digest );
+
+		const int indices[] = { material->materialIndex, static_cast<int>( material->shader() ) };
+		digest = QuickHash( reinterpret_cast<const BYTE *>( indices ), sizeof( indices ), digest );
+
+		for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+		{
+			// textures are shared by content so the file name depends on which material acquired the texture first
+			const Texture * texture = material->texture( slot );
+			const int size[] = { ( texture ) ? texture->width() : -1, ( texture ) ? texture->height() : -1 };
+			digest = QuickHash( reinterpret_cast<const BYTE *>( size ), sizeof( size ), digest );
+			if ( texture && texture->data() )
+			{
+				digest = FastHash( texture->data(), static_cast<size_t>( texture->scan_width() ) * texture->height(), digest );
+			}
+		}
+	}
+
+	return digest;
+}
+
+/* hash of the whole loaded scene including the index buffers */
+static unsigned long long SceneDigest( std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
+{
+	unsigned long long digest = SurfacesDigest( surfaces );
+
+	for ( Surface * surface : surfaces )
+	{
+		digest = QuickHash( reinterpret_cast<const BYTE *>( surface->get_indices() ),
+			surface->no_triangles() * sizeof( Triangle3ui ), digest );
+	}
+
+	return MaterialsDigest( materials ) ^ ( digest * 31 );
+}
+
+/* writes the small OBJ file of the faces with the relative indices interleaved with the vertices, the indices resolve
+against the records read before each face, returns 0 on success */
+static int WriteRelativeIndicesOBJ( const char * file_name )
+{
+	FILE * file = fopen( file_name, "wt" );
+	if ( !file )
+	{
+		return -1;
+	}
+
+	fprintf( file, "# relative indices of each face refer to the records right above it\ng relative\n" );
+	for ( int i = 0; i < 3; ++i )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			fprintf( file, "v %d %d %d\nvt %0.1f %0.1f\nvn %d %d 1\n", 3 * i + j, j, i, 0.1f * j, 0.1f * i, j, i );
+		}
+		fprintf( file, "f -3/-3/-3 -2/-2/-2 -1/-1/-1\n" );
+	}
+	fprintf( file, "f 1/1/1 -2/-2/-2 -1/-1/-1\n" ); // absolute and relative mixed
+
+	return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+int StressTestOBJLoading( const std::vector<std::string> & input_file_names, const int no_threads, const int no_repeats )
+{
+	const int threads = ( no_threads > 0 ) ? no_threads : max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+
+	const char * relative_file_name = "stress_relative_indices.obj";
+	if ( WriteRelativeIndicesOBJ( relative_file_name ) != 0 )
+	{
+		printf( "Unable to write '%s'.\n", relative_file_name );
+
+		return EXIT_FAILURE;
+	}
+	std::vector<std::string> file_names = input_file_names;
+	file_names.push_back( relative_file_name );
+
+	typedef int ( *Loader )( const char *, std::vector<Surface *> &, std::vector<Material *> &, const ObjLoaderContext & );
+	const struct { const char * name; Loader load; } loaders[] = {
+		{ "LoadOBJ", LoadOBJ }, { "LoadOBJMapped", LoadOBJMapped }, { "LoadOBJParallel", LoadOBJParallel } };
+
+	// every load goes through the counting allocator and logger so leaked buffers and errors are detected as well
+	std::atomic<long long> live_buffers{ 0 };
+	std::atomic<int> no_messages{ 0 };
+
+	ObjLoaderContext context;
+	context.allocate = [&live_buffers]( const size_t size ) { ++live_buffers; return malloc( size ); };
+	context.deallocate = [&live_buffers]( void * memory ) { --live_buffers; free( memory ); };
+	context.log = [&no_messages]( const char * message ) { ++no_messages; fputs( message, stdout ); };
+	context.verbose = false;
+	context.no_threads = 1; // concurrency comes from the simultaneous loads
+
+	// loads the scene and returns its digest, textures shared with the other loads are released with the last material
+	const size_t no_textures = TextureRegistry::instance().no_textures();
+	auto load = [&context]( const Loader loader, const std::string & file_name, bool & success )
+	{
+		std::vector<Surface *> surfaces;
+		std::vector<Material *> materials;
+
+		success = ( loader( file_name.c_str(), surfaces, materials, context ) >= 0 );
+		const unsigned long long digest = SceneDigest( surfaces, materials );
+
+		SafeDeleteVectorItems( surfaces );
+		surfaces.clear();
+		SafeDeleteVectorItems( materials );
+		materials.clear();
+
+		return digest;
+	};
+
+	printf( "\nConcurrent OBJ loading of %zu file(s), %d thread(s), %d repeat(s)\n", file_names.size(), threads, no_repeats );
+	printf( "loader\t\tserial\t\tconcurrent\tloads\tdifferent\n" );
+
+	int no_failures = 0;
+	std::vector<unsigned long long> first_references; // of the first loader, the other ones have to match them
+
+	for ( const auto & loader : loaders )
+	{
+		// --- reference digests from serial loads ---
+		std::vector<unsigned long long> references( file_names.size() );
+		auto t0 = std::chrono::steady_clock::now();
+		for ( size_t i = 0; i < file_names.size(); ++i )
+		{
+			bool success = false;
+			references[i] = load( loader.load, file_names[i], success );
+			if ( !success )
+			{
+				printf( "Unable to load '%s'.\n", file_names[i].c_str() );
+				remove( relative_file_name );
+
+				return EXIT_FAILURE;
+			}
+		}
+		const double t_serial = SecondsSince( t0 );
+		if ( first_references.empty() )
+		{
+			first_references = references;
+		}
+		for ( size_t i = 0; i < file_names.size(); ++i )
+		{
+			if ( references[i] != first_references[i] )
+			{
+				printf( "%s loads '%s' differently from %s.\n", loader.name, file_names[i].c_str(), loaders[0].name );
+				++no_failures;
+			}
+		}
+
+		// --- all threads load all files at once, each thread starts at a different file ---
+		std::atomic<int> no_loads{ 0 };
+		std::atomic<int> no_different{ 0 };
+
+		auto worker = [&]( const int thread )
+		{
+			for ( int r = 0; r < no_repeats; ++r )
+			{
+				for ( size_t j = 0; j < file_names.size(); ++j )
+				{
+					const size_t i = ( j + thread ) % file_names.size();
+
+					bool success = false;
+					if ( ( load( loader.load, file_names[i], success ) != references[i] ) || !success )
+					{
+						++no_different;
+					}
+					++no_loads;
+				}
+			}
+		};
+
+		t0 = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for ( int t = 0; t < threads; ++t )
+		{
+			workers.push_back( std::thread( worker, t ) );
+		}
+		for ( std::thread & t : workers )
+		{
+			t.join();
+		}
+		const double t_concurrent = SecondsSince( t0 );
+
+		printf( "%-16s%s\t\t%s\t\t%d\t%d\n", loader.name, TimeToString( t_serial ).c_str(),
+			TimeToString( t_concurrent ).c_str(), no_loads.load(), no_different.load() );
+
+		no_failures += no_different;
+	}
+
+	remove( relative_file_name );
+
+	const size_t leaked_textures = TextureRegistry::instance().no_textures() - no_textures;
+	const bool passed = ( no_failures == 0 ) && ( live_buffers == 0 ) && ( leaked_textures == 0 );
+
+	printf( "%d message(s) logged, %lld file buffer(s) and %zu texture(s) not released\n", no_messages.load(),
+		live_buffers.load(), leaked_textures );
+	printf( "%s\n", passed ? "PASSED" : "FAILED" );
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int BenchmarkTextureBaking( const std::vector<std::string> & file_names, const int no_threads )
+{
+	const int threads = ( no_threads > 0 ) ? no_threads : max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+	const int repetitions = 3;
+	const BlockFormat formats[] = { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC7 };
+
+	printf( "\nTexture baking, %d thread(s), best of %d runs\n", threads, repetitions );
+	printf( "format\t   Mpx\t1 thread Mpx/s\t%2d threads Mpx/s\tspeedup\tratio\tPSNR RGB\tPSNR A\n", threads );
+
+	int no_failures = 0;
+
+	for ( const std::string & file_name : file_names )
+	{
+		Texture texture( file_name.c_str() );
+		if ( !texture.data() )
+		{
+			++no_failures;
+			continue;
+		}
+
+		// the sRGB correct mip chain is the reference of the PSNR and its time is included in the baking
+		std::vector<std::vector<BYTE>> levels;
+		const double t_mips = BestOf( repetitions, [&]() { BuildMipChain( &texture, levels, threads ); } );
+
+		size_t no_pixels = 0;
+		for ( const std::vector<BYTE> & level : levels )
+		{
+			no_pixels += level.size() / 4;
+		}
+
+		printf( "%s (%d x %d px, %d bpp, %zu mips, mip chain %s)\n", file_name.c_str(), texture.width(), texture.height(),
+			texture.pixel_size() * 8, levels.size(), TimeToString( t_mips ).c_str() );
+
+		for ( const BlockFormat format : formats )
+		{
+			BakedTexture baked;
+			const double t_serial = BestOf( repetitions, [&]() { BakeTexture( &texture, format, baked, 1 ); } );
+			const double t_parallel = BestOf( repetitions, [&]() { BakeTexture( &texture, format, baked, threads ); } );
+
+			size_t baked_bytes = 0;
+			for ( const std::vector<BYTE> & level : baked.mips )
+			{
+				baked_bytes += level.size();
+			}
+
+			std::vector<BYTE> decoded( levels[0].size() );
+			DecodeBlocks( baked.mips[0].data(), texture.width(), texture.height(), format, decoded.data() );
+			const size_t no_base_pixels = static_cast<size_t>( texture.width() ) * texture.height();
+
+			printf( "BC%d\t%6.2f\t%13.2f\t%16.2f\t%6.2fx\t%4.1f:1\t%8.2f", static_cast<int>( format ), no_pixels * 1e-6,
+				no_pixels * 1e-6 / t_serial, no_pixels * 1e-6 / t_parallel, t_serial / t_parallel,
+				no_pixels * 3.0 / baked_bytes, PSNR( levels[0].data(), decoded.data(), no_base_pixels, 3 ) );
+
+			// BC1 drops the alpha channel, it is reported for the textures which have one only
+			if ( ( texture.pixel_size() == 4 ) && ( format != BlockFormat::BC1 ) )
+			{
+				std::vector<BYTE> alpha0( no_base_pixels * 4, 0 );
+				std::vector<BYTE> alpha1( no_base_pixels * 4, 0 );
+				for ( size_t i = 0; i < no_base_pixels; ++i )
+				{
+					alpha0[i * 4] = levels[0][i * 4 + 3];
+					alpha1[i * 4] = decoded[i * 4 + 3];
+				}
+				printf( "\t%8.2f\n", PSNR( alpha0.data(), alpha1.data(), no_base_pixels, 1 ) );
+			}
+			else
+			{
+				printf( "\t       -\n" );
+			}
+		}
+	}
+
+	return ( no_failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* largest difference of the colors of two batches */
+static float MaxDifference( const std::vector<float> rgb0[3], const std::vector<float> rgb1[3] )
+{
+	float difference = 0.0f;
+	for ( int c = 0; c < 3; ++c )
+	{
+		for ( size_t i = 0; i < rgb0[c].size(); ++i )
+		{
+			difference = max( difference, fabsf( rgb0[c][i] - rgb1[c][i] ) );
+		}
+	}
+
+	return difference;
+}
+
+int BenchmarkTextureSampling( const char * file_name, const int no_samples )
+{
+	const int repetitions = 5;
+
+	Texture texture( file_name );
+	if ( !texture.data() )
+	{
+		return EXIT_FAILURE;
+	}
+	texture.GenerateMips();
+
+	// random coordinates inside the texture and lods over the whole mip chain
+	std::mt19937 generator( 123 );
+	std::uniform_real_distribution<float> coordinate( 0.0f, 1.0f );
+	std::uniform_real_distribution<float> level( 0.0f, static_cast<float>( texture.no_mips() - 1 ) );
+	std::vector<float> u( no_samples ), v( no_samples ), lods( no_samples );
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		u[i] = coordinate( generator );
+		v[i] = coordinate( generator );
+		lods[i] = level( generator );
+	}
+
+	std::vector<float> reference[3], batch[3], fallback[3];
+	for ( int c = 0; c < 3; ++c )
+	{
+		reference[c].resize( no_samples );
+		batch[c].resize( no_samples );
+		fallback[c].resize( no_samples );
+	}
+
+	auto scalar_pass = [&]( const bool linearize )
+	{
+		for ( int i = 0; i < no_samples; ++i )
+		{
+			const Color3f color = texture.texel( u[i], v[i], linearize );
+			reference[0][i] = color.r;
+			reference[1][i] = color.g;
+			reference[2][i] = color.b;
+		}
+	};
+	auto batch_pass = [&]( std::vector<float> * rgb, const TextureFilter filter, const bool linearize )
+	{
+		texture.texels( u.data(), v.data(), lods.data(), no_samples, filter, linearize, rgb[0].data(), rgb[1].data(), rgb[2].data() );
+	};
+
+	const double t_scalar = BestOf( repetitions, [&]() { scalar_pass( true ); } );
+
+	printf( "\nTexture sampling of '%s' (%d x %d px, %d bpp, %d mips), %d samples, best of %d runs, %s\n", file_name,
+		texture.width(), texture.height(), texture.pixel_size() * 8, texture.no_mips(), no_samples, repetitions,
+		CpuHasAvx2() ? "AVX2" : "no AVX2" );
+	printf( "filter\t\tMsamples/s\tspeedup\tfallback Msamples/s\tmax diff\n" );
+	printf( "texel()\t\t%10.1f\t  1.00x\n", no_samples * 1e-6 / t_scalar );
+
+	const struct { const char * name; TextureFilter filter; } filters[] = {
+		{ "nearest", TextureFilter::NEAREST }, { "bilinear", TextureFilter::BILINEAR }, { "trilinear", TextureFilter::TRILINEAR } };
+
+	float max_difference = 0.0f;
+	for ( const auto & filter : filters )
+	{
+		const double t_batch = BestOf( repetitions, [&]() { batch_pass( batch, filter.filter, true ); } );
+		LimitSimdLevel( SimdLevel::SCALAR );
+		const double t_fallback = BestOf( repetitions, [&]() { batch_pass( fallback, filter.filter, true ); } );
+		LimitSimdLevel( SimdLevel::AVX2 );
+
+		// the vectorized and the fallback kernels have to agree
+		const float difference = MaxDifference( batch, fallback );
+		max_difference = max( max_difference, difference );
+
+		printf( "%-12s\t%10.1f\t%6.2fx\t%19.1f\t%g\n", filter.name, no_samples * 1e-6 / t_batch, t_scalar / t_batch,
+			no_samples * 1e-6 / t_fallback, difference );
+	}
+
+	// without the linearization both interpolate the same values, with it the batch linearizes before the interpolation
+	scalar_pass( false );
+	batch_pass( batch, TextureFilter::BILINEAR, false );
+	const float unorm_difference = MaxDifference( reference, batch );
+	scalar_pass( true );
+	batch_pass( batch, TextureFilter::BILINEAR, true );
+	printf( "bilinear vs texel() max diff %g (sRGB), %g (linearized)\n", unorm_difference, MaxDifference( reference, batch ) );
+
+	return ( ( max_difference < 1e-5f ) && ( unorm_difference < 1e-5f ) ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int BenchmarkPixelConversion( const int no_pixels )
+{
+	const int repetitions = 5;
+
+	enum class Source { BYTES, UNIT_FLOATS, ANY_FLOATS };
+	const struct
+	{
+		const char * name;
+		int src_size; // bytes per pixel or value
+		int dst_size;
+		Source source;
+		std::function<void( const BYTE *, BYTE *, size_t )> convert;
+	} kernels[] = {
+		{ "BGR8 -> RGBA8", 3, 4, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) { ConvertBGR8ToRGBA8( src, dst, n ); } },
+		{ "RGBA8 -> BGR8", 4, 3, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) { ConvertRGBA8ToBGR8( src, dst, n ); } },
+		{ "RGB8 -> RGBA8", 3, 4, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) { ConvertRGB8ToRGBA8( src, dst, n ); } },
+		{ "RGBA8 -> RGB8", 4, 3, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) { ConvertRGBA8ToRGB8( src, dst, n ); } },
+		{ "BGRA8 <-> RGBA8", 4, 4, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) { SwapRedBlue8( src, dst, n ); } },
+		{ "sRGB8 -> linear", 1, 4, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) {
+			ConvertSrgb8ToLinear( src, reinterpret_cast<float *>( dst ), n ); } },
+		{ "linear -> sRGB8", 4, 1, Source::UNIT_FLOATS, []( const BYTE * src, BYTE * dst, size_t n ) {
+			ConvertLinearToSrgb8( reinterpret_cast<const float *>( src ), dst, n ); } },
+		{ "float -> half", 4, 2, Source::ANY_FLOATS, []( const BYTE * src, BYTE * dst, size_t n ) {
+			ConvertFloatToHalf( reinterpret_cast<const float *>( src ), reinterpret_cast<unsigned short *>( dst ), n ); } },
+		{ "half -> float", 2, 4, Source::BYTES, []( const BYTE * src, BYTE * dst, size_t n ) {
+			ConvertHalfToFloat( reinterpret_cast<const unsigned short *>( src ), reinterpret_cast<float *>( dst ), n ); } } };
+	const struct { const char * name; SimdLevel level; } levels[] = {
+		{ "scalar", SimdLevel::SCALAR }, { "SSE4.1", SimdLevel::SSE41 }, { "AVX2", SimdLevel::AVX2 } };
+
+	printf( "\nPixel conversion of %d pixels, best of %d runs, %s, %s (GB/s of read and written data)\n", no_pixels,
+		repetitions, CpuHasSse41() ? "SSE4.1" : "no SSE4.1", CpuHasAvx2() ? "AVX2" : "no AVX2" );
+	printf( "kernel\t\t\tscalar\tSSE4.1\t  AVX2\tspeedup\tidentical\n" );
+
+	std::mt19937 generator( 123 );
+	int no_failures = 0;
+	for ( const auto & kernel : kernels )
+	{
+		// floats are stored as 4-byte aligned values, the pixel sizes 3 and 4 B never misalign them
+		std::vector<float> src_storage( ( static_cast<size_t>( no_pixels ) * kernel.src_size + 3 ) / 4 );
+		BYTE * src = reinterpret_cast<BYTE *>( src_storage.data() );
+		if ( kernel.source == Source::BYTES )
+		{
+			// random bit patterns, halves include denormals, infinities and NaNs
+			std::uniform_int_distribution<int> byte( 0, 255 );
+			for ( size_t i = 0; i < static_cast<size_t>( no_pixels ) * kernel.src_size; ++i )
+			{
+				src[i] = static_cast<BYTE>( byte( generator ) );
+			}
+		}
+		else
+		{
+			// linear values slightly outside <0, 1> or floats from the half denormals up to overflow
+			std::uniform_real_distribution<float> unit( -0.25f, 1.25f );
+			std::uniform_int_distribution<int> exponent( -28, 18 );
+			for ( float & value : src_storage )
+			{
+				value = ( kernel.source == Source::UNIT_FLOATS ) ? unit( generator ) : ldexpf( unit( generator ), exponent( generator ) );
+			}
+		}
+
+		std::vector<BYTE> reference( static_cast<size_t>( no_pixels ) * kernel.dst_size );
+		std::vector<BYTE> dst( reference.size() );
+		const double bytes = static_cast<double>( no_pixels ) * ( kernel.src_size + kernel.dst_size );
+
+		double times[3] = {};
+		bool identical = true;
+		for ( int l = 0; l < 3; ++l )
+		{
+			LimitSimdLevel( levels[l].level );
+			BYTE * out = ( l == 0 ) ? reference.data() : dst.data();
+			times[l] = BestOf( repetitions, [&]() { kernel.convert( src, out, no_pixels ); } );
+			if ( l > 0 )
+			{
+				identical = identical && ( memcmp( reference.data(), dst.data(), reference.size() ) == 0 );
+			}
+		}
+		LimitSimdLevel( SimdLevel::AVX2 );
+		no_failures += ( identical ) ? 0 : 1;
+
+		printf( "%-16s\t%6.2f\t%6.2f\t%6.2f\t%6.2fx\t%s\n", kernel.name, bytes * 1e-9 / times[0], bytes * 1e-9 / times[1],
+			bytes * 1e-9 / times[2], times[0] / times[2], ( identical ) ? "yes" : "NO" );
+	}
+
+	return ( no_failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int BenchmarkTextureArrays( const int no_frames )
+{
+	printf( "\nTexture binds and frame time of %d frames\n", no_frames );
+
+	const char * paths[] = { "bindless", "texture arrays" };
+	double times[2] = {};
+	int binds[2] = {};
+	bool measured[2] = {};
+	for ( int i = 0; i < 2; ++i )
+	{
+		Rasterizer rasterizer( 640, 480, deg2rad( 45.0f ), Vector3( 175, -140, 130 ), Vector3( 0, 0, 35 ) );
+		rasterizer.set_texture_arrays( i == 1 );
+		if ( rasterizer.InitDevice() != S_OK )
+		{
+			continue;
+		}
+		if ( rasterizer.texture_arrays() != ( i == 1 ) )
+		{
+			// the driver lacks the bindless textures, the device fell back to the arrays
+			printf( "Bindless textures are not supported by the driver.\n" );
+			rasterizer.realeaseDevice();
+			continue;
+		}
+		if ( rasterizer.initFrameBuffer() != S_OK )
+		{
+			rasterizer.realeaseDevice();
+			continue;
+		}
+		rasterizer.loadScene( DEFAULT_SCENE );
+		rasterizer.initMaterials();
+
+		times[i] = rasterizer.BenchmarkFrames( no_frames );
+		binds[i] = rasterizer.texture_binds();
+		measured[i] = true;
+	}
+
+	printf( "\npath\t\tbinds/frame\tframe (ms)\n" );
+	for ( int i = 0; i < 2; ++i )
+	{
+		if ( measured[i] )
+		{
+			printf( "%-16s%d\t\t%0.3f\n", paths[i], binds[i], times[i] * 1e3 );
+		}
+		else
+		{
+			printf( "%-16s-\t\t-\n", paths[i] );
+		}
+	}
+	if ( measured[0] && measured[1] )
+	{
+		printf( "Texture arrays take %0.2fx the frame time of the bindless textures.\n", times[1] / times[0] );
+	}
+
+	return ( measured[1] ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* bounds of the buildings of a synthetic city of no_blocks x no_blocks blocks of 4 x 4 buildings, 100 units per block */
+static void BuildCity( const int no_blocks, std::vector<Vector3> & aabb_min, std::vector<Vector3> & aabb_max )
+{
+	std::mt19937 generator( 123 );
+	std::uniform_real_distribution<float> height( 5.0f, 60.0f );
+
+	for ( int by = 0; by < no_blocks; ++by )
+	{
+		for ( int bx = 0; bx < no_blocks; ++bx )
+		{
+			// 20 unit wide streets between the blocks, 16 x 16 units of each 20 x 20 lot are built on
+			for ( int i = 0; i < 16; ++i )
+			{
+				const float x = bx * 100.0f + 10.0f + ( i % 4 ) * 20.0f;
+				const float y = by * 100.0f + 10.0f + ( i / 4 ) * 20.0f;
+				aabb_min.push_back( Vector3( x, y, 0.0f ) );
+				aabb_max.push_back( Vector3( x + 16.0f, y + 16.0f, height( generator ) ) );
+			}
+		}
+	}
+}
+
+/* loop around the center of the bounds dipping from the roofs down to the street level and back */
+static CameraPath CirclePath( const Vector3 & scene_min, const Vector3 & scene_max )
+{
+	const Vector3 center = 0.5f * ( scene_min + scene_max );
+	const float extent = max( scene_max.x - scene_min.x, scene_max.y - scene_min.y );
+	const float radius = 0.35f * extent;
+	const int no_keys = 16;
+
+	CameraPath path;
+	for ( int i = 0; i <= no_keys; ++i )
+	{
+		const float phi = 2.0f * float( M_PI ) * i / no_keys;
+		const float z = scene_min.z + ( ( i % 2 == 0 ) ? 0.05f : 0.3f ) * extent;
+		const Vector3 view_from( center.x + radius * cosf( phi ), center.y + radius * sinf( phi ), z );
+		// along the circle with a slight turn towards the center
+		const Vector3 view_at( center.x + 0.9f * radius * cosf( phi + 0.3f ), center.y + 0.9f * radius * sinf( phi + 0.3f ), z - 0.02f * extent );
+		path.AddKey( CameraPath::Key{ 2.0f * i, view_from, view_at, deg2rad( 45.0f ) } );
+	}
+
+	return path;
+}
+
+int BenchmarkCulling( const char * path_file_name, const int no_frames, const char * file_name )
+{
+	const int repetitions = 5;
+
+	std::vector<Vector3> aabb_min;
+	std::vector<Vector3> aabb_max;
+	if ( file_name )
+	{
+		std::vector<Surface *> surfaces;
+		std::vector<Material *> materials;
+		if ( LoadOBJParallel( file_name, surfaces, materials ) < 0 )
+		{
+			return EXIT_FAILURE;
+		}
+		for ( Surface * surface : surfaces )
+		{
+			aabb_min.push_back( surface->get_aabb_min() );
+			aabb_max.push_back( surface->get_aabb_max() );
+		}
+		SafeDeleteVectorItems( surfaces );
+		SafeDeleteVectorItems( materials );
+	}
+	else
+	{
+		BuildCity( 50, aabb_min, aabb_max );
+	}
+	const int no_boxes = static_cast<int>( aabb_min.size() );
+	if ( no_boxes == 0 )
+	{
+		return EXIT_FAILURE;
+	}
+
+	Vector3 scene_min = aabb_min[0];
+	Vector3 scene_max = aabb_max[0];
+	for ( int i = 0; i < no_boxes; ++i )
+	{
+		scene_min = Vector3( min( scene_min.x, aabb_min[i].x ), min( scene_min.y, aabb_min[i].y ), min( scene_min.z, aabb_min[i].z ) );
+		scene_max = Vector3( max( scene_max.x, aabb_max[i].x ), max( scene_max.y, aabb_max[i].y ), max( scene_max.z, aabb_max[i].z ) );
+	}
+
+	CameraPath path;
+	if ( path_file_name )
+	{
+		if ( path.Load( path_file_name ) != 0 )
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		path = CirclePath( scene_min, scene_max );
+	}
+
+	// the matrices of all frames are prepared in advance, the passes measure the culling only
+	Camera camera( 640, 480, deg2rad( 45.0f ), Vector3( 0, 0, 0 ), Vector3( 1, 0, 0 ) );
+	std::vector<Matrix4x4> mvps( max( 1, no_frames ) );
+	for ( size_t f = 0; f < mvps.size(); ++f )
+	{
+		path.Apply( path.duration() * f / max<size_t>( 1, mvps.size() - 1 ), camera );
+		mvps[f] = camera.projectionMatrix * camera.viewMatrix;
+	}
+
+	const auto t0 = std::chrono::steady_clock::now();
+	SurfaceBvh bvh;
+	bvh.Build( aabb_min.data(), aabb_max.data(), no_boxes );
+	const double build_time = SecondsSince( t0 );
+
+	printf( "\nFrustum culling of %d boxes along %s (%d keys, %0.1f s) in %zu frames, best of %d runs, %s\n", no_boxes,
+		( path_file_name ) ? path_file_name : "the generated loop", path.no_keys(), path.duration(), mvps.size(), repetitions,
+		CpuHasAvx2() ? "AVX2" : "no AVX2" );
+	printf( "BVH of %d nodes of %d children built in %s\n", bvh.no_nodes(), BVH_WIDTH, TimeToString( build_time ).c_str() );
+	printf( "variant\t\t\tframe (us)\tnodes/frame\tboxes/frame\tspeedup\tidentical\n" );
+
+	const struct { const char * name; bool hierarchy; SimdLevel level; } variants[] = {
+		{ "all boxes, scalar", false, SimdLevel::SCALAR }, { "all boxes, AVX2", false, SimdLevel::AVX2 },
+		{ "BVH, scalar", true, SimdLevel::SCALAR }, { "BVH, AVX2", true, SimdLevel::AVX2 } };
+
+	std::vector<std::vector<int>> reference( mvps.size() );
+	std::vector<int> visible;
+	size_t no_visible = 0;
+	double reference_time = 0.0;
+	int no_failures = 0;
+	for ( const auto & variant : variants )
+	{
+		LimitSimdLevel( variant.level );
+		const auto cull = [&]( const size_t f ) {
+			if ( variant.hierarchy )
+			{
+				bvh.Cull( mvps[f], visible );
+			}
+			else
+			{
+				bvh.CullAll( mvps[f], visible );
+			}
+		};
+
+		// the sets of all frames are compared with the ones of the first variant
+		bool identical = true;
+		size_t no_nodes = 0;
+		size_t no_tested = 0;
+		for ( size_t f = 0; f < mvps.size(); ++f )
+		{
+			cull( f );
+			std::sort( visible.begin(), visible.end() );
+			if ( &variant == variants )
+			{
+				reference[f] = visible;
+				no_visible += visible.size();
+			}
+			identical = identical && ( visible == reference[f] );
+			no_nodes += bvh.stats().no_nodes;
+			no_tested += bvh.stats().no_boxes;
+		}
+
+		const double time = BestOf( repetitions, [&]() {
+			for ( size_t f = 0; f < mvps.size(); ++f )
+			{
+				cull( f );
+			}
+		} ) / mvps.size();
+		reference_time = ( &variant == variants ) ? time : reference_time;
+		no_failures += ( identical ) ? 0 : 1;
+
+		printf( "%-20s\t%10.2f\t%11.1f\t%11.1f\t%6.2fx\t%s\n", variant.name, time * 1e6, no_nodes / double( mvps.size() ),
+			no_tested / double( mvps.size() ), reference_time / time, ( identical ) ? "yes" : "NO" );
+	}
+	LimitSimdLevel( SimdLevel::AVX2 );
+
+	printf( "%0.1f of %d boxes (%0.1f %%) visible per frame\n", no_visible / double( mvps.size() ), no_boxes,
+		100.0 * no_visible / ( double( mvps.size() ) * no_boxes ) );
+
+	return ( no_failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* box of 8 vertices and 12 triangles */
+static Surface * BuildBox( const std::string & name, const Vector3 & aabb_min, const Vector3 & aabb_max )
+{
+	// corners of the faces (bit 0 is x, bit 1 is y and bit 2 is z), each face has its own vertices with its normal
+	const unsigned int faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+	const Vector3 normals[6] = { Vector3( -1, 0, 0 ), Vector3( 1, 0, 0 ), Vector3( 0, -1, 0 ), Vector3( 0, 1, 0 ), Vector3( 0, 0, -1 ), Vector3( 0, 0, 1 ) };
+	Coord2f texture_coords[4] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	std::vector<Vertex> vertices;
+	std::vector<Triangle3ui> triangles;
+	for ( int f = 0; f < 6; ++f )
+	{
+		for ( int i = 0; i < 4; ++i )
+		{
+			const unsigned int c = faces[f][i];
+			const Vector3 position( ( c & 1 ) ? aabb_max.x : aabb_min.x, ( c & 2 ) ? aabb_max.y : aabb_min.y, ( c & 4 ) ? aabb_max.z : aabb_min.z );
+			vertices.push_back( Vertex( position, normals[f], Vector3( 1, 1, 1 ), &texture_coords[i] ) );
+		}
+		const unsigned int v = f * 4;
+		triangles.push_back( Triangle3ui{ v, v + 1, v + 2 } );
+		triangles.push_back( Triangle3ui{ v, v + 2, v + 3 } );
+	}
+
+	return BuildSurface( name, vertices, triangles );
+}
+
+/* floor and walls with doorways of no_rooms x no_rooms rooms of 10 x 10 units, each one furnished by 40 boxes */
+static void BuildHouse( const int no_rooms, std::vector<Surface *> & surfaces )
+{
+	const float room = 10.0f;
+	const float wall = 0.1f; // half of the thickness
+	const float door = 0.6f; // half of the width
+	std::mt19937 generator( 123 );
+	std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+
+	surfaces.push_back( BuildBox( "floor", Vector3( 0, 0, -0.2f ), Vector3( no_rooms * room, no_rooms * room, 0 ) ) );
+	for ( int i = 0; i <= no_rooms; ++i )
+	{
+		for ( int j = 0; j < no_rooms; ++j )
+		{
+			// the walls along both axes, the inner ones have a doorway in the middle
+			for ( int axis = 0; axis < 2; ++axis )
+			{
+				const float c = i * room;
+				const float a = j * room;
+				const float m = a + 0.5f * room;
+				const auto box = [&]( const float a0, const float a1, const float z0, const float z1 ) {
+					surfaces.push_back( ( axis == 0 ) ? BuildBox( "wall", Vector3( c - wall, a0, z0 ), Vector3( c + wall, a1, z1 ) ) :
+						BuildBox( "wall", Vector3( a0, c - wall, z0 ), Vector3( a1, c + wall, z1 ) ) ); };
+				if ( ( i == 0 ) || ( i == no_rooms ) )
+				{
+					box( a, a + room, 0.0f, 3.0f );
+				}
+				else
+				{
+					box( a, m - door, 0.0f, 3.0f );
+					box( m + door, a + room, 0.0f, 3.0f );
+					box( m - door, m + door, 2.2f, 3.0f );
+				}
+			}
+		}
+	}
+
+	for ( int y = 0; y < no_rooms; ++y )
+	{
+		for ( int x = 0; x < no_rooms; ++x )
+		{
+			for ( int i = 0; i < 40; ++i )
+			{
+				const Vector3 size( 0.2f + 0.8f * unit( generator ), 0.2f + 0.8f * unit( generator ), 0.3f + 1.5f * unit( generator ) );
+				const Vector3 corner( x * room + 0.5f + ( room - 1.0f - size.x ) * unit( generator ), y * room + 0.5f + ( room - 1.0f - size.y ) * unit( generator ), 0.0f );
+				surfaces.push_back( BuildBox( "furniture", corner, corner + size ) );
+			}
+		}
+	}
+}
+
+/* walk along the middle row of the rooms through the doorways looking around */
+static CameraPath WalkPath( const int no_rooms )
+{
+	CameraPath path;
+	for ( int i = 0; i < no_rooms; ++i )
+	{
+		const Vector3 view_from( ( i + 0.5f ) * 10.0f, ( no_rooms / 2 + 0.5f ) * 10.0f, 1.7f );
+		const float yaw = ( ( i % 2 == 0 ) ? 1.0f : -1.0f ) * deg2rad( 50.0f );
+		path.AddKey( CameraPath::Key{ float( i ), view_from, view_from + Vector3( cosf( yaw ), sinf( yaw ), -0.1f ), deg2rad( 60.0f ) } );
+	}
+
+	return path;
+}
+
+/* surfaces seen at the pixel centers of the width x height image with the exact depth of each pixel */
+static std::vector<bool> SeenSurfaces( const std::vector<Surface *> & surfaces, const Matrix4x4 & mvp, const int width, const int height )
+{
+	std::vector<float> depths( static_cast<size_t>( width ) * height, FLT_MAX );
+	std::vector<int> ids( depths.size(), -1 );
+
+	for ( size_t s = 0; s < surfaces.size(); ++s )
+	{
+		const Vertex * vertices = surfaces[s]->get_vertices();
+		for ( int t = 0; t < surfaces[s]->no_triangles(); ++t )
+		{
+			const Triangle3ui & triangle = surfaces[s]->get_indices()[t];
+			float clip[3][4];
+			for ( int i = 0; i < 3; ++i )
+			{
+				const Vector3 & p = vertices[( i == 0 ) ? triangle.v0 : ( i == 1 ) ? triangle.v1 : triangle.v2].position;
+				for ( int j = 0; j < 4; ++j )
+				{
+					clip[i][j] = mvp.get( j, 0 ) * p.x + mvp.get( j, 1 ) * p.y + mvp.get( j, 2 ) * p.z + mvp.get( j, 3 );
+				}
+			}
+
+			// the part in front of the near plane z + w >= 0
+			float polygon[4][4];
+			int n = 0;
+			for ( int i = 0; i < 3; ++i )
+			{
+				const float * a = clip[i];
+				const float * b = clip[( i + 1 ) % 3];
+				if ( a[2] + a[3] >= 0.0f )
+				{
+					memcpy( polygon[n++], a, sizeof( polygon[0] ) );
+				}
+				if ( ( a[2] + a[3] >= 0.0f ) != ( b[2] + b[3] >= 0.0f ) )
+				{
+					const float u = ( a[2] + a[3] ) / ( ( a[2] + a[3] ) - ( b[2] + b[3] ) );
+					for ( int j = 0; j < 4; ++j )
+					{
+						polygon[n][j] = a[j] + u * ( b[j] - a[j] );
+					}
+					++n;
+				}
+			}
+
+			for ( int i = 2; i < n; ++i )
+			{
+				float x[3], y[3], z[3];
+				const int corners[3] = { 0, i - 1, i };
+				for ( int k = 0; k < 3; ++k )
+				{
+					const float * v = polygon[corners[k]];
+					x[k] = ( v[0] / v[3] * 0.5f + 0.5f ) * width;
+					y[k] = ( v[1] / v[3] * 0.5f + 0.5f ) * height;
+					z[k] = v[2] / v[3] * 0.5f + 0.5f;
+				}
+				const float area = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( x[2] - x[0] ) * ( y[1] - y[0] );
+				if ( area == 0.0f )
+				{
+					continue;
+				}
+
+				const int x0 = max( 0, static_cast<int>( floorf( min( x[0], min( x[1], x[2] ) ) ) ) );
+				const int x1 = min( width - 1, static_cast<int>( ceilf( max( x[0], max( x[1], x[2] ) ) ) ) );
+				const int y0 = max( 0, static_cast<int>( floorf( min( y[0], min( y[1], y[2] ) ) ) ) );
+				const int y1 = min( height - 1, static_cast<int>( ceilf( max( y[0], max( y[1], y[2] ) ) ) ) );
+				for ( int py = y0; py <= y1; ++py )
+				{
+					for ( int px = x0; px <= x1; ++px )
+					{
+						// barycentric coordinates of the pixel center, positive inside for both windings
+						const float cx = px + 0.5f;
+						const float cy = py + 0.5f;
+						const float b0 = ( ( x[1] - cx ) * ( y[2] - cy ) - ( x[2] - cx ) * ( y[1] - cy ) ) / area;
+						const float b1 = ( ( x[2] - cx ) * ( y[0] - cy ) - ( x[0] - cx ) * ( y[2] - cy ) ) / area;
+						const float b2 = 1.0f - b0 - b1;
+						const float depth = b0 * z[0] + b1 * z[1] + b2 * z[2];
+						const size_t p = static_cast<size_t>( py ) * width + px;
+						if ( ( b0 >= 0.0f ) && ( b1 >= 0.0f ) && ( b2 >= 0.0f ) && ( depth <= 1.0f ) && ( depth < depths[p] ) )
+						{
+							depths[p] = depth;
+							ids[p] = static_cast<int>( s );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<bool> seen( surfaces.size(), false );
+	for ( const int id : ids )
+	{
+		if ( id >= 0 )
+		{
+			seen[id] = true;
+		}
+	}
+
+	return seen;
+}
+
+int BenchmarkOcclusionCulling( const char * path_file_name, const int no_frames, const int no_threads, const char * file_name )
+{
+	const int repetitions = 3;
+	const int threads = ( no_threads > 0 ) ? no_threads : max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+	const int no_rooms = 8;
+
+	std::vector<Surface *> surfaces;
+	std::vector<Material *> materials;
+	if ( file_name )
+	{
+		if ( LoadOBJParallel( file_name, surfaces, materials ) < 0 )
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		BuildHouse( no_rooms, surfaces );
+	}
+	size_t no_triangles = 0;
+	for ( Surface * surface : surfaces )
+	{
+		no_triangles += surface->no_triangles();
+	}
+
+	CameraPath path;
+	if ( path_file_name )
+	{
+		if ( path.Load( path_file_name ) != 0 )
+		{
+			SafeDeleteVectorItems( surfaces );
+			SafeDeleteVectorItems( materials );
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		path = WalkPath( no_rooms );
+	}
+
+	// the frustum culled lists are the input of the occlusion culling, the image at the camera resolution is the ground truth
+	const int width = 640;
+	const int height = 480;
+	Camera camera( width, height, deg2rad( 60.0f ), Vector3( 0, 0, 0 ), Vector3( 1, 0, 0 ) );
+	camera.nearProjection = 0.1f;
+	SurfaceBvh bvh;
+	bvh.Build( surfaces );
+	std::vector<Matrix4x4> mvps( max( 1, no_frames ) );
+	std::vector<std::vector<int>> inside( mvps.size() );
+	std::vector<std::vector<bool>> seen( mvps.size() );
+	size_t no_inside = 0;
+	size_t no_hidden = 0; // inside the frustum and not seen
+	for ( size_t f = 0; f < mvps.size(); ++f )
+	{
+		path.Apply( path.duration() * f / max<size_t>( 1, mvps.size() - 1 ), camera );
+		mvps[f] = camera.projectionMatrix * camera.viewMatrix;
+		bvh.Cull( mvps[f], inside[f] );
+		std::sort( inside[f].begin(), inside[f].end() );
+		seen[f] = SeenSurfaces( surfaces, mvps[f], width, height );
+		no_inside += inside[f].size();
+		for ( const int s : inside[f] )
+		{
+			no_hidden += ( seen[f][s] ) ? 0 : 1;
+		}
+	}
+
+	printf( "\nOcclusion culling of %zu surfaces (%zu triangles) along %s in %zu frames, best of %d runs, %s\n", surfaces.size(),
+		no_triangles, ( path_file_name ) ? path_file_name : "the generated walk", mvps.size(), repetitions, CpuHasAvx2() ? "AVX2" : "no AVX2" );
+	printf( "%0.1f surfaces per frame inside the frustum, %0.1f %% of them hidden in the %d x %d reference image\n",
+		no_inside / double( mvps.size() ), 100.0 * no_hidden / max<size_t>( 1, no_inside ), width, height );
+	printf( "buffer\t\tthreads\tkernel\tframe (us)\toccluders\tculled %%\tfalse culls\tidentical\n" );
+
+	const struct { int threads; SimdLevel level; const char * name; } variants[] = {
+		{ 1, SimdLevel::SCALAR, "scalar" }, { 1, SimdLevel::AVX2, "AVX2" }, { threads, SimdLevel::AVX2, "AVX2" } };
+	int no_failures = 0;
+	for ( const int buffer_width : { 64, 128, 256, 512 } )
+	{
+		const int buffer_height = buffer_width * height / width;
+		OcclusionCuller culler;
+		culler.Init( surfaces, buffer_width, buffer_height );
+
+		std::vector<std::vector<int>> reference( mvps.size() );
+		std::vector<int> visible;
+		for ( const auto & variant : variants )
+		{
+			LimitSimdLevel( variant.level );
+			culler.set_threads( variant.threads );
+
+			// the lists of all frames are compared with the ones of the first variant
+			bool identical = true;
+			size_t no_occluders = 0;
+			size_t no_culled = 0;
+			size_t no_false_culls = 0;
+			for ( size_t f = 0; f < mvps.size(); ++f )
+			{
+				visible = inside[f];
+				culler.RenderOccluders( mvps[f] );
+				culler.Cull( visible );
+				if ( &variant == variants )
+				{
+					reference[f] = visible;
+				}
+				identical = identical && ( visible == reference[f] );
+				no_occluders += culler.stats().no_occluders;
+				no_culled += culler.stats().no_occluded;
+
+				// the culled surfaces seen in the reference image
+				size_t v = 0;
+				for ( const int s : inside[f] )
+				{
+					if ( ( v < visible.size() ) && ( visible[v] == s ) )
+					{
+						++v;
+					}
+					else
+					{
+						no_false_culls += ( seen[f][s] ) ? 1 : 0;
+					}
+				}
+			}
+
+			const double time = BestOf( repetitions, [&]() {
+				for ( size_t f = 0; f < mvps.size(); ++f )
+				{
+					visible = inside[f];
+					culler.RenderOccluders( mvps[f] );
+					culler.Cull( visible );
+				}
+			} ) / mvps.size();
+			no_failures += ( identical ) ? 0 : 1;
+
+			printf( "%4d x %-4d\t%d\t%s\t%10.1f\t%9.1f\t%7.1f\t\t%zu\t\t%s\n", buffer_width, buffer_height, variant.threads, variant.name,
+				time * 1e6, no_occluders / double( mvps.size() ), 100.0 * no_culled / max<size_t>( 1, no_inside ), no_false_culls,
+				( identical ) ? "yes" : "NO" );
+		}
+	}
+	LimitSimdLevel( SimdLevel::AVX2 );
+	printf( "culled %% is relative to the surfaces inside the frustum, false culls are the culled surfaces seen in the reference image\n" );
+
+	SafeDeleteVectorItems( surfaces );
+	SafeDeleteVectorItems( materials );
+
+	return ( no_failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int BenchmarkSoftwareRasterizer( const char * file_name, const int no_frames, const int width, const int height )
+{
+	const int repetitions = 3;
+	const int no_rooms = 8;
+
+	std::vector<Surface *> surfaces;
+	std::vector<Material *> materials;
+	if ( file_name )
+	{
+		if ( LoadOBJParallel( file_name, surfaces, materials ) < 0 )
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		BuildHouse( no_rooms, surfaces );
+	}
+	if ( surfaces.empty() )
+	{
+		SafeDeleteVectorItems( materials );
+		return EXIT_FAILURE;
+	}
+
+	// the textures are decoded before the first frame is timed
+	for ( Material * material : materials )
+	{
+		material->texture( Material::kDiffuseMapSlot );
+	}
+
+	size_t no_triangles = 0;
+	Vector3 scene_min = surfaces[0]->get_aabb_min();
+	Vector3 scene_max = surfaces[0]->get_aabb_max();
+	for ( Surface * surface : surfaces )
+	{
+		no_triangles += surface->no_triangles();
+		const Vector3 a = surface->get_aabb_min();
+		const Vector3 b = surface->get_aabb_max();
+		scene_min = Vector3( min( scene_min.x, a.x ), min( scene_min.y, a.y ), min( scene_min.z, a.z ) );
+		scene_max = Vector3( max( scene_max.x, b.x ), max( scene_max.y, b.y ), max( scene_max.z, b.z ) );
+	}
+	const CameraPath path = ( file_name ) ? CirclePath( scene_min, scene_max ) : WalkPath( no_rooms );
+	Camera camera( width, height, deg2rad( 60.0f ), Vector3( 0, 0, 0 ), Vector3( 1, 0, 0 ) );
+	camera.nearProjection = ( file_name ) ? camera.nearProjection : 0.1f;
+	std::vector<Camera> cameras( max( 1, no_frames ), camera );
+	for ( size_t f = 0; f < cameras.size(); ++f )
+	{
+		path.Apply( path.duration() * f / max<size_t>( 1, cameras.size() - 1 ), cameras[f] );
+	}
+
+	const int hardware_threads = max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+	printf( "\nSoftware rasterization of %zu surfaces (%zu triangles) at %d x %d px along %s in %zu frames, best of %d runs, %s\n",
+		surfaces.size(), no_triangles, width, height, ( file_name ) ? "the generated loop" : "the generated walk", cameras.size(),
+		repetitions, CpuHasAvx2() ? "AVX2" : "no AVX2" );
+	printf( "threads\tkernel\tframe (ms)\tvertex\tsetup\traster\tMtris/s\tspeedup\tefficiency\tsteals/frame\tidentical\n" );
+
+	struct Variant { int threads; SimdLevel level; const char * name; };
+	std::vector<Variant> variants = { { 1, SimdLevel::SCALAR, "scalar" } };
+	for ( int threads = 1; ; threads = min( 2 * threads, hardware_threads ) )
+	{
+		variants.push_back( Variant{ threads, SimdLevel::AVX2, "AVX2" } );
+		if ( threads == hardware_threads )
+		{
+			break;
+		}
+	}
+
+	SoftwareRasterizer rasterizer( width, height, 1 );
+	std::vector<BYTE> image( static_cast<size_t>( width ) * height * 4 );
+	std::vector<unsigned long long> reference( cameras.size() );
+	SoftwareRasterizer::Stats totals{};
+	double single_thread_time[2] = { 0.0, 0.0 }; // of the scalar and AVX2 kernels
+	int no_failures = 0;
+	for ( const Variant & variant : variants )
+	{
+		LimitSimdLevel( variant.level );
+		rasterizer.set_threads( variant.threads );
+
+		// the images of all frames are compared with the ones of the first variant
+		bool identical = true;
+		totals = SoftwareRasterizer::Stats();
+		for ( size_t f = 0; f < cameras.size(); ++f )
+		{
+			rasterizer.Render( surfaces, materials, cameras[f] );
+			rasterizer.CopyToRGBA8( image.data() );
+			const unsigned long long digest = FastHash( image.data(), image.size() );
+			if ( &variant == &variants[0] )
+			{
+				reference[f] = digest;
+			}
+			identical = identical && ( digest == reference[f] );
+
+			const SoftwareRasterizer::Stats stats = rasterizer.stats();
+			totals.no_setup += stats.no_setup;
+			totals.no_binned += stats.no_binned;
+			totals.no_blocks += stats.no_blocks;
+			totals.no_hiz_culled += stats.no_hiz_culled;
+			totals.no_fragments += stats.no_fragments;
+			totals.no_shaded += stats.no_shaded;
+		}
+		no_failures += ( identical ) ? 0 : 1;
+
+		double vertex_time = 0.0, setup_time = 0.0, raster_time = 0.0;
+		const double time = BestOf( repetitions, [&]() {
+			vertex_time = setup_time = raster_time = 0.0;
+			for ( const Camera & c : cameras )
+			{
+				rasterizer.Render( surfaces, materials, c );
+				vertex_time += rasterizer.stats().vertex_time;
+				setup_time += rasterizer.stats().setup_time;
+				raster_time += rasterizer.stats().raster_time;
+			}
+		} ) / cameras.size();
+
+		double & single = single_thread_time[( variant.level == SimdLevel::SCALAR ) ? 0 : 1];
+		single = ( variant.threads == 1 ) ? time : single;
+		const double speedup = single / time;
+		const double n = static_cast<double>( cameras.size() );
+		printf( "%d\t%s\t%10.2f\t%6.2f\t%5.2f\t%6.2f\t%7.2f\t%7.2f\t%10.0f %%\t%6.1f\t%s\n", variant.threads, variant.name, time * 1e3,
+			vertex_time / n * 1e3, setup_time / n * 1e3, raster_time / n * 1e3, no_triangles / time * 1e-6, speedup,
+			100.0 * speedup / variant.threads, rasterizer.no_steals() / ( n * ( repetitions + 1 ) ), ( identical ) ? "yes" : "NO" );
+	}
+	LimitSimdLevel( SimdLevel::AVX2 );
+
+	const double n = static_cast<double>( cameras.size() );
+	printf( "per frame: %0.0f triangles set up, %0.0f binned into %d px tiles, %0.0f blocks rasterized and %0.1f %% skipped by the\n",
+		totals.no_setup / n, totals.no_binned / n, SOFTWARE_TILE_SIZE, totals.no_blocks / n,
+		100.0 * totals.no_hiz_culled / max<size_t>( 1, totals.no_blocks + totals.no_hiz_culled ) );
+	printf( "hierarchical depth test, %0.0f fragments written for %0.0f visible pixels (depth complexity %0.2f)\n",
+		totals.no_fragments / n, totals.no_shaded / n, totals.no_fragments / double( max<size_t>( 1, totals.no_shaded ) ) );
+	printf( "Mtris/s are the triangles of the scene per second, the speedup is relative to 1 thread of the same kernel\n" );
+
+	SafeDeleteVectorItems( surfaces );
+	SafeDeleteVectorItems( materials );
+
+	return ( no_failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int BenchmarkCapture( const int no_frames, const CaptureFormat format, const char * prefix )
+{
+	printf( "\nSustained frame rate of %d frames with the %s capture\n", no_frames, ( format == CaptureFormat::EXR ) ? "EXR" : "PNG" );
+
+	const char * variants[] = { "off", "synchronous", "PBO ring" };
+	const int latencies[] = { 0, 0, FRAME_CAPTURE_LATENCY };
+	double times[3] = {};
+	FrameCapture::Stats stats[3] = {};
+	bool measured[3] = {};
+	for ( int i = 0; i < 3; ++i )
+	{
+		// headless if EGL is available so the swap interval of the window does not cap the frame rate
+		Rasterizer rasterizer( 640, 480, deg2rad( 45.0f ), Vector3( 175, -140, 130 ), Vector3( 0, 0, 35 ) );
+		rasterizer.set_headless( true );
+		if ( i > 0 )
+		{
+			rasterizer.set_capture( prefix, format, false, latencies[i] );
+		}
+		if ( rasterizer.InitDevice() != S_OK )
+		{
+			rasterizer.set_headless( false );
+			if ( rasterizer.InitDevice() != S_OK )
+			{
+				continue;
+			}
+		}
+		if ( rasterizer.initFrameBuffer() != S_OK )
+		{
+			rasterizer.realeaseDevice();
+			continue;
+		}
+		rasterizer.loadScene( DEFAULT_SCENE );
+		rasterizer.initMaterials();
+
+		times[i] = rasterizer.BenchmarkFrames( no_frames, true );
+		stats[i] = rasterizer.capture_stats();
+		measured[i] = true;
+	}
+
+	printf( "\ncapture\t\tframe (ms)\tfps\t\tslowdown\tcapture (ms)\tGPU stalls\tencode stalls\timages\n" );
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( !measured[i] )
+		{
+			printf( "%-16s-\n", variants[i] );
+			continue;
+		}
+		const FrameCapture::Stats & s = stats[i];
+		printf( "%-16s%0.3f\t\t%0.1f\t\t%0.2fx\t\t%0.3f\t\t%d\t\t%d\t\t%d\n", variants[i], times[i] * 1e3, 1.0 / max( 1e-9, times[i] ),
+			( measured[0] ) ? times[i] / max( 1e-9, times[0] ) : 0.0, s.capture_time * 1e3 / max( 1, s.no_frames ), s.no_stalls,
+			s.no_encode_stalls, s.no_images );
+	}
+
+	const bool failed = ( stats[1].no_failed > 0 ) || ( stats[2].no_failed > 0 );
+	if ( failed )
+	{
+		printf( "%d image(s) failed to be written.\n", stats[1].no_failed + stats[2].no_failed );
+	}
+
+	return ( measured[2] && !failed ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* loop around the model of the default scene at the distance of the default camera rising and sinking twice */
+static CameraPath OrbitPath()
+{
+	const Vector3 view_at( 0, 0, 35 );
+	const float radius = sqrtf( 175.0f * 175.0f + 140.0f * 140.0f );
+	const int no_keys = 12;
+
+	CameraPath path;
+	for ( int i = 0; i <= no_keys; ++i )
+	{
+		const float phi = atan2f( -140.0f, 175.0f ) + 2.0f * float( M_PI ) * i / no_keys;
+		const float z = ( i % 3 == 0 ) ? 130.0f : ( ( i % 3 == 1 ) ? 60.0f : 190.0f );
+		path.AddKey( CameraPath::Key{ 1.5f * i, Vector3( radius * cosf( phi ), radius * sinf( phi ), z ), view_at, deg2rad( 45.0f ) } );
+	}
+
+	return path;
+}
+
+int BenchmarkCameraPath( const char * path_file_name, const int no_frames, const bool headless, const char * culling,
+	const char * results_prefix, const char * scene )
+{
+	CameraPath path;
+	if ( path_file_name )
+	{
+		if ( path.Load( path_file_name ) != 0 )
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		path = OrbitPath();
+	}
+	const std::string culling_mode = ( culling ) ? culling : "none";
+	if ( ( culling_mode != "none" ) && ( culling_mode != "cpu" ) && ( culling_mode != "occlusion" ) && ( culling_mode != "gpu" ) )
+	{
+		printf( "Unknown culling '%s', expected none, cpu, occlusion or gpu.\n", culling_mode.c_str() );
+		return EXIT_FAILURE;
+	}
+
+	printf( "\nBenchmark of %d frames along a %0.1f s camera path of %d keys (%s, %s culling)\n", no_frames, path.duration(),
+		path.no_keys(), ( headless ) ? "headless" : "windowed", culling_mode.c_str() );
+
+	Rasterizer rasterizer( 640, 480, deg2rad( 45.0f ), Vector3( 175, -140, 130 ), Vector3( 0, 0, 35 ) );
+	rasterizer.set_headless( headless );
+	rasterizer.set_gpu_culling( culling_mode == "gpu" );
+	rasterizer.set_cpu_culling( ( culling_mode == "cpu" ) || ( culling_mode == "occlusion" ) );
+	rasterizer.set_occlusion_culling( culling_mode == "occlusion" );
+	rasterizer.set_profiling( true );
+	if ( rasterizer.InitDevice() != S_OK )
+	{
+		return EXIT_FAILURE;
+	}
+
+	FrameLog log;
+	log.set_info( "scene", ( scene ) ? scene : DEFAULT_SCENE );
+	log.set_info( "path", ( path_file_name ) ? path_file_name : "orbit" );
+	log.set_info( "mode", ( headless ) ? "headless" : "windowed" );
+	log.set_info( "culling", culling_mode );
+	log.set_info( "resolution", "640x480" );
+	log.set_info( "renderer", reinterpret_cast<const char *>( glGetString( GL_RENDERER ) ) );
+	log.set_info( "version", reinterpret_cast<const char *>( glGetString( GL_VERSION ) ) );
+
+	if ( rasterizer.initFrameBuffer() != S_OK )
+	{
+		rasterizer.realeaseDevice();
+		return EXIT_FAILURE;
+	}
+	rasterizer.loadScene( ( scene ) ? scene : DEFAULT_SCENE );
+	rasterizer.initMaterials();
+
+	const int result = rasterizer.BenchmarkPath( no_frames, &path, log );
+	log.set_passes( rasterizer.profiler().scopes() );
+
+	const FrameLog::Summary s = log.summary();
+	printf( "\nmetric\t\tmean\t\tp50\t\tp95\t\tmax\n" );
+	printf( "cpu (ms)\t%0.3f\t\t%0.3f\t\t%0.3f\t\t%0.3f\n", s.cpu_time.mean * 1e3, s.cpu_time.p50 * 1e3, s.cpu_time.p95 * 1e3, s.cpu_time.max * 1e3 );
+	printf( "gpu (ms)\t%0.3f\t\t%0.3f\t\t%0.3f\t\t%0.3f\n", s.gpu_time.mean * 1e3, s.gpu_time.p50 * 1e3, s.gpu_time.p95 * 1e3, s.gpu_time.max * 1e3 );
+	printf( "frame (ms)\t%0.3f\t\t%0.3f\t\t%0.3f\t\t%0.3f\n", s.frame_time.mean * 1e3, s.frame_time.p50 * 1e3, s.frame_time.p95 * 1e3, s.frame_time.max * 1e3 );
+	printf( "draw commands\t%0.1f\t\t%0.0f\t\t%0.0f\t\t%0.0f\n", s.draw_commands.mean, s.draw_commands.p50, s.draw_commands.p95, s.draw_commands.max );
+	printf( "triangles\t%0.1f\t\t%0.0f\t\t%0.0f\t\t%0.0f\n", s.triangles.mean, s.triangles.p50, s.triangles.p95, s.triangles.max );
+	printf( "%d frame(s) at %0.1f fps.\n", s.no_frames, 1.0 / max( 1e-9, s.frame_time.mean ) );
+
+	const std::string prefix = ( results_prefix ) ? results_prefix : "benchmark";
+	if ( ( log.SaveCsv( ( prefix + ".csv" ).c_str() ) != 0 ) || ( log.SaveJson( ( prefix + ".json" ).c_str() ) != 0 ) ||
+		( rasterizer.profiler().SaveTrace( ( prefix + "_trace.json" ).c_str() ) != 0 ) )
+	{
+		return EXIT_FAILURE;
+	}
+	printf( "Results written to %s.csv, %s.json and the timeline of the passes to %s_trace.json.\n", prefix.c_str(), prefix.c_str(), prefix.c_str() );
+
+	return result;
+}
+
+int CompareBenchmarkResults( const char * baseline_file_name, const char * current_file_name, const double threshold )
+{
+	FrameLog baseline;
+	FrameLog current;
+	if ( ( baseline.Load( baseline_file_name ) != 0 ) || ( current.Load( current_file_name ) != 0 ) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	printf( "\nComparison of %s (current) to %s (baseline)\n", current_file_name, baseline_file_name );
+
+	return ( FrameLog::Compare( baseline, current, threshold ) == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
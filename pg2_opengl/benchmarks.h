@@ -0,0 +1,72 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+#include "framecapture.h"
+
+/* loads the OBJ file with 1 up to max_threads threads (0 means all hardware threads) and prints the scaling table */
+int BenchmarkOBJLoading( const char * file_name, const int max_threads = 0 );
+
+/* compares sscanf based parsing of the OBJ records with the fast parsing kernels and prints the throughput table */
+int BenchmarkOBJParsing( const char * file_name );
+
+/* loads the OBJ file and reports memory and vertex shader invocations of the indexed mesh against the non-indexed one */
+int BenchmarkIndexedMesh( const char * file_name );
+
+/* loads all files serially and then again from no_threads threads at once (0 means all hardware threads), every concurrent
+load has to produce bit-identical surfaces, index buffers and materials and all textures have to be released again, all
+loaders have to produce the same scene of each file and of a generated one with the relative face indices, returns
+EXIT_SUCCESS if they all do */
+int StressTestOBJLoading( const std::vector<std::string> & file_names, const int no_threads = 0, const int no_repeats = 4 );
+
+/* builds the mip chains of the textures and bakes them into BC1, BC3 and BC7 on 1 and no_threads threads (0 means all
+hardware threads), prints the encoder throughput and the PSNR of the base level against the uncompressed one */
+int BenchmarkTextureBaking( const std::vector<std::string> & file_names, const int no_threads = 0 );
+
+/* samples the texture (with generated mip chain) by texel() and by the batched nearest, bilinear and trilinear filters
+both vectorized and with the fallback kernels, prints the throughput table and checks that the results agree */
+int BenchmarkTextureSampling( const char * file_name, const int no_samples = 1 << 22 );
+
+/* runs every pixel format and color space conversion kernel with the scalar, SSE4.1 and AVX2 variants, prints their
+throughput and checks that all variants produce bit-identical results */
+int BenchmarkPixelConversion( const int no_pixels = 1 << 22 );
+
+/* renders no_frames frames of the tutorial scene with the bindless textures (if the driver supports them) and with the
+texture arrays, prints the texture binds per frame and the mean frame time of both paths */
+int BenchmarkTextureArrays( const int no_frames = 100 );
+
+/* culls the boxes of the surfaces of the OBJ file (or of a synthetic city of 40000 buildings if file_name is nullptr) by
+the frustum of no_frames frames along the recorded camera path (or a generated loop if path_file_name is nullptr), prints
+the time per frame of the test of all boxes and of the BVH traversal with the scalar and AVX2 kernels and checks that
+all of them find the same visible sets */
+int BenchmarkCulling( const char * path_file_name, const int no_frames, const char * file_name = nullptr );
+
+/* renders the occluders of the OBJ file (or of a synthetic house of 64 furnished rooms if file_name is nullptr) into the
+occlusion buffers of several resolutions and culls the surfaces inside the frustum along the recorded camera path (or a
+generated walk if path_file_name is nullptr) with the scalar and AVX2 kernels on 1 and no_threads threads (0 means all
+hardware threads), prints the time per frame and the culled share against the exact visibility of the 640 x 480 image
+and checks that all variants cull the same surfaces */
+int BenchmarkOcclusionCulling( const char * path_file_name, const int no_frames, const int no_threads = 0, const char * file_name = nullptr );
+
+/* renders no_frames frames of the OBJ file (or of the synthetic house if file_name is nullptr) along a generated camera
+path by SoftwareRasterizer with the scalar kernel and with AVX2 on 1, 2, 4, ... up to all hardware threads, prints the
+frame time, its parts and the triangle throughput of each thread count and checks that all of them render the same
+images */
+int BenchmarkSoftwareRasterizer( const char * file_name, const int no_frames = 30, const int width = 640, const int height = 480 );
+
+/* renders no_frames pipelined frames of the default scene without any capture, with the frames read back and written
+synchronously and with the ring of the pixel buffers of FrameCapture, the images go to prefix + frame number, prints the
+sustained frame rate of each variant and the time the capture takes from the render thread */
+int BenchmarkCapture( const int no_frames = 100, const CaptureFormat format = CaptureFormat::PNG, const char * prefix = "capture_" );
+
+/* renders no_frames frames of the scene (an OBJ file, the default one if nullptr) along the recorded camera path (or an orbit around the model if
+path_file_name is nullptr) in a window or headless with the given culling ("none", "cpu", "occlusion" or "gpu"), prints
+the summary and writes the per-frame CPU and GPU times, draw commands and triangles to results_prefix.csv and .json, the
+JSON holds the statistics of the passes timed by GpuProfiler too and their timeline goes to results_prefix_trace.json */
+int BenchmarkCameraPath( const char * path_file_name, const int no_frames = 300, const bool headless = true,
+	const char * culling = "none", const char * results_prefix = "benchmark", const char * scene = nullptr );
+
+/* compares the result files (CSV or JSON) of two runs of BenchmarkCameraPath, fails if any metric of the current run
+is worse than the baseline by more than threshold (e.g. 0.05 for 5 %) */
+int CompareBenchmarkResults( const char * baseline_file_name, const char * current_file_name, const double threshold = 0.05 );
+
+#endif
@@ -23,6 +23,11 @@ Vector3 Camera::view_from() const
 	return view_from_;
 }
 
+Vector3 Camera::view_at() const
+{
+	return view_at_;
+}
+
 Matrix3x3 Camera::M_c_w() const
 {
 	return M_c_w_;
@@ -33,6 +38,11 @@ float Camera::focal_length() const
 	return f_y_;
 }
 
+float Camera::fov_y() const
+{
+	return fov_y_;
+}
+
 void Camera::set_fov_y( const float fov_y )
 {
 	assert( fov_y > 0.0 );
@@ -40,6 +50,16 @@ void Camera::set_fov_y( const float fov_y )
 	fov_y_ = fov_y;
 }
 
+void Camera::set_view_from( const Vector3 view_from )
+{
+	view_from_ = view_from;
+}
+
+void Camera::set_view_at( const Vector3 view_at )
+{
+	view_at_ = view_at;
+}
+
 void Camera::Update()
 {
 	f_y_ = height_ / ( 2.0f * tanf( fov_y_ * 0.5f ) );
@@ -21,11 +21,17 @@ public:
 		const Vector3 view_from, const Vector3 view_at );
 
 	Vector3 view_from() const;
+	Vector3 view_at() const;
 	Matrix3x3 M_c_w() const;
 	float focal_length() const;
 
+	float fov_y() const;
 	void set_fov_y( const float fov_y );
 
+	// the matrices follow after Update
+	void set_view_from( const Vector3 view_from );
+	void set_view_at( const Vector3 view_at );
+
 	void Update();
 
 	void MoveForward( const float dt );
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "camerapath.h"
+#include "mymath.h"
+#include <algorithm>
+#include <cstring>
+
+/* uniform Catmull-Rom spline through p1 and p2 at t from <0, 1> */
+static Vector3 CatmullRom( const Vector3 & p0, const Vector3 & p1, const Vector3 & p2, const Vector3 & p3, const float t )
+{
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+
+	return 0.5f * ( 2.0f * p1 + ( p2 - p0 ) * t + ( 2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 ) * t2 +
+		( 3.0f * p1 - p0 - 3.0f * p2 + p3 ) * t3 );
+}
+
+int CameraPath::Load( const char * file_name )
+{
+	FILE * file = fopen( file_name, "rt" );
+	if ( !file )
+	{
+		printf( "Camera path file '%s' not found.\n", file_name );
+		return -1;
+	}
+
+	std::vector<Key> keys;
+	char line[1024];
+	int line_number = 0;
+	while ( fgets( line, sizeof( line ), file ) )
+	{
+		++line_number;
+		const char * first = line + strspn( line, " \t\r\n" );
+		if ( ( *first == '\0' ) || ( *first == '#' ) )
+		{
+			continue;
+		}
+
+		Key key;
+		if ( ( sscanf( first, "%f %f %f %f %f %f %f %f", &key.time, &key.view_from.x, &key.view_from.y, &key.view_from.z,
+			&key.view_at.x, &key.view_at.y, &key.view_at.z, &key.fov_y ) != 8 ) ||
+			( !keys.empty() && ( key.time < keys.back().time ) ) || ( key.fov_y <= 0.0f ) )
+		{
+			printf( "Invalid camera path key at line %d of '%s'.\n", line_number, file_name );
+			fclose( file );
+			return -1;
+		}
+		key.fov_y = deg2rad( key.fov_y );
+		keys.push_back( key );
+	}
+	fclose( file );
+
+	if ( keys.empty() )
+	{
+		printf( "Camera path '%s' has no keys.\n", file_name );
+		return -1;
+	}
+	keys_.swap( keys );
+
+	return 0;
+}
+
+int CameraPath::Save( const char * file_name ) const
+{
+	FILE * file = fopen( file_name, "wt" );
+	if ( !file )
+	{
+		return -1;
+	}
+
+	fprintf( file, "# time view_from.x view_from.y view_from.z view_at.x view_at.y view_at.z fov_y (deg)\n" );
+	for ( const Key & key : keys_ )
+	{
+		fprintf( file, "%g %g %g %g %g %g %g %g\n", key.time, key.view_from.x, key.view_from.y, key.view_from.z,
+			key.view_at.x, key.view_at.y, key.view_at.z, rad2deg( key.fov_y ) );
+	}
+
+	return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+void CameraPath::Record( const float time, const Camera & camera )
+{
+	AddKey( Key{ time, camera.view_from(), camera.view_at(), camera.fov_y() } );
+}
+
+void CameraPath::AddKey( const Key & key )
+{
+	assert( keys_.empty() || ( key.time >= keys_.back().time ) );
+
+	keys_.push_back( key );
+}
+
+CameraPath::Key CameraPath::Sample( const float time ) const
+{
+	assert( !keys_.empty() );
+
+	// the first key after the time, the segment runs from the one before it
+	const size_t next = std::upper_bound( keys_.begin(), keys_.end(), time,
+		[]( const float t, const Key & key ) { return t < key.time; } ) - keys_.begin();
+	if ( next == 0 )
+	{
+		return keys_.front();
+	}
+	if ( next == keys_.size() )
+	{
+		return keys_.back();
+	}
+
+	const Key & k1 = keys_[next - 1];
+	const Key & k2 = keys_[next];
+	const Key & k0 = keys_[( next > 1 ) ? next - 2 : next - 1];
+	const Key & k3 = keys_[min( next + 1, keys_.size() - 1 )];
+	const float t = ( k2.time > k1.time ) ? ( time - k1.time ) / ( k2.time - k1.time ) : 1.0f;
+
+	Key key;
+	key.time = time;
+	key.view_from = CatmullRom( k0.view_from, k1.view_from, k2.view_from, k3.view_from, t );
+	key.view_at = CatmullRom( k0.view_at, k1.view_at, k2.view_at, k3.view_at, t );
+	key.fov_y = k1.fov_y + ( k2.fov_y - k1.fov_y ) * t;
+
+	return key;
+}
+
+void CameraPath::Apply( const float time, Camera & camera ) const
+{
+	const Key key = Sample( time );
+
+	camera.set_view_from( key.view_from );
+	camera.set_view_at( key.view_at );
+	camera.set_fov_y( key.fov_y );
+	camera.Update();
+}
+
+float CameraPath::duration() const
+{
+	return ( keys_.empty() ) ? 0.0f : keys_.back().time;
+}
+
+int CameraPath::no_keys() const
+{
+	return static_cast<int>( keys_.size() );
+}
@@ -0,0 +1,51 @@
+#ifndef CAMERA_PATH_H_
+#define CAMERA_PATH_H_
+
+#include "camera.h"
+
+/*! \class CameraPath
+\brief Recorded camera flight replayed by the benchmarks.
+
+The path is a sequence of keys sorted by time, each one holding the eye, the target and the vertical field of view.
+The eye and the target between the keys follow the Catmull-Rom spline through them and the field of view is
+interpolated linearly, the first and the last key hold before and after the path.
+
+The text file has one key per line, "time view_from.x view_from.y view_from.z view_at.x view_at.y view_at.z fov_y"
+with the time in seconds and the field of view in degrees, lines starting with # are comments.
+*/
+class CameraPath
+{
+public:
+	struct Key
+	{
+		float time; // (s)
+		Vector3 view_from;
+		Vector3 view_at;
+		float fov_y; // (rad)
+	};
+
+	/* replaces the keys by the ones of the file, returns 0 on success */
+	int Load( const char * file_name );
+
+	/* writes the keys to the file, returns 0 on success */
+	int Save( const char * file_name ) const;
+
+	/* appends the pose of the camera at the given time, the time must not be less than the one of the last key */
+	void Record( const float time, const Camera & camera );
+	void AddKey( const Key & key );
+
+	/* interpolated pose at the given time */
+	Key Sample( const float time ) const;
+
+	/* moves the camera to the pose at the given time and updates its matrices */
+	void Apply( const float time, Camera & camera ) const;
+
+	/* time of the last key (s) */
+	float duration() const;
+	int no_keys() const;
+
+private:
+	std::vector<Key> keys_;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "fastparse.h"
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define FAST_PARSE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef FAST_PARSE_SSE2
+static inline int FirstSetBit( const unsigned int mask )
+{
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward( &index, mask );
+	return static_cast<int>( index );
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+#endif
+
+const char * FindNewline( const char * begin, const char * end )
+{
+	const char * p = begin;
+
+#ifdef FAST_PARSE_SSE2
+	const __m128i lf = _mm_set1_epi8( '\n' );
+
+	for ( ; p + 16 <= end; p += 16 )
+	{
+		const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+		const unsigned int mask = static_cast<unsigned int>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, lf ) ) );
+		if ( mask != 0 )
+		{
+			return p + FirstSetBit( mask );
+		}
+	}
+#endif
+
+	while ( ( p < end ) && ( *p != '\n' ) ) ++p;
+
+	return p;
+}
+
+const char * FindSeparator( const char * begin, const char * end )
+{
+	const char * p = begin;
+
+#ifdef FAST_PARSE_SSE2
+	const __m128i space = _mm_set1_epi8( ' ' );
+	const __m128i tab = _mm_set1_epi8( '\t' );
+	const __m128i cr = _mm_set1_epi8( '\r' );
+	const __m128i lf = _mm_set1_epi8( '\n' );
+
+	for ( ; p + 16 <= end; p += 16 )
+	{
+		const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+		const __m128i separators = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi8( chunk, space ), _mm_cmpeq_epi8( chunk, tab ) ),
+			_mm_or_si128( _mm_cmpeq_epi8( chunk, cr ), _mm_cmpeq_epi8( chunk, lf ) ) );
+		const unsigned int mask = static_cast<unsigned int>( _mm_movemask_epi8( separators ) );
+		if ( mask != 0 )
+		{
+			return p + FirstSetBit( mask );
+		}
+	}
+#endif
+
+	while ( ( p < end ) && ( *p != ' ' ) && ( *p != '\t' ) && ( *p != '\r' ) && ( *p != '\n' ) ) ++p;
+
+	return p;
+}
+
+/* exactly representable powers of ten */
+static const double kPowersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const char * ParseFloat( const char * p, const char * end, float & value )
+{
+	p = SkipBlanks( p, end );
+
+	bool negative = false;
+	if ( ( p < end ) && ( ( *p == '-' ) || ( *p == '+' ) ) )
+	{
+		negative = ( *p == '-' );
+		++p;
+	}
+
+	// up to 19 significant digits fit into 64-bit mantissa, the rest only scales the exponent
+	unsigned long long mantissa = 0;
+	int significant_digits = 0;
+	int exponent = 0;
+
+	for ( ; ( p < end ) && IsDigit( *p ); ++p )
+	{
+		if ( significant_digits < 19 )
+		{
+			mantissa = mantissa * 10 + ( *p - '0' );
+			if ( mantissa != 0 ) ++significant_digits;
+		}
+		else
+		{
+			++exponent;
+		}
+	}
+
+	if ( ( p < end ) && ( *p == '.' ) )
+	{
+		for ( ++p; ( p < end ) && IsDigit( *p ); ++p )
+		{
+			if ( significant_digits < 19 )
+			{
+				mantissa = mantissa * 10 + ( *p - '0' );
+				if ( mantissa != 0 ) ++significant_digits;
+				--exponent;
+			}
+		}
+	}
+
+	if ( ( p < end ) && ( ( *p == 'e' ) || ( *p == 'E' ) ) )
+	{
+		int explicit_exponent = 0;
+		p = ParseInt( p + 1, end, explicit_exponent );
+		exponent += explicit_exponent;
+	}
+
+	double result = static_cast<double>( mantissa );
+	if ( mantissa != 0 )
+	{
+		while ( exponent < -22 )
+		{
+			result /= kPowersOf10[22];
+			exponent += 22;
+		}
+		while ( exponent > 22 )
+		{
+			result *= kPowersOf10[22];
+			exponent -= 22;
+		}
+		result = ( exponent < 0 ) ? result / kPowersOf10[-exponent] : result * kPowersOf10[exponent];
+	}
+
+	value = static_cast<float>( negative ? -result : result );
+
+	return p;
+}
+
+const char * ParseToken( const char * p, const char * end, char * token, const size_t token_size )
+{
+	p = SkipBlanks( p, end );
+
+	const char * token_end = FindSeparator( p, end );
+	size_t length = static_cast<size_t>( token_end - p );
+	if ( length >= token_size )
+	{
+		length = token_size - 1;
+	}
+
+	memcpy( token, p, length );
+	token[length] = 0;
+
+	return token_end;
+}
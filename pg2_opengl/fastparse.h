@@ -0,0 +1,79 @@
+#ifndef FAST_PARSE_H_
+#define FAST_PARSE_H_
+
+/*
+Locale independent parsing kernels working on non null terminated ranges <p, end).
+Every parsing function skips leading blanks (spaces and tabs) and returns the pointer
+to the first character after the parsed value.
+*/
+
+/* returns the first '\n' in <begin, end) or end if there is none, SIMD */
+const char * FindNewline( const char * begin, const char * end );
+
+/* returns the first blank, CR or LF in <begin, end) or end if there is none, SIMD */
+const char * FindSeparator( const char * begin, const char * end );
+
+inline bool IsDigit( const char c )
+{
+	return static_cast<unsigned char>( c - '0' ) < 10;
+}
+
+inline const char * SkipBlanks( const char * p, const char * end )
+{
+	while ( ( p < end ) && ( ( *p == ' ' ) || ( *p == '\t' ) ) ) ++p;
+
+	return p;
+}
+
+/* parses optionally signed decimal integer, value is zero if there are no digits */
+inline const char * ParseInt( const char * p, const char * end, int & value )
+{
+	p = SkipBlanks( p, end );
+
+	bool negative = false;
+	if ( ( p < end ) && ( ( *p == '-' ) || ( *p == '+' ) ) )
+	{
+		negative = ( *p == '-' );
+		++p;
+	}
+
+	int result = 0;
+	for ( ; ( p < end ) && IsDigit( *p ); ++p )
+	{
+		result = result * 10 + ( *p - '0' );
+	}
+	value = negative ? -result : result;
+
+	return p;
+}
+
+/* parses floating point number in the fixed or scientific notation, value is zero if there are no digits */
+const char * ParseFloat( const char * p, const char * end, float & value );
+
+/* parses single "v", "v/vt", "v//vn" or "v/vt/vn" face item, missing indices are set to zero */
+inline const char * ParseFaceItem( const char * p, const char * end, int item[3] )
+{
+	item[1] = 0;
+	item[2] = 0;
+
+	p = ParseInt( p, end, item[0] );
+	if ( ( p < end ) && ( *p == '/' ) )
+	{
+		++p;
+		if ( ( p < end ) && ( *p != '/' ) )
+		{
+			p = ParseInt( p, end, item[1] );
+		}
+		if ( ( p < end ) && ( *p == '/' ) )
+		{
+			p = ParseInt( p + 1, end, item[2] );
+		}
+	}
+
+	return p;
+}
+
+/* copies the next whitespace delimited token into the null terminated buffer, too long tokens are truncated */
+const char * ParseToken( const char * p, const char * end, char * token, const size_t token_size );
+
+#endif
@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "framecapture.h"
+#include "freeimage.h"
+#include "pixelformat.h"
+#include "mymath.h"
+#include <chrono>
+
+static double SecondsSince( const std::chrono::steady_clock::time_point t0 )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+}
+
+/* buffer of size bytes read back by the CPU, false if its storage was not allocated */
+static bool CreateReadBuffer( const size_t size, GLuint & buffer )
+{
+	// the client storage lets the driver keep the buffer in the system memory
+	glCreateBuffers( 1, &buffer );
+	glNamedBufferStorage( buffer, size, nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT );
+	GLint64 allocated = 0;
+	glGetNamedBufferParameteri64v( buffer, GL_BUFFER_SIZE, &allocated );
+
+	return allocated == static_cast<GLint64>( size );
+}
+
+/* prefix + frame padded to 5 digits + suffix */
+static std::string FrameFileName( const std::string & prefix, const int frame, const char * suffix )
+{
+	char number[16];
+	snprintf( number, sizeof( number ), "%05d", frame );
+
+	return prefix + number + suffix;
+}
+
+/* RGBA8 rows from the bottom one to an 8-bit RGB PNG, returns false if FreeImage fails */
+static bool WritePng( const BYTE * rgba, const int width, const int height, const std::string & file_name )
+{
+	FIBITMAP * dib = FreeImage_Allocate( width, height, 24 );
+	if ( !dib )
+	{
+		return false;
+	}
+
+	// the rows of FreeImage go from the bottom one as well, only the channels are swapped and the pitch is aligned
+	for ( int y = 0; y < height; ++y )
+	{
+		ConvertRGBA8ToBGR8( rgba + static_cast<size_t>( y ) * width * 4, FreeImage_GetScanLine( dib, y ), width );
+	}
+	const bool written = FreeImage_Save( FIF_PNG, dib, file_name.c_str(), PNG_Z_BEST_SPEED ) != FALSE;
+	FreeImage_Unload( dib );
+
+	return written;
+}
+
+/* half float RGBA rows from the bottom one to a half float RGBA EXR */
+static bool WriteExr( const unsigned short * rgba, const int width, const int height, const std::string & file_name )
+{
+	FIBITMAP * dib = FreeImage_AllocateT( FIT_RGBAF, width, height );
+	if ( !dib )
+	{
+		return false;
+	}
+
+	for ( int y = 0; y < height; ++y )
+	{
+		ConvertHalfToFloat( rgba + static_cast<size_t>( y ) * width * 4, reinterpret_cast<float *>( FreeImage_GetScanLine( dib, y ) ), static_cast<size_t>( width ) * 4 );
+	}
+	const bool written = FreeImage_Save( FIF_EXR, dib, file_name.c_str(), EXR_DEFAULT ) != FALSE; // stored as half floats
+	FreeImage_Unload( dib );
+
+	return written;
+}
+
+/* float depth rows from the bottom one to a single channel float EXR */
+static bool WriteDepthExr( const float * depth, const int width, const int height, const std::string & file_name )
+{
+	FIBITMAP * dib = FreeImage_AllocateT( FIT_FLOAT, width, height );
+	if ( !dib )
+	{
+		return false;
+	}
+
+	for ( int y = 0; y < height; ++y )
+	{
+		memcpy( FreeImage_GetScanLine( dib, y ), depth + static_cast<size_t>( y ) * width, width * sizeof( float ) );
+	}
+	const bool written = FreeImage_Save( FIF_EXR, dib, file_name.c_str(), EXR_FLOAT ) != FALSE; // half floats lack the precision of the depth
+	FreeImage_Unload( dib );
+
+	return written;
+}
+
+FrameCapture::FrameCapture()
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+}
+
+int FrameCapture::Init( const int width, const int height, const std::string & prefix, const CaptureFormat format,
+	const bool depth, const int latency, const int no_threads )
+{
+	Release();
+
+	width_ = width;
+	height_ = height;
+	prefix_ = prefix;
+	format_ = format;
+	depth_ = depth;
+	latency_ = max( 0, latency );
+	color_size_ = static_cast<size_t>( width ) * height * 4 * ( ( format == CaptureFormat::EXR ) ? sizeof( unsigned short ) : sizeof( BYTE ) );
+	depth_size_ = ( depth ) ? static_cast<size_t>( width ) * height * sizeof( float ) : 0;
+	stats_ = Stats();
+	no_failed_ = 0;
+	next_ = 0;
+
+	slots_.resize( max( 1, latency_ ) );
+	for ( Slot & slot : slots_ )
+	{
+		if ( !CreateReadBuffer( color_size_, slot.color ) || ( depth && !CreateReadBuffer( depth_size_, slot.depth ) ) )
+		{
+			return -1;
+		}
+	}
+	pool_.reset( new ThreadPool( no_threads ) );
+
+	return 0;
+}
+
+void FrameCapture::Capture( const GLuint framebuffer, const int frame )
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	Slot & slot = slots_[next_];
+	next_ = ( next_ + 1 ) % static_cast<int>( slots_.size() );
+
+	// the frame read latency frames ago, normally finished long before
+	if ( slot.fence )
+	{
+		Retire( slot );
+	}
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffer );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.color );
+	glReadPixels( 0, 0, width_, height_, GL_RGBA, ( format_ == CaptureFormat::EXR ) ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE, nullptr );
+	if ( depth_ )
+	{
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.depth );
+		glReadPixels( 0, 0, width_, height_, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	slot.frame = frame;
+	++stats_.no_frames;
+
+	if ( latency_ == 0 )
+	{
+		Retire( slot );
+	}
+	stats_.capture_time += SecondsSince( t0 );
+}
+
+void FrameCapture::Flush()
+{
+	const auto t0 = std::chrono::steady_clock::now();
+
+	// the oldest frames first so the images are queued in their order
+	for ( size_t i = 0; i < slots_.size(); ++i )
+	{
+		Slot & slot = slots_[( next_ + i ) % slots_.size()];
+		if ( slot.fence )
+		{
+			Retire( slot );
+		}
+	}
+	while ( !encodes_.empty() )
+	{
+		WaitForOldest();
+	}
+	stats_.capture_time += SecondsSince( t0 );
+}
+
+void FrameCapture::Release()
+{
+	if ( pool_ )
+	{
+		Flush();
+		pool_.reset();
+	}
+	for ( Slot & slot : slots_ )
+	{
+		glDeleteBuffers( 1, &slot.color );
+		glDeleteBuffers( 1, &slot.depth );
+	}
+	slots_.clear();
+}
+
+FrameCapture::Stats FrameCapture::stats() const
+{
+	Stats stats = stats_;
+	stats.no_failed = no_failed_;
+
+	return stats;
+}
+
+bool FrameCapture::is_initialized() const
+{
+	return !slots_.empty();
+}
+
+void FrameCapture::Retire( Slot & slot )
+{
+	GLenum status = glClientWaitSync( slot.fence, 0, 0 );
+	if ( status == GL_TIMEOUT_EXPIRED )
+	{
+		const auto t0 = std::chrono::steady_clock::now();
+		do
+		{
+			status = glClientWaitSync( slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 ); // 1 ms
+		} while ( status == GL_TIMEOUT_EXPIRED );
+		stats_.stall_time += SecondsSince( t0 );
+		++stats_.no_stalls;
+	}
+	glDeleteSync( slot.fence );
+	slot.fence = nullptr;
+
+	// the copies free the slot for the next frame, the workers convert them
+	std::vector<BYTE> color( color_size_ );
+	std::vector<BYTE> depth( depth_size_ );
+	const void * mapped = glMapNamedBufferRange( slot.color, 0, color_size_, GL_MAP_READ_BIT );
+	if ( mapped )
+	{
+		memcpy( color.data(), mapped, color_size_ );
+	}
+	glUnmapNamedBuffer( slot.color );
+	if ( depth_ )
+	{
+		mapped = glMapNamedBufferRange( slot.depth, 0, depth_size_, GL_MAP_READ_BIT );
+		if ( mapped )
+		{
+			memcpy( depth.data(), mapped, depth_size_ );
+		}
+		glUnmapNamedBuffer( slot.depth );
+	}
+	stats_.bytes_read += color_size_ + depth_size_;
+
+	// bounded backlog keeps the memory of the copies bounded when the encoding cannot keep up
+	const size_t max_pending = 2 * static_cast<size_t>( pool_->no_threads() );
+	if ( encodes_.size() >= max_pending )
+	{
+		const auto t0 = std::chrono::steady_clock::now();
+		WaitForOldest();
+		stats_.stall_time += SecondsSince( t0 );
+		++stats_.no_encode_stalls;
+	}
+	while ( !encodes_.empty() && ( encodes_.front().wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) )
+	{
+		WaitForOldest();
+	}
+
+	const int width = width_;
+	const int height = height_;
+	const CaptureFormat format = format_;
+	const std::string color_file = FrameFileName( prefix_, slot.frame, ( format == CaptureFormat::EXR ) ? ".exr" : ".png" );
+	const std::string depth_file = FrameFileName( prefix_, slot.frame, "_depth.exr" );
+	std::atomic<int> * no_failed = &no_failed_;
+	encodes_.push_back( pool_->Submit( [=, color = std::move( color ), depth = std::move( depth )]() {
+		const auto t0 = std::chrono::steady_clock::now();
+		const bool color_written = ( format == CaptureFormat::EXR ) ?
+			WriteExr( reinterpret_cast<const unsigned short *>( color.data() ), width, height, color_file ) :
+			WritePng( color.data(), width, height, color_file );
+		const bool depth_written = depth.empty() || WriteDepthExr( reinterpret_cast<const float *>( depth.data() ), width, height, depth_file );
+		*no_failed += ( color_written ? 0 : 1 ) + ( depth_written ? 0 : 1 );
+
+		return SecondsSince( t0 );
+	} ) );
+	stats_.no_images += ( depth_ ) ? 2 : 1;
+}
+
+void FrameCapture::WaitForOldest()
+{
+	stats_.encode_time += encodes_.front().get();
+	encodes_.pop_front();
+}
@@ -0,0 +1,108 @@
+#ifndef FRAME_CAPTURE_H_
+#define FRAME_CAPTURE_H_
+
+#include "threadpool.h"
+#include <deque>
+#include <atomic>
+
+/*! \def FRAME_CAPTURE_LATENCY
+\brief Number of frames between the read of a frame into the pixel buffers and their mapping.
+*/
+#define FRAME_CAPTURE_LATENCY 3
+
+/* file format of the captured color, the depth is always written as EXR */
+enum class CaptureFormat { PNG, EXR };
+
+/*! \class FrameCapture
+\brief Writes every rendered frame to image files without stalling the pipeline.
+
+\a Capture issues glReadPixels of the resolved attachments into pixel buffer objects and fences them, the read runs
+asynchronously on the GPU. The pixel buffers form a ring of FRAME_CAPTURE_LATENCY slots, so a slot is mapped only
+when the ring wraps around to it, i.e. FRAME_CAPTURE_LATENCY frames later, when its fence is normally long signaled.
+The mapped pixels are copied out and the slot is reused at once, the conversion (see pixelformat.h) and the encoding
+run on a ThreadPool. The render thread waits for the oldest image only if the encoding falls behind by more than
+twice the number of the workers.
+
+PNG stores the color as 8-bit RGB read as RGBA8, EXR stores it as half float RGBA read as half floats too. The depth
+is read as floats and stored as a single channel float EXR. The files are named prefix + frame number padded to 5
+digits, the depth adds _depth before the extension.
+
+All methods but the encoding have to be called with the GL context current, \a Release must be called before the
+context is destroyed.
+*/
+class FrameCapture
+{
+public:
+	/* counters since Init */
+	struct Stats
+	{
+		int no_frames; // captured
+		int no_images; // image files queued for the encoding
+		int no_failed; // of them FreeImage failed to write
+		int no_stalls; // mappings waiting for the GPU
+		int no_encode_stalls; // captures waiting for the encoding
+		double capture_time; // of the render thread spent by Capture and Flush (s)
+		double stall_time; // of the render thread waiting for the GPU and the encoding
+		double encode_time; // of the workers converting and encoding
+		size_t bytes_read; // from the pixel buffers
+	};
+
+	FrameCapture();
+	~FrameCapture();
+
+	/* creates the pixel buffers of width x height px images, latency 0 maps each frame right after its read (i.e.
+	the naive glReadPixels), no_threads encoding threads, 0 means all hardware threads, returns 0 on success */
+	int Init( const int width, const int height, const std::string & prefix, const CaptureFormat format,
+		const bool depth, const int latency = FRAME_CAPTURE_LATENCY, const int no_threads = 0 );
+
+	/* reads the color attachment 0 (and the depth) of the single-sampled framebuffer as the given frame and hands the
+	frame read latency frames ago over to the encoding */
+	void Capture( const GLuint framebuffer, const int frame );
+
+	/* hands all frames still in the ring over to the encoding and waits until all of them are written */
+	void Flush();
+
+	/* flushes the frames and deletes the pixel buffers, the stats are kept */
+	void Release();
+
+	Stats stats() const;
+	bool is_initialized() const;
+
+private:
+	/* pixel buffers of a frame */
+	struct Slot
+	{
+		GLuint color{ 0 };
+		GLuint depth{ 0 };
+		GLsync fence{ nullptr }; // of the reads, nullptr if the slot is free
+		int frame{ 0 };
+	};
+
+	/* waits for the reads of the slot, copies its pixels out and queues their encoding */
+	void Retire( Slot & slot );
+
+	/* waits for the oldest encoding and sums its time */
+	void WaitForOldest();
+
+	int width_{ 0 };
+	int height_{ 0 };
+	std::string prefix_;
+	CaptureFormat format_{ CaptureFormat::PNG };
+	bool depth_{ false };
+	int latency_{ FRAME_CAPTURE_LATENCY };
+	size_t color_size_{ 0 }; // of the pixel buffer (bytes)
+	size_t depth_size_{ 0 };
+
+	std::vector<Slot> slots_;
+	int next_{ 0 }; // slot of the next Capture
+	std::unique_ptr<ThreadPool> pool_;
+	std::deque<std::future<double>> encodes_; // time of each queued image, the oldest at the front
+
+	Stats stats_{};
+	std::atomic<int> no_failed_{ 0 }; // written by the workers
+
+	FrameCapture( const FrameCapture & ) = delete;
+	FrameCapture & operator=( const FrameCapture & ) = delete;
+};
+
+#endif
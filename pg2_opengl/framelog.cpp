@@ -0,0 +1,298 @@
+#include "pch.h"
+#include "framelog.h"
+#include "mymath.h"
+#include <algorithm>
+#include <cstring>
+
+/* distribution of the values picked from the records, the negative ones are not measured and skipped */
+static FrameLog::Metric Distribution( const std::vector<FrameLog::Record> & records, const std::function<double( const FrameLog::Record & )> & value )
+{
+	std::vector<double> values;
+	values.reserve( records.size() );
+	double sum = 0.0;
+	for ( const FrameLog::Record & record : records )
+	{
+		const double v = value( record );
+		if ( v >= 0.0 )
+		{
+			values.push_back( v );
+			sum += v;
+		}
+	}
+
+	FrameLog::Metric metric = {};
+	if ( !values.empty() )
+	{
+		metric.mean = sum / values.size();
+		metric.p50 = FrameLog::Percentile( values, 0.5 );
+		metric.p95 = FrameLog::Percentile( values, 0.95 );
+		metric.max = *std::max_element( values.begin(), values.end() );
+	}
+
+	return metric;
+}
+
+/* true if the file name ends with the extension */
+static bool HasExtension( const char * file_name, const char * extension )
+{
+	const size_t length = strlen( file_name );
+	const size_t extension_length = strlen( extension );
+
+	return ( length >= extension_length ) && ( strcmp( file_name + length - extension_length, extension ) == 0 );
+}
+
+/* the string as a JSON string literal */
+static std::string JsonString( const std::string & s )
+{
+	std::string json = "\"";
+	for ( const char c : s )
+	{
+		if ( ( c == '"' ) || ( c == '\\' ) )
+		{
+			json += '\\';
+		}
+		json += ( static_cast<unsigned char>( c ) < 0x20 ) ? ' ' : c;
+	}
+
+	return json + "\"";
+}
+
+static void WriteJsonMetric( FILE * file, const char * name, const FrameLog::Metric & metric, const double scale, const bool last )
+{
+	fprintf( file, "\t\t\"%s\": { \"mean\": %0.4f, \"p50\": %0.4f, \"p95\": %0.4f, \"max\": %0.4f }%s\n", name,
+		metric.mean * scale, metric.p50 * scale, metric.p95 * scale, metric.max * scale, ( last ) ? "" : "," );
+}
+
+size_t FrameLog::Add( const Record & record )
+{
+	records_.push_back( record );
+
+	return records_.size() - 1;
+}
+
+FrameLog::Record & FrameLog::record( const size_t i )
+{
+	return records_[i];
+}
+
+const std::vector<FrameLog::Record> & FrameLog::records() const
+{
+	return records_;
+}
+
+void FrameLog::Clear()
+{
+	records_.clear();
+	info_.clear();
+	passes_.clear();
+}
+
+void FrameLog::set_info( const std::string & key, const std::string & value )
+{
+	for ( auto & info : info_ )
+	{
+		if ( info.first == key )
+		{
+			info.second = value;
+			return;
+		}
+	}
+	info_.push_back( std::make_pair( key, value ) );
+}
+
+void FrameLog::set_passes( const std::vector<GpuProfiler::Scope> & passes )
+{
+	passes_ = passes;
+}
+
+FrameLog::Summary FrameLog::summary() const
+{
+	Summary summary;
+	summary.no_frames = static_cast<int>( records_.size() );
+	summary.cpu_time = Distribution( records_, []( const Record & r ) { return r.cpu_time; } );
+	summary.gpu_time = Distribution( records_, []( const Record & r ) { return r.gpu_time; } );
+	summary.frame_time = Distribution( records_, []( const Record & r ) { return r.frame_time; } );
+	summary.draw_commands = Distribution( records_, []( const Record & r ) { return double( r.draw_commands ); } );
+	summary.triangles = Distribution( records_, []( const Record & r ) { return double( r.triangles ); } );
+
+	return summary;
+}
+
+int FrameLog::SaveCsv( const char * file_name ) const
+{
+	FILE * file = fopen( file_name, "wt" );
+	if ( !file )
+	{
+		printf( "Unable to write '%s'.\n", file_name );
+		return -1;
+	}
+
+	fprintf( file, "frame,time,cpu_ms,gpu_ms,frame_ms,draw_commands,triangles\n" );
+	for ( const Record & r : records_ )
+	{
+		fprintf( file, "%d,%0.4f,%0.4f,%0.4f,%0.4f,%d,%lld\n", r.frame, r.time, r.cpu_time * 1e3,
+			( r.gpu_time >= 0.0 ) ? r.gpu_time * 1e3 : -1.0, r.frame_time * 1e3, r.draw_commands, r.triangles );
+	}
+
+	return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+int FrameLog::SaveJson( const char * file_name ) const
+{
+	FILE * file = fopen( file_name, "wt" );
+	if ( !file )
+	{
+		printf( "Unable to write '%s'.\n", file_name );
+		return -1;
+	}
+
+	fprintf( file, "{\n\t\"info\": {\n" );
+	for ( size_t i = 0; i < info_.size(); ++i )
+	{
+		fprintf( file, "\t\t%s: %s%s\n", JsonString( info_[i].first ).c_str(), JsonString( info_[i].second ).c_str(),
+			( i + 1 < info_.size() ) ? "," : "" );
+	}
+	const Summary s = summary();
+	fprintf( file, "\t},\n\t\"summary\": {\n\t\t\"frames\": %d,\n", s.no_frames );
+	WriteJsonMetric( file, "cpu_ms", s.cpu_time, 1e3, false );
+	WriteJsonMetric( file, "gpu_ms", s.gpu_time, 1e3, false );
+	WriteJsonMetric( file, "frame_ms", s.frame_time, 1e3, false );
+	WriteJsonMetric( file, "draw_commands", s.draw_commands, 1.0, false );
+	WriteJsonMetric( file, "triangles", s.triangles, 1.0, true );
+	fprintf( file, "\t},\n\t\"passes\": [\n" );
+	for ( size_t i = 0; i < passes_.size(); ++i )
+	{
+		const GpuProfiler::Scope & p = passes_[i];
+		fprintf( file, "\t\t{ \"name\": %s, \"depth\": %d, \"samples\": %d, \"cpu_ms\": { \"min\": %0.4f, \"mean\": %0.4f, \"p95\": %0.4f, \"p99\": %0.4f }",
+			JsonString( p.name ).c_str(), p.depth, p.cpu.no_samples, p.cpu.min * 1e3, p.cpu.mean * 1e3, p.cpu.p95 * 1e3, p.cpu.p99 * 1e3 );
+		if ( p.gpu_measured && ( p.gpu.no_samples > 0 ) )
+		{
+			fprintf( file, ", \"gpu_ms\": { \"min\": %0.4f, \"mean\": %0.4f, \"p95\": %0.4f, \"p99\": %0.4f } }",
+				p.gpu.min * 1e3, p.gpu.mean * 1e3, p.gpu.p95 * 1e3, p.gpu.p99 * 1e3 );
+		}
+		else
+		{
+			fprintf( file, ", \"gpu_ms\": null }" );
+		}
+		fprintf( file, "%s\n", ( i + 1 < passes_.size() ) ? "," : "" );
+	}
+	fprintf( file, "\t],\n" );
+	// one frame per line, Load reads them back by these lines
+	fprintf( file, "\t\"frames\": [\n" );
+	for ( size_t i = 0; i < records_.size(); ++i )
+	{
+		const Record & r = records_[i];
+		fprintf( file, "\t\t{ \"frame\": %d, \"time\": %0.4f, \"cpu_ms\": %0.4f, \"gpu_ms\": %0.4f, \"frame_ms\": %0.4f, \"draw_commands\": %d, \"triangles\": %lld }%s\n",
+			r.frame, r.time, r.cpu_time * 1e3, ( r.gpu_time >= 0.0 ) ? r.gpu_time * 1e3 : -1.0, r.frame_time * 1e3, r.draw_commands,
+			r.triangles, ( i + 1 < records_.size() ) ? "," : "" );
+	}
+	fprintf( file, "\t]\n}\n" );
+
+	return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+int FrameLog::Load( const char * file_name )
+{
+	FILE * file = fopen( file_name, "rt" );
+	if ( !file )
+	{
+		printf( "Result file '%s' not found.\n", file_name );
+		return -1;
+	}
+
+	const bool json = HasExtension( file_name, ".json" );
+	std::vector<Record> records;
+	char line[1024];
+	while ( fgets( line, sizeof( line ), file ) )
+	{
+		Record r = {};
+		const char * first = line + strspn( line, " \t" );
+		int no_fields = 0;
+		if ( json )
+		{
+			no_fields = sscanf( first, "{ \"frame\": %d, \"time\": %f, \"cpu_ms\": %lf, \"gpu_ms\": %lf, \"frame_ms\": %lf, \"draw_commands\": %d, \"triangles\": %lld",
+				&r.frame, &r.time, &r.cpu_time, &r.gpu_time, &r.frame_time, &r.draw_commands, &r.triangles );
+		}
+		else
+		{
+			// the header does not start with a number
+			no_fields = sscanf( first, "%d,%f,%lf,%lf,%lf,%d,%lld", &r.frame, &r.time, &r.cpu_time, &r.gpu_time, &r.frame_time,
+				&r.draw_commands, &r.triangles );
+		}
+		if ( no_fields == 7 )
+		{
+			r.cpu_time *= 1e-3;
+			r.gpu_time = ( r.gpu_time >= 0.0 ) ? r.gpu_time * 1e-3 : -1.0;
+			r.frame_time *= 1e-3;
+			records.push_back( r );
+		}
+	}
+	fclose( file );
+
+	if ( records.empty() )
+	{
+		printf( "Result file '%s' has no frames.\n", file_name );
+		return -1;
+	}
+	records_.swap( records );
+	info_.clear();
+	passes_.clear();
+
+	return 0;
+}
+
+int FrameLog::Compare( const FrameLog & baseline, const FrameLog & current, const double threshold )
+{
+	const Summary b = baseline.summary();
+	const Summary c = current.summary();
+	if ( b.no_frames != c.no_frames )
+	{
+		printf( "The runs differ in the number of frames (%d and %d).\n", b.no_frames, c.no_frames );
+	}
+
+	struct Row
+	{
+		const char * name;
+		double baseline;
+		double current;
+		double min_difference; // below which the change is noise
+	};
+	const Row rows[] = {
+		{ "cpu mean (ms)", b.cpu_time.mean * 1e3, c.cpu_time.mean * 1e3, 0.05 },
+		{ "cpu p95 (ms)", b.cpu_time.p95 * 1e3, c.cpu_time.p95 * 1e3, 0.05 },
+		{ "gpu mean (ms)", b.gpu_time.mean * 1e3, c.gpu_time.mean * 1e3, 0.05 },
+		{ "gpu p95 (ms)", b.gpu_time.p95 * 1e3, c.gpu_time.p95 * 1e3, 0.05 },
+		{ "frame mean (ms)", b.frame_time.mean * 1e3, c.frame_time.mean * 1e3, 0.05 },
+		{ "frame p95 (ms)", b.frame_time.p95 * 1e3, c.frame_time.p95 * 1e3, 0.05 },
+		{ "draw commands", b.draw_commands.mean, c.draw_commands.mean, 0.5 },
+		{ "triangles", b.triangles.mean, c.triangles.mean, 0.5 } };
+
+	int no_regressions = 0;
+	printf( "\nmetric\t\t\tbaseline\tcurrent\t\tchange\n" );
+	for ( const Row & row : rows )
+	{
+		// all metrics are better when lower
+		const double change = ( row.baseline > 0.0 ) ? row.current / row.baseline - 1.0 : 0.0;
+		const bool regression = ( change > threshold ) && ( row.current - row.baseline > row.min_difference );
+		no_regressions += ( regression ) ? 1 : 0;
+		printf( "%-24s%0.3f\t\t%0.3f\t\t%+0.1f %%%s\n", row.name, row.baseline, row.current, 100.0 * change,
+			( regression ) ? "\tREGRESSION" : "" );
+	}
+	printf( "%d metric(s) regressed by more than %0.1f %%.\n", no_regressions, 100.0 * threshold );
+
+	return no_regressions;
+}
+
+double FrameLog::Percentile( std::vector<double> values, const double p )
+{
+	if ( values.empty() )
+	{
+		return 0.0;
+	}
+
+	const size_t rank = static_cast<size_t>( ceil( p * values.size() ) );
+	const size_t i = min( values.size() - 1, ( rank > 0 ) ? rank - 1 : 0 );
+	std::nth_element( values.begin(), values.begin() + i, values.end() );
+
+	return values[i];
+}
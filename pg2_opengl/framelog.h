@@ -0,0 +1,82 @@
+#ifndef FRAME_LOG_H_
+#define FRAME_LOG_H_
+
+#include "gpuprofiler.h"
+
+/*! \class FrameLog
+\brief Per-frame measurements of a benchmark run and their result files.
+
+The records are written as CSV with one frame per line and as JSON holding the description of the run, the summary,
+the rolling statistics of the passes timed by GpuProfiler (if any) and the frames, both with the times in milliseconds.
+Either of them can be loaded back, the JSON by the lines of the frames only, so two runs can be compared by
+\a Compare. The GPU time and the triangles are negative if the frame was not measured by the GPU.
+*/
+class FrameLog
+{
+public:
+	struct Record
+	{
+		int frame;
+		float time; // on the camera path (s)
+		double cpu_time; // of the render thread submitting the frame (s)
+		double gpu_time; // between the first and the last command of the frame on the GPU
+		double frame_time; // between the starts of this and the next frame, i.e. the sustained frame time
+		int draw_commands; // indirect commands of the single multi-draw, not GL calls
+		long long triangles; // generated by the scene pass
+	};
+
+	/* distribution of a metric over the frames */
+	struct Metric
+	{
+		double mean;
+		double p50;
+		double p95;
+		double max;
+	};
+
+	struct Summary
+	{
+		int no_frames;
+		Metric cpu_time; // (s)
+		Metric gpu_time; // of the measured frames only
+		Metric frame_time;
+		Metric draw_commands;
+		Metric triangles;
+	};
+
+	/* appends the record and returns its index */
+	size_t Add( const Record & record );
+	Record & record( const size_t i );
+	const std::vector<Record> & records() const;
+	void Clear();
+
+	/* adds a key value pair describing the run (e.g. the scene or the renderer) to the JSON */
+	void set_info( const std::string & key, const std::string & value );
+
+	/* rolling statistics of the passes of the run written to the JSON */
+	void set_passes( const std::vector<GpuProfiler::Scope> & passes );
+
+	Summary summary() const;
+
+	/* writes the result files, return 0 on success */
+	int SaveCsv( const char * file_name ) const;
+	int SaveJson( const char * file_name ) const;
+
+	/* replaces the records by the ones of the CSV or JSON file (by the extension) written by this class, returns 0 on
+	success */
+	int Load( const char * file_name );
+
+	/* prints the summaries of both runs side by side and flags the metrics of the current run worse than the ones of
+	the baseline by more than the threshold (e.g. 0.05 for 5 %), returns the number of the flagged metrics */
+	static int Compare( const FrameLog & baseline, const FrameLog & current, const double threshold );
+
+	/* nearest-rank percentile p from <0, 1> of the values, 0 if there are none */
+	static double Percentile( std::vector<double> values, const double p );
+
+private:
+	std::vector<Record> records_;
+	std::vector<std::pair<std::string, std::string>> info_;
+	std::vector<GpuProfiler::Scope> passes_;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "glutils.h"
+#include "mymath.h"
 
 void SetMatrix4x4( const GLuint program, const GLfloat * data, const char * matrix_name )
 {	
@@ -25,9 +26,47 @@ void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width,
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	// copy data from the host buffer
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, 0); // unbind the newly created texture from the target
 	handle = glGetTextureHandleARB(texture); // produces a handle representing the texture in a shader function
 	glMakeTextureHandleResidentARB(handle);
 }
+
+void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width, const int height, const GLvoid * const * mips, const int no_mips)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// immutable storage for the whole chain, each level is copied from the host buffer
+	glTexStorage2D(GL_TEXTURE_2D, no_mips, GL_RGBA8, width, height);
+	for (int level = 0; level < no_mips; ++level)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, max(1, width >> level), max(1, height >> level), GL_RGBA, GL_UNSIGNED_BYTE, mips[level]);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	handle = glGetTextureHandleARB(texture);
+	glMakeTextureHandleResidentARB(handle);
+}
+
+void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width, const int height, const GLenum internal_format, const GLvoid * const * mips, const GLsizei * mip_sizes, const int no_mips)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// immutable compressed storage, the blocks of each level are copied as they are
+	glTexStorage2D(GL_TEXTURE_2D, no_mips, internal_format, width, height);
+	for (int level = 0; level < no_mips; ++level)
+	{
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, max(1, width >> level), max(1, height >> level), internal_format, mip_sizes[level], mips[level]);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	handle = glGetTextureHandleARB(texture);
+	glMakeTextureHandleResidentARB(handle);
+}
@@ -2,5 +2,10 @@
 #define GL_UTILS_H_
 
 void SetMatrix4x4( const GLuint program, const GLfloat * data, const char * matrix_name );
+/* data are tightly packed RGBA8 pixels (see Texture::CopyToRGBA8), the mip levels are generated */
 void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width, const int height, const GLvoid * data);
+/* same as above but all RGBA8 mip levels are uploaded from mips instead of being generated */
+void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width, const int height, const GLvoid * const * mips, const int no_mips);
+/* same as above but the mip levels are block compressed in the given internal format, sizes of the levels are in bytes */
+void CreateBindlessTexture(GLuint & texture, GLuint64 & handle, const int width, const int height, const GLenum internal_format, const GLvoid * const * mips, const GLsizei * mip_sizes, const int no_mips);
 #endif
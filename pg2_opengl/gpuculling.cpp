@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "gpuculling.h"
+#include "utils.h"
+#include "mymath.h"
+#include <cstddef>
+
+/* size of DrawElementsIndirectCommand (bytes) */
+static const GLsizeiptr command_size = 5 * sizeof( GLuint );
+
+/* compiles and links the compute shader of the given file, returns 0 on failure */
+static GLuint CreateComputeProgram( const char * file_name )
+{
+	const char * source = LoadShader( file_name );
+	if ( !source )
+	{
+		return 0;
+	}
+
+	GLuint shader = glCreateShader( GL_COMPUTE_SHADER );
+	glShaderSource( shader, 1, &source, nullptr );
+	glCompileShader( shader );
+	SAFE_DELETE_ARRAY( source );
+	if ( CheckShader( shader ) != GL_TRUE )
+	{
+		glDeleteShader( shader );
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader( program, shader );
+	glLinkProgram( program );
+	glDeleteShader( shader );
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &linked );
+	if ( linked != GL_TRUE )
+	{
+		glDeleteProgram( program );
+		return 0;
+	}
+
+	return program;
+}
+
+GpuCulling::GpuCulling()
+{
+}
+
+GpuCulling::~GpuCulling()
+{
+}
+
+int GpuCulling::Init( const GLuint commands, const int no_commands, const int width, const int height )
+{
+	Release();
+
+	if ( !GLAD_GL_VERSION_4_6 && !GLAD_GL_ARB_indirect_parameters )
+	{
+		return -1; // the draw count cannot be sourced from a buffer
+	}
+
+	culling_program_ = CreateComputeProgram( "culling.comp" );
+	pyramid_program_ = CreateComputeProgram( "depth_pyramid.comp" );
+	if ( ( culling_program_ == 0 ) || ( pyramid_program_ == 0 ) )
+	{
+		Release();
+		return -1;
+	}
+	glProgramUniform1i( culling_program_, 0, GL_FALSE );
+
+	commands_ = commands;
+	no_commands_ = no_commands;
+	glCreateBuffers( 1, &visible_commands_ );
+	glNamedBufferStorage( visible_commands_, max<GLsizeiptr>( 1, no_commands ) * command_size, nullptr, 0 );
+	const Stats stats = {};
+	glCreateBuffers( 1, &stats_buffer_ );
+	glNamedBufferStorage( stats_buffer_, sizeof( Stats ), &stats, 0 );
+
+	width_ = width;
+	height_ = height;
+	no_levels_ = 1;
+	while ( ( ( width >> no_levels_ ) > 0 ) || ( ( height >> no_levels_ ) > 0 ) )
+	{
+		++no_levels_;
+	}
+
+	glCreateTextures( GL_TEXTURE_2D, 1, &depth_texture_ );
+	glTextureStorage2D( depth_texture_, 1, GL_DEPTH_COMPONENT24, width, height );
+	glCreateFramebuffers( 1, &depth_framebuffer_ );
+	glNamedFramebufferTexture( depth_framebuffer_, GL_DEPTH_ATTACHMENT, depth_texture_, 0 );
+	glNamedFramebufferDrawBuffer( depth_framebuffer_, GL_NONE );
+
+	glCreateTextures( GL_TEXTURE_2D, 1, &pyramid_ );
+	glTextureStorage2D( pyramid_, no_levels_, GL_R32F, width, height );
+	glTextureParameteri( pyramid_, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTextureParameteri( pyramid_, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	pyramid_valid_ = false;
+
+	return ( glCheckNamedFramebufferStatus( depth_framebuffer_, GL_DRAW_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE ) ? 0 : -1;
+}
+
+void GpuCulling::Cull()
+{
+	// only the per-frame counters are reset, the totals keep growing
+	glClearNamedBufferSubData( stats_buffer_, GL_R32UI, 0, offsetof( Stats, total_submitted ), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr );
+
+	glUseProgram( culling_program_ );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, commands_ );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 5, visible_commands_ );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 6, stats_buffer_ );
+	glBindTextureUnit( GPU_CULLING_TEXTURE_UNIT, pyramid_ );
+	glDispatchCompute( ( no_commands_ + GPU_CULLING_GROUP_SIZE - 1 ) / GPU_CULLING_GROUP_SIZE, 1, 1 );
+
+	// the commands and the count are sourced by the draw, the counters may be read back
+	glMemoryBarrier( GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT );
+}
+
+void GpuCulling::Draw() const
+{
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, visible_commands_ );
+	glBindBuffer( GL_PARAMETER_BUFFER_ARB, stats_buffer_ );
+	// the draw count is the first member of Stats
+	if ( GLAD_GL_VERSION_4_6 )
+	{
+		glMultiDrawElementsIndirectCount( GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, no_commands_, 0 );
+	}
+	else
+	{
+		glMultiDrawElementsIndirectCountARB( GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, no_commands_, 0 );
+	}
+	// a bound parameter buffer breaks the plain multi-draw on some drivers (Mesa llvmpipe)
+	glBindBuffer( GL_PARAMETER_BUFFER_ARB, 0 );
+}
+
+void GpuCulling::CopyDrawCount( const GLuint buffer, const GLintptr offset ) const
+{
+	glCopyNamedBufferSubData( stats_buffer_, buffer, offsetof( Stats, draw_count ), offset, sizeof( GLuint ) );
+}
+
+void GpuCulling::CopyVisibleCommands( const GLuint buffer, const GLintptr offset ) const
+{
+	glCopyNamedBufferSubData( visible_commands_, buffer, 0, offset, no_commands_ * command_size );
+}
+
+void GpuCulling::BuildDepthPyramid( const GLuint framebuffer )
+{
+	// the blit resolves the multisampled depth buffer into the texture the compute shader can fetch
+	glBlitNamedFramebuffer( framebuffer, depth_framebuffer_, 0, 0, width_, height_, 0, 0, width_, height_, GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+
+	glUseProgram( pyramid_program_ );
+	glBindTextureUnit( GPU_CULLING_TEXTURE_UNIT, depth_texture_ );
+	for ( int level = 0; level < no_levels_; ++level )
+	{
+		const int width = max( 1, width_ >> level );
+		const int height = max( 1, height_ >> level );
+
+		glProgramUniform1i( pyramid_program_, 0, level );
+		glBindImageTexture( 0, pyramid_, max( 0, level - 1 ), GL_FALSE, 0, GL_READ_ONLY, GL_R32F );
+		glBindImageTexture( 1, pyramid_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+		glDispatchCompute( ( width + GPU_CULLING_PYRAMID_GROUP_SIZE - 1 ) / GPU_CULLING_PYRAMID_GROUP_SIZE,
+			( height + GPU_CULLING_PYRAMID_GROUP_SIZE - 1 ) / GPU_CULLING_PYRAMID_GROUP_SIZE, 1 );
+		// the next level reads this one
+		glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+	}
+	glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT );
+
+	if ( !pyramid_valid_ )
+	{
+		glProgramUniform1i( culling_program_, 0, GL_TRUE );
+		pyramid_valid_ = true;
+	}
+}
+
+void GpuCulling::Invalidate()
+{
+	if ( pyramid_valid_ )
+	{
+		glProgramUniform1i( culling_program_, 0, GL_FALSE );
+		pyramid_valid_ = false;
+	}
+}
+
+GpuCulling::Stats GpuCulling::stats() const
+{
+	Stats stats = {};
+	if ( stats_buffer_ != 0 )
+	{
+		glGetNamedBufferSubData( stats_buffer_, 0, sizeof( Stats ), &stats );
+	}
+
+	return stats;
+}
+
+std::vector<GLuint> GpuCulling::visible_objects() const
+{
+	const Stats counters = stats();
+	std::vector<GLuint> commands( static_cast<size_t>( counters.draw_count ) * 5 );
+	if ( !commands.empty() )
+	{
+		glGetNamedBufferSubData( visible_commands_, 0, counters.draw_count * command_size, commands.data() );
+	}
+
+	std::vector<GLuint> objects( counters.draw_count );
+	for ( size_t i = 0; i < objects.size(); ++i )
+	{
+		objects[i] = commands[i * 5 + 4]; // baseInstance
+	}
+
+	return objects;
+}
+
+void GpuCulling::Release()
+{
+	glDeleteProgram( culling_program_ );
+	glDeleteProgram( pyramid_program_ );
+	glDeleteBuffers( 1, &visible_commands_ );
+	glDeleteBuffers( 1, &stats_buffer_ );
+	glDeleteFramebuffers( 1, &depth_framebuffer_ );
+	glDeleteTextures( 1, &depth_texture_ );
+	glDeleteTextures( 1, &pyramid_ );
+	culling_program_ = pyramid_program_ = 0;
+	visible_commands_ = stats_buffer_ = 0;
+	depth_framebuffer_ = depth_texture_ = pyramid_ = 0;
+	commands_ = 0;
+	no_commands_ = 0;
+	pyramid_valid_ = false;
+}
@@ -0,0 +1,105 @@
+#ifndef GPU_CULLING_H_
+#define GPU_CULLING_H_
+
+/*! \def GPU_CULLING_GROUP_SIZE
+\brief Number of draw commands tested by one work group, must match culling.comp.
+*/
+#define GPU_CULLING_GROUP_SIZE 64
+
+/*! \def GPU_CULLING_PYRAMID_GROUP_SIZE
+\brief Width and height of the texel block built by one work group, must match depth_pyramid.comp.
+*/
+#define GPU_CULLING_PYRAMID_GROUP_SIZE 8
+
+/*! \def GPU_CULLING_TEXTURE_UNIT
+\brief Texture unit of the depth pyramid, the last of the 16 units guaranteed to the compute shaders, must match both
+compute shaders.
+*/
+#define GPU_CULLING_TEXTURE_UNIT 15
+
+/*! \class GpuCulling
+\brief Frustum and occlusion culling of the draw commands by compute shaders.
+
+Each frame one invocation per draw command tests the bounding box of its object against the frustum planes of the
+current MVP and against the max depth pyramid built from the depth buffer of the previous frame. The survivors are
+appended to the visible command buffer by an atomic counter which is also the draw count of
+glMultiDrawElementsIndirectCount, so the CPU never reads per-object visibility. The box is projected by the MVP of the
+previous frame for the occlusion test, an object disoccluded by a camera move is thus drawn one frame late.
+
+The shaders read the FrameData uniform block (binding 0) and the Objects buffer (binding 3) of the vertex shaders,
+the commands are bound to the storage buffer bindings 4 and 5 and the counters to 6. All methods have to be called with
+the GL context current (GL 4.5 with GL_ARB_indirect_parameters or GL 4.6), \a Release must be called before the context
+is destroyed.
+*/
+class GpuCulling
+{
+public:
+	/* counters of the Stats block of culling.comp */
+	struct Stats
+	{
+		GLuint draw_count; // commands drawn by the last frame
+		GLuint frustum_culled;
+		GLuint occlusion_culled;
+		GLuint pad;
+		GLuint total_submitted; // commands tested over all frames
+		GLuint total_frustum_culled;
+		GLuint total_occlusion_culled;
+		GLuint no_frames;
+	};
+
+	GpuCulling();
+	~GpuCulling();
+
+	/* compiles the compute shaders, creates the visible command buffer for the no_commands commands and the depth
+	pyramid of the width x height framebuffer, returns 0 on success */
+	int Init( const GLuint commands, const int no_commands, const int width, const int height );
+
+	/* compacts the commands of the objects which pass both tests into the visible command buffer */
+	void Cull();
+
+	/* draws the visible commands with the bound program, vertex array and framebuffer */
+	void Draw() const;
+
+	/* copies the count of the commands drawn by the last Cull (a GLuint) to the buffer on the GPU without waiting */
+	void CopyDrawCount( const GLuint buffer, const GLintptr offset ) const;
+
+	/* copies all commands of the visible command buffer (the first draw count of them written by the last Cull) to the
+	buffer on the GPU without waiting */
+	void CopyVisibleCommands( const GLuint buffer, const GLintptr offset ) const;
+
+	/* builds the depth pyramid from the depth buffer of the given framebuffer for the next Cull */
+	void BuildDepthPyramid( const GLuint framebuffer );
+
+	/* drops the depth pyramid, the next Cull tests the frustum only (e.g. after a camera cut) */
+	void Invalidate();
+
+	/* counters of the last Cull, waits for the GPU, meant for statistics and tests */
+	Stats stats() const;
+
+	/* objects of the commands drawn by the last Cull, waits for the GPU, meant for tests only */
+	std::vector<GLuint> visible_objects() const;
+
+	/* deletes the programs, buffers and textures */
+	void Release();
+
+private:
+	GLuint culling_program_{ 0 };
+	GLuint pyramid_program_{ 0 };
+	GLuint commands_{ 0 }; // all commands, not owned
+	GLuint visible_commands_{ 0 };
+	GLuint stats_buffer_{ 0 };
+	int no_commands_{ 0 };
+
+	GLuint depth_texture_{ 0 }; // single sampled copy of the depth buffer
+	GLuint depth_framebuffer_{ 0 };
+	GLuint pyramid_{ 0 }; // GL_R32F, each texel holds the max depth of the texels it covers
+	int width_{ 0 };
+	int height_{ 0 };
+	int no_levels_{ 0 };
+	bool pyramid_valid_{ false };
+
+	GpuCulling( const GpuCulling & ) = delete;
+	GpuCulling & operator=( const GpuCulling & ) = delete;
+};
+
+#endif
@@ -0,0 +1,359 @@
+#include "pch.h"
+#include "gpuprofiler.h"
+#include "framelog.h"
+#include "mymath.h"
+#include <algorithm>
+
+/* timestamps created for each frame by Init, enough for the scopes of drawFrame */
+static const int initial_queries = 32;
+
+GpuProfiler::GpuProfiler()
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
+
+int GpuProfiler::Init()
+{
+	Release();
+
+	sets_.resize( GPU_PROFILER_LATENCY );
+	next_ = 0;
+	current_ = -1;
+	stack_.clear();
+	if ( scopes_.empty() && trace_.empty() )
+	{
+		start_ = Clock::now();
+	}
+
+	for ( FrameSet & set : sets_ )
+	{
+		set.queries.resize( initial_queries );
+		glCreateQueries( GL_TIMESTAMP, initial_queries, set.queries.data() );
+		if ( !glIsQuery( set.queries.front() ) )
+		{
+			return -1;
+		}
+	}
+
+	// no bits mean the timestamps are not supported
+	GLint bits = 0;
+	glGetQueryiv( GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits );
+
+	return ( bits > 0 ) ? 0 : -1;
+}
+
+void GpuProfiler::BeginFrame( const int frame )
+{
+	if ( sets_.empty() )
+	{
+		return;
+	}
+
+	current_ = next_;
+	next_ = ( next_ + 1 ) % static_cast<int>( sets_.size() );
+	FrameSet & set = sets_[current_];
+	Retire( set, false );
+
+	// the GPU reaches the commands of this frame later, their timestamps are related to this pair of the clocks
+	set.frame = frame;
+	set.cpu_reference = Now();
+	glGetInteger64v( GL_TIMESTAMP, &set.gpu_reference );
+}
+
+void GpuProfiler::Begin( const char * name, const bool gpu )
+{
+	if ( current_ < 0 )
+	{
+		return;
+	}
+
+	FrameSet & set = sets_[current_];
+	Event event = {};
+	event.scope = ScopeIndex( name, gpu );
+	event.depth = static_cast<int>( stack_.size() );
+	event.query = -1;
+	event.gpu_begin = -1.0;
+	event.gpu_end = -1.0;
+	if ( gpu )
+	{
+		// the pool grows by the scopes of the first frames only
+		if ( set.queries.size() < static_cast<size_t>( set.no_queries + 2 ) )
+		{
+			const size_t size = set.queries.size();
+			set.queries.resize( size + 2 );
+			glCreateQueries( GL_TIMESTAMP, 2, &set.queries[size] );
+		}
+		event.query = set.no_queries;
+		set.no_queries += 2;
+		glQueryCounter( set.queries[event.query], GL_TIMESTAMP );
+	}
+	stack_.push_back( static_cast<int>( set.events.size() ) );
+	event.cpu_begin = Now();
+	set.events.push_back( event );
+}
+
+void GpuProfiler::End()
+{
+	if ( ( current_ < 0 ) || stack_.empty() )
+	{
+		return;
+	}
+
+	FrameSet & set = sets_[current_];
+	Event & event = set.events[stack_.back()];
+	stack_.pop_back();
+	event.cpu_end = Now();
+	if ( event.query >= 0 )
+	{
+		glQueryCounter( set.queries[event.query + 1], GL_TIMESTAMP );
+	}
+}
+
+void GpuProfiler::EndFrame()
+{
+	// the scopes left open end with the frame
+	while ( ( current_ >= 0 ) && !stack_.empty() )
+	{
+		End();
+	}
+	stack_.clear();
+	current_ = -1;
+}
+
+void GpuProfiler::Flush()
+{
+	// the oldest frames first so the windows and the trace keep their order
+	for ( size_t i = 0; i < sets_.size(); ++i )
+	{
+		Retire( sets_[( next_ + i ) % sets_.size()], true );
+	}
+}
+
+void GpuProfiler::Release()
+{
+	if ( sets_.empty() )
+	{
+		return;
+	}
+
+	EndFrame();
+	Flush();
+	for ( FrameSet & set : sets_ )
+	{
+		if ( !set.queries.empty() )
+		{
+			glDeleteQueries( static_cast<GLsizei>( set.queries.size() ), set.queries.data() );
+		}
+	}
+	sets_.clear();
+}
+
+std::vector<GpuProfiler::Scope> GpuProfiler::scopes() const
+{
+	std::vector<Scope> scopes;
+	for ( const ScopeData & data : scopes_ )
+	{
+		Scope scope;
+		scope.name = data.name;
+		scope.depth = data.depth;
+		scope.gpu_measured = data.gpu;
+		scope.cpu = Statistics( data.cpu_window );
+		scope.gpu = Statistics( data.gpu_window );
+		scopes.push_back( scope );
+	}
+
+	return scopes;
+}
+
+void GpuProfiler::Print() const
+{
+	printf( "\nscope\t\t\tCPU min/mean/p95/p99 (ms)\t\tGPU min/mean/p95/p99 (ms)\t\tsamples\n" );
+	for ( const Scope & scope : scopes() )
+	{
+		const std::string name = std::string( 2 * scope.depth, ' ' ) + scope.name;
+		printf( "%-24s%7.3f %7.3f %7.3f %7.3f\t\t", name.c_str(), scope.cpu.min * 1e3, scope.cpu.mean * 1e3, scope.cpu.p95 * 1e3, scope.cpu.p99 * 1e3 );
+		if ( scope.gpu_measured && ( scope.gpu.no_samples > 0 ) )
+		{
+			printf( "%7.3f %7.3f %7.3f %7.3f\t\t%d\n", scope.gpu.min * 1e3, scope.gpu.mean * 1e3, scope.gpu.p95 * 1e3, scope.gpu.p99 * 1e3, scope.cpu.no_samples );
+		}
+		else
+		{
+			printf( "      -       -       -       -\t\t%d\n", scope.cpu.no_samples );
+		}
+	}
+	if ( no_dropped_ > 0 )
+	{
+		printf( "GPU results of %d frame(s) were not available in time and were dropped.\n", no_dropped_ );
+	}
+}
+
+int GpuProfiler::SaveTrace( const char * file_name ) const
+{
+	FILE * file = fopen( file_name, "wt" );
+	if ( !file )
+	{
+		printf( "Unable to write '%s'.\n", file_name );
+		return -1;
+	}
+
+	// complete events ("X") in microseconds, the CPU and the GPU are shown as two threads of one process
+	fprintf( file, "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n" );
+	fprintf( file, "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": { \"name\": \"CPU\" } },\n" );
+	fprintf( file, "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": { \"name\": \"GPU\" } }" );
+	for ( const TraceFrame & frame : trace_ )
+	{
+		for ( const Event & event : frame.events )
+		{
+			const char * name = scopes_[event.scope].name.c_str();
+			fprintf( file, ",\n{ \"name\": \"%s\", \"cat\": \"cpu\", \"ph\": \"X\", \"ts\": %0.3f, \"dur\": %0.3f, \"pid\": 1, \"tid\": 1, \"args\": { \"frame\": %d } }",
+				name, event.cpu_begin * 1e6, ( event.cpu_end - event.cpu_begin ) * 1e6, frame.frame );
+			if ( event.gpu_begin >= 0.0 )
+			{
+				fprintf( file, ",\n{ \"name\": \"%s\", \"cat\": \"gpu\", \"ph\": \"X\", \"ts\": %0.3f, \"dur\": %0.3f, \"pid\": 1, \"tid\": 2, \"args\": { \"frame\": %d } }",
+					name, event.gpu_begin * 1e6, ( event.gpu_end - event.gpu_begin ) * 1e6, frame.frame );
+			}
+		}
+	}
+	fprintf( file, "\n]\n}\n" );
+
+	return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+int GpuProfiler::no_dropped() const
+{
+	return no_dropped_;
+}
+
+bool GpuProfiler::is_initialized() const
+{
+	return !sets_.empty();
+}
+
+void GpuProfiler::Retire( FrameSet & set, const bool wait )
+{
+	if ( set.frame < 0 )
+	{
+		return;
+	}
+
+	// the timestamps complete in order, the last one is available only if all of them are
+	GLint available = GL_TRUE;
+	if ( ( set.no_queries > 0 ) && !wait )
+	{
+		glGetQueryObjectiv( set.queries[set.no_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available );
+	}
+	if ( available )
+	{
+		for ( Event & event : set.events )
+		{
+			if ( event.query >= 0 )
+			{
+				GLuint64 begin = 0;
+				GLuint64 end = 0;
+				glGetQueryObjectui64v( set.queries[event.query], GL_QUERY_RESULT, &begin );
+				glGetQueryObjectui64v( set.queries[event.query + 1], GL_QUERY_RESULT, &end );
+				event.gpu_begin = set.cpu_reference + ( static_cast<GLint64>( begin ) - set.gpu_reference ) * 1e-9;
+				event.gpu_end = set.cpu_reference + ( static_cast<GLint64>( end ) - set.gpu_reference ) * 1e-9;
+			}
+		}
+	}
+	else
+	{
+		++no_dropped_;
+	}
+
+	// one sample of each scope used by the frame, the repeated scopes are summed
+	std::vector<double> cpu_sums( scopes_.size(), -1.0 );
+	std::vector<double> gpu_sums( scopes_.size(), -1.0 );
+	for ( const Event & event : set.events )
+	{
+		cpu_sums[event.scope] = max( 0.0, cpu_sums[event.scope] ) + ( event.cpu_end - event.cpu_begin );
+		if ( event.gpu_begin >= 0.0 )
+		{
+			gpu_sums[event.scope] = max( 0.0, gpu_sums[event.scope] ) + ( event.gpu_end - event.gpu_begin );
+		}
+	}
+	for ( size_t i = 0; i < scopes_.size(); ++i )
+	{
+		ScopeData & scope = scopes_[i];
+		if ( cpu_sums[i] >= 0.0 )
+		{
+			AddSample( scope.cpu_window, scope.cpu_next, cpu_sums[i] );
+		}
+		if ( gpu_sums[i] >= 0.0 )
+		{
+			AddSample( scope.gpu_window, scope.gpu_next, gpu_sums[i] );
+		}
+	}
+
+	trace_.push_back( TraceFrame{ set.frame, set.events } );
+	if ( trace_.size() > GPU_PROFILER_TRACE_FRAMES )
+	{
+		trace_.pop_front();
+	}
+
+	set.frame = -1;
+	set.no_queries = 0;
+	set.events.clear();
+}
+
+void GpuProfiler::AddSample( std::vector<double> & window, int & next, const double sample )
+{
+	if ( window.size() < GPU_PROFILER_WINDOW )
+	{
+		window.push_back( sample );
+	}
+	else
+	{
+		window[next] = sample;
+		next = ( next + 1 ) % GPU_PROFILER_WINDOW;
+	}
+}
+
+GpuProfiler::Stats GpuProfiler::Statistics( const std::vector<double> & window )
+{
+	Stats stats = {};
+	stats.no_samples = static_cast<int>( window.size() );
+	if ( !window.empty() )
+	{
+		double sum = 0.0;
+		for ( const double sample : window )
+		{
+			sum += sample;
+		}
+		stats.min = *std::min_element( window.begin(), window.end() );
+		stats.mean = sum / window.size();
+		stats.p95 = FrameLog::Percentile( window, 0.95 );
+		stats.p99 = FrameLog::Percentile( window, 0.99 );
+	}
+
+	return stats;
+}
+
+int GpuProfiler::ScopeIndex( const char * name, const bool gpu )
+{
+	// a handful of scopes, the linear search is cheaper than hashing the name
+	for ( size_t i = 0; i < scopes_.size(); ++i )
+	{
+		if ( scopes_[i].name == name )
+		{
+			return static_cast<int>( i );
+		}
+	}
+
+	ScopeData scope;
+	scope.name = name;
+	scope.depth = static_cast<int>( stack_.size() );
+	scope.gpu = gpu;
+	scopes_.push_back( scope );
+
+	return static_cast<int>( scopes_.size() ) - 1;
+}
+
+double GpuProfiler::Now() const
+{
+	return std::chrono::duration<double>( Clock::now() - start_ ).count();
+}
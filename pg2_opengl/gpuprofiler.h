@@ -0,0 +1,169 @@
+#ifndef GPU_PROFILER_H_
+#define GPU_PROFILER_H_
+
+#include <deque>
+#include <chrono>
+
+/*! \def GPU_PROFILER_LATENCY
+\brief Number of frames of the query pool, i.e. frames between the issue of the queries and the read of their results.
+*/
+#define GPU_PROFILER_LATENCY 4
+
+/*! \def GPU_PROFILER_WINDOW
+\brief Number of the latest samples of each scope the rolling statistics are computed of.
+*/
+#define GPU_PROFILER_WINDOW 256
+
+/*! \def GPU_PROFILER_TRACE_FRAMES
+\brief Number of the latest frames kept for the trace.
+*/
+#define GPU_PROFILER_TRACE_FRAMES 120
+
+/*! \class GpuProfiler
+\brief Times the named scopes of each frame on the CPU and the GPU.
+
+A scope between \a Begin and \a End measures the CPU time and, unless it is a CPU scope, the GPU time between the
+commands issued before and after it by a pair of GL_TIMESTAMP queries (glQueryCounter), so the scopes may nest and
+run while any GL_TIME_ELAPSED query is active. The queries of a frame come from the set of the pool of
+GPU_PROFILER_LATENCY frames and are read when the pool wraps around to the set again, by then the GPU is normally
+done with them. The GPU samples of a set whose results are still not available are dropped instead of waiting.
+
+Each scope keeps the last GPU_PROFILER_WINDOW samples for the rolling min, mean, p95 and p99. The GPU timestamps are
+moved to the clock of the CPU by the GL_TIMESTAMP of the beginning of the frame, so both share a single timeline which
+\a SaveTrace writes for chrome://tracing (or Perfetto) for the last GPU_PROFILER_TRACE_FRAMES frames.
+
+All methods but the statistics have to be called with the GL context current (GL 3.3 at least), \a Release must be
+called before the context is destroyed. Before \a Init all methods do nothing, so the scopes may stay in the code.
+*/
+class GpuProfiler
+{
+public:
+	/* rolling statistics of a scope (s) */
+	struct Stats
+	{
+		double min;
+		double mean;
+		double p95;
+		double p99;
+		int no_samples; // in the window
+	};
+
+	/* rolling statistics of a scope on both processors */
+	struct Scope
+	{
+		std::string name;
+		int depth; // of the nesting at its first use
+		bool gpu_measured; // the scope is not a CPU one
+		Stats cpu;
+		Stats gpu;
+	};
+
+	GpuProfiler();
+	~GpuProfiler();
+
+	/* creates the query pool, returns 0 on success */
+	int Init();
+
+	/* reads the results of the frame issued GPU_PROFILER_LATENCY frames ago and starts a new frame */
+	void BeginFrame( const int frame );
+
+	/* starts the scope of the given name, the scopes of the same name are summed within a frame */
+	void Begin( const char * name, const bool gpu = true );
+
+	/* ends the innermost scope */
+	void End();
+
+	/* ends the frame and the scopes left open */
+	void EndFrame();
+
+	/* reads the results of all frames still in the pool, waits for the GPU */
+	void Flush();
+
+	/* flushes the frames and deletes the queries, the statistics and the trace are kept */
+	void Release();
+
+	/* rolling statistics of all scopes in the order of their first use */
+	std::vector<Scope> scopes() const;
+
+	/* prints the table of the rolling statistics */
+	void Print() const;
+
+	/* writes the scopes of the traced frames as the Trace Event Format (JSON), returns 0 on success */
+	int SaveTrace( const char * file_name ) const;
+
+	/* frames whose GPU results were not available in time and were dropped */
+	int no_dropped() const;
+	bool is_initialized() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	/* scope of a frame */
+	struct Event
+	{
+		int scope; // index of scopes_
+		int depth; // of the nesting
+		double cpu_begin; // since the start of the profiler (s)
+		double cpu_end;
+		int query; // index of the query of the beginning in the frame set, the end follows, -1 for CPU scopes
+		double gpu_begin; // on the timeline of the CPU, set once read, negative if dropped
+		double gpu_end;
+	};
+
+	/* queries and events of a frame */
+	struct FrameSet
+	{
+		std::vector<GLuint> queries;
+		int no_queries{ 0 }; // used by the frame
+		std::vector<Event> events;
+		int frame{ -1 }; // -1 if the set holds no frame
+		GLint64 gpu_reference{ 0 }; // GL_TIMESTAMP at the beginning of the frame (ns)
+		double cpu_reference{ 0.0 }; // CPU time of it
+	};
+
+	/* traced events of a frame */
+	struct TraceFrame
+	{
+		int frame;
+		std::vector<Event> events;
+	};
+
+	/* reads the results of the set and adds a sample of each scope of its frame, drops the frame if wait is false and
+	the results are not available */
+	void Retire( FrameSet & set, const bool wait );
+
+	/* adds the sample to the window, it replaces the oldest one once the window is full */
+	static void AddSample( std::vector<double> & window, int & next, const double sample );
+	static Stats Statistics( const std::vector<double> & window );
+
+	/* index of the scope of the name, adds it at its first use */
+	int ScopeIndex( const char * name, const bool gpu );
+
+	/* CPU time since the start of the profiler (s) */
+	double Now() const;
+
+	struct ScopeData
+	{
+		std::string name;
+		int depth{ 0 };
+		bool gpu{ false };
+		std::vector<double> cpu_window; // the last GPU_PROFILER_WINDOW samples
+		std::vector<double> gpu_window;
+		int cpu_next{ 0 }; // slot of the next sample once the window is full
+		int gpu_next{ 0 };
+	};
+
+	std::vector<ScopeData> scopes_;
+	std::vector<FrameSet> sets_;
+	int next_{ 0 }; // set of the next frame
+	int current_{ -1 }; // set of the current frame, -1 outside of the frames
+	std::vector<int> stack_; // events of the open scopes
+	std::deque<TraceFrame> trace_;
+	Clock::time_point start_;
+	int no_dropped_{ 0 };
+
+	GpuProfiler( const GpuProfiler & ) = delete;
+	GpuProfiler & operator=( const GpuProfiler & ) = delete;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "pch.h"
+#include "headlesscontext.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define EGL_APIENTRY __stdcall
+#else
+#include <dlfcn.h>
+#define EGL_APIENTRY
+#endif
+
+// the subset of EGL 1.5 and its extensions used here, the values are those of EGL/egl.h and EGL/eglext.h
+#define EGL_DEFAULT_DISPLAY 0
+#define EGL_NO_DISPLAY 0
+#define EGL_NONE 0x3038
+#define EGL_EXTENSIONS 0x3055
+#define EGL_RED_SIZE 0x3024
+#define EGL_GREEN_SIZE 0x3023
+#define EGL_BLUE_SIZE 0x3022
+#define EGL_ALPHA_SIZE 0x3021
+#define EGL_SAMPLES 0x3031
+#define EGL_SAMPLE_BUFFERS 0x3032
+#define EGL_SURFACE_TYPE 0x3033
+#define EGL_PBUFFER_BIT 0x0001
+#define EGL_RENDERABLE_TYPE 0x3040
+#define EGL_OPENGL_BIT 0x0008
+#define EGL_WIDTH 0x3057
+#define EGL_HEIGHT 0x3056
+#define EGL_OPENGL_API 0x30A2
+#define EGL_CONTEXT_MAJOR_VERSION 0x3098
+#define EGL_CONTEXT_MINOR_VERSION 0x30FB
+#define EGL_CONTEXT_OPENGL_PROFILE_MASK 0x30FD
+#define EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT 0x00000001
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+
+typedef void * ( EGL_APIENTRY * EGLGetProcAddress )( const char * name );
+typedef void * ( EGL_APIENTRY * EGLGetDisplay )( void * native_display );
+typedef void * ( EGL_APIENTRY * EGLGetPlatformDisplayEXT )( unsigned int platform, void * native_display, const int * attributes );
+typedef unsigned int ( EGL_APIENTRY * EGLInitialize )( void * display, int * major, int * minor );
+typedef unsigned int ( EGL_APIENTRY * EGLTerminate )( void * display );
+typedef const char * ( EGL_APIENTRY * EGLQueryString )( void * display, int name );
+typedef unsigned int ( EGL_APIENTRY * EGLBindAPI )( unsigned int api );
+typedef unsigned int ( EGL_APIENTRY * EGLGetConfigAttrib )( void * display, void * config, int attribute, int * value );
+typedef unsigned int ( EGL_APIENTRY * EGLChooseConfig )( void * display, const int * attributes, void ** configs, int size, int * count );
+typedef void * ( EGL_APIENTRY * EGLCreatePbufferSurface )( void * display, void * config, const int * attributes );
+typedef unsigned int ( EGL_APIENTRY * EGLDestroySurface )( void * display, void * surface );
+typedef void * ( EGL_APIENTRY * EGLCreateContext )( void * display, void * config, void * share_context, const int * attributes );
+typedef unsigned int ( EGL_APIENTRY * EGLDestroyContext )( void * display, void * context );
+typedef unsigned int ( EGL_APIENTRY * EGLMakeCurrent )( void * display, void * draw, void * read, void * context );
+
+// resolves the GL functions for glad, set by the first Create
+static EGLGetProcAddress egl_get_proc_address = nullptr;
+
+static void * LoadLibraryEGL()
+{
+#ifdef _WIN32
+	return LoadLibraryA( "libEGL.dll" );
+#else
+	return dlopen( "libEGL.so.1", RTLD_NOW | RTLD_LOCAL );
+#endif
+}
+
+static void * LibraryFunction( void * library, const char * name )
+{
+#ifdef _WIN32
+	return reinterpret_cast<void *>( ::GetProcAddress( static_cast<HMODULE>( library ), name ) );
+#else
+	return dlsym( library, name );
+#endif
+}
+
+/* true if the space separated list contains the name */
+static bool HasExtension( const char * extensions, const char * name )
+{
+	const size_t length = strlen( name );
+
+	for ( const char * p = extensions; p && ( p = strstr( p, name ) ); p += length )
+	{
+		if ( ( ( p == extensions ) || ( p[-1] == ' ' ) ) && ( ( p[length] == ' ' ) || ( p[length] == '\0' ) ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	Release();
+}
+
+int HeadlessContext::Create( const int width, const int height, const int major, const int minor, const int samples )
+{
+	Release();
+
+	library_ = LoadLibraryEGL();
+	if ( !library_ )
+	{
+		printf( "EGL library not found.\n" );
+
+		return -1;
+	}
+
+	egl_get_proc_address = reinterpret_cast<EGLGetProcAddress>( LibraryFunction( library_, "eglGetProcAddress" ) );
+	EGLGetDisplay get_display = reinterpret_cast<EGLGetDisplay>( LibraryFunction( library_, "eglGetDisplay" ) );
+	EGLInitialize initialize = reinterpret_cast<EGLInitialize>( LibraryFunction( library_, "eglInitialize" ) );
+	EGLQueryString query_string = reinterpret_cast<EGLQueryString>( LibraryFunction( library_, "eglQueryString" ) );
+	EGLBindAPI bind_api = reinterpret_cast<EGLBindAPI>( LibraryFunction( library_, "eglBindAPI" ) );
+	EGLChooseConfig choose_config = reinterpret_cast<EGLChooseConfig>( LibraryFunction( library_, "eglChooseConfig" ) );
+	EGLGetConfigAttrib get_config_attrib = reinterpret_cast<EGLGetConfigAttrib>( LibraryFunction( library_, "eglGetConfigAttrib" ) );
+	EGLCreatePbufferSurface create_pbuffer_surface = reinterpret_cast<EGLCreatePbufferSurface>( LibraryFunction( library_, "eglCreatePbufferSurface" ) );
+	EGLCreateContext create_context = reinterpret_cast<EGLCreateContext>( LibraryFunction( library_, "eglCreateContext" ) );
+	EGLMakeCurrent make_current = reinterpret_cast<EGLMakeCurrent>( LibraryFunction( library_, "eglMakeCurrent" ) );
+	if ( !egl_get_proc_address || !get_display || !initialize || !query_string || !bind_api || !choose_config ||
+		!get_config_attrib || !create_pbuffer_surface || !create_context || !make_current )
+	{
+		printf( "EGL library lacks the functions of EGL 1.4.\n" );
+		Release();
+
+		return -1;
+	}
+
+	// the client extensions are queried without any display, EGL 1.4 without them returns null
+	const char * client_extensions = query_string( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+	EGLGetPlatformDisplayEXT get_platform_display = reinterpret_cast<EGLGetPlatformDisplayEXT>( egl_get_proc_address( "eglGetPlatformDisplayEXT" ) );
+	if ( get_platform_display && HasExtension( client_extensions, "EGL_MESA_platform_surfaceless" ) )
+	{
+		display_ = get_platform_display( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+		surfaceless_ = ( display_ != nullptr );
+	}
+	if ( !display_ )
+	{
+		display_ = get_display( EGL_DEFAULT_DISPLAY );
+	}
+	int egl_major = 0;
+	int egl_minor = 0;
+	if ( !display_ || !initialize( display_, &egl_major, &egl_minor ) )
+	{
+		printf( "EGL display not available.\n" );
+		display_ = nullptr;
+		Release();
+
+		return -1;
+	}
+
+	// the most samples up to the requested ones, EGL sorts the deeper colors first but the window of GLFW has 8 bits
+	// per channel like the read back pixels
+	void * config = nullptr;
+	for ( int s = samples; ( s >= 0 ) && !config; s = ( s > 1 ) ? s / 2 : s - 1 )
+	{
+		const int config_attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+			EGL_SAMPLE_BUFFERS, ( s > 0 ) ? 1 : 0, EGL_SAMPLES, s, EGL_NONE };
+		void * configs[64];
+		int no_configs = 0;
+		if ( !choose_config( display_, config_attributes, configs, 64, &no_configs ) )
+		{
+			no_configs = 0;
+		}
+		for ( int i = 0; i < no_configs; ++i )
+		{
+			int red = 0;
+			int alpha = 0;
+			get_config_attrib( display_, configs[i], EGL_RED_SIZE, &red );
+			get_config_attrib( display_, configs[i], EGL_ALPHA_SIZE, &alpha );
+			if ( ( ( red == 8 ) && ( alpha == 8 ) ) || !config )
+			{
+				config = configs[i];
+			}
+			if ( ( red == 8 ) && ( alpha == 8 ) )
+			{
+				break;
+			}
+		}
+	}
+	if ( !config || !bind_api( EGL_OPENGL_API ) )
+	{
+		printf( "EGL %d.%d has no pbuffer config of desktop OpenGL.\n", egl_major, egl_minor );
+		Release();
+
+		return -1;
+	}
+
+	const int surface_attributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	surface_ = create_pbuffer_surface( display_, config, surface_attributes );
+	const int context_attributes[] = { EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	context_ = ( surface_ ) ? create_context( display_, config, nullptr, context_attributes ) : nullptr;
+	if ( !context_ || !make_current( display_, surface_, surface_, context_ ) )
+	{
+		printf( "EGL context of OpenGL %d.%d core profile not available.\n", major, minor );
+		Release();
+
+		return -1;
+	}
+
+	return 0;
+}
+
+void HeadlessContext::Release()
+{
+	if ( display_ )
+	{
+		EGLMakeCurrent make_current = reinterpret_cast<EGLMakeCurrent>( LibraryFunction( library_, "eglMakeCurrent" ) );
+		EGLDestroyContext destroy_context = reinterpret_cast<EGLDestroyContext>( LibraryFunction( library_, "eglDestroyContext" ) );
+		EGLDestroySurface destroy_surface = reinterpret_cast<EGLDestroySurface>( LibraryFunction( library_, "eglDestroySurface" ) );
+		EGLTerminate terminate = reinterpret_cast<EGLTerminate>( LibraryFunction( library_, "eglTerminate" ) );
+
+		make_current( display_, nullptr, nullptr, nullptr );
+		if ( context_ )
+		{
+			destroy_context( display_, context_ );
+		}
+		if ( surface_ )
+		{
+			destroy_surface( display_, surface_ );
+		}
+		terminate( display_ );
+	}
+	display_ = nullptr;
+	surface_ = nullptr;
+	context_ = nullptr;
+	surfaceless_ = false;
+
+	// the library stays loaded once the context was current, the GL functions resolved by glad point into it
+	library_ = nullptr;
+}
+
+void * HeadlessContext::GetProcAddress( const char * name )
+{
+	return ( egl_get_proc_address ) ? egl_get_proc_address( name ) : nullptr;
+}
+
+const char * HeadlessContext::platform() const
+{
+	return ( surfaceless_ ) ? "EGL surfaceless" : "EGL";
+}
+
+bool HeadlessContext::is_created() const
+{
+	return context_ != nullptr;
+}
@@ -0,0 +1,42 @@
+#ifndef HEADLESS_CONTEXT_H_
+#define HEADLESS_CONTEXT_H_
+
+/*! \class HeadlessContext
+\brief OpenGL context without any window for the machines without a display.
+
+The context comes from EGL loaded at run time (libEGL.so.1 or libEGL.dll), so the program neither links nor needs
+it unless it renders headless. The display is the surfaceless platform of Mesa if available (e.g. llvmpipe on a
+machine without any X server) and the default one otherwise. The frames go to a pbuffer of the requested size which
+stands in for the back buffer of the window, so the blit and the read back of the default framebuffer work as usual.
+*/
+class HeadlessContext
+{
+public:
+	HeadlessContext() { }
+	~HeadlessContext();
+
+	/* creates the core profile context of the given version with a pbuffer of width x height px and makes it current,
+	the pbuffer has the most samples per pixel up to the given ones the driver offers, returns 0 on success and -1
+	otherwise */
+	int Create( const int width, const int height, const int major, const int minor, const int samples = 0 );
+	void Release();
+
+	/* address of the GL function for gladLoadGLLoader, a context has to be created */
+	static void * GetProcAddress( const char * name );
+
+	/* name of the EGL platform of the display */
+	const char * platform() const;
+	bool is_created() const;
+
+private:
+	void * library_{ nullptr }; // handle of the EGL library
+	void * display_{ nullptr }; // EGLDisplay
+	void * surface_{ nullptr }; // EGLSurface of the pbuffer
+	void * context_{ nullptr }; // EGLContext
+	bool surfaceless_{ false }; // the display of EGL_MESA_platform_surfaceless
+
+	HeadlessContext( const HeadlessContext & ) = delete;
+	HeadlessContext & operator=( const HeadlessContext & ) = delete;
+};
+
+#endif
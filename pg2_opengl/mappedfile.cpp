@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+int MappedFile::Open( const char * file_name )
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA( file_name, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if ( file == INVALID_HANDLE_VALUE )
+	{
+		return -1;
+	}
+	file_ = file;
+
+	LARGE_INTEGER file_size;
+	if ( !GetFileSizeEx( file, &file_size ) )
+	{
+		Close();
+
+		return -1;
+	}
+	size_ = static_cast<size_t>( file_size.QuadPart );
+
+	if ( size_ > 0 ) // empty files cannot be mapped
+	{
+		mapping_ = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( mapping_ == nullptr )
+		{
+			Close();
+
+			return -1;
+		}
+
+		data_ = static_cast<const char *>( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+		if ( data_ == nullptr )
+		{
+			Close();
+
+			return -1;
+		}
+	}
+#else
+	fd_ = open( file_name, O_RDONLY );
+	if ( fd_ == -1 )
+	{
+		return -1;
+	}
+
+	struct stat file_stat;
+	if ( fstat( fd_, &file_stat ) != 0 )
+	{
+		Close();
+
+		return -1;
+	}
+	size_ = static_cast<size_t>( file_stat.st_size );
+
+	if ( size_ > 0 ) // empty files cannot be mapped
+	{
+		void * view = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+		if ( view == MAP_FAILED )
+		{
+			Close();
+
+			return -1;
+		}
+		madvise( view, size_, MADV_SEQUENTIAL );
+		data_ = static_cast<const char *>( view );
+	}
+#endif
+
+	return 0;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if ( data_ )
+	{
+		UnmapViewOfFile( data_ );
+	}
+	if ( mapping_ )
+	{
+		CloseHandle( mapping_ );
+		mapping_ = nullptr;
+	}
+	if ( file_ )
+	{
+		CloseHandle( file_ );
+		file_ = nullptr;
+	}
+#else
+	if ( data_ )
+	{
+		munmap( const_cast<char *>( data_ ), size_ );
+	}
+	if ( fd_ != -1 )
+	{
+		close( fd_ );
+		fd_ = -1;
+	}
+#endif
+
+	data_ = nullptr;
+	size_ = 0;
+}
+
+const char * MappedFile::data() const
+{
+	return data_;
+}
+
+size_t MappedFile::size() const
+{
+	return size_;
+}
+
+bool MappedFile::is_open() const
+{
+#ifdef _WIN32
+	return file_ != nullptr;
+#else
+	return fd_ != -1;
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+/*! \class MappedFile
+\brief Read-only memory mapping of a whole file.
+
+The content is not null terminated, always use \a size() to find the end of the data.
+*/
+class MappedFile
+{
+public:
+	MappedFile() { }
+	~MappedFile();
+
+	/* maps the whole file, returns 0 on success and -1 otherwise, the callers report the failure */
+	int Open( const char * file_name );
+	void Close();
+
+	const char * data() const;
+	size_t size() const;
+	bool is_open() const;
+
+private:
+#ifdef _WIN32
+	void * file_{ nullptr }; // HANDLE of the opened file
+	void * mapping_{ nullptr }; // HANDLE of the file mapping object
+#else
+	int fd_{ -1 }; // file descriptor
+#endif
+
+	const char * data_{ nullptr }; // first byte of the mapped view
+	size_t size_{ 0 }; // size of the mapped view (bytes)
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile & operator=( const MappedFile & ) = delete;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "material.h"
+#include "textureregistry.h"
+#include <cctype>
 
 const char Material::kDiffuseMapSlot = 0;
 const char Material::kSpecularMapSlot = 1;
@@ -24,8 +26,6 @@ Material::Material()
 
 	ior = -1.0f;
 
-	memset( textures_, 0, sizeof( *textures_ ) * NO_TEXTURES );
-
 	name_ = "default";
 	shader_ = Shader::PHONG;
 }
@@ -49,7 +49,10 @@ Material::Material( std::string & name, const Color3f & ambient, const Color3f &
 
 	if ( textures )
 	{
-		memcpy( textures_, textures, sizeof( textures ) * no_textures );
+		for ( int i = 0; i < no_textures; ++i )
+		{
+			set_texture( i, textures[i] );
+		}
 	}
 }
 
@@ -57,11 +60,7 @@ Material::~Material()
 {
 	for ( int i = 0; i < NO_TEXTURES; ++i )
 	{
-		if ( textures_[i] )
-		{
-			delete[] textures_[i];
-			textures_[i] = nullptr;
-		};
+		ReleaseTexture( i );
 	}
 }
 
@@ -77,12 +76,139 @@ std::string Material::name() const
 
 void Material::set_texture( const int slot, Texture * texture )
 {
+	std::promise<Texture *> ready;
+	ready.set_value( texture );
+	set_texture( slot, ready.get_future().share() );
+}
+
+void Material::set_texture( const int slot, TextureFuture texture )
+{
+	std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+	ReleaseTexture( slot );
 	textures_[slot] = texture;
 }
 
+void Material::set_texture_file( const int slot, const std::string & file_name )
+{
+	std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+	ReleaseTexture( slot );
+	texture_files_[slot] = file_name;
+}
+
+std::string Material::texture_file( const int slot ) const
+{
+	{
+		std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+		if ( !texture_files_[slot].empty() )
+		{
+			return texture_files_[slot];
+		}
+	}
+
+	const Texture * texture = this->texture( slot );
+
+	return ( texture ) ? texture->file_name() : std::string();
+}
+
+bool Material::RequestTexture( const int slot, ThreadPool * pool )
+{
+	std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+	if ( textures_[slot].valid() || texture_files_[slot].empty() )
+	{
+		return false;
+	}
+
+	textures_[slot] = TextureRegistry::instance().Acquire( texture_files_[slot], pool );
+
+	return true;
+}
+
+bool Material::texture_requested( const int slot ) const
+{
+	std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+	return textures_[slot].valid();
+}
+
 Texture * Material::texture( const int slot ) const
 {
-	return textures_[slot];
+	TextureFuture texture;
+
+	{
+		std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+		if ( !textures_[slot].valid() && !texture_files_[slot].empty() )
+		{
+			// odloen textura, o kterou zatm nikdo nepodal
+			textures_[slot] = TextureRegistry::instance().Acquire( texture_files_[slot] );
+		}
+		texture = textures_[slot];
+	}
+
+	return ( texture.valid() ) ? texture.get() : nullptr;
+}
+
+bool Material::texture_ready( const int slot ) const
+{
+	std::lock_guard<std::mutex> lock( textures_mutex_ );
+
+	if ( !textures_[slot].valid() )
+	{
+		return texture_files_[slot].empty();
+	}
+
+	return textures_[slot].wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+}
+
+int Material::SampledTextureSlots( const char * shader_source )
+{
+	int slots = 0;
+
+	// bindless samplers and the ids of the virtual textures or texture array layers
+	for ( const char * type : { "sampler2D", "uvec2" } )
+	{
+		for ( const char * p = strstr( shader_source, type ); p != NULL; p = strstr( p, type ) )
+		{
+			p += strlen( type );
+			while ( isspace( static_cast<unsigned char>( *p ) ) ) ++p;
+
+			const char * name = p;
+			while ( isalnum( static_cast<unsigned char>( *p ) ) || ( *p == '_' ) ) ++p;
+
+			for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+			{
+				const std::string member = std::string( "tex_" ).append( slot_name( slot ) );
+				if ( ( static_cast<size_t>( p - name ) == member.size() ) && ( strncmp( name, member.c_str(), member.size() ) == 0 ) )
+				{
+					slots |= 1 << slot;
+				}
+			}
+		}
+	}
+
+	return slots;
+}
+
+const char * Material::slot_name( const int slot )
+{
+	static const char * const names[NO_TEXTURES] = { "diffuse", "specular", "normal", "opacity", "roughness", "metallicness" };
+
+	return names[slot];
+}
+
+void Material::ReleaseTexture( const int slot )
+{
+	// textury mohou sdlet dal materily, uvoln se a s posledn referenc
+	if ( textures_[slot].valid() )
+	{
+		TextureRegistry::instance().Release( textures_[slot].get() ); // pok na ppadn dekdovn
+	}
+	textures_[slot] = TextureFuture();
+	texture_files_[slot].clear();
 }
 
 Shader Material::shader() const
@@ -104,7 +230,7 @@ Color3f Material::diffuse( const Coord2f * tex_coord ) const
 {
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kDiffuseMapSlot];
+		Texture * texture = this->texture( kDiffuseMapSlot );
 
 		if ( texture )
 		{
@@ -119,7 +245,7 @@ Color3f Material::specular( const Coord2f * tex_coord ) const
 {
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kSpecularMapSlot];
+		Texture * texture = this->texture( kSpecularMapSlot );
 
 		if ( texture )
 		{
@@ -134,7 +260,7 @@ Color3f Material::bump( const Coord2f * tex_coord ) const
 {	
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kNormalMapSlot];
+		Texture * texture = this->texture( kNormalMapSlot );
 
 		if ( texture )
 		{
@@ -150,7 +276,7 @@ float Material::roughness( const Coord2f * tex_coord ) const
 
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kRoughnessMapSlot];
+		Texture * texture = this->texture( kRoughnessMapSlot );
 
 		if ( texture )
 		{
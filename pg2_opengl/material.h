@@ -3,6 +3,8 @@
 
 #include "vector3.h"
 #include "texture.h"
+#include <future>
+#include <mutex>
 
 /*! \def NO_TEXTURES
 \brief Maximln poet textur piazench materilu.
@@ -24,6 +26,13 @@
 */
 #define IOR_GLASS 1.5f
 
+/*! \typedef TextureFuture
+\brief Ukazatel na texturu, kter se me jet dekdovat na pozad, viz \a ThreadPool.
+*/
+typedef std::shared_future<Texture *> TextureFuture;
+
+class ThreadPool;
+
 /* types of shaders */
 enum class Shader : char { NORMAL = 1, LAMBERT = 2, PHONG = 3, GLASS = 4, PBR = 5, MIRROR = 6, TS = 7, CT = 8 };
 
@@ -85,18 +94,80 @@ public:
 
 	//! Nastav texturu.
 	/*!	
+	Materil pebr jednu referenci na texturu, viz \a TextureRegistry::Acquire, pedchoz textura ve slotu je uvolnna.
 	\param slot slo slotu, do kterho bude textura piazena. Maximln \a NO_TEXTURES - 1.
 	\param texture ukazatel na texturu.
 	*/
 	void set_texture( const int slot, Texture * texture );
 
+	//! Nastav texturu, kter se dekduje asynchronn.
+	/*!	
+	\param slot slo slotu, do kterho bude textura piazena. Maximln \a NO_TEXTURES - 1.
+	\param texture budouc ukazatel na texturu, viz \a ThreadPool::Submit.
+	*/
+	void set_texture( const int slot, TextureFuture texture );
+
+	//! Nastav odloenou texturu.
+	/*!	
+	Textura se pouze zaznamen a dekduje se a pi prvnm poadavku, viz \a RequestTexture a \a texture.
+	\param slot slo slotu, do kterho bude textura piazena. Maximln \a NO_TEXTURES - 1.
+	\param file_name pln cesta k souboru textury.
+	*/
+	void set_texture_file( const int slot, const std::string & file_name );
+
+	//! Vrt nzev souboru textury.
+	/*!	
+	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
+	\return pln cesta k souboru textury nebo przdn etzec, pokud ve slotu dn nen.
+	*/
+	std::string texture_file( const int slot ) const;
+
+	//! Zahj dekdovn odloen textury.
+	/*!	
+	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
+	\param pool fond vlken, na kterm se textura dekduje, nullptr znamen dekdovn v tomto vlkn.
+	\return True, pokud dekdovn zahjilo toto voln.
+	*/
+	bool RequestTexture( const int slot, ThreadPool * pool = nullptr );
+
+	//! Zjist, zda byla textura ji vydna.
+	/*!	
+	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
+	\return True, pokud je textura dekdovna nebo se prv dekduje.
+	*/
+	bool texture_requested( const int slot ) const;
+
 	//! Vrt texturu.
 	/*!	
+	Pokud se textura jet dekduje, pok na dokonen dekdovn. Odloen textura se dekduje hned pi prvnm voln.
 	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
 	\return Ukazatel na zvolenou texturu.
 	*/
 	Texture * texture( const int slot ) const;
 
+	//! Zjist, zda je textura pipravena.
+	/*!	
+	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
+	\return True, pokud je textura dekdovna nebo ve slotu dn nen, tj. \a texture nebude ekat.
+	*/
+	bool texture_ready( const int slot ) const;
+
+	//! Zjist, kter sloty textur shader vzorkuje.
+	/*!	
+	Shader deklaruje vzorkovan sloty jako leny sampler2D struktury Material pojmenovan tex_ a nzvem slotu,
+	nap. tex_diffuse, viz \a slot_name. leny uvec2 (virtuln textura nebo pole a vrstva) se potaj tak.
+	\param shader_source zdrojov kd shaderu.
+	\return Maska vzorkovanch slot (1 << slot).
+	*/
+	static int SampledTextureSlots( const char * shader_source );
+
+	//! Vrt nzev slotu textury.
+	/*!	
+	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
+	\return Nzev slotu, nap. diffuse.
+	*/
+	static const char * slot_name( const int slot );
+
 	Shader shader() const;
 
 	void set_shader( Shader shader );
@@ -132,7 +203,11 @@ public:
 	static const char kMetallicnessMapSlot; /*!< slo slotu textury kovovosti. */
 
 private:
-	Texture * textures_[NO_TEXTURES]; /*!< Pole ukazatel na textury. */
+	void ReleaseTexture( const int slot );
+
+	mutable TextureFuture textures_[NO_TEXTURES]; /*!< Pole ukazatel na textury, nkter se mohou jet dekdovat. */
+	std::string texture_files_[NO_TEXTURES]; /*!< Soubory odloench textur. */
+	mutable std::mutex textures_mutex_; /*!< Chrn pole textures_ a texture_files_. */
 	/*
 	slot 0 - diffuse map + alpha
 	slot 1 - specular map + opaque alpha
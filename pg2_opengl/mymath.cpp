@@ -14,3 +14,93 @@ unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned l
 
 	return mix ^ ( mix << 37 );
 }
+
+static inline unsigned long long RotateLeft64( const unsigned long long x, const int r )
+{
+	return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline unsigned long long Load64( const BYTE * data )
+{
+	unsigned long long value;
+	memcpy( &value, data, sizeof( value ) ); // unaligned little endian load
+
+	return value;
+}
+
+static inline unsigned int Load32( const BYTE * data )
+{
+	unsigned int value;
+	memcpy( &value, data, sizeof( value ) );
+
+	return value;
+}
+
+unsigned long long FastHash( const BYTE * data, const size_t length, const unsigned long long seed )
+{
+	// xxHash64, four independent lanes consume 32 bytes per iteration
+	const unsigned long long prime1 = 11400714785074694791ULL;
+	const unsigned long long prime2 = 14029467366897019727ULL;
+	const unsigned long long prime3 = 1609587929392839161ULL;
+	const unsigned long long prime4 = 9650029242287828579ULL;
+	const unsigned long long prime5 = 2870177450012600261ULL;
+
+	const BYTE * p = data;
+	const BYTE * const end = data + length;
+	unsigned long long hash = 0;
+
+	if ( length >= 32 )
+	{
+		unsigned long long lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+
+		for ( ; p + 32 <= end; p += 32 )
+		{
+			for ( int i = 0; i < 4; ++i )
+			{
+				lanes[i] = RotateLeft64( lanes[i] + Load64( p + i * 8 ) * prime2, 31 ) * prime1;
+			}
+		}
+
+		hash = RotateLeft64( lanes[0], 1 ) + RotateLeft64( lanes[1], 7 ) +
+			RotateLeft64( lanes[2], 12 ) + RotateLeft64( lanes[3], 18 );
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			hash ^= RotateLeft64( lanes[i] * prime2, 31 ) * prime1;
+			hash = hash * prime1 + prime4;
+		}
+	}
+	else
+	{
+		hash = seed + prime5;
+	}
+
+	hash += static_cast<unsigned long long>( length );
+
+	for ( ; p + 8 <= end; p += 8 )
+	{
+		hash ^= RotateLeft64( Load64( p ) * prime2, 31 ) * prime1;
+		hash = RotateLeft64( hash, 27 ) * prime1 + prime4;
+	}
+
+	if ( p + 4 <= end )
+	{
+		hash ^= Load32( p ) * prime1;
+		hash = RotateLeft64( hash, 23 ) * prime2 + prime3;
+		p += 4;
+	}
+
+	for ( ; p < end; ++p )
+	{
+		hash ^= ( *p ) * prime5;
+		hash = RotateLeft64( hash, 11 ) * prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
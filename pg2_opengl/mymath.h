@@ -42,6 +42,11 @@ inline float deg2rad( const float x )
 	return x * float( M_PI ) / 180.0f;
 }
 
+inline float rad2deg( const float x )
+{
+	return x * 180.0f / float( M_PI );
+}
+
 template <class T> inline float clamp( const T x, const T a, const T b )
 {
 	return min( max( x, a ), b );
@@ -54,4 +59,7 @@ inline Vector3 reflect( const Vector3 & v, const Vector3 & n )
 
 unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned long long mix = 0 );
 
+/* xxHash64 of the given data, several times faster than QuickHash on large buffers */
+unsigned long long FastHash( const BYTE * data, const size_t length, const unsigned long long seed = 0 );
+
 #endif
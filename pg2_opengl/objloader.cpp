@@ -8,94 +8,169 @@ http://en.wikipedia.org/wiki/Wavefront_.obj_file
 #include "utils.h"
 #include "surface.h"
 #include "mymath.h"
+#include "mappedfile.h"
+#include "fastparse.h"
+#include "objloader.h"
+#include "threadpool.h"
+#include "textureregistry.h"
+#include <thread>
+#include <cstdarg>
+#include <unordered_map>
+
+/*! \def MAX_FACE_CORNERS
+\brief Maximal number of corners of a single polygonal face.
+*/
+#define MAX_FACE_CORNERS 32
 
-bool MaterialExists(std::vector<Material *> & materials, char * material_name)
+/*! \fn void LogMessage( const ObjLoaderContext & context, const char * format, ... )
+\brief Formats the message and passes it to the logger of the context, stdout is used when there is none.
+*/
+void LogMessage(const ObjLoaderContext & context, const char * format, ...)
 {
-	for (Material * material : materials)
-	{
-		if (material->name().compare(material_name) == 0)
-		{
-			return true;
-		}
-	}
+	char message[512];
 
-	return false;
-}
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
 
-Texture * TextureProxy(const std::string & full_name, std::map<std::string, Texture*> & already_loaded_textures,
-	const int flip = -1, const bool single_channel = false)
-{
-	std::map<std::string, Texture*>::iterator already_loaded_texture = already_loaded_textures.find(full_name);
-	Texture * texture = NULL;
-	if (already_loaded_texture != already_loaded_textures.end())
+	if (context.log)
 	{
-		texture = already_loaded_texture->second;
+		context.log(message);
 	}
 	else
 	{
-		texture = new Texture(full_name.c_str());// , flip, single_channel);
-		already_loaded_textures[full_name] = texture;
+		fputs(message, stdout);
 	}
+}
 
-	return texture;
+/*! \def LOG_PROGRESS
+\brief Reports the loading progress unless the context is quiet, arguments are not evaluated otherwise.
+*/
+#define LOG_PROGRESS(context, ...) do { if ((context).verbose) LogMessage((context), __VA_ARGS__); } while (0)
+
+void * Allocate(const ObjLoaderContext & context, const size_t size)
+{
+	return (context.allocate) ? context.allocate(size) : malloc(size);
 }
 
-/*! \fn LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
-\brief Nate materily z MTL souboru \a file_name.
-Soubor \a file_name se mus nachzet v cest \a path. Naten materily budou vrceny pes pole \a materials.
-\param file_name nzev MTL souboru vetn ppony.
-\param path cesta k zadanmu souboru.
-\param materials pole materil, do kterho se budou ukldat naten materily.
+void Deallocate(const ObjLoaderContext & context, void * memory)
+{
+	if (memory != NULL)
+	{
+		if (context.deallocate)
+		{
+			context.deallocate(memory);
+		}
+		else
+		{
+			free(memory);
+		}
+	}
+}
+
+/*! \fn char * ReadTextFile( const char * file_name, const ObjLoaderContext & context, size_t & file_size )
+\brief Reads the whole file into a null terminated buffer allocated by the context.
+\param file_size size of the file in bytes, the buffer has one more byte for the terminating NULL.
+\return Pointer to the buffer to be released by \a Deallocate or NULL on error.
 */
-int LoadMTL(const char * file_name, const char * path, std::vector<Material *> & materials)
+char * ReadTextFile(const char * file_name, const ObjLoaderContext & context, size_t & file_size)
 {
 	// oteven soouboru
 	FILE * file = fopen(file_name, "rt");
 	if (file == NULL)
 	{
-		printf("File %s not found.\n", file_name);
+		LogMessage(context, "File %s not found.\n", file_name);
 
-		return -1;
+		return NULL;
 	}
 
-	// naten celho souboru do pamti	
-	size_t file_size = static_cast<size_t>(GetFileSize64(file_name));
-	char * buffer = new char[file_size + 1]; // +1 protoe budeme za posledn naten byte dvat NULL
-	char * buffer_backup = new char[file_size + 1];
+	// naten celho souboru do pamti
+	file_size = static_cast<size_t>(GetFileSize64(file_name));
+	char * buffer = static_cast<char *>(Allocate(context, file_size + 1)); // +1 protoe budeme za posledn naten byte dvat NULL
+	if (buffer == NULL)
+	{
+		LogMessage(context, "Unable to allocate %zu bytes for %s.\n", file_size + 1, file_name);
+		fclose(file);
 
-	printf("Loading materials from '%s' (%0.1f KB)...\n", file_name, file_size / 1024.0f);
+		return NULL;
+	}
 
 	size_t number_of_items_read = fread(buffer, sizeof(*buffer), file_size, file);
 
 	// otestujeme korektnost naten dat
 	if (!feof(file) && (number_of_items_read != file_size))
 	{
-		printf("Unexpected end of file encountered.\n");
+		LogMessage(context, "Unexpected end of file encountered.\n");
 
 		fclose(file);
-		file = NULL;
+		Deallocate(context, buffer);
 
-		return -1;
+		return NULL;
 	}
 
 	buffer[number_of_items_read] = 0; // zajistme korektn ukonen etzce
 
 	fclose(file); // ukonme prci se souborem
-	file = NULL;
 
-	memcpy(buffer_backup, buffer, file_size + 1); // zloha bufferu
+	return buffer;
+}
 
-	printf("Done.\n\n");
+bool MaterialExists(std::vector<Material *> & materials, char * material_name)
+{
+	for (Material * material : materials)
+	{
+		if (material->name().compare(material_name) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*! \fn void TextureProxy( Material * material, const int slot, const std::string & full_name, const ObjLoaderContext & context )
+\brief Assigns the texture file \a full_name to the material slot.
+Only the slots listed in \a context.texture_slots are decoded right away (on the texture pool if set), the others are lazy
+references decoded when a render path asks for them. Files with the same content share a single texture, see \a TextureRegistry.
+*/
+void TextureProxy(Material * material, const int slot, const std::string & full_name, const ObjLoaderContext & context)
+{
+	material->set_texture_file(slot, full_name);
 
-	printf("Parsing mesh data...\n");
+	if (context.texture_slots & (1 << slot))
+	{
+		material->RequestTexture(slot, context.texture_pool);
+	}
+}
+
+/*! \fn LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
+\brief Nate materily z MTL souboru \a file_name.
+Soubor \a file_name se mus nachzet v cest \a path. Naten materily budou vrceny pes pole \a materials.
+\param file_name nzev MTL souboru vetn ppony.
+\param path cesta k zadanmu souboru.
+\param materials pole materil, do kterho se budou ukldat naten materily.
+*/
+int LoadMTL(const char * file_name, const char * path, std::vector<Material *> & materials, const ObjLoaderContext & context)
+{
+	size_t file_size = 0;
+	char * buffer = ReadTextFile(file_name, context, file_size);
+	if (buffer == NULL)
+	{
+		return -1;
+	}
+
+	LOG_PROGRESS(context, "Loading materials from '%s' (%0.1f KB)...\n", file_name, file_size / 1024.0f);
+	LOG_PROGRESS(context, "Done.\n\n");
+
+	LOG_PROGRESS(context, "Parsing mesh data...\n");
 
 	char material_name[128] = { 0 };
 	char image_file_name[256] = { 0 };
 
 	const char delim[] = "\n";
-	char * line = strtok(buffer, delim);
-
-	std::map<std::string, Texture*> already_loaded_textures;
+	char * tokenizer = NULL; // stav tokenizru, msto strtok aby lo natat z vce vlken najednou
+	char * line = NextToken(buffer, delim, &tokenizer);
 
 	Material * material = NULL;
 
@@ -113,7 +188,7 @@ int LoadMTL(const char * file_name, const char * path, std::vector<Material *> &
 					if (!MaterialExists(materials, material_name))
 					{
 						materials.push_back(material);
-						printf("\r%I64u material(s)\t\t", materials.size());
+						LOG_PROGRESS(context, "\r%zu material(s)\t\t", materials.size());
 					}
 				}
 				material = NULL;
@@ -156,37 +231,37 @@ int LoadMTL(const char * file_name, const char * path, std::vector<Material *> &
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kDiffuseMapSlot, TextureProxy(full_name, already_loaded_textures));
+					TextureProxy(material, Material::kDiffuseMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "map_Ks") == tmp) // specular map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kSpecularMapSlot, TextureProxy(full_name, already_loaded_textures));
+					TextureProxy(material, Material::kSpecularMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "map_bump") == tmp) // normal map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kNormalMapSlot, TextureProxy(full_name, already_loaded_textures));
+					TextureProxy(material, Material::kNormalMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "map_D") == tmp) // opacity map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kOpacityMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					TextureProxy(material, Material::kOpacityMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "map_Pr") == tmp) // roughness map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kRoughnessMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					TextureProxy(material, Material::kRoughnessMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "map_Pm") == tmp) // metallicness map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kMetallicnessMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					TextureProxy(material, Material::kMetallicnessMapSlot, full_name, context);
 				}
 				else if (strstr(tmp, "shader") == tmp) // used shader
 				{
@@ -209,38 +284,305 @@ int LoadMTL(const char * file_name, const char * path, std::vector<Material *> &
 			}
 		}
 
-		line = strtok(NULL, delim); // naten dalho dku
+		line = NextToken(NULL, delim, &tokenizer); // naten dalho dku
 	}
 
 	if (material != NULL)
 	{
 		material->set_name(material_name);
 		materials.push_back(material);
-		printf("\r%I64u material(s)\t\t", materials.size());
+		LOG_PROGRESS(context, "\r%zu material(s)\t\t", materials.size());
 	}
 	material = NULL;
 
-	//memcpy( buffer, buffer_backup, file_size + 1 ); // obnoven bufferu po innosti strtok
-	SAFE_DELETE_ARRAY(buffer_backup);
-	SAFE_DELETE_ARRAY(buffer);
+	Deallocate(context, buffer);
 
-	printf("\n");
+	LOG_PROGRESS(context, "\n");
 
 	return 0;
 }
 
-int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
-	const bool flip_yz, const Vector3 default_color)
+/*! \fn int ResolveIndex( const int index, const int count )
+\brief Converts one-based (or negative relative) OBJ index to zero-based index.
+\param index index as stored in the OBJ file, zero means the item is missing.
+\param count number of items read so far.
+\return Zero-based index or -1 if the item is missing.
+*/
+inline int ResolveIndex(const int index, const int count)
 {
-	// oteven soouboru
-	FILE * file = fopen(file_name, "rt");
-	if (file == NULL)
+	return (index < 0) ? count + index : index - 1;
+}
+
+/*! \struct ObjCorner
+\brief Zero-based (v, vt, vn) indices of a single triangle corner.
+*/
+struct ObjCorner
+{
+	int v, vt, vn;
+
+	bool operator==(const ObjCorner & corner) const
 	{
-		printf("File %s not found.\n", file_name);
+		return (v == corner.v) && (vt == corner.vt) && (vn == corner.vn);
+	}
+};
 
-		return -1;
+/*! \struct ObjCornerHash
+\brief Hash of the (v, vt, vn) triple used to find already emitted vertices of a surface.
+*/
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner & corner) const
+	{
+		unsigned long long hash = static_cast<unsigned int>(corner.v) * 0x9E3779B97F4A7C15ULL;
+		hash ^= static_cast<unsigned int>(corner.vt) * 0xC2B2AE3D27D4EB4FULL + (hash >> 29);
+		hash ^= static_cast<unsigned int>(corner.vn) * 0x165667B19E3779F9ULL + (hash >> 32);
+
+		return static_cast<size_t>(hash);
+	}
+};
+
+/*! \fn void ParseAttribute( const char * line, const char * end, const bool flip_yz, std::vector<Vector3> & vertices, std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords )
+\brief Parses a single "v", "vn" or "vt" record <\a line, \a end) and appends it to the corresponding array.
+*/
+void ParseAttribute(const char * line, const char * end, const bool flip_yz, std::vector<Vector3> & vertices,
+	std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords)
+{
+	const char * p = line + 2; // skip "v ", "vn" or "vt" tag
+
+	switch (line[1])
+	{
+	case ' ': // vertex
+	{
+		Vector3 vertex;
+		p = ParseFloat(p, end, vertex.x);
+		if (flip_yz)
+		{
+			p = ParseFloat(p, end, vertex.z);
+			p = ParseFloat(p, end, vertex.y);
+			vertex.y *= -1;
+		}
+		else
+		{
+			p = ParseFloat(p, end, vertex.y);
+			p = ParseFloat(p, end, vertex.z);
+		}
+
+		vertices.push_back(vertex);
+	}
+	break;
+
+	case 'n': // normla vertexu
+	{
+		Vector3 normal;
+		p = ParseFloat(p, end, normal.x);
+		if (flip_yz)
+		{
+			p = ParseFloat(p, end, normal.z);
+			p = ParseFloat(p, end, normal.y);
+			normal.y *= -1;
+		}
+		else
+		{
+			p = ParseFloat(p, end, normal.y);
+			p = ParseFloat(p, end, normal.z);
+		}
+		normal.Normalize();
+		per_vertex_normals.push_back(normal);
 	}
+	break;
 
+	case 't': // texturovac souadnice
+	{
+		Coord2f texture_coord;
+		p = ParseFloat(p, end, texture_coord.u);
+		p = ParseFloat(p, end, texture_coord.v);
+		texture_coords.push_back(texture_coord);
+	}
+	break;
+	}
+}
+
+/*! \fn int ParseFace( const char * line, const char * end, int corners[MAX_FACE_CORNERS][3] )
+\brief Parses a face record <\a line, \a end) into one-based (v, vt, vn) index triples.
+Both "v/vt/vn" and "v//vn" items are supported, missing vt index is set to zero.
+\param corners output index triples.
+\return Number of face corners, zero for unsupported faces.
+*/
+int ParseFace(const char * line, const char * end, int corners[MAX_FACE_CORNERS][3])
+{
+	int no_corners = 0;
+	const char * p = SkipBlanks(line + 1, end); // skip the 'f' tag
+
+	while ((p < end) && (IsDigit(*p) || (*p == '-')))
+	{
+		if (no_corners == MAX_FACE_CORNERS)
+		{
+			return 0;
+		}
+
+		int * corner = corners[no_corners++];
+		p = SkipBlanks(ParseFaceItem(p, end, corner), end);
+
+		// ! all face items must contain the normal index !
+		if (corner[2] == 0)
+		{
+			return 0;
+		}
+	}
+
+	return (no_corners >= 3) ? no_corners : 0;
+}
+
+/*! \fn Vertex MakeVertex( const int vertex_index, const int texture_coord_index, const int per_vertex_normal_index, const std::vector<Vector3> & vertices, const std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords, const Vector3 & default_color )
+\brief Creates vertex of a single face corner from zero-based attribute indices.
+Texture coordinates are not set when \a texture_coord_index is negative.
+*/
+inline Vertex MakeVertex(const int vertex_index, const int texture_coord_index, const int per_vertex_normal_index,
+	const std::vector<Vector3> & vertices, const std::vector<Vector3> & per_vertex_normals,
+	std::vector<Coord2f> & texture_coords, const Vector3 & default_color)
+{
+	if (texture_coord_index >= 0)
+	{
+		return Vertex(vertices[vertex_index], per_vertex_normals[per_vertex_normal_index],
+			default_color, &texture_coords[texture_coord_index]);
+	}
+	else
+	{
+		return Vertex(vertices[vertex_index], per_vertex_normals[per_vertex_normal_index],
+			default_color);
+	}
+}
+
+/*! \fn void AppendFace( const int corners[MAX_FACE_CORNERS][3], const int no_corners, const int counts[3], std::vector<ObjCorner> & face_corners )
+\brief Triangulates the parsed face and appends zero-based indices of its corners to \a face_corners.
+Polygon (0, 1, 2, 3, ...) is split into the fan of triangles (0, 1, 2), (0, 2, 3), ...
+\param counts number of vertices, texture coords and normals read so far (for relative indices).
+*/
+void AppendFace(const int corners[MAX_FACE_CORNERS][3], const int no_corners, const int counts[3],
+	std::vector<ObjCorner> & face_corners)
+{
+	for (int t = 1; t < no_corners - 1; ++t)
+	{
+		const int fan[3] = { 0, t, t + 1 };
+
+		for (int j = 0; j < 3; ++j)
+		{
+			const int * corner = corners[fan[j]];
+
+			face_corners.push_back(ObjCorner{ ResolveIndex(corner[0], counts[0]),
+				ResolveIndex(corner[1], counts[1]), ResolveIndex(corner[2], counts[2]) });
+		}
+	}
+}
+
+/*! \fn Surface * BuildIndexedSurface( const std::string & name, const ObjCorner * corners, const size_t no_corners, const std::vector<Vector3> & vertices, const std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords, const Vector3 & default_color )
+\brief Builds the indexed surface from triangulated face corners.
+Every distinct (v, vt, vn) triple becomes a single vertex of the surface, all corners referring to it share its index.
+*/
+Surface * BuildIndexedSurface(const std::string & name, const ObjCorner * corners, const size_t no_corners,
+	const std::vector<Vector3> & vertices, const std::vector<Vector3> & per_vertex_normals,
+	std::vector<Coord2f> & texture_coords, const Vector3 & default_color)
+{
+	std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> unique_corners;
+	unique_corners.reserve(no_corners / 2);
+
+	std::vector<Vertex> surface_vertices;
+	std::vector<Triangle3ui> triangles(no_corners / 3);
+	unsigned int * indices = &triangles[0].v0; // triangles are just consecutive triples of indices
+
+	for (size_t i = 0; i < no_corners; ++i)
+	{
+		const ObjCorner & corner = corners[i];
+		const unsigned int next_index = static_cast<unsigned int>(surface_vertices.size());
+		const auto inserted = unique_corners.insert(std::make_pair(corner, next_index));
+
+		if (inserted.second)
+		{
+			surface_vertices.push_back(MakeVertex(corner.v, corner.vt, corner.vn,
+				vertices, per_vertex_normals, texture_coords, default_color));
+		}
+		indices[i] = inserted.first->second;
+	}
+
+	return BuildSurface(name, surface_vertices, triangles);
+}
+
+/*! \fn Surface * FlushGroup( const char * group_name, std::vector<ObjCorner> & face_corners, const std::vector<Vector3> & vertices, const std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords, const ObjLoaderContext & context, std::vector<Surface *> & surfaces )
+\brief Builds a new surface from all face corners of the current group.
+\return Pointer to the new surface or NULL if the group is empty.
+*/
+Surface * FlushGroup(const char * group_name, std::vector<ObjCorner> & face_corners, const std::vector<Vector3> & vertices,
+	const std::vector<Vector3> & per_vertex_normals, std::vector<Coord2f> & texture_coords, const ObjLoaderContext & context,
+	std::vector<Surface *> & surfaces)
+{
+	if (face_corners.size() == 0)
+	{
+		return NULL;
+	}
+
+	Surface * surface = BuildIndexedSurface(std::string(group_name), face_corners.data(), face_corners.size(),
+		vertices, per_vertex_normals, texture_coords, context.default_color);
+	surfaces.push_back(surface);
+	LOG_PROGRESS(context, "\r%zu group(s)\t\t", surfaces.size());
+	face_corners.clear();
+
+	return surface;
+}
+
+/*! \fn void AssignMaterial( Surface * surface, const char * material_name, std::vector<Material *> & materials )
+\brief Assigns the first material called \a material_name to the given surface.
+*/
+void AssignMaterial(Surface * surface, const char * material_name, std::vector<Material *> & materials)
+{
+	for (int i = 0; i < static_cast<int>(materials.size()); ++i)
+	{
+		if (materials[i]->name().compare(material_name) == 0)
+		{
+			surface->set_material(materials[i]);
+			break;
+		}
+	}
+}
+
+/*! \fn bool NextLine( const char * & next, const char * end, const char * & line, const char * & line_end )
+\brief Finds the next non-empty line <\a line, \a line_end) in the range <\a next, \a end) without copying it.
+Trailing CR is not part of the returned line.
+\param next first byte of the next line, advanced past the returned line.
+\param end end of the whole range.
+\return False when there are no more lines.
+*/
+bool NextLine(const char * & next, const char * end, const char * & line, const char * & line_end)
+{
+	while (next < end)
+	{
+		line = next;
+		line_end = FindNewline(next, end);
+		next = (line_end < end) ? line_end + 1 : end;
+
+		if ((line_end > line) && (line_end[-1] == '\r'))
+		{
+			--line_end;
+		}
+		if (line_end > line)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*! \fn void ParseRecordName( const char * line, const char * end, char * name, const size_t name_size )
+\brief Copies the second token of the record, e.g. the name following "g", "usemtl" or "mtllib" tag.
+*/
+inline void ParseRecordName(const char * line, const char * end, char * name, const size_t name_size)
+{
+	ParseToken(FindSeparator(line, end), end, name, name_size);
+}
+
+int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context)
+{
 	// cesta k zadanmu souboru
 	char path[128] = { "" };
 	const char * tmp = strrchr(file_name, '/');
@@ -250,42 +592,36 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 	}
 
 	// naten celho souboru do pamti
-	/*const long long*/size_t file_size = static_cast<size_t>(GetFileSize64(file_name));
-	char * buffer = new char[file_size + 1]; // +1 protoe budeme za posledn naten byte dvat NULL
-	char * buffer_backup = new char[file_size + 1];
-
-	printf("Loading model from '%s' (%0.1f MB)...\n", file_name, file_size / sqr(1024.0f));
-
-	size_t number_of_items_read = fread(buffer, sizeof(*buffer), file_size, file);
-
-	// otestujeme korektnost naten dat
-	if (!feof(file) && (number_of_items_read != file_size))
+	size_t file_size = 0;
+	char * buffer = ReadTextFile(file_name, context, file_size);
+	if (buffer == NULL)
 	{
-		printf("Unexpected end of file encountered.\n");
-
-		fclose(file);
-		file = NULL;
-
 		return -1;
 	}
+	char * buffer_backup = static_cast<char *>(Allocate(context, file_size + 1));
+	if (buffer_backup == NULL)
+	{
+		LogMessage(context, "Unable to allocate %zu bytes for %s.\n", file_size + 1, file_name);
+		Deallocate(context, buffer);
 
-	buffer[number_of_items_read] = 0; // zajistme korektn ukonen etzce
+		return -1;
+	}
 
-	fclose(file); // ukonme prci se souborem
-	file = NULL;
+	LOG_PROGRESS(context, "Loading model from '%s' (%0.1f MB)...\n", file_name, file_size / sqr(1024.0f));
 
 	memcpy(buffer_backup, buffer, file_size + 1); // zloha bufferu
 
-	printf("Done.\n\n");
+	LOG_PROGRESS(context, "Done.\n\n");
 
-	printf("Parsing material data...\n");
+	LOG_PROGRESS(context, "Parsing material data...\n");
 
 	char material_library[128] = { 0 };
 
 	std::vector<std::string> material_libraries;
 
 	const char delim[] = "\n";
-	char * line = strtok(buffer, delim);
+	char * tokenizer = NULL; // stav tokenizru, msto strtok aby lo natat z vce vlken najednou
+	char * line = NextToken(buffer, delim, &tokenizer);
 
 	// --- natn vech materilovch knihoven, prvn prchod ---
 	while (line != NULL)
@@ -295,27 +631,27 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 		case 'm': // mtllib
 		{
 			sscanf(line, "%*s %s", &material_library);
-			printf("Material library: %s\n", material_library);
+			LOG_PROGRESS(context, "Material library: %s\n", material_library);
 			material_libraries.push_back(std::string(path).append(std::string(material_library)));
 		}
 		break;
 		}
 
-		line = strtok(NULL, delim); // naten dalho dku
+		line = NextToken(NULL, delim, &tokenizer); // naten dalho dku
 	}
 
-	memcpy(buffer, buffer_backup, file_size + 1); // obnoven bufferu po innosti strtok
+	memcpy(buffer, buffer_backup, file_size + 1); // obnoven bufferu po innosti tokenizru
 
 	for (int i = 0; i < static_cast<int>(material_libraries.size()); ++i)
 	{
-		LoadMTL(material_libraries[i].c_str(), path, materials);
+		LoadMTL(material_libraries[i].c_str(), path, materials, context);
 	}
 
 	std::vector<Vector3> vertices; // cel jeden soubor
 	std::vector<Vector3> per_vertex_normals;
 	std::vector<Coord2f> texture_coords;
 
-	line = strtok(buffer, delim);
+	line = NextToken(buffer, delim, &tokenizer);
 	//line = Trim( line );
 
 	// --- natn vech souadnic, druh prchod ---
@@ -324,79 +660,31 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 		switch (line[0])
 		{
 		case 'v': // seznam vrchol, norml nebo texturovacch souadnic aktuln skupiny			
-		{
-			switch (line[1])
-			{
-			case ' ': // vertex
-			{
-				Vector3 vertex;
-				if (flip_yz)
-				{
-					//float x, y, z;
-					sscanf(line, "%*s %f %f %f", &vertex.x, &vertex.z, &vertex.y);
-					vertex.y *= -1;
-				}
-				else
-				{
-					sscanf(line, "%*s %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-				}
-
-				vertices.push_back(vertex);
-			}
-			break;
-
-			case 'n': // normla vertexu
-			{
-				Vector3 normal;
-				if (flip_yz)
-				{
-					//float x, y, z;
-					sscanf(line, "%*s %f %f %f", &normal.x, &normal.z, &normal.y);
-					normal.y *= -1;
-				}
-				else
-				{
-					sscanf(line, "%*s %f %f %f", &normal.x, &normal.y, &normal.z);
-				}
-				normal.Normalize();
-				per_vertex_normals.push_back(normal);
-			}
-			break;
-
-			case 't': // texturovac souadnice
-			{
-				Coord2f texture_coord;
-				float z = 0;
-				sscanf(line, "%*s %f %f %f",
-					&texture_coord.u, &texture_coord.v, &z);
-				texture_coords.push_back(texture_coord);
-			}
+			ParseAttribute(line, line + strlen(line), context.flip_yz, vertices, per_vertex_normals, texture_coords);
 			break;
-			}
-		}
-		break;
 		}
 
-		line = strtok(NULL, delim); // naten dalho dku
+		line = NextToken(NULL, delim, &tokenizer); // naten dalho dku
 									//line = Trim( line );
 	}
 
-	memcpy(buffer, buffer_backup, file_size + 1); // obnoven bufferu po innosti strtok
+	memcpy(buffer, buffer_backup, file_size + 1); // obnoven bufferu po innosti tokenizru
 
-	printf("%I64u vertices, %I64u normals and %I64u texture coords.\n",
+	LOG_PROGRESS(context, "%zu vertices, %zu normals and %zu texture coords.\n",
 		vertices.size(), per_vertex_normals.size(), texture_coords.size());
 
 	/// buffery pro natn etzc	
-	char group_name[128];
-	char material_name[128];
-	char vertices_indices[4][8 * 3 + 2];	// pomocn etzec pro natn index a 4 x "v/vt/vn"
-	char vertex_indices[3][8];				// pomocn etzec jednotlivch index "v", "vt" a "vn"	
+	char group_name[128] = { 0 };
+	char material_name[128] = { 0 };
+	int corners[MAX_FACE_CORNERS][3]; // (v, vt, vn) indices of the face corners
 
-	std::vector<Vertex> face_vertices; // pole vech vertex prv natan face
+	std::vector<ObjCorner> face_corners; // indexy vrchol vech trojhelnk prv natan skupiny
+	// relativn indexy se vztahuj k souadnicm petenm ped plochou, jejich poty se proto znovu potaj
+	int counts[3] = { 0, 0, 0 }; // (v, vt, vn) records read so far
 
 	int no_surfaces = 0; // poet natench ploch
 
-	line = strtok(buffer, delim); // reset
+	line = NextToken(buffer, delim, &tokenizer); // reset
 								  //line = Trim( line );
 
 								  // --- natn jednotlivch objekt (group), tet prchod ---
@@ -406,22 +694,12 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 		{
 		case 'g': // group
 		{
-			if (face_vertices.size() > 0)
+			Surface * surface = FlushGroup(group_name, face_corners, vertices, per_vertex_normals, texture_coords,
+				context, surfaces);
+			if (surface)
 			{
-				surfaces.push_back(BuildSurface(std::string(group_name), face_vertices));
-				printf("\r%I64u group(s)\t\t", surfaces.size());
 				++no_surfaces;
-				face_vertices.clear();
-
-				for (int i = 0; i < static_cast<int>(materials.size()); ++i)
-				{
-					if (materials[i]->name().compare(material_name) == 0)
-					{
-						Surface * s = *--surfaces.end();
-						s->set_material(materials[i]);
-						break;
-					}
-				}
+				AssignMaterial(surface, material_name, materials);
 			}
 
 			sscanf(line, "%*s %s", &group_name);
@@ -429,6 +707,15 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 		}
 		break;
 
+		case 'v': // the same records as ParseAttribute, already parsed by the second pass
+			switch (line[1])
+			{
+			case ' ': ++counts[0]; break;
+			case 't': ++counts[1]; break;
+			case 'n': ++counts[2]; break;
+			}
+			break;
+
 		case 'u': // usemtl			
 		{
 			sscanf(line, "%*s %s", &material_name);
@@ -438,115 +725,453 @@ int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vect
 
 		case 'f': // face
 		{
-			// ! pedpokldme pouze trojhelnky !
-			// ! pedpokldme vyuit vech t poloek v/vt/vn !				
-			int no_slashes = 0;
-			for (int i = 0; i < int(strlen(line)); ++i)
+			const int no_corners = ParseFace(line, line + strlen(line), corners);
+			AppendFace(corners, no_corners, counts, face_corners);
+			// TODO smoothing groups
+		}
+		break;
+		}
+
+		line = NextToken(NULL, delim, &tokenizer); // naten dalho dku
+									//line = Trim( line );
+	}
+
+	Surface * surface = FlushGroup(group_name, face_corners, vertices, per_vertex_normals, texture_coords,
+		context, surfaces);
+	if (surface)
+	{
+		++no_surfaces;
+		AssignMaterial(surface, material_name, materials);
+	}
+
+	texture_coords.clear();
+	per_vertex_normals.clear();
+	vertices.clear();
+
+	Deallocate(context, buffer_backup);
+	Deallocate(context, buffer);
+
+	LOG_PROGRESS(context, "\nDone.\n\n");
+
+	return no_surfaces;
+}
+
+/*! \fn ObjLoaderContext MakeContext( const bool flip_yz, const Vector3 & default_color, const int no_threads )
+\brief Default context of the loaders taking the options as separate parameters.
+*/
+ObjLoaderContext MakeContext(const bool flip_yz, const Vector3 & default_color, const int no_threads = 0)
+{
+	ObjLoaderContext context;
+	context.flip_yz = flip_yz;
+	context.default_color = default_color;
+	context.no_threads = no_threads;
+
+	return context;
+}
+
+int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const bool flip_yz, const Vector3 default_color)
+{
+	return LoadOBJ(file_name, surfaces, materials, MakeContext(flip_yz, default_color));
+}
+
+int LoadOBJMapped(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context)
+{
+	MappedFile file;
+	if (file.Open(file_name) != 0)
+	{
+		LogMessage(context, "File %s not found.\n", file_name);
+
+		return -1;
+	}
+
+	// path to the given file
+	char path[128] = { "" };
+	const char * tmp = strrchr(file_name, '/');
+	if (tmp != NULL)
+	{
+		memcpy(path, file_name, sizeof(char) * (tmp - file_name + 1));
+	}
+
+	LOG_PROGRESS(context, "Mapping model from '%s' (%0.1f MB)...\n", file_name, file.size() / sqr(1024.0f));
+
+	std::vector<Vector3> vertices;
+	std::vector<Vector3> per_vertex_normals;
+	std::vector<Coord2f> texture_coords;
+
+	std::vector<ObjCorner> face_corners; // triangulated faces of the current group
+	std::vector<std::string> surface_materials; // material names of the new surfaces, resolved at the end
+
+	const char * line = NULL; // the current line, the mapped view itself is never modified
+	const char * line_end = NULL;
+	char material_library[128] = { 0 };
+	char group_name[128] = { 0 };
+	char material_name[128] = { 0 };
+	int corners[MAX_FACE_CORNERS][3]; // (v, vt, vn) indices of the face corners
+
+	const size_t first_surface = surfaces.size();
+
+	const char * next = file.data();
+	const char * const end = next + file.size();
+
+	// --- single pass over all records ---
+	while (NextLine(next, end, line, line_end))
+	{
+		switch (line[0])
+		{
+		case 'm': // mtllib, materials are needed only after the last group is built
+		{
+			ParseRecordName(line, line_end, material_library, sizeof(material_library));
+			LOG_PROGRESS(context, "Material library: %s\n", material_library);
+			LoadMTL(std::string(path).append(material_library).c_str(), path, materials, context);
+		}
+		break;
+
+		case 'v': // vertex, normal or texture coordinate
+			ParseAttribute(line, line_end, context.flip_yz, vertices, per_vertex_normals, texture_coords);
+			break;
+
+		case 'g': // group
+		{
+			if (FlushGroup(group_name, face_corners, vertices, per_vertex_normals, texture_coords, context, surfaces))
 			{
-				if (line[i] == '/')
-				{
-					++no_slashes;
-				}
+				surface_materials.push_back(material_name);
 			}
-			switch (no_slashes)
-			{
-			case 2 * 3: // triangles
-				sscanf(line, "%*s %s %s %s",
-					&vertices_indices[0], &vertices_indices[1], &vertices_indices[2]);
-				break;
 
-			case 2 * 4: // quadrilaterals				
-				sscanf(line, "%*s %s %s %s %s",
-					&vertices_indices[0], &vertices_indices[1], &vertices_indices[2], &vertices_indices[3]);
-				break;
-			}
+			ParseRecordName(line, line_end, group_name, sizeof(group_name));
+		}
+		break;
 
-			// TODO smoothing groups
+		case 'u': // usemtl
+			ParseRecordName(line, line_end, material_name, sizeof(material_name));
+			break;
 
-			for (int i = 0; i < 3; ++i)
-			{
-				if (strstr(vertices_indices[i], "//"))
-				{
-					sscanf(vertices_indices[i], "%[0-9]//%[0-9]",
-						&vertex_indices[0], &vertex_indices[2]);
-					vertex_indices[1][0] = 0;
-				}
-				else
-				{
-					sscanf(vertices_indices[i], "%[0-9]/%[0-9]/%[0-9]",
-						&vertex_indices[0], &vertex_indices[1], &vertex_indices[2]);
-				}
+		case 'f': // face
+		{
+			const int no_corners = ParseFace(line, line_end, corners);
+			const int counts[3] = { static_cast<int>(vertices.size()),
+				static_cast<int>(texture_coords.size()), static_cast<int>(per_vertex_normals.size()) };
+			AppendFace(corners, no_corners, counts, face_corners);
+		}
+		break;
+		}
+	}
 
-				const int vertex_index = atoi(vertex_indices[0]) - 1;
-				const int texture_coord_index = atoi(vertex_indices[1]) - 1;
-				const int per_vertex_normal_index = atoi(vertex_indices[2]) - 1;
+	if (FlushGroup(group_name, face_corners, vertices, per_vertex_normals, texture_coords, context, surfaces))
+	{
+		surface_materials.push_back(material_name);
+	}
 
-				if (texture_coord_index >= 0)
-				{
-					face_vertices.push_back(Vertex(vertices[vertex_index],
-						per_vertex_normals[per_vertex_normal_index],
-						default_color, &texture_coords[texture_coord_index]));
-				}
-				else
-				{
-					face_vertices.push_back(Vertex(vertices[vertex_index],
-						per_vertex_normals[per_vertex_normal_index],
-						default_color));
-				}
+	// all material libraries are loaded now so the material names can be resolved
+	for (size_t i = 0; i < surface_materials.size(); ++i)
+	{
+		AssignMaterial(surfaces[first_surface + i], surface_materials[i].c_str(), materials);
+	}
 
-			}
+	LOG_PROGRESS(context, "\n%zu vertices, %zu normals and %zu texture coords.\n",
+		vertices.size(), per_vertex_normals.size(), texture_coords.size());
+	LOG_PROGRESS(context, "Done.\n\n");
+
+	return static_cast<int>(surface_materials.size());
+}
+
+int LoadOBJMapped(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const bool flip_yz, const Vector3 default_color)
+{
+	return LoadOBJMapped(file_name, surfaces, materials, MakeContext(flip_yz, default_color));
+}
 
-			if (no_slashes == 2 * 4)
+/*! \struct ObjEvent
+\brief Group, usemtl or mtllib record found in a chunk.
+*/
+struct ObjEvent
+{
+	enum Type : char { GROUP, USEMTL, MTLLIB } type;
+	size_t position; // number of triangle corners of the chunk preceding this record
+	std::string name;
+};
+
+/*! \struct ObjChunk
+\brief All records parsed from a single newline aligned part of the OBJ file.
+Positive OBJ indices are stored as global zero-based indices already, negative (relative) ones are
+stored relative to the beginning of the chunk and listed in \a relative_items until the chunk offsets are known.
+*/
+struct ObjChunk
+{
+	const char * begin{ nullptr };
+	const char * end{ nullptr };
+
+	std::vector<Vector3> vertices;
+	std::vector<Vector3> per_vertex_normals;
+	std::vector<Coord2f> texture_coords;
+
+	std::vector<ObjCorner> corners; // triangulated faces
+	std::vector<std::pair<size_t, int>> relative_items; // (corner, 0 = v, 1 = vt, 2 = vn)
+	std::vector<ObjEvent> events;
+};
+
+/*! \fn void ParseChunk( ObjChunk & chunk, const bool flip_yz )
+\brief Parses all v/vn/vt/f/g/usemtl/mtllib records of the given chunk.
+*/
+void ParseChunk(ObjChunk & chunk, const bool flip_yz)
+{
+	const char * line = NULL;
+	const char * line_end = NULL;
+	char name[128];
+	int face[MAX_FACE_CORNERS][3];
+
+	const char * next = chunk.begin;
+	while (NextLine(next, chunk.end, line, line_end))
+	{
+		switch (line[0])
+		{
+		case 'v': // vertex, normal or texture coordinate
+			ParseAttribute(line, line_end, flip_yz, chunk.vertices, chunk.per_vertex_normals, chunk.texture_coords);
+			break;
+
+		case 'f': // face
+		{
+			const int no_corners = ParseFace(line, line_end, face);
+			const int counts[3] = { static_cast<int>(chunk.vertices.size()),
+				static_cast<int>(chunk.texture_coords.size()), static_cast<int>(chunk.per_vertex_normals.size()) };
+
+			for (int t = 1; t < no_corners - 1; ++t)
 			{
-				const int i[] = { 0, 2, 3 };
+				const int fan[3] = { 0, t, t + 1 };
+
 				for (int j = 0; j < 3; ++j)
 				{
-					sscanf(vertices_indices[i[j]], "%[0-9]/%[0-9]/%[0-9]",
-						&vertex_indices[0], &vertex_indices[1], &vertex_indices[2]);
+					const int * item = face[fan[j]];
+					int corner[3];
 
-					const int vertex_index = atoi(vertex_indices[0]) - 1;
-					const int texture_coord_index = atoi(vertex_indices[1]) - 1;
-					const int per_vertex_normal_index = atoi(vertex_indices[2]) - 1;
+					for (int k = 0; k < 3; ++k)
+					{
+						corner[k] = ResolveIndex(item[k], counts[k]);
+						if (item[k] < 0)
+						{
+							chunk.relative_items.push_back(std::make_pair(chunk.corners.size(), k));
+						}
+					}
 
-					face_vertices.push_back(Vertex(vertices[vertex_index],
-						per_vertex_normals[per_vertex_normal_index],
-						default_color, &texture_coords[texture_coord_index]));
+					chunk.corners.push_back(ObjCorner{ corner[0], corner[1], corner[2] });
 				}
 			}
 		}
 		break;
+
+		case 'g': // group
+		case 'u': // usemtl
+		case 'm': // mtllib
+		{
+			ParseRecordName(line, line_end, name, sizeof(name));
+			const ObjEvent::Type type = (line[0] == 'g') ? ObjEvent::GROUP :
+				((line[0] == 'u') ? ObjEvent::USEMTL : ObjEvent::MTLLIB);
+			chunk.events.push_back(ObjEvent{ type, chunk.corners.size(), std::string(name) });
+		}
+		break;
 		}
+	}
+}
 
-		line = strtok(NULL, delim); // naten dalho dku
-									//line = Trim( line );
+int LoadOBJParallel(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context)
+{
+	MappedFile file;
+	if (file.Open(file_name) != 0)
+	{
+		LogMessage(context, "File %s not found.\n", file_name);
+
+		return -1;
 	}
 
-	if (face_vertices.size() > 0)
+	// path to the given file
+	char path[128] = { "" };
+	const char * tmp = strrchr(file_name, '/');
+	if (tmp != NULL)
 	{
-		surfaces.push_back(BuildSurface(std::string(group_name), face_vertices));
-		printf("\r%I64u group(s)\t\t", surfaces.size());
-		++no_surfaces;
-		face_vertices.clear();
+		memcpy(path, file_name, sizeof(char) * (tmp - file_name + 1));
+	}
+
+	const int threads = (context.no_threads > 0) ? context.no_threads :
+		max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	LOG_PROGRESS(context, "Mapping model from '%s' (%0.1f MB), %d thread(s)...\n", file_name, file.size() / sqr(1024.0f), threads);
+
+	// --- split the file into newline aligned chunks, few chunks per thread for better balancing ---
+	const size_t min_chunk_size = 1 << 20;
+	const size_t no_chunks = max<size_t>(1, min<size_t>(threads * 4, file.size() / min_chunk_size));
+	std::vector<ObjChunk> chunks(no_chunks);
+
+	const char * const end = file.data() + file.size();
+	const char * begin = file.data();
+	for (size_t i = 0; i < no_chunks; ++i)
+	{
+		const char * split = (i + 1 == no_chunks) ? end : file.data() + file.size() / no_chunks * (i + 1);
+		if (split < begin)
+		{
+			split = begin;
+		}
+		const char * eol = static_cast<const char *>(memchr(split, '\n', end - split));
+		split = (eol == NULL) ? end : eol + 1;
 
-		for (int i = 0; i < static_cast<int>(materials.size()); ++i)
+		chunks[i].begin = begin;
+		chunks[i].end = split;
+		begin = split;
+	}
+
+	// --- material libraries preceding the geometry are loaded first so their textures decode during the parsing ---
+	size_t no_preloaded_libraries = 0;
+	{
+		const char * line = NULL;
+		const char * line_end = NULL;
+		char material_library[128] = { 0 };
+
+		const char * next = file.data();
+		while (NextLine(next, end, line, line_end) && (line[0] != 'v') && (line[0] != 'f') &&
+			(line[0] != 'g') && (line[0] != 'u'))
 		{
-			if (materials[i]->name().compare(material_name) == 0)
+			if (line[0] == 'm') // mtllib
 			{
-				Surface * s = *--surfaces.end();
-				s->set_material(materials[i]);
+				ParseRecordName(line, line_end, material_library, sizeof(material_library));
+				LOG_PROGRESS(context, "Material library: %s\n", material_library);
+				LoadMTL(std::string(path).append(material_library).c_str(), path, materials, context);
+				++no_preloaded_libraries;
+			}
+		}
+	}
+
+	// --- parse all chunks independently ---
+	ParallelFor(static_cast<int>(no_chunks), threads, [&](const int i)
+	{
+		ParseChunk(chunks[i], context.flip_yz);
+	});
+
+	// --- prefix sums of the per chunk counts ---
+	std::vector<size_t> vertex_offsets(no_chunks + 1, 0);
+	std::vector<size_t> normal_offsets(no_chunks + 1, 0);
+	std::vector<size_t> texture_coord_offsets(no_chunks + 1, 0);
+	std::vector<size_t> corner_offsets(no_chunks + 1, 0);
+
+	for (size_t i = 0; i < no_chunks; ++i)
+	{
+		vertex_offsets[i + 1] = vertex_offsets[i] + chunks[i].vertices.size();
+		normal_offsets[i + 1] = normal_offsets[i] + chunks[i].per_vertex_normals.size();
+		texture_coord_offsets[i + 1] = texture_coord_offsets[i] + chunks[i].texture_coords.size();
+		corner_offsets[i + 1] = corner_offsets[i] + chunks[i].corners.size();
+	}
+
+	std::vector<Vector3> vertices(vertex_offsets[no_chunks]);
+	std::vector<Vector3> per_vertex_normals(normal_offsets[no_chunks]);
+	std::vector<Coord2f> texture_coords(texture_coord_offsets[no_chunks]);
+	std::vector<ObjCorner> corners(corner_offsets[no_chunks]);
+
+	// --- stitch the chunks together ---
+	ParallelFor(static_cast<int>(no_chunks), threads, [&](const int i)
+	{
+		ObjChunk & chunk = chunks[i];
+
+		for (const std::pair<size_t, int> & item : chunk.relative_items)
+		{
+			ObjCorner & corner = chunk.corners[item.first];
+			switch (item.second)
+			{
+			case 0: corner.v += static_cast<int>(vertex_offsets[i]); break;
+			case 1: corner.vt += static_cast<int>(texture_coord_offsets[i]); break;
+			case 2: corner.vn += static_cast<int>(normal_offsets[i]); break;
+			}
+		}
+
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + vertex_offsets[i]);
+		std::copy(chunk.per_vertex_normals.begin(), chunk.per_vertex_normals.end(), per_vertex_normals.begin() + normal_offsets[i]);
+		std::copy(chunk.texture_coords.begin(), chunk.texture_coords.end(), texture_coords.begin() + texture_coord_offsets[i]);
+		std::copy(chunk.corners.begin(), chunk.corners.end(), corners.begin() + corner_offsets[i]);
+
+		std::vector<Vector3>().swap(chunk.vertices);
+		std::vector<Vector3>().swap(chunk.per_vertex_normals);
+		std::vector<Coord2f>().swap(chunk.texture_coords);
+		std::vector<ObjCorner>().swap(chunk.corners);
+	});
+
+	// --- replay group, usemtl and mtllib records in the file order ---
+	struct ObjGroup
+	{
+		std::string name;
+		std::string material_name; // usemtl in effect when the group is closed
+		size_t begin, end; // range of corners
+	};
+	std::vector<ObjGroup> groups;
+
+	std::string group_name;
+	std::string material_name;
+	size_t group_begin = 0;
+
+	for (size_t i = 0; i < no_chunks; ++i)
+	{
+		for (const ObjEvent & event : chunks[i].events)
+		{
+			const size_t position = corner_offsets[i] + event.position;
+
+			switch (event.type)
+			{
+			case ObjEvent::GROUP:
+				if (position > group_begin)
+				{
+					groups.push_back(ObjGroup{ group_name, material_name, group_begin, position });
+				}
+				group_begin = position;
+				group_name = event.name;
+				break;
+
+			case ObjEvent::USEMTL:
+				material_name = event.name;
+				break;
+
+			case ObjEvent::MTLLIB:
+				if (no_preloaded_libraries > 0)
+				{
+					--no_preloaded_libraries; // already loaded before the parsing
+				}
+				else
+				{
+					LOG_PROGRESS(context, "Material library: %s\n", event.name.c_str());
+					LoadMTL(std::string(path).append(event.name).c_str(), path, materials, context);
+				}
 				break;
 			}
 		}
 	}
+	if (corners.size() > group_begin)
+	{
+		groups.push_back(ObjGroup{ group_name, material_name, group_begin, corners.size() });
+	}
 
-	texture_coords.clear();
-	per_vertex_normals.clear();
-	vertices.clear();
+	// --- build all surfaces ---
+	std::vector<Surface *> new_surfaces(groups.size(), nullptr);
 
-	SAFE_DELETE_ARRAY(buffer_backup);
-	SAFE_DELETE_ARRAY(buffer);
+	ParallelFor(static_cast<int>(groups.size()), threads, [&](const int i)
+	{
+		const ObjGroup & group = groups[i];
 
-	printf("\nDone.\n\n");
+		new_surfaces[i] = BuildIndexedSurface(group.name, &corners[group.begin], group.end - group.begin,
+			vertices, per_vertex_normals, texture_coords, context.default_color);
+	});
 
-	return no_surfaces;
+	for (size_t i = 0; i < groups.size(); ++i)
+	{
+		AssignMaterial(new_surfaces[i], groups[i].material_name.c_str(), materials);
+		surfaces.push_back(new_surfaces[i]);
+	}
+
+	LOG_PROGRESS(context, "%zu group(s), %zu vertices, %zu normals and %zu texture coords.\n", groups.size(),
+		vertices.size(), per_vertex_normals.size(), texture_coords.size());
+	LOG_PROGRESS(context, "Done.\n\n");
+
+	return static_cast<int>(groups.size());
+}
+
+int LoadOBJParallel(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const int no_threads, const bool flip_yz, const Vector3 default_color)
+{
+	return LoadOBJParallel(file_name, surfaces, materials, MakeContext(flip_yz, default_color, no_threads));
 }
@@ -4,6 +4,42 @@
 #include "vector3.h"
 #include "surface.h"
 
+class ThreadPool;
+
+/*! \struct ObjLoaderContext
+\brief Explicit state shared by all loaders of a single scene.
+Loaders taking the context keep their tokenizer state on the stack and touch no global state, so any number of scenes
+can be loaded from different threads at once as long as every load writes into its own surface and material vectors.
+*/
+struct ObjLoaderContext
+{
+	/* allocator of the file buffers, malloc and free are used when not set */
+	std::function<void * ( const size_t size )> allocate;
+	std::function<void ( void * memory )> deallocate;
+
+	/* receives all progress and error messages, they are printed to stdout when not set */
+	std::function<void ( const char * message )> log;
+
+	bool flip_yz{ false }; // swap y and z coordinates of vertices and normals
+	Vector3 default_color{ 0.5f, 0.5f, 0.5f }; // default vertex color
+	int no_threads{ 0 }; // worker threads of LoadOBJParallel, 0 means all hardware threads
+	bool verbose{ true }; // report the loading progress, errors are reported always
+
+	/* decodes textures in the background when set, the loaders then return before all textures are decoded and
+	the pool has to outlive them, see Material::texture_ready */
+	ThreadPool * texture_pool{ nullptr };
+
+	/* mask of the material texture slots (1 << slot) decoded during the loading, the other slots keep only the file
+	names and are decoded on the first use, see Material::RequestTexture and Material::SampledTextureSlots */
+	int texture_slots{ ~0 };
+};
+
+/*! \fn int LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials, const ObjLoaderContext & context )
+\brief Loads all materials from the MTL file \a file_name, texture file names are relative to \a path.
+\return 0 on success and -1 otherwise.
+*/
+int LoadMTL(const char * file_name, const char * path, std::vector<Material *> & materials, const ObjLoaderContext & context);
+
 /*! \fn int LoadOBJ( const char * file_name, Vector3 & default_color, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
 \brief Nate geometrii z OBJ souboru \a file_name.
 \param file_name pln cesta k OBJ souboru vetn ppony.
@@ -14,4 +50,33 @@
 int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
 	const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f));
 
+/*! \fn int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials, const ObjLoaderContext & context )
+\brief Reentrant variant of \a LoadOBJ, options, buffers and messages are taken from the given context.
+\return Number of loaded surfaces or -1 on error.
+*/
+int LoadOBJ(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context);
+
+/*! \fn int LoadOBJMapped( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials, const bool flip_yz, const Vector3 default_color )
+\brief Single pass variant of \a LoadOBJ reading directly from the memory mapped file \a file_name.
+Material libraries are loaded as soon as they are referenced, produced surfaces and materials are the same as from \a LoadOBJ.
+\return Number of loaded surfaces or -1 on error.
+*/
+int LoadOBJMapped(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f));
+int LoadOBJMapped(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context);
+
+/*! \fn int LoadOBJParallel( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials, const int no_threads, const bool flip_yz, const Vector3 default_color )
+\brief Multithreaded variant of \a LoadOBJMapped.
+The mapped file is split into newline aligned chunks parsed independently, the results are merged using prefix sums
+of the per chunk counts so the global indices, groups and materials are the same as from the serial loaders.
+\param no_threads number of worker threads, 0 means all hardware threads.
+\return Number of loaded surfaces or -1 on error.
+*/
+int LoadOBJParallel(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const int no_threads = 0, const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f));
+int LoadOBJParallel(const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
+	const ObjLoaderContext & context);
+
 #endif
@@ -0,0 +1,462 @@
+#include "pch.h"
+#include "occlusionculler.h"
+#include "simd.h"
+#include "mymath.h"
+#include <algorithm>
+#include <cfloat>
+#include <tuple>
+
+/* subtile rows rasterized by one task */
+static const int band_height = 4;
+
+/* candidate triangles projected by one task */
+static const int chunk_size = 1024;
+
+/* all 32 pixels of the subtile */
+static const unsigned int full_mask = 0xffffffffu;
+
+/* clip space position of the point, the matrix is row-major */
+static void Transform( const float m[4][4], const Vector3 & v, float clip[4] )
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		clip[i] = m[i][0] * v.x + m[i][1] * v.y + m[i][2] * v.z + m[i][3];
+	}
+}
+
+/* edge functions, depth plane and pixel bounds of the triangle given in the buffer coordinates, false if it is too small
+or covers no pixel */
+static bool SetupTriangle( const float x[3], const float y[3], const float z[3], const int width, const int height,
+	const float min_area, OcclusionCuller::ScreenTriangle & triangle )
+{
+	const float area2 = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( x[2] - x[0] ) * ( y[1] - y[0] );
+	if ( fabsf( area2 ) < 2.0f * min_area )
+	{
+		return false;
+	}
+
+	const float x_min = min( x[0], min( x[1], x[2] ) );
+	const float x_max = max( x[0], max( x[1], x[2] ) );
+	const float y_min = min( y[0], min( y[1], y[2] ) );
+	const float y_max = max( y[0], max( y[1], y[2] ) );
+	if ( ( x_max < 0.0f ) || ( y_max < 0.0f ) || ( x_min >= width ) || ( y_min >= height ) )
+	{
+		return false;
+	}
+	triangle.x0 = static_cast<int>( max( 0.0f, floorf( x_min ) ) );
+	triangle.y0 = static_cast<int>( max( 0.0f, floorf( y_min ) ) );
+	triangle.x1 = static_cast<int>( min( float( width - 1 ), floorf( x_max ) ) );
+	triangle.y1 = static_cast<int>( min( float( height - 1 ), floorf( y_max ) ) );
+
+	// the interior is positive for both windings
+	const float sign = ( area2 > 0.0f ) ? 1.0f : -1.0f;
+	for ( int i = 0; i < 3; ++i )
+	{
+		const int j = ( i + 1 ) % 3;
+		triangle.edges[i][0] = sign * ( y[i] - y[j] );
+		triangle.edges[i][1] = sign * ( x[j] - x[i] );
+		triangle.edges[i][2] = sign * ( x[i] * y[j] - x[j] * y[i] );
+	}
+
+	// the depth after the perspective division is linear in the screen space
+	triangle.plane[0] = ( ( z[1] - z[0] ) * ( y[2] - y[0] ) - ( z[2] - z[0] ) * ( y[1] - y[0] ) ) / area2;
+	triangle.plane[1] = ( ( x[1] - x[0] ) * ( z[2] - z[0] ) - ( x[2] - x[0] ) * ( z[1] - z[0] ) ) / area2;
+	triangle.plane[2] = z[0] - triangle.plane[0] * x[0] - triangle.plane[1] * y[0];
+	triangle.depth_max = max( z[0], max( z[1], z[2] ) );
+
+	return true;
+}
+
+/* clips the triangle by the near plane z + w >= 0 and appends the projected parts */
+static void ProjectTriangle( const float m[4][4], const Vector3 * v, const int width, const int height, const float min_area,
+	std::vector<OcclusionCuller::ScreenTriangle> & triangles )
+{
+	float clip[3][4];
+	for ( int i = 0; i < 3; ++i )
+	{
+		Transform( m, v[i], clip[i] );
+	}
+
+	// Sutherland-Hodgman by a single plane leaves at most 4 vertices
+	float polygon[4][4];
+	int n = 0;
+	for ( int i = 0; i < 3; ++i )
+	{
+		const float * current = clip[i];
+		const float * next = clip[( i + 1 ) % 3];
+		const float d_current = current[2] + current[3];
+		const float d_next = next[2] + next[3];
+		if ( d_current >= 0.0f )
+		{
+			memcpy( polygon[n++], current, sizeof( polygon[0] ) );
+		}
+		if ( ( d_current >= 0.0f ) != ( d_next >= 0.0f ) )
+		{
+			const float t = d_current / ( d_current - d_next );
+			for ( int j = 0; j < 4; ++j )
+			{
+				polygon[n][j] = current[j] + t * ( next[j] - current[j] );
+			}
+			++n;
+		}
+	}
+	if ( n < 3 )
+	{
+		return;
+	}
+
+	float x[4], y[4], z[4];
+	for ( int i = 0; i < n; ++i )
+	{
+		if ( polygon[i][3] <= 1e-6f )
+		{
+			return;
+		}
+		const float w = 1.0f / polygon[i][3];
+		x[i] = ( polygon[i][0] * w * 0.5f + 0.5f ) * width;
+		y[i] = ( polygon[i][1] * w * 0.5f + 0.5f ) * height;
+		z[i] = polygon[i][2] * w * 0.5f + 0.5f;
+	}
+
+	// fan of the polygon
+	for ( int i = 2; i < n; ++i )
+	{
+		const float tx[3] = { x[0], x[i - 1], x[i] };
+		const float ty[3] = { y[0], y[i - 1], y[i] };
+		const float tz[3] = { z[0], z[i - 1], z[i] };
+		OcclusionCuller::ScreenTriangle triangle;
+		if ( SetupTriangle( tx, ty, tz, width, height, min_area, triangle ) )
+		{
+			triangles.push_back( triangle );
+		}
+	}
+}
+
+/* pixels of the subtile at (x, y) whose centers lie inside the triangle, the edge functions are evaluated in the same
+order by both kernels, so their masks are bit-identical */
+static unsigned int Coverage( const OcclusionCuller::ScreenTriangle & triangle, const int x, const int y )
+{
+	unsigned int mask = 0;
+
+	for ( int row = 0; row < OCCLUSION_SUBTILE_HEIGHT; ++row )
+	{
+		const float py = y + row + 0.5f;
+		for ( int column = 0; column < OCCLUSION_SUBTILE_WIDTH; ++column )
+		{
+			const float px = x + column + 0.5f;
+			bool inside = true;
+			for ( int e = 0; e < 3; ++e )
+			{
+				const float * edge = triangle.edges[e];
+				inside = inside && ( edge[0] * px + edge[1] * py + edge[2] >= 0.0f );
+			}
+			mask |= ( inside ) ? 1u << ( row * OCCLUSION_SUBTILE_WIDTH + column ) : 0u;
+		}
+	}
+
+	return mask;
+}
+
+#ifdef SIMD_X64
+/* a row of 8 pixels at once */
+SIMD_TARGET_AVX2 static unsigned int CoverageAvx2( const OcclusionCuller::ScreenTriangle & triangle, const int x, const int y )
+{
+	const __m256 px = _mm256_add_ps( _mm256_set1_ps( float( x ) ),
+		_mm256_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f ) );
+	const __m256 zero = _mm256_setzero_ps();
+	unsigned int mask = 0;
+
+	for ( int row = 0; row < OCCLUSION_SUBTILE_HEIGHT; ++row )
+	{
+		const __m256 py = _mm256_set1_ps( y + row + 0.5f );
+		__m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+		for ( int e = 0; e < 3; ++e )
+		{
+			const float * edge = triangle.edges[e];
+			// no FMA, the fallback rounds every product
+			const __m256 value = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( edge[0] ), px ),
+				_mm256_mul_ps( _mm256_set1_ps( edge[1] ), py ) ), _mm256_set1_ps( edge[2] ) );
+			inside = _mm256_and_ps( inside, _mm256_cmp_ps( value, zero, _CMP_GE_OQ ) );
+		}
+		mask |= static_cast<unsigned int>( _mm256_movemask_ps( inside ) ) << ( row * OCCLUSION_SUBTILE_WIDTH );
+	}
+
+	return mask;
+}
+#endif
+
+void OcclusionCuller::Init( const std::vector<Surface *> & surfaces, const int width, const int height, const int max_occluders )
+{
+	width_ = width;
+	height_ = height;
+	no_subtiles_x_ = ( width + OCCLUSION_SUBTILE_WIDTH - 1 ) / OCCLUSION_SUBTILE_WIDTH;
+	no_subtiles_y_ = ( height + OCCLUSION_SUBTILE_HEIGHT - 1 ) / OCCLUSION_SUBTILE_HEIGHT;
+	subtiles_.assign( static_cast<size_t>( no_subtiles_x_ ) * no_subtiles_y_, Subtile{ FLT_MAX, FLT_MAX, 0 } );
+
+	aabb_min_.resize( surfaces.size() );
+	aabb_max_.resize( surfaces.size() );
+	std::vector<std::tuple<float, int, int>> candidates; // minus the area, surface and triangle
+	for ( size_t s = 0; s < surfaces.size(); ++s )
+	{
+		Surface * surface = surfaces[s];
+		aabb_min_[s] = surface->get_aabb_min();
+		aabb_max_[s] = surface->get_aabb_max();
+
+		const Vertex * vertices = surface->get_vertices();
+		const Triangle3ui * indices = surface->get_indices();
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			const Vector3 & v0 = vertices[indices[i].v0].position;
+			const Vector3 & v1 = vertices[indices[i].v1].position;
+			const Vector3 & v2 = vertices[indices[i].v2].position;
+			candidates.push_back( std::make_tuple( -0.5f * ( v1 - v0 ).CrossProduct( v2 - v0 ).L2Norm(), static_cast<int>( s ), i ) );
+		}
+	}
+
+	// the largest ones first, they fill whole subtiles before the smaller ones merge into the working layers
+	std::sort( candidates.begin(), candidates.end() );
+	candidates.resize( min( candidates.size(), static_cast<size_t>( max( 0, max_occluders ) ) ) );
+
+	occluders_.clear();
+	occluders_.reserve( candidates.size() * 3 );
+	for ( const auto & candidate : candidates )
+	{
+		const Vertex * vertices = surfaces[std::get<1>( candidate )]->get_vertices();
+		const Triangle3ui & triangle = surfaces[std::get<1>( candidate )]->get_indices()[std::get<2>( candidate )];
+		occluders_.push_back( vertices[triangle.v0].position );
+		occluders_.push_back( vertices[triangle.v1].position );
+		occluders_.push_back( vertices[triangle.v2].position );
+	}
+	triangles_.clear();
+	stats_ = Stats();
+
+	if ( !pool_ )
+	{
+		set_threads( 0 );
+	}
+}
+
+void OcclusionCuller::set_threads( const int no_threads )
+{
+	pool_.reset( new WorkStealingPool( no_threads ) );
+}
+
+void OcclusionCuller::set_min_occluder_area( const float area )
+{
+	min_occluder_area_ = area;
+}
+
+void OcclusionCuller::RenderOccluders( const Matrix4x4 & mvp )
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			mvp_[i][j] = mvp.get( i, j );
+		}
+	}
+
+	// the chunks are joined in their order, so the triangles come in the order of the candidates
+	const int no_candidates = static_cast<int>( occluders_.size() / 3 );
+	std::vector<std::vector<ScreenTriangle>> chunks( ( no_candidates + chunk_size - 1 ) / chunk_size );
+	pool_->Run( static_cast<int>( chunks.size() ), [&]( const int chunk, const int )
+	{
+		const int end = min( no_candidates, ( chunk + 1 ) * chunk_size );
+		for ( int i = chunk * chunk_size; i < end; ++i )
+		{
+			ProjectTriangle( mvp_, &occluders_[i * 3], width_, height_, min_occluder_area_, chunks[chunk] );
+		}
+	} );
+	triangles_.clear();
+	for ( const auto & chunk : chunks )
+	{
+		triangles_.insert( triangles_.end(), chunk.begin(), chunk.end() );
+	}
+
+	std::fill( subtiles_.begin(), subtiles_.end(), Subtile{ FLT_MAX, FLT_MAX, 0 } );
+	const bool avx2 = CpuHasAvx2();
+	pool_->Run( ( no_subtiles_y_ + band_height - 1 ) / band_height, [&]( const int band, const int ) { RenderBand( band, avx2 ); } );
+
+	stats_ = Stats();
+	stats_.no_occluders = static_cast<int>( triangles_.size() );
+}
+
+void OcclusionCuller::RenderBand( const int band, const bool avx2 )
+{
+	const int row_begin = band * band_height;
+	const int row_end = min( no_subtiles_y_, row_begin + band_height );
+
+	for ( const ScreenTriangle & triangle : triangles_ )
+	{
+		const int sy0 = max( row_begin, triangle.y0 / OCCLUSION_SUBTILE_HEIGHT );
+		const int sy1 = min( row_end - 1, triangle.y1 / OCCLUSION_SUBTILE_HEIGHT );
+		for ( int sy = sy0; sy <= sy1; ++sy )
+		{
+			for ( int sx = triangle.x0 / OCCLUSION_SUBTILE_WIDTH; sx <= triangle.x1 / OCCLUSION_SUBTILE_WIDTH; ++sx )
+			{
+				const int x = sx * OCCLUSION_SUBTILE_WIDTH;
+				const int y = sy * OCCLUSION_SUBTILE_HEIGHT;
+#ifdef SIMD_X64
+				const unsigned int coverage = ( avx2 ) ? CoverageAvx2( triangle, x, y ) : Coverage( triangle, x, y );
+#else
+				const unsigned int coverage = Coverage( triangle, x, y );
+#endif
+				if ( coverage == 0 )
+				{
+					continue;
+				}
+
+				// the plane at the corners of the subtile, none of its pixel centers lies farther
+				const float * plane = triangle.plane;
+				const float dx = max( plane[0] * x, plane[0] * ( x + OCCLUSION_SUBTILE_WIDTH ) );
+				const float dy = max( plane[1] * y, plane[1] * ( y + OCCLUSION_SUBTILE_HEIGHT ) );
+				const float depth_max = min( triangle.depth_max, dx + dy + plane[2] );
+
+				UpdateSubtile( subtiles_[sy * no_subtiles_x_ + sx], coverage, depth_max );
+			}
+		}
+	}
+}
+
+void OcclusionCuller::UpdateSubtile( Subtile & subtile, const unsigned int coverage, const float depth_max )
+{
+	if ( depth_max >= subtile.depth )
+	{
+		return; // the subtile is already nearer everywhere
+	}
+
+	if ( coverage == full_mask )
+	{
+		subtile.depth = depth_max;
+		subtile.layer_depth = min( subtile.layer_depth, depth_max );
+		return;
+	}
+
+	// the working layer far behind the triangle would only hold it back, it is dropped (the depth stays valid)
+	if ( ( subtile.mask != 0 ) && ( subtile.layer_depth - depth_max > subtile.depth - subtile.layer_depth ) )
+	{
+		subtile.mask = 0;
+	}
+	subtile.layer_depth = ( subtile.mask == 0 ) ? depth_max : max( subtile.layer_depth, depth_max );
+	subtile.mask |= coverage;
+
+	if ( subtile.mask == full_mask )
+	{
+		subtile.depth = min( subtile.depth, subtile.layer_depth );
+		subtile.layer_depth = FLT_MAX;
+		subtile.mask = 0;
+	}
+}
+
+bool OcclusionCuller::Occluded( const Vector3 & aabb_min, const Vector3 & aabb_max ) const
+{
+	float x_min = FLT_MAX, x_max = -FLT_MAX;
+	float y_min = FLT_MAX, y_max = -FLT_MAX;
+	float depth_min = FLT_MAX;
+	for ( int i = 0; i < 8; ++i )
+	{
+		const Vector3 corner( ( i & 1 ) ? aabb_max.x : aabb_min.x, ( i & 2 ) ? aabb_max.y : aabb_min.y, ( i & 4 ) ? aabb_max.z : aabb_min.z );
+		float clip[4];
+		Transform( mvp_, corner, clip );
+		if ( ( clip[2] + clip[3] < 0.0f ) || ( clip[3] <= 1e-6f ) )
+		{
+			return false; // the box crosses the near plane
+		}
+
+		const float w = 1.0f / clip[3];
+		const float x = ( clip[0] * w * 0.5f + 0.5f ) * width_;
+		const float y = ( clip[1] * w * 0.5f + 0.5f ) * height_;
+		x_min = min( x_min, x );
+		x_max = max( x_max, x );
+		y_min = min( y_min, y );
+		y_max = max( y_max, y );
+		depth_min = min( depth_min, clip[2] * w * 0.5f + 0.5f );
+	}
+	if ( ( x_max < 0.0f ) || ( y_max < 0.0f ) || ( x_min >= width_ ) || ( y_min >= height_ ) )
+	{
+		return false; // off the screen, left to the frustum culling
+	}
+
+	// every pixel the rectangle touches, not only those whose centers it covers
+	const int px0 = static_cast<int>( max( 0.0f, floorf( x_min ) ) );
+	const int py0 = static_cast<int>( max( 0.0f, floorf( y_min ) ) );
+	const int px1 = static_cast<int>( min( float( width_ - 1 ), floorf( x_max ) ) );
+	const int py1 = static_cast<int>( min( float( height_ - 1 ), floorf( y_max ) ) );
+	for ( int sy = py0 / OCCLUSION_SUBTILE_HEIGHT; sy <= py1 / OCCLUSION_SUBTILE_HEIGHT; ++sy )
+	{
+		const int row0 = max( 0, py0 - sy * OCCLUSION_SUBTILE_HEIGHT );
+		const int row1 = min( OCCLUSION_SUBTILE_HEIGHT - 1, py1 - sy * OCCLUSION_SUBTILE_HEIGHT );
+		for ( int sx = px0 / OCCLUSION_SUBTILE_WIDTH; sx <= px1 / OCCLUSION_SUBTILE_WIDTH; ++sx )
+		{
+			const int column0 = max( 0, px0 - sx * OCCLUSION_SUBTILE_WIDTH );
+			const int column1 = min( OCCLUSION_SUBTILE_WIDTH - 1, px1 - sx * OCCLUSION_SUBTILE_WIDTH );
+			const unsigned int columns = ( 0xffu >> ( OCCLUSION_SUBTILE_WIDTH - 1 - column1 ) ) & ( 0xffu << column0 );
+			unsigned int rectangle = 0;
+			for ( int row = row0; row <= row1; ++row )
+			{
+				rectangle |= columns << ( row * OCCLUSION_SUBTILE_WIDTH );
+			}
+
+			// the pixels of the working layer are bounded by both depths
+			const Subtile & subtile = subtiles_[sy * no_subtiles_x_ + sx];
+			const float depth = ( ( rectangle & ~subtile.mask ) == 0 ) ? min( subtile.depth, subtile.layer_depth ) : subtile.depth;
+			if ( depth_min <= depth )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void OcclusionCuller::Cull( std::vector<int> & surfaces )
+{
+	const int no_surfaces = static_cast<int>( surfaces.size() );
+	std::vector<char> occluded( no_surfaces );
+	const int test_chunk_size = 256;
+	pool_->Run( ( no_surfaces + test_chunk_size - 1 ) / test_chunk_size, [&]( const int chunk, const int )
+	{
+		const int end = min( no_surfaces, ( chunk + 1 ) * test_chunk_size );
+		for ( int i = chunk * test_chunk_size; i < end; ++i )
+		{
+			occluded[i] = Occluded( aabb_min_[surfaces[i]], aabb_max_[surfaces[i]] ) ? 1 : 0;
+		}
+	} );
+
+	int no_visible = 0;
+	for ( int i = 0; i < no_surfaces; ++i )
+	{
+		if ( !occluded[i] )
+		{
+			surfaces[no_visible++] = surfaces[i];
+		}
+	}
+	surfaces.resize( no_visible );
+
+	stats_.no_tested += no_surfaces;
+	stats_.no_occluded += no_surfaces - no_visible;
+}
+
+float OcclusionCuller::depth( const int x, const int y ) const
+{
+	const Subtile & subtile = subtiles_[( y / OCCLUSION_SUBTILE_HEIGHT ) * no_subtiles_x_ + x / OCCLUSION_SUBTILE_WIDTH];
+	const unsigned int bit = 1u << ( ( y % OCCLUSION_SUBTILE_HEIGHT ) * OCCLUSION_SUBTILE_WIDTH + x % OCCLUSION_SUBTILE_WIDTH );
+
+	return ( subtile.mask & bit ) ? min( subtile.depth, subtile.layer_depth ) : subtile.depth;
+}
+
+OcclusionCuller::Stats OcclusionCuller::stats() const
+{
+	return stats_;
+}
+
+int OcclusionCuller::width() const
+{
+	return width_;
+}
+
+int OcclusionCuller::height() const
+{
+	return height_;
+}
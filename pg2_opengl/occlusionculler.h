@@ -0,0 +1,113 @@
+#ifndef OCCLUSION_CULLER_H_
+#define OCCLUSION_CULLER_H_
+
+#include "surface.h"
+#include "matrix4x4.h"
+#include "workstealingpool.h"
+
+/*! \def OCCLUSION_SUBTILE_WIDTH
+\brief Width of the block of pixels sharing the coverage mask and the depth layers, a row fills one AVX2 register.
+*/
+#define OCCLUSION_SUBTILE_WIDTH 8
+
+/*! \def OCCLUSION_SUBTILE_HEIGHT
+\brief Height of the block of pixels sharing the coverage mask and the depth layers, the 32 pixels fit one mask.
+*/
+#define OCCLUSION_SUBTILE_HEIGHT 4
+
+/*! \class OcclusionCuller
+\brief Software occlusion culling by a low resolution depth buffer in the masked occlusion style.
+
+The largest triangles of the surfaces are collected as the occluder candidates once the scene is loaded, each frame
+those covering at least the minimum screen area are clipped by the near plane and rasterized into the buffer. The
+buffer does not hold the depth of each pixel, every subtile of 8 x 4 px holds the coverage mask of its working layer
+and two conservative depths, the farthest depth of all its pixels and the farthest depth of the pixels of the mask.
+A triangle covering only part of the subtile merges into the working layer, once the mask gets full the layer
+replaces the farthest depth of the subtile. The coverage of the 32 pixel centers is evaluated by the edge functions
+8 pixels at a time with AVX2 (with a bit-identical scalar fallback) and the bands of subtile rows are rasterized by
+the persistent threads of a WorkStealingPool, every subtile sees the triangles in the same order so the buffer does not depend on the number of
+threads.
+
+A box is occluded if its nearest projected depth lies behind the buffer in all subtiles its screen rectangle touches,
+a box crossing the near plane never is. The buffer is conservative in depth, the coverage is sampled at the pixel
+centers of the low resolution like any rasterizer, an object seen only through a gap narrower than a pixel of the
+buffer may thus be culled.
+*/
+class OcclusionCuller
+{
+public:
+	/* counters of the last frame */
+	struct Stats
+	{
+		int no_occluders; // triangles rasterized after the clipping
+		int no_tested; // boxes
+		int no_occluded;
+	};
+
+	/* keeps the bounds of the surfaces, takes at most max_occluders of their largest triangles as the occluder
+	candidates and allocates the buffer of width x height px (rounded up to whole subtiles) */
+	void Init( const std::vector<Surface *> & surfaces, const int width, const int height, const int max_occluders = 16384 );
+
+	/* restarts the pool rasterizing the bands and testing the boxes with no_threads threads, 0 means all hardware
+	threads (the default) */
+	void set_threads( const int no_threads );
+
+	/* projected area (px of the buffer) of the smallest rasterized occluder */
+	void set_min_occluder_area( const float area );
+
+	/* clears the buffer and rasterizes the occluder candidates projected by the MVP */
+	void RenderOccluders( const Matrix4x4 & mvp );
+
+	/* true if the box lies behind the occluders of the last RenderOccluders in every pixel it covers */
+	bool Occluded( const Vector3 & aabb_min, const Vector3 & aabb_max ) const;
+
+	/* removes the occluded surfaces (indices into the surfaces of Init) from the list and keeps the order of the rest */
+	void Cull( std::vector<int> & surfaces );
+
+	/* conservative depth of the pixel, 1 is the far plane and FLT_MAX means no occluder */
+	float depth( const int x, const int y ) const;
+
+	Stats stats() const;
+	int width() const;
+	int height() const;
+
+	/* occluder clipped by the near plane and projected onto the buffer */
+	struct ScreenTriangle
+	{
+		float edges[3][3]; // a x + b y + c >= 0 inside the triangle
+		float plane[3]; // depth = a x + b y + c
+		float depth_max; // of the vertices
+		int x0, y0, x1, y1; // bounding rectangle of the pixels (inclusive)
+	};
+
+	/* the mask and the depths of the 8 x 4 px block */
+	struct Subtile
+	{
+		float depth; // farthest depth of all pixels
+		float layer_depth; // farthest depth of the pixels of the mask
+		unsigned int mask; // pixels of the working layer, bit 8 * row + column
+	};
+
+private:
+	/* rasterizes the triangles overlapping the band of subtile rows */
+	void RenderBand( const int band, const bool avx2 );
+
+	/* merges the coverage of the triangle with the given max depth into the subtile */
+	static void UpdateSubtile( Subtile & subtile, const unsigned int coverage, const float depth_max );
+
+	int width_{ 0 }; // of the projection (px)
+	int height_{ 0 };
+	int no_subtiles_x_{ 0 };
+	int no_subtiles_y_{ 0 };
+	std::vector<Subtile> subtiles_; // row-major
+	std::vector<Vector3> occluders_; // three vertices of each candidate triangle in world space
+	std::vector<ScreenTriangle> triangles_; // projected by the last RenderOccluders
+	std::vector<Vector3> aabb_min_; // of the surfaces
+	std::vector<Vector3> aabb_max_;
+	float mvp_[4][4]{}; // of the last RenderOccluders, row-major
+	float min_occluder_area_{ 1.0f };
+	std::unique_ptr<WorkStealingPool> pool_; // started by Init unless set_threads did it before
+	Stats stats_{};
+};
+
+#endif
@@ -1,9 +1,181 @@
 #include "pch.h"
 #include "tutorials.h"
+#include "benchmarks.h"
 
-int main()
+int main( int argc, char * argv[] )
 {
 	printf( "PG2 OpenGL, (c)2019 Tomas Fabian\n\n" );
 
-	return tutorial_1();
+	// pg2_opengl --bench-obj file.obj [max_threads]
+	if ( ( argc > 2 ) && ( strcmp( argv[1], "--bench-obj" ) == 0 ) )
+	{
+		return BenchmarkOBJLoading( argv[2], ( argc > 3 ) ? atoi( argv[3] ) : 0 );
+	}
+
+	// pg2_opengl --bench-parse file.obj
+	if ( ( argc > 2 ) && ( strcmp( argv[1], "--bench-parse" ) == 0 ) )
+	{
+		return BenchmarkOBJParsing( argv[2] );
+	}
+
+	// pg2_opengl --bench-mesh file.obj
+	if ( ( argc > 2 ) && ( strcmp( argv[1], "--bench-mesh" ) == 0 ) )
+	{
+		return BenchmarkIndexedMesh( argv[2] );
+	}
+
+	// pg2_opengl --stress-obj threads repeats file.obj [file.obj ...]
+	if ( ( argc > 4 ) && ( strcmp( argv[1], "--stress-obj" ) == 0 ) )
+	{
+		return StressTestOBJLoading( std::vector<std::string>( argv + 4, argv + argc ), atoi( argv[2] ), atoi( argv[3] ) );
+	}
+
+	// pg2_opengl --bench-bake threads texture.png [texture.png ...]
+	if ( ( argc > 3 ) && ( strcmp( argv[1], "--bench-bake" ) == 0 ) )
+	{
+		return BenchmarkTextureBaking( std::vector<std::string>( argv + 3, argv + argc ), atoi( argv[2] ) );
+	}
+
+	// pg2_opengl --bench-sample texture.png [samples]
+	if ( ( argc > 2 ) && ( strcmp( argv[1], "--bench-sample" ) == 0 ) )
+	{
+		return BenchmarkTextureSampling( argv[2], ( argc > 3 ) ? atoi( argv[3] ) : 1 << 22 );
+	}
+
+	// pg2_opengl --bench-convert [pixels]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-convert" ) == 0 ) )
+	{
+		return BenchmarkPixelConversion( ( argc > 2 ) ? atoi( argv[2] ) : 1 << 22 );
+	}
+
+	// pg2_opengl --bench-texture-arrays [frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-texture-arrays" ) == 0 ) )
+	{
+		return BenchmarkTextureArrays( ( argc > 2 ) ? atoi( argv[2] ) : 100 );
+	}
+
+	// pg2_opengl --bench-culling [path.txt|-] [frames] [file.obj]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-culling" ) == 0 ) )
+	{
+		return BenchmarkCulling( ( ( argc > 2 ) && ( strcmp( argv[2], "-" ) != 0 ) ) ? argv[2] : nullptr,
+			( argc > 3 ) ? atoi( argv[3] ) : 1000, ( argc > 4 ) ? argv[4] : nullptr );
+	}
+
+	// pg2_opengl --bench-occlusion [path.txt|-] [frames] [threads] [file.obj]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-occlusion" ) == 0 ) )
+	{
+		return BenchmarkOcclusionCulling( ( ( argc > 2 ) && ( strcmp( argv[2], "-" ) != 0 ) ) ? argv[2] : nullptr,
+			( argc > 3 ) ? atoi( argv[3] ) : 200, ( argc > 4 ) ? atoi( argv[4] ) : 0, ( argc > 5 ) ? argv[5] : nullptr );
+	}
+
+	// pg2_opengl --bench-software [file.obj|-] [frames] [width] [height]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-software" ) == 0 ) )
+	{
+		return BenchmarkSoftwareRasterizer( ( ( argc > 2 ) && ( strcmp( argv[2], "-" ) != 0 ) ) ? argv[2] : nullptr,
+			( argc > 3 ) ? atoi( argv[3] ) : 30, ( argc > 4 ) ? atoi( argv[4] ) : 640, ( argc > 5 ) ? atoi( argv[5] ) : 480 );
+	}
+
+	// pg2_opengl --bench-capture [frames] [png|exr] [capture_prefix]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--bench-capture" ) == 0 ) )
+	{
+		return BenchmarkCapture( ( argc > 2 ) ? atoi( argv[2] ) : 100,
+			( ( argc > 3 ) && ( strcmp( argv[3], "exr" ) == 0 ) ) ? CaptureFormat::EXR : CaptureFormat::PNG, ( argc > 4 ) ? argv[4] : "capture_" );
+	}
+
+	// pg2_opengl --benchmark [path.txt|-] [frames] [headless|windowed] [none|cpu|occlusion|gpu] [results_prefix] [file.obj]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--benchmark" ) == 0 ) )
+	{
+		return BenchmarkCameraPath( ( ( argc > 2 ) && ( strcmp( argv[2], "-" ) != 0 ) ) ? argv[2] : nullptr, ( argc > 3 ) ? atoi( argv[3] ) : 300,
+			!( ( argc > 4 ) && ( strcmp( argv[4], "windowed" ) == 0 ) ), ( argc > 5 ) ? argv[5] : "none", ( argc > 6 ) ? argv[6] : "benchmark",
+			( argc > 7 ) ? argv[7] : nullptr );
+	}
+
+	// pg2_opengl --benchmark-compare baseline.csv current.csv [threshold_percent]
+	if ( ( argc > 3 ) && ( strcmp( argv[1], "--benchmark-compare" ) == 0 ) )
+	{
+		return CompareBenchmarkResults( argv[2], argv[3], ( ( argc > 4 ) ? atof( argv[4] ) : 5.0 ) / 100.0 );
+	}
+
+	// pg2_opengl --virtual-texturing [test_frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--virtual-texturing" ) == 0 ) )
+	{
+		return tutorial_vt( ( argc > 2 ) ? atoi( argv[2] ) : 0 );
+	}
+
+	// pg2_opengl --test-gpu-culling [frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--test-gpu-culling" ) == 0 ) )
+	{
+		return tutorial_culling( ( argc > 2 ) ? atoi( argv[2] ) : 30 );
+	}
+
+	// pg2_opengl --test-cpu-culling [frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--test-cpu-culling" ) == 0 ) )
+	{
+		return tutorial_culling( ( argc > 2 ) ? atoi( argv[2] ) : 30, true );
+	}
+
+	// pg2_opengl --test-occlusion-culling [frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--test-occlusion-culling" ) == 0 ) )
+	{
+		return tutorial_culling( ( argc > 2 ) ? atoi( argv[2] ) : 30, true, true );
+	}
+
+	// pg2_opengl --headless [frames] [path.txt|-] [width] [height] [capture_prefix|- [png|exr|png+depth|exr+depth [file.obj]]]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--headless" ) == 0 ) )
+	{
+		const char * format = ( argc > 7 ) ? argv[7] : "png";
+		return tutorial_headless( ( argc > 2 ) ? atoi( argv[2] ) : 100, ( ( argc > 3 ) && ( strcmp( argv[3], "-" ) != 0 ) ) ? argv[3] : nullptr,
+			( argc > 4 ) ? atoi( argv[4] ) : 640, ( argc > 5 ) ? atoi( argv[5] ) : 480,
+			( ( argc > 6 ) && ( strcmp( argv[6], "-" ) != 0 ) ) ? argv[6] : nullptr,
+			( strncmp( format, "exr", 3 ) == 0 ) ? CaptureFormat::EXR : CaptureFormat::PNG, strstr( format, "+depth" ) != nullptr,
+			( argc > 8 ) ? argv[8] : nullptr );
+	}
+
+	// pg2_opengl --test-software [frames]
+	if ( ( argc > 1 ) && ( strcmp( argv[1], "--test-software" ) == 0 ) )
+	{
+		return tutorial_software( ( argc > 2 ) ? atoi( argv[2] ) : 30 );
+	}
+
+	// pg2_opengl [--texture-arrays] [--no-gpu-culling] [--cpu-culling] [--occlusion-culling] [--profile] [--texture-budget MB]
+	// the options of tutorial_1 may be combined in any order
+	TutorialOptions options;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( strcmp( argv[i], "--texture-arrays" ) == 0 )
+		{
+			options.texture_arrays = true;
+		}
+		else if ( strcmp( argv[i], "--no-gpu-culling" ) == 0 )
+		{
+			options.gpu_culling = false;
+		}
+		else if ( strcmp( argv[i], "--cpu-culling" ) == 0 )
+		{
+			options.gpu_culling = false;
+			options.cpu_culling = true;
+		}
+		else if ( strcmp( argv[i], "--occlusion-culling" ) == 0 )
+		{
+			options.gpu_culling = false;
+			options.cpu_culling = true;
+			options.occlusion_culling = true;
+		}
+		else if ( strcmp( argv[i], "--profile" ) == 0 )
+		{
+			options.profiling = true;
+		}
+		else if ( ( strcmp( argv[i], "--texture-budget" ) == 0 ) && ( i + 1 < argc ) )
+		{
+			options.texture_budget = atoi( argv[++i] );
+		}
+		else
+		{
+			printf( "Unknown option %s.\n", argv[i] );
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	return tutorial_1( 640, 480, options );
 }
@@ -0,0 +1,462 @@
+#include "pch.h"
+#include "pixelformat.h"
+#include "simd.h"
+#include "structs.h"
+
+struct ColorTables
+{
+	float srgb_to_linear[256];
+	BYTE linear_to_srgb[LINEAR_TO_SRGB_TABLE_SIZE + 3]; // padded so the 32-bit gathers stay inside
+};
+
+static const ColorTables & Tables()
+{
+	static const ColorTables tables = []()
+	{
+		ColorTables t;
+		for ( int i = 0; i < 256; ++i )
+		{
+			t.srgb_to_linear[i] = c_linear( i / 255.0f );
+		}
+		for ( int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; ++i )
+		{
+			t.linear_to_srgb[i] = static_cast<BYTE>( c_srgb( i / static_cast<float>( LINEAR_TO_SRGB_TABLE_SIZE - 1 ) ) * 255.0f + 0.5f );
+		}
+		t.linear_to_srgb[LINEAR_TO_SRGB_TABLE_SIZE] = t.linear_to_srgb[LINEAR_TO_SRGB_TABLE_SIZE + 1] =
+			t.linear_to_srgb[LINEAR_TO_SRGB_TABLE_SIZE + 2] = 255;
+		return t;
+	}();
+
+	return tables;
+}
+
+const float * SrgbToLinearTable()
+{
+	return Tables().srgb_to_linear;
+}
+
+const BYTE * LinearToSrgbTable()
+{
+	return Tables().linear_to_srgb;
+}
+
+/* --- 3 <-> 4 B pixel shuffles, the masks are indices of the source bytes of each destination byte --- */
+
+static const char kBGRToRGBA[16] = { 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 };
+static const char kRGBToRGBA[16] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
+static const char kRGBAToBGR[16] = { 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 };
+static const char kRGBAToRGB[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 };
+static const char kSwapRedBlue[16] = { 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 };
+
+static void ExpandScalar( const BYTE * src, BYTE * dst, const size_t first, const size_t no_pixels, const char * mask )
+{
+	for ( size_t i = first; i < no_pixels; ++i )
+	{
+		dst[i * 4 + 0] = src[i * 3 + mask[0]];
+		dst[i * 4 + 1] = src[i * 3 + mask[1]];
+		dst[i * 4 + 2] = src[i * 3 + mask[2]];
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+static void PackScalar( const BYTE * src, BYTE * dst, const size_t first, const size_t no_pixels, const char * mask )
+{
+	for ( size_t i = first; i < no_pixels; ++i )
+	{
+		dst[i * 3 + 0] = src[i * 4 + mask[0]];
+		dst[i * 3 + 1] = src[i * 4 + mask[1]];
+		dst[i * 3 + 2] = src[i * 4 + mask[2]];
+	}
+}
+
+static void SwapScalar( const BYTE * src, BYTE * dst, const size_t first, const size_t no_pixels )
+{
+	for ( size_t i = first; i < no_pixels; ++i )
+	{
+		const BYTE b = src[i * 4 + 0];
+		const BYTE g = src[i * 4 + 1];
+		const BYTE r = src[i * 4 + 2];
+		const BYTE a = src[i * 4 + 3];
+		dst[i * 4 + 0] = r;
+		dst[i * 4 + 1] = g;
+		dst[i * 4 + 2] = b;
+		dst[i * 4 + 3] = a;
+	}
+}
+
+#ifdef SIMD_X64
+/* 4 pixels per 16 B load, the loads read up to 4 B past the 12 B of pixels so the last ones are left to the scalar loop,
+returns the number of converted pixels */
+SIMD_TARGET_SSE41 static size_t ExpandSse41( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	const __m128i shuffle = _mm_loadu_si128( reinterpret_cast<const __m128i *>( mask ) );
+	const __m128i alpha = _mm_set1_epi32( static_cast<int>( 0xff000000 ) );
+
+	size_t i = 0;
+	for ( ; i * 3 + 16 <= no_pixels * 3; i += 4 )
+	{
+		const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 3 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 4 ), _mm_or_si128( _mm_shuffle_epi8( pixels, shuffle ), alpha ) );
+	}
+
+	return i;
+}
+
+/* 4 pixels per 16 B store, the stores write 4 B past the 12 B of pixels which the next store overwrites */
+SIMD_TARGET_SSE41 static size_t PackSse41( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	const __m128i shuffle = _mm_loadu_si128( reinterpret_cast<const __m128i *>( mask ) );
+
+	size_t i = 0;
+	for ( ; i * 3 + 16 <= no_pixels * 3; i += 4 )
+	{
+		const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 4 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 3 ), _mm_shuffle_epi8( pixels, shuffle ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_SSE41 static size_t SwapSse41( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	const __m128i shuffle = _mm_loadu_si128( reinterpret_cast<const __m128i *>( kSwapRedBlue ) );
+
+	size_t i = 0;
+	for ( ; i + 4 <= no_pixels; i += 4 )
+	{
+		const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 4 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 4 ), _mm_shuffle_epi8( pixels, shuffle ) );
+	}
+
+	return i;
+}
+
+/* 8 pixels per iteration, each 128-bit lane shuffles 4 of them */
+SIMD_TARGET_AVX2 static size_t ExpandAvx2( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( mask ) ) );
+	const __m256i alpha = _mm256_set1_epi32( static_cast<int>( 0xff000000 ) );
+
+	size_t i = 0;
+	for ( ; i * 3 + 28 <= no_pixels * 3; i += 8 )
+	{
+		const __m256i pixels = _mm256_inserti128_si256( _mm256_castsi128_si256(
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 3 ) ) ),
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 3 + 12 ) ), 1 );
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i * 4 ), _mm256_or_si256( _mm256_shuffle_epi8( pixels, shuffle ), alpha ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t PackAvx2( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( mask ) ) );
+
+	size_t i = 0;
+	for ( ; i * 3 + 28 <= no_pixels * 3; i += 8 )
+	{
+		const __m256i pixels = _mm256_shuffle_epi8( _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i * 4 ) ), shuffle );
+		// the upper lane overwrites the 4 B of garbage stored by the lower one
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 3 ), _mm256_castsi256_si128( pixels ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 3 + 12 ), _mm256_extracti128_si256( pixels, 1 ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t SwapAvx2( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( kSwapRedBlue ) ) );
+
+	size_t i = 0;
+	for ( ; i + 8 <= no_pixels; i += 8 )
+	{
+		const __m256i pixels = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i * 4 ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i * 4 ), _mm256_shuffle_epi8( pixels, shuffle ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t SrgbToLinearAvx2( const BYTE * src, float * dst, const size_t no_values )
+{
+	const float * table = Tables().srgb_to_linear;
+
+	size_t i = 0;
+	for ( ; i + 8 <= no_values; i += 8 )
+	{
+		const __m256i indices = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( src + i ) ) );
+		_mm256_storeu_ps( dst + i, _mm256_i32gather_ps( table, indices, 4 ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t LinearToSrgbAvx2( const float * src, BYTE * dst, const size_t no_values )
+{
+	const BYTE * table = Tables().linear_to_srgb;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps( 1.0f );
+	const __m256 scale = _mm256_set1_ps( static_cast<float>( LINEAR_TO_SRGB_TABLE_SIZE - 1 ) );
+	const __m256 half = _mm256_set1_ps( 0.5f );
+	// the lowest byte of every dword to the first 4 bytes of its lane and both lanes next to each other
+	const __m256i bytes = _mm256_setr_epi8( 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m256i lanes = _mm256_setr_epi32( 0, 4, 0, 0, 0, 0, 0, 0 );
+
+	size_t i = 0;
+	for ( ; i + 8 <= no_values; i += 8 )
+	{
+		// the same operations as LinearToSrgb8, max and min return the second operand for NaN so NaN becomes 0
+		const __m256 clamped = _mm256_min_ps( _mm256_max_ps( _mm256_loadu_ps( src + i ), zero ), one );
+		const __m256i indices = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( clamped, scale ), half ) );
+		const __m256i values = _mm256_i32gather_epi32( reinterpret_cast<const int *>( table ), indices, 1 );
+		const __m256i packed = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( values, bytes ), lanes );
+		_mm_storel_epi64( reinterpret_cast<__m128i *>( dst + i ), _mm256_castsi256_si128( packed ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t FloatToHalfAvx2( const float * src, unsigned short * dst, const size_t no_values )
+{
+	size_t i = 0;
+	for ( ; i + 8 <= no_values; i += 8 )
+	{
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT ) );
+	}
+
+	return i;
+}
+
+SIMD_TARGET_AVX2 static size_t HalfToFloatAvx2( const unsigned short * src, float * dst, const size_t no_values )
+{
+	size_t i = 0;
+	for ( ; i + 8 <= no_values; i += 8 )
+	{
+		_mm256_storeu_ps( dst + i, _mm256_cvtph_ps( _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) ) ) );
+	}
+
+	return i;
+}
+#endif
+
+static void Expand( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = ExpandAvx2( src, dst, no_pixels, mask );
+	}
+	else if ( CpuHasSse41() )
+	{
+		i = ExpandSse41( src, dst, no_pixels, mask );
+	}
+#endif
+	ExpandScalar( src, dst, i, no_pixels, mask );
+}
+
+static void Pack( const BYTE * src, BYTE * dst, const size_t no_pixels, const char * mask )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = PackAvx2( src, dst, no_pixels, mask );
+	}
+	else if ( CpuHasSse41() )
+	{
+		i = PackSse41( src, dst, no_pixels, mask );
+	}
+#endif
+	PackScalar( src, dst, i, no_pixels, mask );
+}
+
+void ConvertBGR8ToRGBA8( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	Expand( src, dst, no_pixels, kBGRToRGBA );
+}
+
+void ConvertRGBA8ToBGR8( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	Pack( src, dst, no_pixels, kRGBAToBGR );
+}
+
+void ConvertRGB8ToRGBA8( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	Expand( src, dst, no_pixels, kRGBToRGBA );
+}
+
+void ConvertRGBA8ToRGB8( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	Pack( src, dst, no_pixels, kRGBAToRGB );
+}
+
+void SwapRedBlue8( const BYTE * src, BYTE * dst, const size_t no_pixels )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = SwapAvx2( src, dst, no_pixels );
+	}
+	else if ( CpuHasSse41() )
+	{
+		i = SwapSse41( src, dst, no_pixels );
+	}
+#endif
+	SwapScalar( src, dst, i, no_pixels );
+}
+
+void ConvertSrgb8ToLinear( const BYTE * src, float * dst, const size_t no_values )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = SrgbToLinearAvx2( src, dst, no_values );
+	}
+#endif
+	const float * table = Tables().srgb_to_linear;
+	for ( ; i < no_values; ++i )
+	{
+		dst[i] = table[src[i]];
+	}
+}
+
+void ConvertLinearToSrgb8( const float * src, BYTE * dst, const size_t no_values )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = LinearToSrgbAvx2( src, dst, no_values );
+	}
+#endif
+	for ( ; i < no_values; ++i )
+	{
+		dst[i] = LinearToSrgb8( src[i] );
+	}
+}
+
+/* the same rounding and special values as the F16C instructions */
+static unsigned short FloatToHalf( const float value )
+{
+	unsigned int bits = 0;
+	memcpy( &bits, &value, sizeof( bits ) );
+
+	const unsigned int sign = ( bits >> 16 ) & 0x8000;
+	const int exponent = static_cast<int>( ( bits >> 23 ) & 0xff ) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	if ( exponent == 0xff - 127 + 15 )
+	{
+		// infinity or quiet NaN with the upper bits of the payload
+		return static_cast<unsigned short>( sign | 0x7c00 | ( ( mantissa != 0 ) ? ( 0x200 | ( mantissa >> 13 ) ) : 0 ) );
+	}
+
+	if ( exponent >= 31 )
+	{
+		return static_cast<unsigned short>( sign | 0x7c00 ); // overflow
+	}
+
+	if ( exponent <= 0 )
+	{
+		if ( exponent < -10 )
+		{
+			return static_cast<unsigned short>( sign ); // below the half of the smallest denormal
+		}
+
+		// denormal, the implicit one is shifted into the mantissa
+		mantissa |= 0x800000;
+		const int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		const unsigned int remainder = mantissa & ( ( 1u << shift ) - 1 );
+		const unsigned int halfway = 1u << ( shift - 1 );
+		if ( ( remainder > halfway ) || ( ( remainder == halfway ) && ( half & 1 ) ) )
+		{
+			++half; // may carry into the smallest normal
+		}
+
+		return static_cast<unsigned short>( sign | half );
+	}
+
+	unsigned int half = sign | ( exponent << 10 ) | ( mantissa >> 13 );
+	const unsigned int remainder = mantissa & 0x1fff;
+	if ( ( remainder > 0x1000 ) || ( ( remainder == 0x1000 ) && ( half & 1 ) ) )
+	{
+		++half; // may carry into the exponent up to infinity
+	}
+
+	return static_cast<unsigned short>( half );
+}
+
+static float HalfToFloat( const unsigned short half )
+{
+	const unsigned int sign = static_cast<unsigned int>( half & 0x8000 ) << 16;
+	int exponent = ( half >> 10 ) & 0x1f;
+	unsigned int mantissa = half & 0x3ff;
+	unsigned int bits = 0;
+
+	if ( exponent == 0x1f )
+	{
+		// infinity or NaN which is always quiet like with F16C
+		bits = sign | 0x7f800000 | ( ( mantissa != 0 ) ? ( 0x400000 | ( mantissa << 13 ) ) : 0 );
+	}
+	else if ( exponent != 0 )
+	{
+		bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+	}
+	else if ( mantissa != 0 )
+	{
+		// denormal half is a normal float
+		exponent = 127 - 15 + 1;
+		while ( ( mantissa & 0x400 ) == 0 )
+		{
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+	}
+	else
+	{
+		bits = sign;
+	}
+
+	float value = 0.0f;
+	memcpy( &value, &bits, sizeof( value ) );
+
+	return value;
+}
+
+void ConvertFloatToHalf( const float * src, unsigned short * dst, const size_t no_values )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = FloatToHalfAvx2( src, dst, no_values );
+	}
+#endif
+	for ( ; i < no_values; ++i )
+	{
+		dst[i] = FloatToHalf( src[i] );
+	}
+}
+
+void ConvertHalfToFloat( const unsigned short * src, float * dst, const size_t no_values )
+{
+	size_t i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() )
+	{
+		i = HalfToFloatAvx2( src, dst, no_values );
+	}
+#endif
+	for ( ; i < no_values; ++i )
+	{
+		dst[i] = HalfToFloat( src[i] );
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef PIXEL_FORMAT_H_
+#define PIXEL_FORMAT_H_
+
+/*
+Whole image pixel format and color space conversions. Every kernel converts no_pixels tightly packed pixels (or
+no_values single channel values) and dispatches at runtime to the best of its AVX2, SSE4.1 (byte shuffles only) and
+scalar variants (see simd.h). All variants of a kernel produce bit-identical results. Source and destination must not overlap except for the
+kernels converting in place (same pixel size).
+*/
+
+/* size of the table of LinearToSrgbTable */
+#define LINEAR_TO_SRGB_TABLE_SIZE ( 1 << 14 )
+
+/* linear values of all 256 sRGB encoded bytes */
+const float * SrgbToLinearTable();
+
+/* sRGB encoded bytes of the linear values i / ( LINEAR_TO_SRGB_TABLE_SIZE - 1 ), fine enough to round trip all bytes */
+const BYTE * LinearToSrgbTable();
+
+/* sRGB encoded byte of the linear value, values outside <0, 1> are clamped */
+inline BYTE LinearToSrgb8( const float linear )
+{
+	const float clamped = ( linear > 0.0f ) ? ( ( linear < 1.0f ) ? linear : 1.0f ) : 0.0f;
+
+	return LinearToSrgbTable()[static_cast<int>( clamped * ( LINEAR_TO_SRGB_TABLE_SIZE - 1 ) + 0.5f )];
+}
+
+/* BGR8 to RGBA8 with opaque alpha */
+void ConvertBGR8ToRGBA8( const BYTE * src, BYTE * dst, const size_t no_pixels );
+
+/* RGBA8 to BGR8, alpha is dropped */
+void ConvertRGBA8ToBGR8( const BYTE * src, BYTE * dst, const size_t no_pixels );
+
+/* RGB8 to RGBA8 with opaque alpha */
+void ConvertRGB8ToRGBA8( const BYTE * src, BYTE * dst, const size_t no_pixels );
+
+/* RGBA8 to RGB8, alpha is dropped */
+void ConvertRGBA8ToRGB8( const BYTE * src, BYTE * dst, const size_t no_pixels );
+
+/* BGRA8 to RGBA8 and vice versa, src may be the same as dst */
+void SwapRedBlue8( const BYTE * src, BYTE * dst, const size_t no_pixels );
+
+/* sRGB encoded bytes to linear floats */
+void ConvertSrgb8ToLinear( const BYTE * src, float * dst, const size_t no_values );
+
+/* linear floats to sRGB encoded bytes, values outside <0, 1> are clamped */
+void ConvertLinearToSrgb8( const float * src, BYTE * dst, const size_t no_values );
+
+/* floats to IEEE 754 half floats rounded to the nearest even */
+void ConvertFloatToHalf( const float * src, unsigned short * dst, const size_t no_values );
+
+/* IEEE 754 half floats to floats */
+void ConvertHalfToFloat( const unsigned short * src, float * dst, const size_t no_values );
+
+#endif
@@ -0,0 +1,629 @@
+#include "pch.h"
+#include "scenecache.h"
+#include "textureregistry.h"
+#include "texturebaker.h"
+#include "fastparse.h"
+#include "mymath.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
+/* identification of the cache format, bump the version whenever any of the records below changes */
+static const char kSceneCacheMagic[8] = { 'P', 'G', '2', 'S', 'C', 'E', 'N', 'E' };
+static const unsigned int kSceneCacheVersion = 5;
+
+/* size of the dependency record of a source file which did not exist when the cache was written */
+static const unsigned long long kMissingFile = ~0ULL;
+
+/*! \def MAX_CACHED_MIPS
+\brief Maximal number of mip levels stored for a single texture (enough for 32768 x 32768 px).
+*/
+#define MAX_CACHED_MIPS 16
+
+/* all offsets are relative to the beginning of the cache file, names are offsets into the string table */
+struct CacheHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int vertex_size; // vertices are stored as is so their layout must match
+	unsigned long long file_size;
+
+	unsigned long long no_dependencies, dependencies_offset;
+	unsigned long long no_textures, textures_offset;
+	unsigned long long no_materials, materials_offset;
+	unsigned long long no_surfaces, surfaces_offset;
+	unsigned long long no_vertices, vertices_offset;
+	unsigned long long no_triangles, triangles_offset;
+	unsigned long long names_size, names_offset;
+};
+
+struct CacheDependency
+{
+	unsigned long long name;
+	unsigned long long size; // kMissingFile if the file does not exist
+	unsigned long long modified; // last write time (s since the epoch) the hash was computed at
+	unsigned long long hash; // FastHash of the whole file content
+};
+
+struct CacheTexture
+{
+	unsigned long long name;
+	int width, height; // base level size (px)
+	int pixel_size, scan_width; // (bytes), rows of the smaller mip levels are 4 B aligned
+	int no_mips; // 0 for the lazy texture slots which are not decoded yet, only their file name is stored
+	int block_format; // BlockFormat of block_mips, NONE if the texture is not baked
+	unsigned long long mips[MAX_CACHED_MIPS];
+	unsigned long long block_mips[MAX_CACHED_MIPS]; // the same no_mips levels block compressed
+};
+
+struct CacheMaterial
+{
+	unsigned long long name;
+	Color3f ambient, diffuse, specular, emission;
+	float shininess, roughness, metallicness, reflectivity, ior;
+	int material_index;
+	int shader;
+	int textures[NO_TEXTURES]; // indices into the texture table or -1
+};
+
+struct CacheSurface
+{
+	unsigned long long name;
+	unsigned long long first_vertex;
+	unsigned long long no_vertices;
+	unsigned long long first_triangle; // indices are relative to the first vertex of the surface
+	unsigned long long no_triangles;
+	int material; // index into the material table of this cache
+	int pad;
+};
+
+static const CacheHeader & Header( const MappedFile & file )
+{
+	return *reinterpret_cast<const CacheHeader *>( file.data() );
+}
+
+/* size and content hash of the given file, returns -1 if the file cannot be read */
+static int HashFile( const char * file_name, unsigned long long & size, unsigned long long & hash )
+{
+	MappedFile file;
+	if ( file.Open( file_name ) != 0 )
+	{
+		return -1;
+	}
+
+	size = file.size();
+	hash = FastHash( reinterpret_cast<const BYTE *>( file.data() ), file.size() );
+
+	return 0;
+}
+
+/* size and last write time of the given file, returns -1 if the file does not exist */
+static int StatFile( const char * file_name, unsigned long long & size, unsigned long long & modified )
+{
+	struct _stat64 info;
+	if ( _stat64( file_name, &info ) != 0 )
+	{
+		return -1;
+	}
+
+	size = static_cast<unsigned long long>( info.st_size );
+	modified = static_cast<unsigned long long>( info.st_mtime );
+
+	return 0;
+}
+
+/* appends full paths of all material libraries referenced by the OBJ file */
+static void CollectMaterialLibraries( const char * file_name, std::vector<std::string> & libraries )
+{
+	MappedFile file;
+	if ( file.Open( file_name ) != 0 )
+	{
+		return;
+	}
+
+	// the same path rules as in the OBJ loaders
+	std::string path;
+	const char * tmp = strrchr( file_name, '/' );
+	if ( tmp != NULL )
+	{
+		path.assign( file_name, tmp - file_name + 1 );
+	}
+
+	const char * end = file.data() + file.size();
+	for ( const char * line = file.data(); line < end; )
+	{
+		const char * line_end = FindNewline( line, end );
+
+		if ( ( line_end - line > 6 ) && ( strncmp( line, "mtllib", 6 ) == 0 ) )
+		{
+			char library[128];
+			ParseToken( line + 6, line_end, library, sizeof( library ) );
+			libraries.push_back( path + library );
+		}
+
+		line = ( line_end < end ) ? line_end + 1 : end;
+	}
+}
+
+static unsigned long long AddName( std::vector<char> & names, const std::string & name )
+{
+	const unsigned long long offset = names.size();
+	names.insert( names.end(), name.c_str(), name.c_str() + name.size() + 1 );
+
+	return offset;
+}
+
+/* pads the file to the next 16 B aligned position and returns it */
+static unsigned long long Align( FILE * file, unsigned long long & position )
+{
+	static const char zeros[16] = { 0 };
+	const size_t padding = static_cast<size_t>( ( 16 - position % 16 ) % 16 );
+	fwrite( zeros, 1, padding, file );
+	position += padding;
+
+	return position;
+}
+
+/* writes the data at the next 16 B aligned position and returns its offset */
+static unsigned long long WriteAligned( FILE * file, unsigned long long & position, const void * data, const size_t size )
+{
+	const unsigned long long offset = Align( file, position );
+	if ( size > 0 )
+	{
+		fwrite( data, 1, size, file );
+		position += size;
+	}
+
+	return offset;
+}
+
+static int MipScanWidth( const int width, const int pixel_size )
+{
+	return ( ( width * pixel_size + 3 ) / 4 ) * 4;
+}
+
+/* writes the base level and the whole mip chain of the texture followed by its block compressed copy if it can be baked */
+static void WriteTexture( FILE * file, unsigned long long & position, Texture * texture, CacheTexture & record,
+	size_t & baked_bytes )
+{
+	record.width = texture->width();
+	record.height = texture->height();
+	record.pixel_size = texture->pixel_size();
+	record.scan_width = texture->scan_width();
+	record.no_mips = 1;
+	record.mips[0] = WriteAligned( file, position, texture->data(), static_cast<size_t>( record.scan_width ) * record.height );
+
+	std::vector<BYTE> previous;
+	std::vector<BYTE> current;
+	const BYTE * src = texture->data();
+	int src_width = record.width;
+	int src_height = record.height;
+	int src_scan_width = record.scan_width;
+
+	while ( ( ( src_width > 1 ) || ( src_height > 1 ) ) && ( record.no_mips < MAX_CACHED_MIPS ) )
+	{
+		const int dst_width = max( 1, src_width / 2 );
+		const int dst_height = max( 1, src_height / 2 );
+		const int dst_scan_width = MipScanWidth( dst_width, record.pixel_size );
+
+		current.assign( static_cast<size_t>( dst_scan_width ) * dst_height, 0 );
+		DownsampleSrgb( src, src_width, src_height, src_scan_width,
+			current.data(), dst_width, dst_height, dst_scan_width, record.pixel_size );
+		record.mips[record.no_mips++] = WriteAligned( file, position, current.data(), current.size() );
+
+		previous.swap( current );
+		src = previous.data();
+		src_width = dst_width;
+		src_height = dst_height;
+		src_scan_width = dst_scan_width;
+	}
+
+	BakedTexture baked;
+	if ( ( BakeTexture( texture, ChooseBlockFormat( texture ), baked ) == 0 ) &&
+		( baked.mips.size() == static_cast<size_t>( record.no_mips ) ) )
+	{
+		record.block_format = static_cast<int>( baked.format );
+		for ( int level = 0; level < record.no_mips; ++level )
+		{
+			record.block_mips[level] = WriteAligned( file, position, baked.mips[level].data(), baked.mips[level].size() );
+			baked_bytes += baked.mips[level].size();
+		}
+	}
+}
+
+std::string SceneCache::CacheFileName( const char * file_name )
+{
+	return std::string( file_name ).append( ".cache" );
+}
+
+int SceneCache::Save( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
+{
+	const std::string cache_file_name = CacheFileName( file_name );
+	const std::string tmp_file_name = cache_file_name + ".tmp";
+
+	std::vector<char> names;
+
+	// unique textures, textures without any data are not cached and their slots stay empty, lazy slots are stored
+	// by the file name only (texture is NULL) so saving the cache never decodes them
+	std::vector<Texture *> textures;
+	std::vector<std::string> texture_names;
+	std::map<Texture *, int> texture_indices;
+	std::map<std::string, int> lazy_texture_indices;
+	std::vector<int> slot_indices( materials.size() * NO_TEXTURES, -1 );
+
+	for ( size_t i = 0; i < materials.size(); ++i )
+	{
+		Material * material = materials[i];
+
+		for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+		{
+			if ( material->texture_requested( slot ) )
+			{
+				Texture * texture = material->texture( slot );
+				if ( texture && texture->data() )
+				{
+					if ( texture_indices.find( texture ) == texture_indices.end() )
+					{
+						texture_indices[texture] = static_cast<int>( textures.size() );
+						textures.push_back( texture );
+						texture_names.push_back( texture->file_name() );
+					}
+					slot_indices[i * NO_TEXTURES + slot] = texture_indices[texture];
+				}
+			}
+			else if ( !material->texture_file( slot ).empty() )
+			{
+				const std::string texture_file = material->texture_file( slot );
+				if ( lazy_texture_indices.find( texture_file ) == lazy_texture_indices.end() )
+				{
+					lazy_texture_indices[texture_file] = static_cast<int>( textures.size() );
+					textures.push_back( NULL );
+					texture_names.push_back( texture_file );
+				}
+				slot_indices[i * NO_TEXTURES + slot] = lazy_texture_indices[texture_file];
+			}
+		}
+	}
+
+	// all source files the cache is derived from including the images which failed to load
+	std::vector<std::string> dependency_names{ std::string( file_name ) };
+	CollectMaterialLibraries( file_name, dependency_names );
+	for ( Material * material : materials )
+	{
+		for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+		{
+			const std::string texture_file = material->texture_file( slot );
+			if ( !texture_file.empty() && ( std::find( dependency_names.begin(), dependency_names.end(), texture_file ) == dependency_names.end() ) )
+			{
+				dependency_names.push_back( texture_file );
+			}
+		}
+	}
+
+	std::vector<CacheDependency> dependencies( dependency_names.size() );
+	for ( size_t i = 0; i < dependency_names.size(); ++i )
+	{
+		CacheDependency & dependency = dependencies[i];
+		dependency.name = AddName( names, dependency_names[i] );
+		if ( ( StatFile( dependency_names[i].c_str(), dependency.size, dependency.modified ) != 0 ) ||
+			( HashFile( dependency_names[i].c_str(), dependency.size, dependency.hash ) != 0 ) )
+		{
+			dependency.size = kMissingFile;
+			dependency.modified = 0;
+			dependency.hash = 0;
+		}
+	}
+
+	FILE * file = fopen( tmp_file_name.c_str(), "wb" );
+	if ( file == NULL )
+	{
+		printf( "Unable to create scene cache '%s'.\n", tmp_file_name.c_str() );
+
+		return -1;
+	}
+
+	printf( "Writing scene cache '%s'...\n", cache_file_name.c_str() );
+
+	// the header is rewritten once all offsets are known
+	CacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	fwrite( &header, sizeof( header ), 1, file );
+	unsigned long long position = sizeof( header );
+
+	// --- texture data, the block compressed mip chains are baked right here ---
+	const auto t_bake = std::chrono::steady_clock::now();
+	size_t baked_bytes = 0;
+	std::vector<CacheTexture> texture_records( textures.size() );
+	for ( size_t i = 0; i < textures.size(); ++i )
+	{
+		CacheTexture & record = texture_records[i];
+		memset( &record, 0, sizeof( record ) );
+		record.name = AddName( names, texture_names[i] );
+		if ( textures[i] )
+		{
+			WriteTexture( file, position, textures[i], record, baked_bytes );
+		}
+	}
+	const double bake_time = std::chrono::duration<double>( std::chrono::steady_clock::now() - t_bake ).count();
+
+	// --- vertices and triangle indices of all surfaces in two flat arrays ---
+	std::vector<CacheSurface> surface_records( surfaces.size() );
+	std::map<Material *, int> material_indices;
+	for ( size_t i = 0; i < materials.size(); ++i )
+	{
+		material_indices[materials[i]] = static_cast<int>( i );
+	}
+
+	header.vertices_offset = Align( file, position );
+	for ( size_t i = 0; i < surfaces.size(); ++i )
+	{
+		Surface * surface = surfaces[i];
+		CacheSurface & record = surface_records[i];
+		memset( &record, 0, sizeof( record ) );
+
+		record.name = AddName( names, surface->get_name() );
+		record.first_vertex = header.no_vertices;
+		record.no_vertices = surface->no_vertices();
+		record.first_triangle = header.no_triangles;
+		record.no_triangles = surface->no_triangles();
+		record.material = ( surface->get_material() ) ? material_indices[surface->get_material()] : -1;
+		header.no_vertices += record.no_vertices;
+		header.no_triangles += record.no_triangles;
+
+		// the array continues without any padding
+		const size_t size = sizeof( Vertex ) * surface->no_vertices();
+		fwrite( surface->get_vertices(), 1, size, file );
+		position += size;
+	}
+
+	header.triangles_offset = Align( file, position );
+	for ( Surface * surface : surfaces )
+	{
+		const size_t size = sizeof( Triangle3ui ) * surface->no_triangles();
+		fwrite( surface->get_indices(), 1, size, file );
+		position += size;
+	}
+
+	// --- tables, the records are value initialized (zeroed) by the vectors ---
+	std::vector<CacheMaterial> material_records( materials.size() );
+	for ( size_t i = 0; i < materials.size(); ++i )
+	{
+		const Material * material = materials[i];
+		CacheMaterial & record = material_records[i];
+
+		record.name = AddName( names, material->name() );
+		record.ambient = material->ambient_;
+		record.diffuse = material->diffuse_;
+		record.specular = material->specular_;
+		record.emission = material->emission_;
+		record.shininess = material->shininess;
+		record.roughness = material->roughness_;
+		record.metallicness = material->metallicness;
+		record.reflectivity = material->reflectivity;
+		record.ior = material->ior;
+		record.material_index = material->materialIndex;
+		record.shader = static_cast<int>( material->shader() );
+
+		for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+		{
+			record.textures[slot] = slot_indices[i * NO_TEXTURES + slot];
+		}
+	}
+
+	memcpy( header.magic, kSceneCacheMagic, sizeof( header.magic ) );
+	header.version = kSceneCacheVersion;
+	header.vertex_size = sizeof( Vertex );
+	header.no_dependencies = dependencies.size();
+	header.dependencies_offset = WriteAligned( file, position, dependencies.data(), sizeof( CacheDependency ) * dependencies.size() );
+	header.no_textures = texture_records.size();
+	header.textures_offset = WriteAligned( file, position, texture_records.data(), sizeof( CacheTexture ) * texture_records.size() );
+	header.no_materials = material_records.size();
+	header.materials_offset = WriteAligned( file, position, material_records.data(), sizeof( CacheMaterial ) * material_records.size() );
+	header.no_surfaces = surface_records.size();
+	header.surfaces_offset = WriteAligned( file, position, surface_records.data(), sizeof( CacheSurface ) * surface_records.size() );
+	header.names_size = names.size();
+	header.names_offset = WriteAligned( file, position, names.data(), names.size() );
+	header.file_size = position;
+
+	fseek( file, 0, SEEK_SET );
+	fwrite( &header, sizeof( header ), 1, file );
+
+	const bool failed = ferror( file ) != 0;
+	fclose( file );
+	file = NULL;
+
+	// replace the old cache only by the complete new one
+	remove( cache_file_name.c_str() );
+	if ( failed || ( rename( tmp_file_name.c_str(), cache_file_name.c_str() ) != 0 ) )
+	{
+		printf( "Unable to write scene cache '%s'.\n", cache_file_name.c_str() );
+		remove( tmp_file_name.c_str() );
+
+		return -1;
+	}
+
+	printf( "Done (%0.1f MB, textures baked to %0.1f MB of blocks in %s).\n\n", position / sqr( 1024.0 ),
+		baked_bytes / sqr( 1024.0 ), TimeToString( bake_time ).c_str() );
+
+	return 0;
+}
+
+int SceneCache::Load( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	const std::string cache_file_name = CacheFileName( file_name );
+
+	if ( GetFileSize64( cache_file_name.c_str() ) < static_cast<long long>( sizeof( CacheHeader ) ) )
+	{
+		return -1; // there is no cache yet
+	}
+
+	if ( file_.Open( cache_file_name.c_str() ) != 0 )
+	{
+		return -1;
+	}
+
+	const char * data = file_.data();
+	const CacheHeader & header = *reinterpret_cast<const CacheHeader *>( data );
+
+	if ( ( memcmp( header.magic, kSceneCacheMagic, sizeof( header.magic ) ) != 0 ) ||
+		( header.version != kSceneCacheVersion ) || ( header.vertex_size != sizeof( Vertex ) ) ||
+		( header.file_size != file_.size() ) || ( header.names_offset + header.names_size > file_.size() ) )
+	{
+		printf( "Scene cache '%s' has an incompatible format.\n", cache_file_name.c_str() );
+		file_.Close();
+
+		return -1;
+	}
+
+	const char * names = data + header.names_offset;
+
+	// --- validation against the current content of all sources, only the files whose size matches but whose last write
+	// time differs are hashed again ---
+	const auto t_validation = std::chrono::steady_clock::now();
+	int no_hashed = 0;
+	const CacheDependency * dependencies = reinterpret_cast<const CacheDependency *>( data + header.dependencies_offset );
+	for ( unsigned long long i = 0; i < header.no_dependencies; ++i )
+	{
+		const CacheDependency & dependency = dependencies[i];
+		const char * dependency_name = names + dependency.name;
+		unsigned long long size = 0;
+		unsigned long long modified = 0;
+		unsigned long long hash = dependency.hash;
+
+		if ( StatFile( dependency_name, size, modified ) != 0 )
+		{
+			size = kMissingFile;
+		}
+		else if ( ( size == dependency.size ) && ( modified != dependency.modified ) )
+		{
+			++no_hashed;
+			if ( HashFile( dependency_name, size, hash ) != 0 )
+			{
+				size = kMissingFile;
+			}
+		}
+
+		if ( ( size != dependency.size ) || ( hash != dependency.hash ) )
+		{
+			printf( "Scene cache '%s' is out of date ('%s' has changed).\n", cache_file_name.c_str(), dependency_name );
+			file_.Close();
+
+			return -1;
+		}
+	}
+
+	const double validation_time = std::chrono::duration<double>( std::chrono::steady_clock::now() - t_validation ).count();
+
+	// --- textures point directly into the mapped view, lazy ones are decoded from their files on the first use ---
+	std::vector<Texture *> textures( static_cast<size_t>( header.no_textures ), nullptr );
+	const CacheTexture * texture_records = reinterpret_cast<const CacheTexture *>( data + header.textures_offset );
+	for ( size_t i = 0; i < textures.size(); ++i )
+	{
+		const CacheTexture & record = texture_records[i];
+		if ( record.no_mips == 0 )
+		{
+			continue;
+		}
+		const BYTE * mips[MAX_CACHED_MIPS];
+		for ( int level = 0; level < record.no_mips; ++level )
+		{
+			mips[level] = reinterpret_cast<const BYTE *>( data + record.mips[level] );
+		}
+
+		textures[i] = new Texture( names + record.name, record.width, record.height, record.pixel_size, record.scan_width,
+			mips, record.no_mips );
+
+		if ( record.block_format != static_cast<int>( BlockFormat::NONE ) )
+		{
+			for ( int level = 0; level < record.no_mips; ++level )
+			{
+				mips[level] = reinterpret_cast<const BYTE *>( data + record.block_mips[level] );
+			}
+			textures[i]->set_block_mips( BlockFormat( record.block_format ), mips );
+		}
+	}
+
+	// --- materials ---
+	const size_t first_material = materials.size();
+	const CacheMaterial * material_records = reinterpret_cast<const CacheMaterial *>( data + header.materials_offset );
+	for ( unsigned long long i = 0; i < header.no_materials; ++i )
+	{
+		const CacheMaterial & record = material_records[i];
+		Material * material = new Material();
+
+		material->set_name( names + record.name );
+		material->ambient_ = record.ambient;
+		material->diffuse_ = record.diffuse;
+		material->specular_ = record.specular;
+		material->emission_ = record.emission;
+		material->shininess = record.shininess;
+		material->roughness_ = record.roughness;
+		material->metallicness = record.metallicness;
+		material->reflectivity = record.reflectivity;
+		material->ior = record.ior;
+		material->materialIndex = record.material_index;
+		material->set_shader( Shader( record.shader ) );
+
+		for ( int slot = 0; slot < NO_TEXTURES; ++slot )
+		{
+			if ( ( record.textures[slot] >= 0 ) && textures[record.textures[slot]] )
+			{
+				material->set_texture( slot, TextureRegistry::instance().Acquire( textures[record.textures[slot]] ) );
+			}
+			else if ( record.textures[slot] >= 0 )
+			{
+				material->set_texture_file( slot, names + texture_records[record.textures[slot]].name );
+			}
+		}
+
+		materials.push_back( material );
+	}
+
+	// --- surfaces point directly into the mapped view as well ---
+	const Vertex * vertices = this->vertices();
+	const Triangle3ui * triangles = this->triangles();
+	const CacheSurface * surface_records = reinterpret_cast<const CacheSurface *>( data + header.surfaces_offset );
+	for ( unsigned long long i = 0; i < header.no_surfaces; ++i )
+	{
+		const CacheSurface & record = surface_records[i];
+
+		Surface * surface = new Surface( std::string( names + record.name ), vertices + record.first_vertex,
+			static_cast<int>( record.no_vertices ), triangles + record.first_triangle, static_cast<int>( record.no_triangles ) );
+
+		if ( record.material >= 0 )
+		{
+			surface->set_material( materials[first_material + record.material] );
+		}
+
+		surfaces.push_back( surface );
+	}
+
+	printf( "Scene loaded from cache '%s' (%0.1f MB, %llu surfaces, %llu materials, %llu textures) in %s, %llu sources validated in %s (%d hashed).\n\n",
+		cache_file_name.c_str(), file_.size() / sqr( 1024.0 ), header.no_surfaces, header.no_materials, header.no_textures,
+		TimeToString( std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ).c_str(),
+		header.no_dependencies, TimeToString( validation_time ).c_str(), no_hashed );
+
+	return static_cast<int>( header.no_surfaces );
+}
+
+const Vertex * SceneCache::vertices() const
+{
+	return ( file_.is_open() ) ? reinterpret_cast<const Vertex *>( file_.data() + Header( file_ ).vertices_offset ) : NULL;
+}
+
+const Triangle3ui * SceneCache::triangles() const
+{
+	return ( file_.is_open() ) ? reinterpret_cast<const Triangle3ui *>( file_.data() + Header( file_ ).triangles_offset ) : NULL;
+}
+
+size_t SceneCache::no_vertices() const
+{
+	return ( file_.is_open() ) ? static_cast<size_t>( Header( file_ ).no_vertices ) : 0;
+}
+
+size_t SceneCache::no_triangles() const
+{
+	return ( file_.is_open() ) ? static_cast<size_t>( Header( file_ ).no_triangles ) : 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SCENE_CACHE_H_
+#define SCENE_CACHE_H_
+
+#include "surface.h"
+#include "mappedfile.h"
+
+/*! \class SceneCache
+\brief Versioned binary cache of the scene loaded from the OBJ file.
+
+The cache file is stored next to the OBJ file (with an additional .cache extension) and holds the flattened
+vertex and index arrays, the surface table, material records and decoded textures including their mip chains, which are
+baked into block compressed formats as well (see texturebaker.h) when the cache is written. It is
+validated against the content hashes of the OBJ file, the referenced MTL files and all texture images so
+any change of the sources rebuilds the cache automatically. A source is hashed again only if its size matches and its
+last write time differs from the one stored in the cache.
+
+Textures and surfaces loaded from the cache point directly into the mapped view, nothing is copied, therefore the cache
+object has to outlive all materials and surfaces created by \a Load. The vertices and the triangles of all surfaces form
+two flat arrays in the order of the surfaces, so they can be uploaded to the GPU at once.
+*/
+class SceneCache
+{
+public:
+	SceneCache() { }
+
+	/* loads the scene from the valid cache of the given OBJ file, returns the number of surfaces or -1 if the cache is missing or stale */
+	int Load( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials );
+
+	/* writes the cache of the scene loaded from the given OBJ file, returns 0 on success and -1 otherwise */
+	static int Save( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials );
+
+	/* name of the cache file belonging to the given OBJ file */
+	static std::string CacheFileName( const char * file_name );
+
+	/* flat arrays of the vertices and the triangles of all loaded surfaces, the indices are relative to the first vertex
+	of their surface, NULL if no cache is loaded */
+	const Vertex * vertices() const;
+	const Triangle3ui * triangles() const;
+	size_t no_vertices() const;
+	size_t no_triangles() const;
+
+private:
+	MappedFile file_; // the mapped cache file
+
+	SceneCache( const SceneCache & ) = delete;
+	SceneCache & operator=( const SceneCache & ) = delete;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "simd.h"
+#include <algorithm>
+#include <atomic>
+
+#if defined( SIMD_X64 ) && defined( _MSC_VER )
+#include <intrin.h>
+#elif defined( SIMD_X64 )
+#include <cpuid.h>
+#endif
+
+static std::atomic<int> simd_limit{ static_cast<int>( SimdLevel::AVX2 ) };
+
+#ifdef SIMD_X64
+static void CpuId( const int leaf, unsigned int info[4] )
+{
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuidex( registers, leaf, 0 );
+	for ( int i = 0; i < 4; ++i )
+	{
+		info[i] = static_cast<unsigned int>( registers[i] );
+	}
+#else
+	__cpuid_count( leaf, 0, info[0], info[1], info[2], info[3] );
+#endif
+}
+
+/* state components enabled by the OS in XCR0 */
+static unsigned long long EnabledStates()
+{
+#ifdef _MSC_VER
+	return _xgetbv( 0 );
+#else
+	unsigned int eax = 0, edx = 0;
+	__asm__ volatile( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+	return ( static_cast<unsigned long long>( edx ) << 32 ) | eax;
+#endif
+}
+#endif
+
+static SimdLevel DetectSimdLevel()
+{
+#ifdef SIMD_X64
+	unsigned int info[4];
+	CpuId( 0, info );
+	const unsigned int max_leaf = info[0];
+
+	// SSSE3 and SSE4.1 in ECX of leaf 1
+	CpuId( 1, info );
+	const unsigned int ecx = info[2];
+	if ( ( ecx & ( ( 1u << 9 ) | ( 1u << 19 ) ) ) != ( ( 1u << 9 ) | ( 1u << 19 ) ) )
+	{
+		return SimdLevel::SCALAR;
+	}
+
+	// FMA, OSXSAVE, AVX and F16C in ECX of leaf 1, the OS has to save the XMM and YMM registers
+	const unsigned int avx = ( 1u << 12 ) | ( 1u << 27 ) | ( 1u << 28 ) | ( 1u << 29 );
+	if ( ( max_leaf < 7 ) || ( ( ecx & avx ) != avx ) || ( ( EnabledStates() & 6 ) != 6 ) )
+	{
+		return SimdLevel::SSE41;
+	}
+
+	// AVX2 in EBX of leaf 7
+	CpuId( 7, info );
+
+	return ( info[1] & ( 1u << 5 ) ) ? SimdLevel::AVX2 : SimdLevel::SSE41;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+static int SupportedLevel()
+{
+	static const SimdLevel level = DetectSimdLevel();
+
+	return std::min( static_cast<int>( level ), simd_limit.load() );
+}
+
+bool CpuHasSse41()
+{
+	return SupportedLevel() >= static_cast<int>( SimdLevel::SSE41 );
+}
+
+bool CpuHasAvx2()
+{
+	return SupportedLevel() >= static_cast<int>( SimdLevel::AVX2 );
+}
+
+void LimitSimdLevel( const SimdLevel level )
+{
+	simd_limit = static_cast<int>( level );
+}
@@ -0,0 +1,36 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+/*
+Runtime dispatch of the vectorized kernels. The program is built for the baseline x64 instruction set (SSE2) while
+the SSE4.1 and AVX2 variants of the kernels are compiled for their instruction sets separately, they may be called
+only if CpuHasSse41() or CpuHasAvx2() returns true.
+*/
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define SIMD_X64
+#include <immintrin.h>
+#endif
+
+/* attributes of the functions using SSSE3/SSE4.1 and AVX2/FMA/F16C intrinsics, MSVC accepts them without any attribute */
+#if defined( SIMD_X64 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define SIMD_TARGET_SSE41 __attribute__( ( target( "ssse3,sse4.1" ) ) )
+#define SIMD_TARGET_AVX2 __attribute__( ( target( "avx2,fma,f16c" ) ) )
+#else
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#endif
+
+/* instruction set levels of the kernels, every level includes the previous ones */
+enum class SimdLevel : char { SCALAR = 0, SSE41 = 1, AVX2 = 2 };
+
+/* true if the CPU supports SSSE3 and SSE4.1 and the level is not limited below them */
+bool CpuHasSse41();
+
+/* true if both the CPU and the OS support AVX2, FMA and F16C and the level is not limited below them */
+bool CpuHasAvx2();
+
+/* limits the kernels to the given level, e.g. to benchmark the fallbacks on the AVX2 capable CPU */
+void LimitSimdLevel( const SimdLevel level );
+
+#endif
@@ -0,0 +1,735 @@
+#include "pch.h"
+#include "softwarerasterizer.h"
+#include "simd.h"
+#include "mymath.h"
+#include <algorithm>
+#include <chrono>
+
+/* vertices shaded or triangles set up by one task */
+static const int chunk_size = 4096;
+
+/* the vertices are snapped to 1/256 px like the 8 bits of the subpixel precision of the GPUs */
+static const float subpixel_scale = 256.0f;
+
+/* the triangles are clipped by the sides of the frustum only outside of the guard band of this many screens, the edge
+functions of the huge ones would lose the precision otherwise */
+static const float guard_band = 2.0f;
+
+/* planes a x + b y + c z + d w >= 0 of the clip space the triangles are clipped by, the near and far ones first */
+static const float clip_planes[6][4] = { { 0, 0, 1, 1 }, { 0, 0, -1, 1 }, { 1, 0, 0, guard_band }, { -1, 0, 0, guard_band },
+	{ 0, 1, 0, guard_band }, { 0, -1, 0, guard_band } };
+
+static double SecondsSince( const std::chrono::steady_clock::time_point t0 )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+}
+
+/* the point transformed by the row-major matrix */
+static void Transform( const float m[4][4], const Vector3 & v, const float w, float out[4] )
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		out[i] = m[i][0] * v.x + m[i][1] * v.y + m[i][2] * v.z + m[i][3] * w;
+	}
+}
+
+/* the same as main of basic_shader.vert, mv is the MVN matrix */
+static void ShadeVertex( const Vertex & vertex, const float mvp[4][4], const float mv[4][4], const Vector3 & light_position,
+	const Vector3 & view_from, SoftwareRasterizer::ShadedVertex & out )
+{
+	Transform( mvp, vertex.position, 1.0f, out.clip );
+
+	float v[4];
+	Transform( mv, vertex.normal, 0.0f, v );
+	Vector3 normal( v[0], v[1], v[2] );
+	normal.Normalize();
+	Transform( mv, vertex.position, 1.0f, v );
+	Vector3 omega_i( v[0] / v[3], v[1] / v[3], v[2] / v[3] );
+	omega_i.Normalize();
+	if ( normal.DotProduct( omega_i ) > 0.0f )
+	{
+		normal *= -1.0f;
+	}
+
+	Vector3 to_light = light_position - vertex.position;
+	to_light.Normalize();
+	Transform( mv, to_light, 0.0f, v );
+	Vector3 to_light_es( v[0], v[1], v[2] );
+	to_light_es.Normalize();
+	const float normal_light_dot = normal.DotProduct( to_light_es );
+	const Vector3 lr = 2.0f * normal_light_dot * normal - to_light_es;
+
+	Vector3 direction = vertex.position - view_from;
+	direction.Normalize();
+	Transform( mv, direction, 0.0f, v );
+	Vector3 direction_es( v[0], v[1], v[2] );
+	direction_es.Normalize();
+
+	// texcoord, normalLightDot, lr and directionVector
+	const float varyings[SOFTWARE_NO_VARYINGS] = { vertex.texture_coords[0].u, 1.0f - vertex.texture_coords[0].v, normal_light_dot,
+		lr.x, lr.y, lr.z, direction_es.x, direction_es.y, direction_es.z };
+	memcpy( out.varyings, varyings, sizeof( varyings ) );
+}
+
+/* clips the convex polygon by the plane, the attributes are interpolated linearly in the clip space, returns the number
+of the vertices left in out */
+static int ClipPolygon( const SoftwareRasterizer::ShadedVertex * in, const int n, const float plane[4], SoftwareRasterizer::ShadedVertex * out )
+{
+	int m = 0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		const SoftwareRasterizer::ShadedVertex & current = in[i];
+		const SoftwareRasterizer::ShadedVertex & next = in[( i + 1 ) % n];
+		const float d_current = plane[0] * current.clip[0] + plane[1] * current.clip[1] + plane[2] * current.clip[2] + plane[3] * current.clip[3];
+		const float d_next = plane[0] * next.clip[0] + plane[1] * next.clip[1] + plane[2] * next.clip[2] + plane[3] * next.clip[3];
+		if ( d_current >= 0.0f )
+		{
+			out[m++] = current;
+		}
+		if ( ( d_current >= 0.0f ) != ( d_next >= 0.0f ) )
+		{
+			const float t = d_current / ( d_current - d_next );
+			for ( int j = 0; j < 4; ++j )
+			{
+				out[m].clip[j] = current.clip[j] + t * ( next.clip[j] - current.clip[j] );
+			}
+			for ( int j = 0; j < SOFTWARE_NO_VARYINGS; ++j )
+			{
+				out[m].varyings[j] = current.varyings[j] + t * ( next.varyings[j] - current.varyings[j] );
+			}
+			++m;
+		}
+	}
+
+	return m;
+}
+
+/* edge functions, planes and pixel bounds of the triangle given by the snapped screen positions, false if it is
+degenerate or covers no pixel center */
+static bool SetupTriangle( const float x[3], const float y[3], const float z[3], const float inv_w[3], const int width,
+	const int height, SoftwareRasterizer::ScreenTriangle & triangle )
+{
+	const float area2 = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( x[2] - x[0] ) * ( y[1] - y[0] );
+	if ( area2 == 0.0f )
+	{
+		return false;
+	}
+
+	// the pixel centers inside the bounding box
+	const float x_min = max( 0.0f, ceilf( min( x[0], min( x[1], x[2] ) ) - 0.5f ) );
+	const float y_min = max( 0.0f, ceilf( min( y[0], min( y[1], y[2] ) ) - 0.5f ) );
+	const float x_max = min( float( width - 1 ), floorf( max( x[0], max( x[1], x[2] ) ) - 0.5f ) );
+	const float y_max = min( float( height - 1 ), floorf( max( y[0], max( y[1], y[2] ) ) - 0.5f ) );
+	if ( ( x_min > x_max ) || ( y_min > y_max ) )
+	{
+		return false;
+	}
+	triangle.x0 = static_cast<int>( x_min );
+	triangle.y0 = static_cast<int>( y_min );
+	triangle.x1 = static_cast<int>( x_max );
+	triangle.y1 = static_cast<int>( y_max );
+
+	// the interior is positive for both windings, the edges of the neighbouring triangles are exactly opposite
+	const float sign = ( area2 > 0.0f ) ? 1.0f : -1.0f;
+	for ( int i = 0; i < 3; ++i )
+	{
+		const int j = ( i + 1 ) % 3;
+		triangle.edges[i][0] = sign * ( y[i] - y[j] );
+		triangle.edges[i][1] = sign * ( x[j] - x[i] );
+		triangle.edges[i][2] = sign * ( x[i] * y[j] - x[j] * y[i] );
+		// the interior lies to the right of a left edge and below a top edge, y goes up
+		triangle.top_left[i] = ( triangle.edges[i][0] > 0.0f ) || ( ( triangle.edges[i][0] == 0.0f ) && ( triangle.edges[i][1] < 0.0f ) );
+	}
+
+	// the depth after the perspective division is linear in the screen space
+	triangle.depth[0] = ( ( z[1] - z[0] ) * ( y[2] - y[0] ) - ( z[2] - z[0] ) * ( y[1] - y[0] ) ) / area2;
+	triangle.depth[1] = ( ( x[1] - x[0] ) * ( z[2] - z[0] ) - ( x[2] - x[0] ) * ( z[1] - z[0] ) ) / area2;
+	triangle.depth[2] = z[0] - triangle.depth[0] * x[0] - triangle.depth[1] * y[0];
+	triangle.depth_min = min( z[0], min( z[1], z[2] ) );
+
+	// the barycentric coordinate of a vertex is the edge function of the opposite edge over the area, so is 1 / w
+	for ( int k = 0; k < 3; ++k )
+	{
+		const float scale = inv_w[k] / fabsf( area2 );
+		for ( int i = 0; i < 3; ++i )
+		{
+			triangle.weights[k][i] = triangle.edges[( k + 1 ) % 3][i] * scale;
+		}
+	}
+
+	return true;
+}
+
+/* clips the triangle, projects it onto the screen and appends the triangles of the fan of the clipped polygon */
+static void ProjectTriangle( const SoftwareRasterizer::ShadedVertex & v0, const SoftwareRasterizer::ShadedVertex & v1,
+	const SoftwareRasterizer::ShadedVertex & v2, const int material, const int width, const int height,
+	std::vector<SoftwareRasterizer::ScreenTriangle> & triangles )
+{
+	// planes the vertices lie behind, the triangle is dropped if all of them lie behind the same one
+	int outside[3] = { 0, 0, 0 };
+	const SoftwareRasterizer::ShadedVertex * vertices[3] = { &v0, &v1, &v2 };
+	for ( int i = 0; i < 3; ++i )
+	{
+		const float * c = vertices[i]->clip;
+		for ( int p = 0; p < 6; ++p )
+		{
+			const float * plane = clip_planes[p];
+			outside[i] |= ( plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3] * c[3] < 0.0f ) ? 1 << p : 0;
+		}
+	}
+	if ( ( outside[0] & outside[1] & outside[2] ) != 0 )
+	{
+		return;
+	}
+
+	// each plane adds at most one vertex
+	SoftwareRasterizer::ShadedVertex polygons[2][9];
+	polygons[0][0] = v0;
+	polygons[0][1] = v1;
+	polygons[0][2] = v2;
+	int n = 3;
+	int current = 0;
+	const int clipped = outside[0] | outside[1] | outside[2];
+	for ( int p = 0; ( p < 6 ) && ( n >= 3 ); ++p )
+	{
+		if ( clipped & ( 1 << p ) )
+		{
+			n = ClipPolygon( polygons[current], n, clip_planes[p], polygons[1 - current] );
+			current = 1 - current;
+		}
+	}
+	if ( n < 3 )
+	{
+		return;
+	}
+
+	const SoftwareRasterizer::ShadedVertex * polygon = polygons[current];
+	float x[9], y[9], z[9], inv_w[9];
+	for ( int i = 0; i < n; ++i )
+	{
+		if ( polygon[i].clip[3] <= 0.0f )
+		{
+			return;
+		}
+		inv_w[i] = 1.0f / polygon[i].clip[3];
+		x[i] = roundf( ( polygon[i].clip[0] * inv_w[i] * 0.5f + 0.5f ) * width * subpixel_scale ) / subpixel_scale;
+		y[i] = roundf( ( polygon[i].clip[1] * inv_w[i] * 0.5f + 0.5f ) * height * subpixel_scale ) / subpixel_scale;
+		z[i] = polygon[i].clip[2] * inv_w[i] * 0.5f + 0.5f;
+	}
+
+	// fan of the polygon
+	for ( int i = 2; i < n; ++i )
+	{
+		const int corners[3] = { 0, i - 1, i };
+		float tx[3], ty[3], tz[3], tw[3];
+		for ( int k = 0; k < 3; ++k )
+		{
+			tx[k] = x[corners[k]];
+			ty[k] = y[corners[k]];
+			tz[k] = z[corners[k]];
+			tw[k] = inv_w[corners[k]];
+		}
+		SoftwareRasterizer::ScreenTriangle triangle;
+		if ( SetupTriangle( tx, ty, tz, tw, width, height, triangle ) )
+		{
+			triangle.material = material;
+			for ( int k = 0; k < 3; ++k )
+			{
+				memcpy( triangle.varyings[k], polygon[corners[k]].varyings, sizeof( triangle.varyings[k] ) );
+			}
+			triangles.push_back( triangle );
+		}
+	}
+}
+
+/* false if the triangle covers no pixel center of the size x size px square at x, y, each edge is evaluated at the
+center farthest inside */
+static bool Overlaps( const SoftwareRasterizer::ScreenTriangle & triangle, const int x, const int y, const int size )
+{
+	for ( int e = 0; e < 3; ++e )
+	{
+		const float * edge = triangle.edges[e];
+		const float px = x + ( ( edge[0] > 0.0f ) ? size - 0.5f : 0.5f );
+		const float py = y + ( ( edge[1] > 0.0f ) ? size - 0.5f : 0.5f );
+		if ( edge[0] * px + edge[1] * py + edge[2] < 0.0f )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* writes the pixels of the block at x, y covered by the triangle and nearer than the depth buffer, returns their number,
+the values are computed in the same order by both kernels, so their results are bit-identical */
+static int RasterBlock( const SoftwareRasterizer::ScreenTriangle & triangle, const int id, const int x, const int y,
+	float * depth, int * ids, const int stride )
+{
+	int no_written = 0;
+
+	for ( int row = 0; row < SOFTWARE_BLOCK_SIZE; ++row )
+	{
+		const float py = y + row + 0.5f;
+		for ( int column = 0; column < SOFTWARE_BLOCK_SIZE; ++column )
+		{
+			const float px = x + column + 0.5f;
+			bool inside = true;
+			for ( int e = 0; e < 3; ++e )
+			{
+				const float * edge = triangle.edges[e];
+				const float value = edge[0] * px + edge[1] * py + edge[2];
+				inside = inside && ( ( triangle.top_left[e] ) ? ( value >= 0.0f ) : ( value > 0.0f ) );
+			}
+			const float z = triangle.depth[0] * px + triangle.depth[1] * py + triangle.depth[2];
+			const int i = row * stride + column;
+			if ( inside && ( z < depth[i] ) )
+			{
+				depth[i] = z;
+				ids[i] = id;
+				++no_written;
+			}
+		}
+	}
+
+	return no_written;
+}
+
+#ifdef SIMD_X64
+/* a row of 8 pixels at once */
+SIMD_TARGET_AVX2 static int RasterBlockAvx2( const SoftwareRasterizer::ScreenTriangle & triangle, const int id, const int x,
+	const int y, float * depth, int * ids, const int stride )
+{
+	const __m256 px = _mm256_add_ps( _mm256_set1_ps( float( x ) ), _mm256_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f ) );
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i id8 = _mm256_set1_epi32( id );
+	int no_written = 0;
+
+	for ( int row = 0; row < SOFTWARE_BLOCK_SIZE; ++row )
+	{
+		const __m256 py = _mm256_set1_ps( y + row + 0.5f );
+		__m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+		for ( int e = 0; e < 3; ++e )
+		{
+			const float * edge = triangle.edges[e];
+			// no FMA, the fallback rounds every product
+			const __m256 value = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( edge[0] ), px ),
+				_mm256_mul_ps( _mm256_set1_ps( edge[1] ), py ) ), _mm256_set1_ps( edge[2] ) );
+			inside = _mm256_and_ps( inside, ( triangle.top_left[e] ) ? _mm256_cmp_ps( value, zero, _CMP_GE_OQ ) :
+				_mm256_cmp_ps( value, zero, _CMP_GT_OQ ) );
+		}
+		const __m256 z = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( triangle.depth[0] ), px ),
+			_mm256_mul_ps( _mm256_set1_ps( triangle.depth[1] ), py ) ), _mm256_set1_ps( triangle.depth[2] ) );
+
+		float * row_depth = depth + row * stride;
+		int * row_ids = ids + row * stride;
+		const __m256 old_depth = _mm256_loadu_ps( row_depth );
+		const __m256 pass = _mm256_and_ps( inside, _mm256_cmp_ps( z, old_depth, _CMP_LT_OQ ) );
+		unsigned int mask = static_cast<unsigned int>( _mm256_movemask_ps( pass ) );
+		if ( mask == 0 )
+		{
+			continue;
+		}
+		_mm256_storeu_ps( row_depth, _mm256_blendv_ps( old_depth, z, pass ) );
+		const __m256i old_ids = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( row_ids ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( row_ids ), _mm256_castps_si256( _mm256_blendv_ps(
+			_mm256_castsi256_ps( old_ids ), _mm256_castsi256_ps( id8 ), pass ) ) );
+		for ( ; mask != 0; mask &= mask - 1 )
+		{
+			++no_written;
+		}
+	}
+
+	return no_written;
+}
+#endif
+
+SoftwareRasterizer::SoftwareRasterizer( const int width, const int height, const int no_threads )
+{
+	width_ = max( 1, width );
+	height_ = max( 1, height );
+	no_tiles_x_ = ( width_ + SOFTWARE_TILE_SIZE - 1 ) / SOFTWARE_TILE_SIZE;
+	no_tiles_y_ = ( height_ + SOFTWARE_TILE_SIZE - 1 ) / SOFTWARE_TILE_SIZE;
+	stride_ = no_tiles_x_ * SOFTWARE_TILE_SIZE;
+
+	const size_t no_pixels = static_cast<size_t>( stride_ ) * no_tiles_y_ * SOFTWARE_TILE_SIZE;
+	depth_.resize( no_pixels );
+	ids_.resize( no_pixels );
+	hiz_.resize( no_pixels / ( SOFTWARE_BLOCK_SIZE * SOFTWARE_BLOCK_SIZE ) );
+	color_.assign( no_pixels * 4, 0 );
+
+	set_threads( no_threads );
+}
+
+void SoftwareRasterizer::set_threads( const int no_threads )
+{
+	pool_.reset( new WorkStealingPool( no_threads ) );
+	scratch_.resize( pool_->no_threads() );
+	thread_stats_.resize( pool_->no_threads() );
+}
+
+void SoftwareRasterizer::set_light_position( const Vector3 & position )
+{
+	light_position_ = position;
+}
+
+void SoftwareRasterizer::Render( const std::vector<Surface *> & surfaces, const std::vector<Material *> & materials, const Camera & camera )
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	stats_ = Stats();
+
+	// the same parameters as the materials of Rasterizer::initMaterials, the textured ones have the white diffuse color
+	const Material default_material;
+	materials_.clear();
+	for ( const Material * material : materials )
+	{
+		Texture * texture = material->texture( Material::kDiffuseMapSlot );
+		materials_.push_back( ShadingMaterial{ material->ambient(), ( texture ) ? Color3f( 1.0f, 1.0f, 1.0f ) : material->diffuse(),
+			material->specular(), static_cast<int>( material->shininess ), texture } );
+	}
+	materials_.push_back( ShadingMaterial{ default_material.ambient(), default_material.diffuse(), default_material.specular(),
+		static_cast<int>( default_material.shininess ), nullptr } );
+
+	float mvp[4][4], mv[4][4];
+	const Matrix4x4 mvp_matrix = camera.projectionMatrix * camera.viewMatrix;
+	for ( int i = 0; i < 4; ++i )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			mvp[i][j] = mvp_matrix.get( i, j );
+			mv[i][j] = camera.viewMatrix.get( i, j );
+		}
+	}
+	const Vector3 view_from = camera.view_from();
+
+	// the vertices and triangles of all surfaces are numbered consecutively
+	std::vector<int> first_vertex( surfaces.size() + 1, 0 );
+	std::vector<int> first_triangle( surfaces.size() + 1, 0 );
+	for ( size_t s = 0; s < surfaces.size(); ++s )
+	{
+		first_vertex[s + 1] = first_vertex[s] + surfaces[s]->no_vertices();
+		first_triangle[s + 1] = first_triangle[s] + surfaces[s]->no_triangles();
+	}
+	const auto surface_of = []( const std::vector<int> & first, const int i ) {
+		return static_cast<int>( std::upper_bound( first.begin(), first.end(), i ) - first.begin() ) - 1; };
+
+	vertices_.resize( first_vertex.back() );
+	pool_->Run( ( first_vertex.back() + chunk_size - 1 ) / chunk_size, [&]( const int chunk, const int )
+	{
+		const int end = min( first_vertex.back(), ( chunk + 1 ) * chunk_size );
+		for ( int i = chunk * chunk_size, s = surface_of( first_vertex, i ); i < end; ++i )
+		{
+			while ( i >= first_vertex[s + 1] )
+			{
+				++s;
+			}
+			ShadeVertex( surfaces[s]->get_vertices()[i - first_vertex[s]], mvp, mv, light_position_, view_from, vertices_[i] );
+		}
+	} );
+	const auto t1 = std::chrono::steady_clock::now();
+
+	// the chunks are joined in their order, so the triangles keep the order of the surfaces
+	const int default_index = static_cast<int>( materials_.size() ) - 1;
+	chunks_.resize( ( first_triangle.back() + chunk_size - 1 ) / chunk_size );
+	pool_->Run( static_cast<int>( chunks_.size() ), [&]( const int chunk, const int )
+	{
+		chunks_[chunk].clear();
+		const int end = min( first_triangle.back(), ( chunk + 1 ) * chunk_size );
+		for ( int i = chunk * chunk_size, s = surface_of( first_triangle, i ); i < end; ++i )
+		{
+			while ( i >= first_triangle[s + 1] )
+			{
+				++s;
+			}
+			const Material * material = surfaces[s]->get_material();
+			const int m = ( material && ( material->materialIndex >= 0 ) && ( material->materialIndex < default_index ) ) ?
+				material->materialIndex : default_index;
+			const Triangle3ui & triangle = surfaces[s]->get_indices()[i - first_triangle[s]];
+			const ShadedVertex * vertices = &vertices_[first_vertex[s]];
+			ProjectTriangle( vertices[triangle.v0], vertices[triangle.v1], vertices[triangle.v2], m, width_, height_, chunks_[chunk] );
+		}
+	} );
+	triangles_.clear();
+	for ( const auto & chunk : chunks_ )
+	{
+		triangles_.insert( triangles_.end(), chunk.begin(), chunk.end() );
+	}
+
+	// each thread bins a contiguous range of the triangles, the tiles visit the bins in the order of the ranges
+	const int no_tiles = no_tiles_x_ * no_tiles_y_;
+	const int no_ranges = pool_->no_threads();
+	const int no_setup = static_cast<int>( triangles_.size() );
+	bins_.resize( static_cast<size_t>( no_ranges ) * no_tiles );
+	pool_->Run( no_ranges, [&]( const int range, const int )
+	{
+		std::vector<int> * bins = &bins_[static_cast<size_t>( range ) * no_tiles];
+		for ( int tile = 0; tile < no_tiles; ++tile )
+		{
+			bins[tile].clear();
+		}
+		const int end = static_cast<int>( static_cast<long long>( no_setup ) * ( range + 1 ) / no_ranges );
+		for ( int i = static_cast<int>( static_cast<long long>( no_setup ) * range / no_ranges ); i < end; ++i )
+		{
+			const ScreenTriangle & triangle = triangles_[i];
+			const int tx0 = triangle.x0 / SOFTWARE_TILE_SIZE;
+			const int tx1 = triangle.x1 / SOFTWARE_TILE_SIZE;
+			const int ty0 = triangle.y0 / SOFTWARE_TILE_SIZE;
+			const int ty1 = triangle.y1 / SOFTWARE_TILE_SIZE;
+			for ( int ty = ty0; ty <= ty1; ++ty )
+			{
+				for ( int tx = tx0; tx <= tx1; ++tx )
+				{
+					if ( ( ( tx0 == tx1 ) && ( ty0 == ty1 ) ) || Overlaps( triangle, tx * SOFTWARE_TILE_SIZE, ty * SOFTWARE_TILE_SIZE, SOFTWARE_TILE_SIZE ) )
+					{
+						bins[ty * no_tiles_x_ + tx].push_back( i );
+					}
+				}
+			}
+		}
+	} );
+	const auto t2 = std::chrono::steady_clock::now();
+
+	const bool avx2 = CpuHasAvx2();
+	std::fill( thread_stats_.begin(), thread_stats_.end(), Stats() );
+	pool_->Run( no_tiles, [&]( const int tile, const int thread ) { RenderTile( tile, thread, avx2 ); } );
+
+	for ( const Stats & t : thread_stats_ )
+	{
+		stats_.no_binned += t.no_binned;
+		stats_.no_blocks += t.no_blocks;
+		stats_.no_hiz_culled += t.no_hiz_culled;
+		stats_.no_fragments += t.no_fragments;
+		stats_.no_shaded += t.no_shaded;
+	}
+	stats_.no_triangles = first_triangle.back();
+	stats_.no_setup = no_setup;
+	stats_.vertex_time = std::chrono::duration<double>( t1 - t0 ).count();
+	stats_.setup_time = std::chrono::duration<double>( t2 - t1 ).count();
+	stats_.raster_time = SecondsSince( t2 );
+}
+
+void SoftwareRasterizer::RenderTile( const int tile, const int thread, const bool avx2 )
+{
+	const int x_begin = ( tile % no_tiles_x_ ) * SOFTWARE_TILE_SIZE;
+	const int y_begin = ( tile / no_tiles_x_ ) * SOFTWARE_TILE_SIZE;
+	const int no_blocks_x = stride_ / SOFTWARE_BLOCK_SIZE;
+	const int no_tiles = no_tiles_x_ * no_tiles_y_;
+	Stats & stats = thread_stats_[thread];
+
+	for ( int y = y_begin; y < y_begin + SOFTWARE_TILE_SIZE; ++y )
+	{
+		std::fill_n( &depth_[static_cast<size_t>( y ) * stride_ + x_begin], SOFTWARE_TILE_SIZE, 1.0f );
+		std::fill_n( &ids_[static_cast<size_t>( y ) * stride_ + x_begin], SOFTWARE_TILE_SIZE, -1 );
+		if ( y % SOFTWARE_BLOCK_SIZE == 0 )
+		{
+			std::fill_n( &hiz_[( y / SOFTWARE_BLOCK_SIZE ) * no_blocks_x + x_begin / SOFTWARE_BLOCK_SIZE], SOFTWARE_TILE_SIZE / SOFTWARE_BLOCK_SIZE, 1.0f );
+		}
+	}
+
+	for ( int range = 0; range < pool_->no_threads(); ++range )
+	{
+		const std::vector<int> & bin = bins_[static_cast<size_t>( range ) * no_tiles + tile];
+		stats.no_binned += bin.size();
+		for ( const int id : bin )
+		{
+			const ScreenTriangle & triangle = triangles_[id];
+			const int bx0 = max( triangle.x0, x_begin ) / SOFTWARE_BLOCK_SIZE;
+			const int bx1 = min( triangle.x1, x_begin + SOFTWARE_TILE_SIZE - 1 ) / SOFTWARE_BLOCK_SIZE;
+			const int by0 = max( triangle.y0, y_begin ) / SOFTWARE_BLOCK_SIZE;
+			const int by1 = min( triangle.y1, y_begin + SOFTWARE_TILE_SIZE - 1 ) / SOFTWARE_BLOCK_SIZE;
+			for ( int by = by0; by <= by1; ++by )
+			{
+				for ( int bx = bx0; bx <= bx1; ++bx )
+				{
+					const int x = bx * SOFTWARE_BLOCK_SIZE;
+					const int y = by * SOFTWARE_BLOCK_SIZE;
+					if ( !Overlaps( triangle, x, y, SOFTWARE_BLOCK_SIZE ) )
+					{
+						continue;
+					}
+					// the nearest vertex lies behind all pixels of the block
+					float & block_depth = hiz_[by * no_blocks_x + bx];
+					if ( triangle.depth_min >= block_depth )
+					{
+						++stats.no_hiz_culled;
+						continue;
+					}
+					++stats.no_blocks;
+
+					float * depth = &depth_[static_cast<size_t>( y ) * stride_ + x];
+					int * ids = &ids_[static_cast<size_t>( y ) * stride_ + x];
+#ifdef SIMD_X64
+					const int no_written = ( avx2 ) ? RasterBlockAvx2( triangle, id, x, y, depth, ids, stride_ ) :
+						RasterBlock( triangle, id, x, y, depth, ids, stride_ );
+#else
+					const int no_written = RasterBlock( triangle, id, x, y, depth, ids, stride_ );
+#endif
+					if ( no_written > 0 )
+					{
+						stats.no_fragments += no_written;
+						float farthest = 0.0f;
+						for ( int row = 0; row < SOFTWARE_BLOCK_SIZE; ++row )
+						{
+							for ( int column = 0; column < SOFTWARE_BLOCK_SIZE; ++column )
+							{
+								farthest = max( farthest, depth[row * stride_ + column] );
+							}
+						}
+						block_depth = farthest;
+					}
+				}
+			}
+		}
+	}
+
+	ShadeTile( tile, thread );
+}
+
+void SoftwareRasterizer::ShadeTile( const int tile, const int thread )
+{
+	const int x_begin = ( tile % no_tiles_x_ ) * SOFTWARE_TILE_SIZE;
+	const int y_begin = ( tile / no_tiles_x_ ) * SOFTWARE_TILE_SIZE;
+	const int x_end = min( width_, x_begin + SOFTWARE_TILE_SIZE );
+	const int y_end = min( height_, y_begin + SOFTWARE_TILE_SIZE );
+	const int no_pixels = SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE;
+
+	// texture coordinates, normalLightDot, the specular term and the sampled texels of the pixels of a material
+	std::vector<float> & scratch = scratch_[thread];
+	scratch.resize( no_pixels * 7 );
+	float * u = &scratch[0];
+	float * v = &scratch[no_pixels];
+	float * normal_light_dot = &scratch[no_pixels * 2];
+	float * specular = &scratch[no_pixels * 3];
+	float * r = &scratch[no_pixels * 4];
+	float * g = &scratch[no_pixels * 5];
+	float * b = &scratch[no_pixels * 6];
+	int pixels[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+	int n = 0;
+	int material = -1;
+	size_t no_shaded = 0;
+
+	// the pixels of the same material are shaded at once, the textures are sampled by Texture::texels
+	const auto flush = [&]()
+	{
+		const ShadingMaterial & m = materials_[max( 0, material )];
+		if ( m.texture )
+		{
+			m.texture->texels( u, v, nullptr, n, TextureFilter::BILINEAR, false, r, g, b );
+		}
+		else
+		{
+			std::fill_n( r, n, 1.0f );
+			std::fill_n( g, n, 1.0f );
+			std::fill_n( b, n, 1.0f );
+		}
+		for ( int i = 0; i < n; ++i )
+		{
+			const float color[3] = { m.ambient.r + m.diffuse.r * r[i] * normal_light_dot[i] + m.specular.r * specular[i],
+				m.ambient.g + m.diffuse.g * g[i] * normal_light_dot[i] + m.specular.g * specular[i],
+				m.ambient.b + m.diffuse.b * b[i] * normal_light_dot[i] + m.specular.b * specular[i] };
+			BYTE * rgba = &color_[static_cast<size_t>( pixels[i] ) * 4];
+			for ( int c = 0; c < 3; ++c )
+			{
+				rgba[c] = static_cast<BYTE>( min( 1.0f, max( 0.0f, color[c] ) ) * 255.0f + 0.5f );
+			}
+			rgba[3] = 255;
+		}
+		n = 0;
+	};
+
+	for ( int y = y_begin; y < y_end; ++y )
+	{
+		const float py = y + 0.5f;
+		for ( int x = x_begin; x < x_end; ++x )
+		{
+			const int pixel = y * stride_ + x;
+			const int id = ids_[pixel];
+			if ( id < 0 )
+			{
+				memset( &color_[static_cast<size_t>( pixel ) * 4], 0, 4 );
+				continue;
+			}
+
+			const ScreenTriangle & triangle = triangles_[id];
+			if ( ( triangle.material != material ) && ( n > 0 ) )
+			{
+				flush();
+			}
+			material = triangle.material;
+
+			// perspective-correct interpolation of the varyings
+			const float px = x + 0.5f;
+			float weights[3];
+			for ( int k = 0; k < 3; ++k )
+			{
+				weights[k] = triangle.weights[k][0] * px + triangle.weights[k][1] * py + triangle.weights[k][2];
+			}
+			const float sum = weights[0] + weights[1] + weights[2];
+			float varyings[SOFTWARE_NO_VARYINGS];
+			for ( int j = 0; j < SOFTWARE_NO_VARYINGS; ++j )
+			{
+				varyings[j] = ( weights[0] * triangle.varyings[0][j] + weights[1] * triangle.varyings[1][j] +
+					weights[2] * triangle.varyings[2][j] ) / sum;
+			}
+
+			// GL_REPEAT and the texel centers of GL_LINEAR, Texture::texels starts the texels at their corners
+			const Texture * texture = materials_[material].texture;
+			float tu = varyings[0] - floorf( varyings[0] );
+			float tv = varyings[1] - floorf( varyings[1] );
+			if ( texture )
+			{
+				tu -= 0.5f / texture->width();
+				tv -= 0.5f / texture->height();
+				tu += ( tu < 0.0f ) ? 1.0f : 0.0f;
+				tv += ( tv < 0.0f ) ? 1.0f : 0.0f;
+			}
+			u[n] = tu;
+			v[n] = tv;
+			normal_light_dot[n] = varyings[2];
+			// pow( clamp( dot( -directionVector, lr ), 0, 1 ), shininess )
+			const float r_dot_v = -( varyings[6] * varyings[3] + varyings[7] * varyings[4] + varyings[8] * varyings[5] );
+			specular[n] = powf( min( 1.0f, max( 0.0f, r_dot_v ) ), static_cast<float>( materials_[material].shininess ) );
+			pixels[n++] = pixel;
+			++no_shaded;
+		}
+	}
+	if ( n > 0 )
+	{
+		flush();
+	}
+
+	thread_stats_[thread].no_shaded += no_shaded;
+}
+
+void SoftwareRasterizer::CopyToRGBA8( BYTE * rgba ) const
+{
+	for ( int y = 0; y < height_; ++y )
+	{
+		memcpy( rgba + static_cast<size_t>( y ) * width_ * 4, &color_[static_cast<size_t>( y ) * stride_ * 4], width_ * 4 );
+	}
+}
+
+SoftwareRasterizer::Stats SoftwareRasterizer::stats() const
+{
+	return stats_;
+}
+
+int SoftwareRasterizer::width() const
+{
+	return width_;
+}
+
+int SoftwareRasterizer::height() const
+{
+	return height_;
+}
+
+int SoftwareRasterizer::no_threads() const
+{
+	return pool_->no_threads();
+}
+
+size_t SoftwareRasterizer::no_steals() const
+{
+	return pool_->no_steals();
+}
@@ -0,0 +1,142 @@
+#ifndef SOFTWARE_RASTERIZER_H_
+#define SOFTWARE_RASTERIZER_H_
+
+#include "surface.h"
+#include "material.h"
+#include "camera.h"
+#include "workstealingpool.h"
+
+/*! \def SOFTWARE_TILE_SIZE
+\brief Size of the square screen tile (px) the triangles are binned into, one task of the pool rasterizes and shades it.
+*/
+#define SOFTWARE_TILE_SIZE 64
+
+/*! \def SOFTWARE_BLOCK_SIZE
+\brief Size of the square block of the hierarchical depth test (px), a row of the block fills one AVX2 register.
+*/
+#define SOFTWARE_BLOCK_SIZE 8
+
+/*! \def SOFTWARE_NO_VARYINGS
+\brief Attributes interpolated over the triangles, texcoord, normalLightDot, lr and directionVector of basic_shader.vert.
+*/
+#define SOFTWARE_NO_VARYINGS 9
+
+/*! \class SoftwareRasterizer
+\brief Reference renderer of the scene of Rasterizer on the CPU.
+
+Reproduces the draw of basic_shader.vert and basic_shader.frag without any GPU. The vertices of all surfaces are
+shaded in parallel, the triangles are clipped by the near and far planes, snapped to 1/256 px and binned into the
+tiles of SOFTWARE_TILE_SIZE px. The tiles are processed by a WorkStealingPool, each one by a single thread, so no
+locks are needed and the image does not depend on the number of threads. The triangles of a tile are rasterized in
+the order of the surfaces into a visibility buffer, the edge functions and the depth of a row of 8 px are evaluated
+by AVX2 (with a bit-identical scalar fallback) and each block of 8 x 8 px keeps its farthest depth, so a triangle
+lying behind the whole block skips it. The visible pixels are shaded once after all triangles of the tile are done,
+the attributes are interpolated perspective-correctly and the diffuse textures are sampled bilinearly from the base
+level like the GL_LINEAR filter of the bindless textures.
+
+The fill rule is top-left and the depth test is GL_LESS, the image thus matches the GL one up to the differences in
+the precision of the rasterization and of the texture filtering.
+*/
+class SoftwareRasterizer
+{
+public:
+	/* counters of the last frame */
+	struct Stats
+	{
+		int no_triangles; // of the surfaces
+		int no_setup; // left by the clipping, without the degenerate and off-screen ones
+		size_t no_binned; // pairs of a triangle and a tile it overlaps
+		size_t no_blocks; // blocks rasterized
+		size_t no_hiz_culled; // blocks skipped by the hierarchical depth test
+		size_t no_fragments; // written into the visibility buffer
+		size_t no_shaded; // visible pixels
+		double vertex_time; // s
+		double setup_time; // clipping, setup and binning
+		double raster_time; // rasterization and shading of the tiles
+	};
+
+	/* image of width x height px rendered by no_threads threads, 0 means all hardware threads */
+	SoftwareRasterizer( const int width, const int height, const int no_threads = 0 );
+
+	void set_threads( const int no_threads );
+
+	/* world space position of the point light, the same as in Rasterizer::drawFrame by default */
+	void set_light_position( const Vector3 & position );
+
+	/* renders the surfaces shaded by the materials (indexed by Material::materialIndex) as seen by the camera, the
+	camera is expected to have the aspect ratio of the image */
+	void Render( const std::vector<Surface *> & surfaces, const std::vector<Material *> & materials, const Camera & camera );
+
+	/* copies the last frame as RGBA8 pixels in the order of glReadPixels, the bottom row first */
+	void CopyToRGBA8( BYTE * rgba ) const;
+
+	Stats stats() const;
+	int width() const;
+	int height() const;
+	int no_threads() const;
+
+	/* ranges of the loops stolen by the threads of the pool since the last set_threads */
+	size_t no_steals() const;
+
+	/* vertex shaded by basic_shader.vert */
+	struct ShadedVertex
+	{
+		float clip[4];
+		float varyings[SOFTWARE_NO_VARYINGS];
+	};
+
+	/* triangle projected onto the screen */
+	struct ScreenTriangle
+	{
+		float edges[3][3]; // a x + b y + c >= 0 inside the triangle, > 0 for the edges neither top nor left
+		bool top_left[3];
+		float depth[3]; // plane of the depth after the perspective division
+		float weights[3][3]; // planes of the barycentric coordinates divided by w
+		float depth_min; // of the vertices
+		int x0, y0, x1, y1; // bounding rectangle of the pixels (inclusive)
+		int material; // index into the shading materials, the last one is the default for the surfaces without any
+		float varyings[3][SOFTWARE_NO_VARYINGS]; // of the vertices
+	};
+
+	/* parameters of basic_shader.frag */
+	struct ShadingMaterial
+	{
+		Color3f ambient;
+		Color3f diffuse;
+		Color3f specular;
+		int shininess;
+		Texture * texture; // diffuse texture, nullptr samples white
+	};
+
+private:
+	/* rasterizes the triangles binned into the tile into the visibility buffer and shades its visible pixels */
+	void RenderTile( const int tile, const int thread, const bool avx2 );
+
+	/* fills the pixels of the tile in the visibility buffer by the shaded colors */
+	void ShadeTile( const int tile, const int thread );
+
+	int width_{ 0 };
+	int height_{ 0 };
+	int no_tiles_x_{ 0 };
+	int no_tiles_y_{ 0 };
+	int stride_{ 0 }; // of the buffers padded to whole tiles (px)
+	std::unique_ptr<WorkStealingPool> pool_;
+	Vector3 light_position_{ 50, 0, 120 };
+
+	std::vector<ShadedVertex> vertices_; // of all surfaces
+	std::vector<ScreenTriangle> triangles_; // in the order of the surfaces
+	std::vector<std::vector<int>> bins_; // the triangles overlapping each tile binned by each thread, [thread * tiles + tile]
+	std::vector<ShadingMaterial> materials_;
+
+	std::vector<float> depth_; // padded to whole tiles, row-major from the bottom row
+	std::vector<int> ids_; // triangle covering the pixel, -1 for the background
+	std::vector<float> hiz_; // farthest depth of each block
+	std::vector<BYTE> color_; // RGBA8 of the visible pixels
+
+	std::vector<std::vector<ScreenTriangle>> chunks_; // triangles set up by each task, joined in their order
+	std::vector<std::vector<float>> scratch_; // shading arrays of each thread
+	std::vector<Stats> thread_stats_; // counters of the tiles summed by each thread
+	Stats stats_{};
+};
+
+#endif
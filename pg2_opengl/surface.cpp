@@ -1,60 +1,81 @@
 #include "pch.h"
 #include "surface.h"
+#include "mymath.h"
 
-Surface * BuildSurface( const std::string & name, std::vector<Vertex> & face_vertices )
+Surface * BuildSurface( const std::string & name, std::vector<Vertex> & vertices, std::vector<Triangle3ui> & triangles )
 {
-	const int no_vertices = static_cast< int >( face_vertices.size() );
+	assert( ( vertices.size() > 0 ) && ( triangles.size() > 0 ) );
 
-	assert( ( no_vertices > 0 ) && ( no_vertices % 3 == 0 ) );
-
-	const int no_triangles = no_vertices / 3;
-
-	Surface * surface = new Surface( name, no_triangles );
-
-	// koprovn dat
-	for ( int i = 0; i < no_triangles; ++i )
-	{		
-		surface->get_triangles()[i] = Triangle( face_vertices[i * 3],
-			face_vertices[i * 3 + 1], face_vertices[i * 3 + 2], surface );
-	}
-
-	return surface;
+	// data se nekopruj, pole jsou do plochy pesunuta
+	return new Surface( name, vertices, triangles );
 }
 
 Surface::Surface()
 {
-	n_ = 0;
-	triangles_ = NULL;
 }
 
-Surface::Surface( const std::string & name, const int n )
+Surface::Surface( const std::string & name, std::vector<Vertex> & vertices, std::vector<Triangle3ui> & triangles )
 {
-	assert( n > 0 );
+	name_ = name;
+
+	vertices_.swap( vertices );
+	triangles_.swap( triangles );
+
+	vertex_data_ = vertices_.data();
+	triangle_data_ = triangles_.data();
+	no_vertices_ = static_cast<int>( vertices_.size() );
+	no_triangles_ = static_cast<int>( triangles_.size() );
 
+	UpdateAabb();
+}
+
+Surface::Surface( const std::string & name, const Vertex * vertices, const int no_vertices, const Triangle3ui * triangles,
+	const int no_triangles )
+{
 	name_ = name;
 
-	n_ = n;
-	triangles_ = new Triangle[n_];
+	vertex_data_ = vertices;
+	triangle_data_ = triangles;
+	no_vertices_ = no_vertices;
+	no_triangles_ = no_triangles;
+
+	UpdateAabb();
 }
 
-Surface::~Surface()
+void Surface::UpdateAabb()
 {
-	if ( triangles_ )
+	// obalov kvdr se pot jen jednou, pi naten scny
+	if ( no_vertices_ > 0 )
+	{
+		aabb_min_ = aabb_max_ = vertex_data_[0].position;
+	}
+	for ( int i = 0; i < no_vertices_; ++i )
 	{
-		delete[] triangles_;
-		triangles_ = nullptr;
+		const Vertex & vertex = vertex_data_[i];
+		aabb_min_ = Vector3( min( aabb_min_.x, vertex.position.x ), min( aabb_min_.y, vertex.position.y ), min( aabb_min_.z, vertex.position.z ) );
+		aabb_max_ = Vector3( max( aabb_max_.x, vertex.position.x ), max( aabb_max_.y, vertex.position.y ), max( aabb_max_.z, vertex.position.z ) );
 	}
-	n_ = 0;
 }
 
-Triangle & Surface::get_triangle( const int i )
+Surface::~Surface()
+{
+}
+
+Triangle Surface::get_triangle( const int i )
+{
+	const Triangle3ui & triangle = triangle_data_[i];
+
+	return Triangle( vertex_data_[triangle.v0], vertex_data_[triangle.v1], vertex_data_[triangle.v2], this );
+}
+
+const Vertex * Surface::get_vertices() const
 {
-	return triangles_[i];
+	return vertex_data_;
 }
 
-Triangle * Surface::get_triangles()
+const Triangle3ui * Surface::get_indices() const
 {
-	return triangles_;
+	return triangle_data_;
 }
 
 std::string Surface::get_name()
@@ -64,12 +85,22 @@ std::string Surface::get_name()
 
 int Surface::no_triangles()
 {
-	return n_;
+	return no_triangles_;
 }
 
 int Surface::no_vertices()
 {
-	return 3 * n_;
+	return no_vertices_;
+}
+
+Vector3 Surface::get_aabb_min() const
+{
+	return aabb_min_;
+}
+
+Vector3 Surface::get_aabb_max() const
+{
+	return aabb_max_;
 }
 
 void Surface::set_material( Material * material )
@@ -23,12 +23,17 @@ public:
 
 	//! Obecn konstruktor.
 	/*!
-	Inicializuje vertex podle zadanch hodnot parametr.
+	Inicializuje indexovanou s. Obsah obou pol je do st pesunut, pole zstanou przdn.
 
 	\param name nzev plochy.
-	\param n poet trojhelnk tvocch s.
+	\param vertices pole uniktnch vrchol st.
+	\param triangles pole index trojhelnk do pole \a vertices.
 	*/
-	Surface( const std::string & name, const int n );
+	Surface( const std::string & name, std::vector<Vertex> & vertices, std::vector<Triangle3ui> & triangles );
+
+	/* surface over external vertex and index data (e.g. memory mapped scene cache), the data are neither copied nor released */
+	Surface( const std::string & name, const Vertex * vertices, const int no_vertices, const Triangle3ui * triangles,
+		const int no_triangles );
 
 	//! Destruktor.
 	/*!
@@ -39,15 +44,21 @@ public:
 	//! Vrt poadovan trojhelnk.
 	/*!
 	\param i index trojhelnka.
-	\return Trojhelnk.
+	\return Trojhelnk sestaven z indexovanch vrchol.
 	*/
-	Triangle & get_triangle( const int i );
+	Triangle get_triangle( const int i );
 
-	//! Vrt pole vech trojhelnk.
-	/*!	
-	\return Pole vech trojhelnk.
+	//! Vrt pole vech uniktnch vrchol st.
+	/*!
+	\return Pole vrchol o dlce \a no_vertices.
 	*/
-	Triangle * get_triangles();
+	const Vertex * get_vertices() const;
+
+	//! Vrt pole index vech trojhelnk st.
+	/*!
+	\return Pole index o dlce \a no_triangles.
+	*/
+	const Triangle3ui * get_indices() const;
 
 	//! Vrt nzev plochy.
 	/*!	
@@ -61,12 +72,26 @@ public:
 	*/
 	int no_triangles();
 
-	//! Vrt poet vech vrchol v sti.
+	//! Vrt poet uniktnch vrchol v sti.
 	/*!	
-	\return Poet vech vrchol v sti.
+	\return Poet uniktnch vrchol v sti.
 	*/
 	int no_vertices();	
 
+	//! Vrt minimln roh obalovho kvdru st.
+	/*!
+	Obalov kvdr je zarovnan s osami a spoten z vrchol st pi jejm sestaven.
+
+	\return Minimln souadnice vech vrchol st.
+	*/
+	Vector3 get_aabb_min() const;
+
+	//! Vrt maximln roh obalovho kvdru st.
+	/*!
+	\return Maximln souadnice vech vrchol st.
+	*/
+	Vector3 get_aabb_max() const;
+
 	//! Vrt ukazatel na matici transformace z loklnho do svtovho souadnho systmu.
 	/*!	
 	\return Ukazatel na matici transformace z LS do WS.
@@ -88,20 +113,35 @@ public:
 protected:
 
 private:
-	int n_{ 0 }; /*!< Poet trojhelnk v sti. */
-	Triangle * triangles_{ nullptr }; /*!< Trojhelnkov s. */
+	/* bounding box of the vertices */
+	void UpdateAabb();
+
+	std::vector<Vertex> vertices_; /*!< Uniktn vrcholy st. */
+	std::vector<Triangle3ui> triangles_; /*!< Indexy vrchol jednotlivch trojhelnk. */
+
+	const Vertex * vertex_data_{ nullptr }; // either vertices_ or the external data
+	const Triangle3ui * triangle_data_{ nullptr };
+	int no_vertices_{ 0 };
+	int no_triangles_{ 0 };
 
 	std::string name_{ "unknown" }; /*!< Nzev plochy. */
 
+	Vector3 aabb_min_; /*!< Minimln roh obalovho kvdru st. */
+	Vector3 aabb_max_; /*!< Maximln roh obalovho kvdru st. */
+
 	//Matrix4x4 transformation_; /*!< Transforman matice pro pechod z modelovho do svtovho souadnho systmu. */
 	Material * material_{ nullptr }; /*!< Materil plochy. */
+
+	Surface( const Surface & ) = delete;
+	Surface & operator=( const Surface & ) = delete;
 };
 
-/*! \fn Surface * BuildSurface( const std::string & name, std::vector<Vertex> & face_vertices )
-\brief Sestaven plochy z pole trojic vrchol.
+/*! \fn Surface * BuildSurface( const std::string & name, std::vector<Vertex> & vertices, std::vector<Triangle3ui> & triangles )
+\brief Sestaven plochy z pole uniktnch vrchol a pole index trojhelnk.
 \param name nzev plochy.
-\param face_vertices pole trojic vrchol.
+\param vertices pole uniktnch vrchol.
+\param triangles pole index trojhelnk.
 */
-Surface * BuildSurface( const std::string & name, std::vector<Vertex> & face_vertices );
+Surface * BuildSurface( const std::string & name, std::vector<Vertex> & vertices, std::vector<Triangle3ui> & triangles );
 
 #endif
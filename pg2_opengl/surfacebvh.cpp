@@ -0,0 +1,308 @@
+#include "pch.h"
+#include "surfacebvh.h"
+#include "simd.h"
+#include "mymath.h"
+#include <algorithm>
+#include <cfloat>
+
+/* Gribb-Hartmann planes (a, b, c, d) of the clip volume -w <= x, y, z <= w, a x + b y + c z + d >= 0 inside */
+static void ExtractPlanes( const Matrix4x4 & mvp, float planes[6][4] )
+{
+	for ( int i = 0; i < 6; ++i )
+	{
+		const float sign = ( ( i & 1 ) == 0 ) ? 1.0f : -1.0f;
+		for ( int j = 0; j < 4; ++j )
+		{
+			planes[i][j] = mvp.get( 3, j ) + sign * mvp.get( i >> 1, j );
+		}
+	}
+}
+
+/* the products are summed in the same order by both kernels, so their results are bit-identical */
+static void TestBoxes( const SurfaceBvh::Node & node, const float planes[6][4], int & outside, int & inside )
+{
+	outside = 0;
+	inside = 0;
+
+	for ( int i = 0; i < node.no_children; ++i )
+	{
+		bool culled = false;
+		bool contained = true;
+		for ( int p = 0; p < 6; ++p )
+		{
+			const float * plane = planes[p];
+			// the corner farthest along the normal decides the culling, the nearest one the containment
+			const int sx = ( plane[0] > 0.0f ) ? 3 : 0;
+			const int sy = ( plane[1] > 0.0f ) ? 4 : 1;
+			const int sz = ( plane[2] > 0.0f ) ? 5 : 2;
+			const float far_distance = plane[0] * node.bounds[sx][i] + plane[1] * node.bounds[sy][i] + plane[2] * node.bounds[sz][i] + plane[3];
+			const float near_distance = plane[0] * node.bounds[3 - sx][i] + plane[1] * node.bounds[5 - sy][i] + plane[2] * node.bounds[7 - sz][i] + plane[3];
+			culled = culled || ( far_distance < 0.0f );
+			contained = contained && ( near_distance >= 0.0f );
+		}
+		outside |= ( culled ) ? 1 << i : 0;
+		inside |= ( contained ) ? 1 << i : 0;
+	}
+}
+
+#ifdef SIMD_X64
+/* all BVH_WIDTH boxes at once, the empty slots are masked out by the caller */
+SIMD_TARGET_AVX2 static void TestBoxesAvx2( const SurfaceBvh::Node & node, const float planes[6][4], int & outside, int & inside )
+{
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 culled = zero;
+	__m256 contained = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+
+	for ( int p = 0; p < 6; ++p )
+	{
+		const float * plane = planes[p];
+		const int sx = ( plane[0] > 0.0f ) ? 3 : 0;
+		const int sy = ( plane[1] > 0.0f ) ? 4 : 1;
+		const int sz = ( plane[2] > 0.0f ) ? 5 : 2;
+		const __m256 a = _mm256_set1_ps( plane[0] );
+		const __m256 b = _mm256_set1_ps( plane[1] );
+		const __m256 c = _mm256_set1_ps( plane[2] );
+		const __m256 d = _mm256_set1_ps( plane[3] );
+
+		// no FMA, the fallback rounds every product
+		const __m256 far_distance = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+			_mm256_mul_ps( a, _mm256_loadu_ps( node.bounds[sx] ) ), _mm256_mul_ps( b, _mm256_loadu_ps( node.bounds[sy] ) ) ),
+			_mm256_mul_ps( c, _mm256_loadu_ps( node.bounds[sz] ) ) ), d );
+		const __m256 near_distance = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+			_mm256_mul_ps( a, _mm256_loadu_ps( node.bounds[3 - sx] ) ), _mm256_mul_ps( b, _mm256_loadu_ps( node.bounds[5 - sy] ) ) ),
+			_mm256_mul_ps( c, _mm256_loadu_ps( node.bounds[7 - sz] ) ) ), d );
+		culled = _mm256_or_ps( culled, _mm256_cmp_ps( far_distance, zero, _CMP_LT_OQ ) );
+		contained = _mm256_and_ps( contained, _mm256_cmp_ps( near_distance, zero, _CMP_GE_OQ ) );
+	}
+
+	const int valid = ( 1 << node.no_children ) - 1;
+	outside = _mm256_movemask_ps( culled ) & valid;
+	inside = _mm256_movemask_ps( contained ) & valid;
+}
+#endif
+
+/* stores the box into the given slot of the node */
+static void SetChildBox( SurfaceBvh::Node & node, const int i, const Vector3 & aabb_min, const Vector3 & aabb_max )
+{
+	node.bounds[0][i] = aabb_min.x;
+	node.bounds[1][i] = aabb_min.y;
+	node.bounds[2][i] = aabb_min.z;
+	node.bounds[3][i] = aabb_max.x;
+	node.bounds[4][i] = aabb_max.y;
+	node.bounds[5][i] = aabb_max.z;
+}
+
+void SurfaceBvh::Build( const std::vector<Surface *> & surfaces )
+{
+	std::vector<Vector3> aabb_min( surfaces.size() );
+	std::vector<Vector3> aabb_max( surfaces.size() );
+	for ( size_t i = 0; i < surfaces.size(); ++i )
+	{
+		aabb_min[i] = surfaces[i]->get_aabb_min();
+		aabb_max[i] = surfaces[i]->get_aabb_max();
+	}
+
+	Build( aabb_min.data(), aabb_max.data(), static_cast<int>( surfaces.size() ) );
+}
+
+void SurfaceBvh::Build( const Vector3 * aabb_min, const Vector3 * aabb_max, const int no_boxes )
+{
+	aabb_min_.assign( aabb_min, aabb_min + no_boxes );
+	aabb_max_.assign( aabb_max, aabb_max + no_boxes );
+	order_.resize( no_boxes );
+	for ( int i = 0; i < no_boxes; ++i )
+	{
+		order_[i] = i;
+	}
+
+	// empty slots keep zero bounds, the kernels never report them
+	blocks_.assign( ( no_boxes + BVH_WIDTH - 1 ) / BVH_WIDTH, Node{} );
+	for ( int i = 0; i < no_boxes; ++i )
+	{
+		Node & block = blocks_[i / BVH_WIDTH];
+		SetChildBox( block, block.no_children, aabb_min[i], aabb_max[i] );
+		block.child[block.no_children] = -1;
+		block.first[block.no_children] = i;
+		block.count[block.no_children] = 1;
+		++block.no_children;
+	}
+
+	nodes_.clear();
+	nodes_.reserve( blocks_.size() + 1 );
+	if ( no_boxes > 0 )
+	{
+		BuildNode( 0, no_boxes );
+	}
+	stats_ = Stats();
+}
+
+int SurfaceBvh::BuildNode( const int begin, const int end )
+{
+	int group_begin[BVH_WIDTH] = { begin };
+	int group_end[BVH_WIDTH] = { end };
+	int no_groups = 1;
+
+	// the largest group is halved until there are BVH_WIDTH of them or all of them are single surfaces
+	while ( no_groups < BVH_WIDTH )
+	{
+		int largest = -1;
+		for ( int g = 0; g < no_groups; ++g )
+		{
+			if ( ( group_end[g] - group_begin[g] > 1 ) &&
+				( ( largest < 0 ) || ( group_end[g] - group_begin[g] > group_end[largest] - group_begin[largest] ) ) )
+			{
+				largest = g;
+			}
+		}
+		if ( largest < 0 )
+		{
+			break;
+		}
+
+		// centroids are compared as sums of the corners, the halving would not change their order
+		const int b = group_begin[largest];
+		const int e = group_end[largest];
+		Vector3 centroid_min( FLT_MAX, FLT_MAX, FLT_MAX );
+		Vector3 centroid_max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		for ( int i = b; i < e; ++i )
+		{
+			const Vector3 centroid = aabb_min_[order_[i]] + aabb_max_[order_[i]];
+			centroid_min = Vector3( min( centroid_min.x, centroid.x ), min( centroid_min.y, centroid.y ), min( centroid_min.z, centroid.z ) );
+			centroid_max = Vector3( max( centroid_max.x, centroid.x ), max( centroid_max.y, centroid.y ), max( centroid_max.z, centroid.z ) );
+		}
+		const int axis = ( centroid_max - centroid_min ).LargestComponent();
+
+		const int middle = ( b + e ) / 2;
+		std::nth_element( order_.begin() + b, order_.begin() + middle, order_.begin() + e, [this, axis]( const int i, const int j ) {
+			return aabb_min_[i].data[axis] + aabb_max_[i].data[axis] < aabb_min_[j].data[axis] + aabb_max_[j].data[axis]; } );
+
+		group_end[largest] = middle;
+		group_begin[no_groups] = middle;
+		group_end[no_groups] = e;
+		++no_groups;
+	}
+
+	const int index = static_cast<int>( nodes_.size() );
+	nodes_.push_back( Node{} );
+	for ( int g = 0; g < no_groups; ++g )
+	{
+		Vector3 aabb_min( FLT_MAX, FLT_MAX, FLT_MAX );
+		Vector3 aabb_max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		for ( int i = group_begin[g]; i < group_end[g]; ++i )
+		{
+			const Vector3 & box_min = aabb_min_[order_[i]];
+			const Vector3 & box_max = aabb_max_[order_[i]];
+			aabb_min = Vector3( min( aabb_min.x, box_min.x ), min( aabb_min.y, box_min.y ), min( aabb_min.z, box_min.z ) );
+			aabb_max = Vector3( max( aabb_max.x, box_max.x ), max( aabb_max.y, box_max.y ), max( aabb_max.z, box_max.z ) );
+		}
+
+		// the recursion may reallocate the nodes
+		const int child = ( group_end[g] - group_begin[g] > 1 ) ? BuildNode( group_begin[g], group_end[g] ) : -1;
+		Node & node = nodes_[index];
+		SetChildBox( node, g, aabb_min, aabb_max );
+		node.child[g] = child;
+		node.first[g] = group_begin[g];
+		node.count[g] = group_end[g] - group_begin[g];
+	}
+	nodes_[index].no_children = no_groups;
+
+	return index;
+}
+
+void SurfaceBvh::TestNode( const Node & node, const float planes[6][4], const bool avx2, int & outside, int & inside ) const
+{
+#ifdef SIMD_X64
+	if ( avx2 )
+	{
+		TestBoxesAvx2( node, planes, outside, inside );
+		return;
+	}
+#endif
+	TestBoxes( node, planes, outside, inside );
+}
+
+void SurfaceBvh::Cull( const Matrix4x4 & mvp, std::vector<int> & visible )
+{
+	visible.clear();
+	stats_ = Stats();
+	if ( nodes_.empty() )
+	{
+		return;
+	}
+
+	float planes[6][4];
+	ExtractPlanes( mvp, planes );
+	const bool avx2 = CpuHasAvx2();
+
+	stack_.assign( 1, 0 );
+	while ( !stack_.empty() )
+	{
+		const Node & node = nodes_[stack_.back()];
+		stack_.pop_back();
+
+		int outside = 0;
+		int inside = 0;
+		TestNode( node, planes, avx2, outside, inside );
+		++stats_.no_nodes;
+		stats_.no_boxes += node.no_children;
+
+		for ( int i = 0; i < node.no_children; ++i )
+		{
+			if ( outside & ( 1 << i ) )
+			{
+				continue;
+			}
+			if ( ( node.child[i] < 0 ) || ( inside & ( 1 << i ) ) )
+			{
+				// every box of the subtree lies within the one of the child
+				visible.insert( visible.end(), order_.begin() + node.first[i], order_.begin() + node.first[i] + node.count[i] );
+			}
+			else
+			{
+				stack_.push_back( node.child[i] );
+			}
+		}
+	}
+}
+
+void SurfaceBvh::CullAll( const Matrix4x4 & mvp, std::vector<int> & visible )
+{
+	visible.clear();
+	stats_ = Stats();
+
+	float planes[6][4];
+	ExtractPlanes( mvp, planes );
+	const bool avx2 = CpuHasAvx2();
+
+	for ( const Node & block : blocks_ )
+	{
+		int outside = 0;
+		int inside = 0;
+		TestNode( block, planes, avx2, outside, inside );
+		++stats_.no_nodes;
+		stats_.no_boxes += block.no_children;
+
+		for ( int i = 0; i < block.no_children; ++i )
+		{
+			if ( !( outside & ( 1 << i ) ) )
+			{
+				visible.push_back( block.first[i] );
+			}
+		}
+	}
+}
+
+SurfaceBvh::Stats SurfaceBvh::stats() const
+{
+	return stats_;
+}
+
+int SurfaceBvh::no_nodes() const
+{
+	return static_cast<int>( nodes_.size() );
+}
+
+int SurfaceBvh::no_boxes() const
+{
+	return static_cast<int>( order_.size() );
+}
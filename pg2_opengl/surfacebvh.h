@@ -0,0 +1,76 @@
+#ifndef SURFACE_BVH_H_
+#define SURFACE_BVH_H_
+
+#include "surface.h"
+#include "matrix4x4.h"
+
+/*! \def BVH_WIDTH
+\brief Number of children of a node of SurfaceBvh, their bounds along one axis fill one AVX2 register.
+*/
+#define BVH_WIDTH 8
+
+/*! \class SurfaceBvh
+\brief Bounding volume hierarchy over the bounds of the surfaces culled by the view frustum on the CPU.
+
+Each node holds the boxes of up to BVH_WIDTH children in the SoA layout, the AVX2 kernel thus tests all of them against
+one plane by a handful of vector instructions. The tree is built top-down once the scene is loaded, the surfaces of a
+node are split at the median of their centroids along the longest extent until the node has BVH_WIDTH groups, a group
+of a single surface is a leaf. The surfaces of every subtree are contiguous in the order of the tree, a child found
+entirely inside the frustum emits all of them without visiting its subtree.
+
+The six planes are extracted from the MVP the same way as in culling.comp and a box is culled if its corner farthest
+along the normal lies behind any of them. The result is exactly the one of testing every box on its own, the scalar
+fallback of CPUs without AVX2 gives the same one.
+*/
+class SurfaceBvh
+{
+public:
+	/* counters of the last Cull */
+	struct Stats
+	{
+		int no_nodes; // visited
+		int no_boxes; // tested against the planes
+	};
+
+	/* builds the tree over the bounds of the surfaces, Cull returns indices to this array */
+	void Build( const std::vector<Surface *> & surfaces );
+	void Build( const Vector3 * aabb_min, const Vector3 * aabb_max, const int no_boxes );
+
+	/* replaces the content of visible by the indices of the surfaces whose boxes are at least partially inside the
+	frustum of the MVP, they come in the order of the tree */
+	void Cull( const Matrix4x4 & mvp, std::vector<int> & visible );
+
+	/* the same test of all boxes in blocks of BVH_WIDTH without the hierarchy, the indices come in ascending order */
+	void CullAll( const Matrix4x4 & mvp, std::vector<int> & visible );
+
+	Stats stats() const;
+	int no_nodes() const;
+	int no_boxes() const;
+
+	/* children of a node in the SoA layout */
+	struct Node
+	{
+		float bounds[6][BVH_WIDTH]; // min x, y, z and max x, y, z of the boxes of the children
+		int child[BVH_WIDTH]; // index of the child node, -1 for a single surface
+		int first[BVH_WIDTH]; // surfaces of the subtree in order_
+		int count[BVH_WIDTH];
+		int no_children;
+	};
+
+private:
+	/* splits the surfaces order_[begin, end) among the children of a new node, returns its index */
+	int BuildNode( const int begin, const int end );
+
+	/* bit masks of the children culled by any plane and of the children inside all of them */
+	void TestNode( const Node & node, const float planes[6][4], const bool avx2, int & outside, int & inside ) const;
+
+	std::vector<Node> nodes_; // the root is the first one
+	std::vector<Node> blocks_; // all boxes by BVH_WIDTH in the original order, see CullAll
+	std::vector<int> order_; // indices of the surfaces in the order of the tree
+	std::vector<Vector3> aabb_min_;
+	std::vector<Vector3> aabb_max_;
+	std::vector<int> stack_; // nodes left to visit by Cull
+	Stats stats_{};
+};
+
+#endif
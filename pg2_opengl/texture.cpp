@@ -1,9 +1,20 @@
 #include "pch.h"
 #include "texture.h"
 #include "mymath.h"
+#include "simd.h"
+#include "texturebaker.h"
+#include "pixelformat.h"
+#include <climits>
+
+/*! \def MAX_SAMPLED_LEVELS
+\brief Maximal number of mip levels sampled by the trilinear filter (enough for 32768 x 32768 px).
+*/
+#define MAX_SAMPLED_LEVELS 16
 
 Texture::Texture( const char * file_name )
 {
+	file_name_ = std::string( file_name );
+
 	// image format
 	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
 	// pointer to the image, once loaded
@@ -61,12 +72,32 @@ Texture::Texture( const char * file_name )
 	}
 }
 
+Texture::Texture( const char * file_name, const int width, const int height, const int pixel_size, const int scan_width,
+	const BYTE * const * mips, const int no_mips )
+{
+	file_name_ = std::string( file_name );
+
+	width_ = width;
+	height_ = height;
+	pixel_size_ = pixel_size;
+	scan_width_ = scan_width;
+
+	// the data are read-only, nothing in Texture writes to data_ after the construction
+	data_ = const_cast<BYTE *>( mips[0] );
+	owns_data_ = false;
+
+	mips_.assign( mips + 1, mips + no_mips );
+}
+
 Texture::~Texture()
 {	
 	if ( data_ )
 	{
 		// free FreeImage's copy of the data
-		delete[] data_;
+		if ( owns_data_ )
+		{
+			delete[] data_;
+		}
 		data_ = nullptr;
 		
 		width_ = 0;
@@ -131,6 +162,282 @@ Color3f Texture::texel( const float u, const float v, const bool linearize ) con
 	}
 }
 
+/* normalized values of all 256 bytes, the linearized ones are in SrgbToLinearTable */
+static const float * UnormTable()
+{
+	static const std::vector<float> table = []()
+	{
+		std::vector<float> t( 256 );
+		for ( int i = 0; i < 256; ++i )
+		{
+			t[i] = i / 255.0f;
+		}
+		return t;
+	}();
+
+	return table.data();
+}
+
+/* geometry of the mip levels sampled by Texture::texels, offsets are relative to the base level */
+struct SampledLevels
+{
+	int no_levels;
+	long long offsets[MAX_SAMPLED_LEVELS];
+	int widths[MAX_SAMPLED_LEVELS];
+	int heights[MAX_SAMPLED_LEVELS];
+	int scan_widths[MAX_SAMPLED_LEVELS];
+};
+
+/* bilinear (or nearest) sample of the single level, texels are converted by the table before the interpolation */
+static void SampleLevel( const BYTE * data, const int width, const int height, const int scan_width, const int pixel_size,
+	const float u, const float v, const bool nearest, const float * table, float rgb[3] )
+{
+	const float x = u * width;
+	const float y = v * height;
+
+	const int x0 = max( 0, min( width - 1, int( x ) ) );
+	const int y0 = max( 0, min( height - 1, int( y ) ) );
+
+	if ( nearest )
+	{
+		const BYTE * p = &data[y0 * scan_width + x0 * pixel_size];
+		for ( int c = 0; c < 3; ++c )
+		{
+			rgb[c] = table[p[2 - c]];
+		}
+
+		return;
+	}
+
+	const int x1 = min( width - 1, x0 + 1 );
+	const int y1 = min( height - 1, y0 + 1 );
+
+	const float kx = min( 1.0f, max( 0.0f, x - x0 ) );
+	const float ky = min( 1.0f, max( 0.0f, y - y0 ) );
+
+	const BYTE * p1 = &data[y0 * scan_width + x0 * pixel_size];
+	const BYTE * p2 = &data[y0 * scan_width + x1 * pixel_size];
+	const BYTE * p3 = &data[y1 * scan_width + x0 * pixel_size];
+	const BYTE * p4 = &data[y1 * scan_width + x1 * pixel_size];
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		const float top = table[p1[2 - c]] + kx * ( table[p2[2 - c]] - table[p1[2 - c]] );
+		const float bottom = table[p3[2 - c]] + kx * ( table[p4[2 - c]] - table[p3[2 - c]] );
+		rgb[c] = top + ky * ( bottom - top );
+	}
+}
+
+static void SampleScalar( const BYTE * data, const SampledLevels & levels, const int pixel_size, const float u, const float v,
+	const float lod, const TextureFilter filter, const float * table, float rgb[3] )
+{
+	if ( filter != TextureFilter::TRILINEAR )
+	{
+		SampleLevel( data, levels.widths[0], levels.heights[0], levels.scan_widths[0], pixel_size, u, v,
+			filter == TextureFilter::NEAREST, table, rgb );
+
+		return;
+	}
+
+	const float level = min( static_cast<float>( levels.no_levels - 1 ), max( 0.0f, lod ) );
+	const int l0 = int( level );
+	const int l1 = min( levels.no_levels - 1, l0 + 1 );
+	const float t = level - l0;
+
+	float rgb0[3], rgb1[3];
+	SampleLevel( data + levels.offsets[l0], levels.widths[l0], levels.heights[l0], levels.scan_widths[l0], pixel_size,
+		u, v, false, table, rgb0 );
+	SampleLevel( data + levels.offsets[l1], levels.widths[l1], levels.heights[l1], levels.scan_widths[l1], pixel_size,
+		u, v, false, table, rgb1 );
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		rgb[c] = rgb0[c] + t * ( rgb1[c] - rgb0[c] );
+	}
+}
+
+#ifdef SIMD_X64
+/* 8 pixels at the given byte offsets as B | G << 8 | R << 16, 3 B pixels except the first ones in a row are read
+together with the preceding byte so the gather never reads past the end of the image */
+SIMD_TARGET_AVX2 static inline __m256i Fetch8( const BYTE * data, const __m256i offsets, const __m256i x, const int pixel_size )
+{
+	if ( pixel_size == 4 )
+	{
+		return _mm256_i32gather_epi32( reinterpret_cast<const int *>( data ), offsets, 1 );
+	}
+
+	const __m256i preceding = _mm256_cmpgt_epi32( x, _mm256_setzero_si256() ); // -1 where x > 0
+	const __m256i pixels = _mm256_i32gather_epi32( reinterpret_cast<const int *>( data ), _mm256_add_epi32( offsets, preceding ), 1 );
+
+	return _mm256_srlv_epi32( pixels, _mm256_and_si256( preceding, _mm256_set1_epi32( 8 ) ) );
+}
+
+SIMD_TARGET_AVX2 static inline void Convert8( const __m256i pixels, const float * table, __m256 rgb[3] )
+{
+	const __m256i mask = _mm256_set1_epi32( 0xff );
+
+	rgb[0] = _mm256_i32gather_ps( table, _mm256_and_si256( _mm256_srli_epi32( pixels, 16 ), mask ), 4 );
+	rgb[1] = _mm256_i32gather_ps( table, _mm256_and_si256( _mm256_srli_epi32( pixels, 8 ), mask ), 4 );
+	rgb[2] = _mm256_i32gather_ps( table, _mm256_and_si256( pixels, mask ), 4 );
+}
+
+/* 8 bilinear (or nearest) samples, every lane may sample a different level given by its offset and size */
+SIMD_TARGET_AVX2 static inline void SampleLevel8( const BYTE * data, const __m256i offset, const __m256i width, const __m256i height,
+	const __m256i scan_width, const int pixel_size, const __m256 u, const __m256 v, const bool nearest, const float * table,
+	__m256 rgb[3] )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32( 1 );
+	const __m256i max_x = _mm256_sub_epi32( width, one );
+	const __m256i max_y = _mm256_sub_epi32( height, one );
+
+	const __m256 x = _mm256_mul_ps( u, _mm256_cvtepi32_ps( width ) );
+	const __m256 y = _mm256_mul_ps( v, _mm256_cvtepi32_ps( height ) );
+
+	// truncation towards zero like int() in the scalar path
+	const __m256i x0 = _mm256_max_epi32( zero, _mm256_min_epi32( max_x, _mm256_cvttps_epi32( x ) ) );
+	const __m256i y0 = _mm256_max_epi32( zero, _mm256_min_epi32( max_y, _mm256_cvttps_epi32( y ) ) );
+
+	const __m256i bytes_x0 = _mm256_mullo_epi32( x0, _mm256_set1_epi32( pixel_size ) );
+	const __m256i row0 = _mm256_add_epi32( offset, _mm256_mullo_epi32( y0, scan_width ) );
+
+	if ( nearest )
+	{
+		Convert8( Fetch8( data, _mm256_add_epi32( row0, bytes_x0 ), x0, pixel_size ), table, rgb );
+
+		return;
+	}
+
+	const __m256i x1 = _mm256_min_epi32( max_x, _mm256_add_epi32( x0, one ) );
+	const __m256i y1 = _mm256_min_epi32( max_y, _mm256_add_epi32( y0, one ) );
+	const __m256i bytes_x1 = _mm256_mullo_epi32( x1, _mm256_set1_epi32( pixel_size ) );
+	const __m256i row1 = _mm256_add_epi32( offset, _mm256_mullo_epi32( y1, scan_width ) );
+
+	const __m256 zero_ps = _mm256_setzero_ps();
+	const __m256 one_ps = _mm256_set1_ps( 1.0f );
+	const __m256 kx = _mm256_min_ps( one_ps, _mm256_max_ps( zero_ps, _mm256_sub_ps( x, _mm256_cvtepi32_ps( x0 ) ) ) );
+	const __m256 ky = _mm256_min_ps( one_ps, _mm256_max_ps( zero_ps, _mm256_sub_ps( y, _mm256_cvtepi32_ps( y0 ) ) ) );
+
+	__m256 p1[3], p2[3], p3[3], p4[3];
+	Convert8( Fetch8( data, _mm256_add_epi32( row0, bytes_x0 ), x0, pixel_size ), table, p1 );
+	Convert8( Fetch8( data, _mm256_add_epi32( row0, bytes_x1 ), x1, pixel_size ), table, p2 );
+	Convert8( Fetch8( data, _mm256_add_epi32( row1, bytes_x0 ), x0, pixel_size ), table, p3 );
+	Convert8( Fetch8( data, _mm256_add_epi32( row1, bytes_x1 ), x1, pixel_size ), table, p4 );
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		const __m256 top = _mm256_fmadd_ps( kx, _mm256_sub_ps( p2[c], p1[c] ), p1[c] );
+		const __m256 bottom = _mm256_fmadd_ps( kx, _mm256_sub_ps( p4[c], p3[c] ), p3[c] );
+		rgb[c] = _mm256_fmadd_ps( ky, _mm256_sub_ps( bottom, top ), top );
+	}
+}
+
+/* samples the groups of 8 texels, returns the number of processed samples */
+SIMD_TARGET_AVX2 static int SampleAvx2( const BYTE * data, const SampledLevels & levels, const int pixel_size,
+	const float * u, const float * v, const float * lods, const int count, const TextureFilter filter, const float * table,
+	float * r, float * g, float * b )
+{
+	int offsets[MAX_SAMPLED_LEVELS];
+	for ( int level = 0; level < levels.no_levels; ++level )
+	{
+		offsets[level] = static_cast<int>( levels.offsets[level] );
+	}
+
+	int i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		const __m256 vu = _mm256_loadu_ps( u + i );
+		const __m256 vv = _mm256_loadu_ps( v + i );
+		__m256 rgb[3];
+
+		if ( ( filter != TextureFilter::TRILINEAR ) || ( levels.no_levels == 1 ) )
+		{
+			SampleLevel8( data, _mm256_set1_epi32( offsets[0] ), _mm256_set1_epi32( levels.widths[0] ),
+				_mm256_set1_epi32( levels.heights[0] ), _mm256_set1_epi32( levels.scan_widths[0] ), pixel_size, vu, vv,
+				filter == TextureFilter::NEAREST, table, rgb );
+		}
+		else
+		{
+			// geometry of both levels of every lane is gathered from the level tables
+			const __m256 max_level = _mm256_set1_ps( static_cast<float>( levels.no_levels - 1 ) );
+			const __m256 level = _mm256_min_ps( max_level, _mm256_max_ps( _mm256_setzero_ps(),
+				( lods ) ? _mm256_loadu_ps( lods + i ) : _mm256_setzero_ps() ) );
+			const __m256i l0 = _mm256_cvttps_epi32( level );
+			const __m256i l1 = _mm256_min_epi32( _mm256_set1_epi32( levels.no_levels - 1 ), _mm256_add_epi32( l0, _mm256_set1_epi32( 1 ) ) );
+			const __m256 t = _mm256_sub_ps( level, _mm256_cvtepi32_ps( l0 ) );
+
+			__m256 rgb0[3], rgb1[3];
+			SampleLevel8( data, _mm256_i32gather_epi32( offsets, l0, 4 ), _mm256_i32gather_epi32( levels.widths, l0, 4 ),
+				_mm256_i32gather_epi32( levels.heights, l0, 4 ), _mm256_i32gather_epi32( levels.scan_widths, l0, 4 ),
+				pixel_size, vu, vv, false, table, rgb0 );
+			SampleLevel8( data, _mm256_i32gather_epi32( offsets, l1, 4 ), _mm256_i32gather_epi32( levels.widths, l1, 4 ),
+				_mm256_i32gather_epi32( levels.heights, l1, 4 ), _mm256_i32gather_epi32( levels.scan_widths, l1, 4 ),
+				pixel_size, vu, vv, false, table, rgb1 );
+
+			for ( int c = 0; c < 3; ++c )
+			{
+				rgb[c] = _mm256_fmadd_ps( t, _mm256_sub_ps( rgb1[c], rgb0[c] ), rgb0[c] );
+			}
+		}
+
+		_mm256_storeu_ps( r + i, rgb[0] );
+		_mm256_storeu_ps( g + i, rgb[1] );
+		_mm256_storeu_ps( b + i, rgb[2] );
+	}
+
+	return i;
+}
+#endif
+
+void Texture::texels( const float * u, const float * v, const float * lods, const int count, const TextureFilter filter,
+	const bool linearize, float * r, float * g, float * b ) const
+{
+	if ( ( pixel_size_ != 3 ) && ( pixel_size_ != 4 ) )
+	{
+		for ( int i = 0; i < count; ++i )
+		{
+			const Color3f color = texel( u[i], v[i], linearize );
+			r[i] = color.r;
+			g[i] = color.g;
+			b[i] = color.b;
+		}
+
+		return;
+	}
+
+	const float * table = ( linearize ) ? SrgbToLinearTable() : UnormTable();
+
+	SampledLevels levels;
+	levels.no_levels = ( filter == TextureFilter::TRILINEAR ) ? min( no_mips(), MAX_SAMPLED_LEVELS ) : 1;
+	bool fits_int = true; // the gathers address all levels by 32-bit offsets from the base level
+	for ( int level = 0; level < levels.no_levels; ++level )
+	{
+		levels.widths[level] = max( 1, width_ >> level );
+		levels.heights[level] = max( 1, height_ >> level );
+		levels.scan_widths[level] = mip_scan_width( level );
+		levels.offsets[level] = static_cast<long long>( mip_data( level ) - data_ );
+		fits_int &= ( levels.offsets[level] >= INT_MIN ) && ( levels.offsets[level] + levels.scan_widths[level] *
+			static_cast<long long>( levels.heights[level] ) <= INT_MAX );
+	}
+
+	int i = 0;
+#ifdef SIMD_X64
+	if ( CpuHasAvx2() && fits_int )
+	{
+		i = SampleAvx2( data_, levels, pixel_size_, u, v, lods, count, filter, table, r, g, b );
+	}
+#endif
+
+	for ( ; i < count; ++i )
+	{
+		float rgb[3];
+		SampleScalar( data_, levels, pixel_size_, u[i], v[i], ( lods ) ? lods[i] : 0.0f, filter, table, rgb );
+		r[i] = rgb[0];
+		g[i] = rgb[1];
+		b[i] = rgb[2];
+	}
+}
+
 BYTE * Texture::data() const {
 	return data_;
 }
@@ -145,6 +452,89 @@ int Texture::height() const
 	return height_;
 }
 
+int Texture::pixel_size() const
+{
+	return pixel_size_;
+}
+
+int Texture::scan_width() const
+{
+	return scan_width_;
+}
+
+std::string Texture::file_name() const
+{
+	return file_name_;
+}
+
+int Texture::GenerateMips()
+{
+	if ( !data_ || !owns_data_ || ( no_mips() > 1 ) || ( pixel_size_ > 4 ) )
+	{
+		return no_mips();
+	}
+
+	// rows of the smaller levels are 4 B aligned like the mip levels of the scene cache
+	std::vector<size_t> offsets( 1, 0 );
+	size_t size = static_cast<size_t>( scan_width_ ) * height_;
+	for ( int level = 1; ( ( width_ >> ( level - 1 ) ) > 1 ) || ( ( height_ >> ( level - 1 ) ) > 1 ); ++level )
+	{
+		offsets.push_back( size );
+		size += static_cast<size_t>( mip_scan_width( level ) ) * max( 1, height_ >> level );
+	}
+
+	// all levels share one allocation so the batched sampler addresses them relative to the base level
+	BYTE * data = new BYTE[size];
+	memcpy( data, data_, static_cast<size_t>( scan_width_ ) * height_ );
+	delete[] data_;
+	data_ = data;
+
+	for ( size_t level = 1; level < offsets.size(); ++level )
+	{
+		const int src_width = max( 1, width_ >> ( level - 1 ) );
+		const int src_height = max( 1, height_ >> ( level - 1 ) );
+		const int dst_width = max( 1, width_ >> level );
+		const int dst_height = max( 1, height_ >> level );
+
+		DownsampleSrgb( data_ + offsets[level - 1], src_width, src_height, mip_scan_width( static_cast<int>( level ) - 1 ),
+			data_ + offsets[level], dst_width, dst_height, mip_scan_width( static_cast<int>( level ) ), pixel_size_ );
+		mips_.push_back( data_ + offsets[level] );
+	}
+
+	return no_mips();
+}
+
+int Texture::no_mips() const
+{
+	return 1 + static_cast<int>( mips_.size() );
+}
+
+const BYTE * Texture::mip_data( const int level ) const
+{
+	return ( level == 0 ) ? data_ : mips_[level - 1];
+}
+
+int Texture::mip_scan_width( const int level ) const
+{
+	return ( level == 0 ) ? scan_width_ : ( ( max( 1, width_ >> level ) * pixel_size_ + 3 ) / 4 ) * 4;
+}
+
+void Texture::set_block_mips( const BlockFormat format, const BYTE * const * mips )
+{
+	block_format_ = format;
+	block_mips_.assign( mips, mips + ( ( format != BlockFormat::NONE ) ? no_mips() : 0 ) );
+}
+
+BlockFormat Texture::block_format() const
+{
+	return block_format_;
+}
+
+const BYTE * Texture::block_mip_data( const int level ) const
+{
+	return block_mips_[level];
+}
+
 void Texture::CopyTo( BYTE * data, const int pixel_size )
 {
 	if ( pixel_size == pixel_size_ )
@@ -153,17 +543,92 @@ void Texture::CopyTo( BYTE * data, const int pixel_size )
 	}
 	else
 	{
+		// the channels keep their order, 3 -> 4 B pixels get opaque alpha and 4 -> 3 B pixels lose it
 		for ( int y = 0; y < height_; ++y )
 		{
-			for ( int x = 0; x < width_; ++x )
+			const BYTE * src = &data_[y * scan_width_];
+			BYTE * dst = &data[y * pixel_size * width_];
+
+			if ( ( pixel_size_ == 3 ) && ( pixel_size == 4 ) )
 			{
-				for ( int c = 0; c < min( pixel_size, pixel_size_ ); c++ )
+				ConvertRGB8ToRGBA8( src, dst, width_ );
+			}
+			else if ( ( pixel_size_ == 4 ) && ( pixel_size == 3 ) )
+			{
+				ConvertRGBA8ToRGB8( src, dst, width_ );
+			}
+			else
+			{
+				for ( int x = 0; x < width_; ++x )
 				{
-					data[y * pixel_size * width_ + x * pixel_size + c] = data_[y * scan_width_ + x * pixel_size_ + c];
+					for ( int c = 0; c < min( pixel_size, pixel_size_ ); c++ )
+					{
+						dst[x * pixel_size + c] = src[x * pixel_size_ + c];
+					}
 				}
 			}
 		}
 	}
 }
 
+/* converts a run of pixels of the given size to RGBA8 */
+static void ConvertRunToRGBA8( const BYTE * src, BYTE * dst, const int count, const int pixel_size )
+{
+	if ( pixel_size == 3 )
+	{
+		ConvertBGR8ToRGBA8( src, dst, count );
+	}
+	else if ( pixel_size == 4 )
+	{
+		SwapRedBlue8( src, dst, count );
+	}
+	else
+	{
+		// gray and anything else is read as gray or BGR
+		for ( int x = 0; x < count; ++x, src += pixel_size, dst += 4 )
+		{
+			dst[0] = ( pixel_size >= 3 ) ? src[2] : src[0];
+			dst[1] = ( pixel_size >= 3 ) ? src[1] : src[0];
+			dst[2] = src[0];
+			dst[3] = 255;
+		}
+	}
+}
+
+void Texture::CopyToRGBA8( BYTE * rgba, const int level ) const
+{
+	const int width = max( 1, width_ >> level );
+	const int height = max( 1, height_ >> level );
+	const int scan_width = mip_scan_width( level );
+	const BYTE * data = mip_data( level );
+
+	for ( int y = 0; y < height; ++y )
+	{
+		ConvertRunToRGBA8( data + y * scan_width, rgba + static_cast<size_t>( y ) * width * 4, width, pixel_size_ );
+	}
+}
+
+void Texture::CopyRegionToRGBA8( BYTE * rgba, const int level, const int x0, const int y0, const int width, const int height ) const
+{
+	const int level_width = max( 1, width_ >> level );
+	const int level_height = max( 1, height_ >> level );
+	const int scan_width = mip_scan_width( level );
+	const BYTE * data = mip_data( level );
+
+	for ( int y = 0; y < height; ++y )
+	{
+		const BYTE * src = data + ( ( ( y0 + y ) % level_height + level_height ) % level_height ) * scan_width;
+		BYTE * dst = rgba + static_cast<size_t>( y ) * width * 4;
+
+		// the row is split into runs which do not cross the edge of the level
+		for ( int x = 0; x < width; )
+		{
+			const int sx = ( ( x0 + x ) % level_width + level_width ) % level_width;
+			const int count = min( width - x, level_width - sx );
+			ConvertRunToRGBA8( src + sx * pixel_size_, dst + x * 4, count, pixel_size_ );
+			x += count;
+		}
+	}
+}
+
 
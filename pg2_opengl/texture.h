@@ -4,6 +4,12 @@
 #include "freeimage.h"
 #include "structs.h"
 
+/* block compressed formats of the baked mip chains, the values are the BCn numbers (see texturebaker.h) */
+enum class BlockFormat : char { NONE = 0, BC1 = 1, BC3 = 3, BC7 = 7 };
+
+/* filters of the batched sampling, trilinear blends the bilinear samples of two adjacent mip levels */
+enum class TextureFilter : char { NEAREST = 1, BILINEAR = 2, TRILINEAR = 3 };
+
 /*! \class Texture
 \brief Single texture stored in original byte format (srgb is expected).
 
@@ -15,24 +21,73 @@ class Texture
 {
 public:
 	Texture( const char * file_name );
+
+	/* texture over external pixel data (e.g. memory mapped scene cache), the data are neither copied nor released */
+	Texture( const char * file_name, const int width, const int height, const int pixel_size, const int scan_width,
+		const BYTE * const * mips, const int no_mips );
+
 	~Texture();
 
 	/* returns interpolated texel in linear format */
 	Color3f texel( const float u, const float v, const bool linearize ) const;
 
+	/* samples count texels at once and writes their colors into the separate r, g and b arrays, lods are the mip levels
+	of the trilinear filter (NULL means the base level), the texels are linearized before they are interpolated unlike
+	in texel(), 8 samples are processed at once with AVX2 gathers, only 3 and 4 B pixels are vectorized */
+	void texels( const float * u, const float * v, const float * lods, const int count, const TextureFilter filter,
+		const bool linearize, float * r, float * g, float * b ) const;
+
 	int width() const;
 	int height() const;
 
+	int pixel_size() const;
+	int scan_width() const;
+
 	BYTE * data() const;
 	void CopyTo( BYTE * data, const int pixel_size = 3);
+	/* converts the given mip level to tightly packed RGBA8 pixels, gray is replicated and missing alpha is opaque */
+	void CopyToRGBA8( BYTE * rgba, const int level = 0 ) const;
+	/* converts the width x height px region of the mip level starting at x0, y0 to tightly packed RGBA8 pixels, the
+	coordinates wrap around the edges of the level like GL_REPEAT */
+	void CopyRegionToRGBA8( BYTE * rgba, const int level, const int x0, const int y0, const int width, const int height ) const;
+
+	/* full path of the source image file */
+	std::string file_name() const;
+
+	/* number of available mip levels including the base level */
+	int no_mips() const;
+	/* data of the given mip level, level 0 is the same as data() */
+	const BYTE * mip_data( const int level ) const;
+
+	/* builds the sRGB correct mip chain of the decoded texture in the same allocation as the base level, returns the
+	number of mip levels */
+	int GenerateMips();
+
+	/* attaches the block compressed mip chain with no_mips() levels, the data are neither copied nor released */
+	void set_block_mips( const BlockFormat format, const BYTE * const * mips );
+	/* format of the attached block compressed mip chain, NONE if there is none */
+	BlockFormat block_format() const;
+	/* blocks of the given compressed mip level */
+	const BYTE * block_mip_data( const int level ) const;
 
 private:	
+	/* size of the row of the given mip level (bytes), rows of the smaller levels are 4 B aligned */
+	int mip_scan_width( const int level ) const;
+
 	int width_{ 0 }; // image width (px)
 	int height_{ 0 }; // image height (px)
 	int scan_width_{ 0 }; // size of image row (bytes)
 	int pixel_size_{ 0 }; // size of each pixel (bytes)
 
 	BYTE * data_{ nullptr }; // image data in BGR format
+	bool owns_data_{ true }; // data_ has been allocated by this texture
+
+	std::vector<const BYTE *> mips_; // optional mip levels 1, 2, ... stored next to data_ (rows are 4 B aligned)
+
+	BlockFormat block_format_{ BlockFormat::NONE }; // format of block_mips_
+	std::vector<const BYTE *> block_mips_; // optional block compressed levels 0, 1, ... baked offline
+
+	std::string file_name_; // path of the source image
 
 	Texture( const Texture & ) = delete;
 	Texture & operator=( const Texture & ) = delete;
@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "texturearrays.h"
+#include "texturebaker.h"
+#include "pixelformat.h"
+#include "mymath.h"
+#include <algorithm>
+
+bool TextureArrays::Bucket::operator<( const Bucket & bucket ) const
+{
+	if ( width != bucket.width ) return width < bucket.width;
+	if ( height != bucket.height ) return height < bucket.height;
+	if ( no_levels != bucket.no_levels ) return no_levels < bucket.no_levels;
+
+	return format < bucket.format;
+}
+
+bool TextureArrays::Bucket::operator==( const Bucket & bucket ) const
+{
+	return ( width == bucket.width ) && ( height == bucket.height ) && ( no_levels == bucket.no_levels ) &&
+		( format == bucket.format );
+}
+
+/* resamples the texture to the given level of the width x height px RGBA8 image by the trilinear filter */
+static void ResampleToRGBA8( const Texture * texture, const int width, const int height, const int level, BYTE * rgba )
+{
+	const int level_width = max( 1, width >> level );
+	const int level_height = max( 1, height >> level );
+	// the same footprint as the hardware filter of the minified texture
+	const float lod = max( 0.0f, log2f( max( texture->width() / float( level_width ), texture->height() / float( level_height ) ) ) );
+
+	std::vector<float> u( level_width ), v( level_width ), lods( level_width, lod );
+	std::vector<float> r( level_width ), g( level_width ), b( level_width );
+	for ( int y = 0; y < level_height; ++y )
+	{
+		for ( int x = 0; x < level_width; ++x )
+		{
+			u[x] = ( x + 0.5f ) / level_width;
+			v[x] = ( y + 0.5f ) / level_height;
+		}
+		texture->texels( u.data(), v.data(), lods.data(), level_width, TextureFilter::TRILINEAR, true, r.data(), g.data(), b.data() );
+
+		BYTE * row = rgba + static_cast<size_t>( y ) * level_width * 4;
+		for ( int x = 0; x < level_width; ++x )
+		{
+			row[x * 4 + 0] = LinearToSrgb8( r[x] );
+			row[x * 4 + 1] = LinearToSrgb8( g[x] );
+			row[x * 4 + 2] = LinearToSrgb8( b[x] );
+			row[x * 4 + 3] = 255;
+		}
+	}
+}
+
+TextureArrays::TextureArrays()
+{
+}
+
+TextureArrays::~TextureArrays()
+{
+}
+
+TextureArrays::Bucket TextureArrays::TextureBucket( const Texture * texture, const int first_level )
+{
+	Bucket bucket;
+	bucket.width = max( 1, texture->width() >> first_level );
+	bucket.height = max( 1, texture->height() >> first_level );
+	bucket.no_levels = texture->no_mips() - first_level;
+	bucket.format = texture->block_format();
+
+	return bucket;
+}
+
+int TextureArrays::Add( Texture * texture )
+{
+	// all layers of an array share the number of levels, the full chain is the common one
+	texture->GenerateMips();
+
+	Entry entry;
+	entry.texture = texture;
+	entries_.push_back( entry );
+
+	return static_cast<int>( entries_.size() ) - 1;
+}
+
+int TextureArrays::Build()
+{
+	Release();
+
+	// the most populated buckets get their arrays, larger textures first among the equally populated ones
+	std::map<Bucket, int> counts;
+	for ( const Entry & entry : entries_ )
+	{
+		++counts[TextureBucket( entry.texture, 0 )];
+	}
+	std::vector<std::pair<Bucket, int>> buckets( counts.begin(), counts.end() );
+	std::stable_sort( buckets.begin(), buckets.end(), []( const std::pair<Bucket, int> & a, const std::pair<Bucket, int> & b )
+	{
+		if ( a.second != b.second ) return a.second > b.second;
+		return a.first.width * a.first.height > b.first.width * b.first.height;
+	} );
+	// the last unit is left for the overflow array if there are more buckets than units
+	const size_t no_buckets = ( buckets.size() > TEXTURE_ARRAYS_MAX ) ? TEXTURE_ARRAYS_MAX - 1 : buckets.size();
+	for ( size_t i = 0; i < no_buckets; ++i )
+	{
+		Array array;
+		array.bucket = buckets[i].first;
+		arrays_.push_back( array );
+	}
+
+	Array overflow;
+	for ( Entry & entry : entries_ )
+	{
+		for ( int level = 0; ( level < entry.texture->no_mips() ) && ( entry.array == TEXTURE_ARRAY_NONE ); ++level )
+		{
+			const Bucket bucket = TextureBucket( entry.texture, level );
+			for ( size_t i = 0; i < arrays_.size(); ++i )
+			{
+				if ( arrays_[i].bucket == bucket )
+				{
+					entry.array = static_cast<GLuint>( i );
+					entry.first_level = level;
+					entry.layer = static_cast<GLuint>( arrays_[i].no_layers++ );
+					break;
+				}
+			}
+		}
+		if ( ( entry.array == TEXTURE_ARRAY_NONE ) && entry.texture->data() )
+		{
+			// resampled into the RGBA8 array as large as the largest of such textures
+			entry.array = static_cast<GLuint>( arrays_.size() );
+			entry.layer = static_cast<GLuint>( overflow.no_layers++ );
+			entry.resampled = true;
+			overflow.bucket.width = max( overflow.bucket.width, entry.texture->width() );
+			overflow.bucket.height = max( overflow.bucket.height, entry.texture->height() );
+		}
+	}
+	if ( overflow.no_layers > 0 )
+	{
+		overflow.bucket.no_levels = 1;
+		while ( ( ( overflow.bucket.width >> ( overflow.bucket.no_levels - 1 ) ) > 1 ) ||
+			( ( overflow.bucket.height >> ( overflow.bucket.no_levels - 1 ) ) > 1 ) )
+		{
+			++overflow.bucket.no_levels;
+		}
+		arrays_.push_back( overflow );
+	}
+
+	for ( Array & array : arrays_ )
+	{
+		const Bucket & bucket = array.bucket;
+		glCreateTextures( GL_TEXTURE_2D_ARRAY, 1, &array.id );
+		// the same sampling as the bindless textures (see CreateBindlessTexture)
+		glTextureParameteri( array.id, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTextureParameteri( array.id, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glTextureParameteri( array.id, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		glTextureParameteri( array.id, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		glTextureStorage3D( array.id, bucket.no_levels, ( bucket.format != BlockFormat::NONE ) ? BlockInternalFormat( bucket.format ) : GL_RGBA8,
+			bucket.width, bucket.height, array.no_layers );
+		ids_.push_back( array.id );
+	}
+
+	for ( const Entry & entry : entries_ )
+	{
+		if ( entry.array != TEXTURE_ARRAY_NONE )
+		{
+			Upload( entry );
+		}
+	}
+
+	return static_cast<int>( arrays_.size() );
+}
+
+void TextureArrays::Upload( const Entry & entry ) const
+{
+	const Array & array = arrays_[entry.array];
+	const Bucket & bucket = array.bucket;
+	const Texture * texture = entry.texture;
+	std::vector<BYTE> rgba;
+
+	for ( int level = 0; level < bucket.no_levels; ++level )
+	{
+		const int width = max( 1, bucket.width >> level );
+		const int height = max( 1, bucket.height >> level );
+
+		if ( bucket.format != BlockFormat::NONE )
+		{
+			// block compressed mip chain baked into the scene cache
+			glCompressedTextureSubImage3D( array.id, level, 0, 0, entry.layer, width, height, 1, BlockInternalFormat( bucket.format ),
+				static_cast<GLsizei>( BlockImageSize( bucket.format, width, height ) ), texture->block_mip_data( entry.first_level + level ) );
+			continue;
+		}
+
+		rgba.resize( static_cast<size_t>( width ) * height * 4 );
+		if ( entry.resampled )
+		{
+			ResampleToRGBA8( texture, bucket.width, bucket.height, level, rgba.data() );
+		}
+		else
+		{
+			texture->CopyToRGBA8( rgba.data(), entry.first_level + level );
+		}
+		glTextureSubImage3D( array.id, level, 0, 0, entry.layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data() );
+	}
+}
+
+int TextureArrays::Bind( const GLuint first_unit ) const
+{
+	if ( !ids_.empty() )
+	{
+		glBindTextures( first_unit, static_cast<GLsizei>( ids_.size() ), ids_.data() );
+	}
+
+	return static_cast<int>( ids_.size() );
+}
+
+GLuint TextureArrays::array( const int id ) const
+{
+	return entries_[id].array;
+}
+
+GLuint TextureArrays::layer( const int id ) const
+{
+	return entries_[id].layer;
+}
+
+void TextureArrays::Release()
+{
+	if ( !ids_.empty() )
+	{
+		glDeleteTextures( static_cast<GLsizei>( ids_.size() ), ids_.data() );
+	}
+	ids_.clear();
+	arrays_.clear();
+	for ( Entry & entry : entries_ )
+	{
+		entry = Entry{ entry.texture };
+	}
+}
+
+size_t TextureArrays::no_textures() const
+{
+	return entries_.size();
+}
+
+size_t TextureArrays::no_arrays() const
+{
+	return arrays_.size();
+}
+
+size_t TextureArrays::no_reduced() const
+{
+	return std::count_if( entries_.begin(), entries_.end(), []( const Entry & entry ) { return entry.first_level > 0; } );
+}
+
+size_t TextureArrays::no_resampled() const
+{
+	return std::count_if( entries_.begin(), entries_.end(), []( const Entry & entry ) { return entry.resampled; } );
+}
+
+size_t TextureArrays::bytes() const
+{
+	size_t bytes = 0;
+	for ( const Array & array : arrays_ )
+	{
+		for ( int level = 0; level < array.bucket.no_levels; ++level )
+		{
+			const int width = max( 1, array.bucket.width >> level );
+			const int height = max( 1, array.bucket.height >> level );
+			bytes += array.no_layers * ( ( array.bucket.format != BlockFormat::NONE ) ?
+				BlockImageSize( array.bucket.format, width, height ) : static_cast<size_t>( width ) * height * 4 );
+		}
+	}
+
+	return bytes;
+}
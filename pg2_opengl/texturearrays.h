@@ -0,0 +1,103 @@
+#ifndef TEXTURE_ARRAYS_H_
+#define TEXTURE_ARRAYS_H_
+
+#include "texture.h"
+
+/*! \def TEXTURE_ARRAYS_MAX
+\brief Maximal number of texture arrays bound at once, must match array_shader.frag.
+*/
+#define TEXTURE_ARRAYS_MAX 8
+
+/*! \def TEXTURE_ARRAY_NONE
+\brief Array index of the materials without a texture in the material SSBO.
+*/
+#define TEXTURE_ARRAY_NONE 0xffffffffu
+
+/*! \class TextureArrays
+\brief Packs the textures into GL_TEXTURE_2D_ARRAY buckets for the drivers without bindless textures.
+
+Textures of the same size, number of mip levels and block format share one array, the material SSBO then addresses
+each of them by the (array, layer) pair and all arrays are bound to consecutive texture units by a single call, so the
+whole scene is drawn with at most TEXTURE_ARRAYS_MAX bound textures. If there are more buckets, only the most populated
+ones get their array and the rest of the textures is put into an array whose size matches one of their coarser mip
+levels or, if there is none, resampled into the last RGBA8 array as large as the largest of them.
+
+All methods but \a Add have to be called with the GL context current, \a Release must be called before the context is
+destroyed.
+*/
+class TextureArrays
+{
+public:
+	TextureArrays();
+	~TextureArrays();
+
+	/* registers the texture, generates the host mip chain of textures without one, returns the id of the texture */
+	int Add( Texture * texture );
+
+	/* groups all added textures into buckets and uploads them into the arrays, returns the number of arrays */
+	int Build();
+
+	/* binds the arrays to the texture units first_unit, first_unit + 1, ... by a single call, returns the number of
+	bound arrays */
+	int Bind( const GLuint first_unit ) const;
+
+	/* array and layer of the texture, TEXTURE_ARRAY_NONE if it could not be placed into any array */
+	GLuint array( const int id ) const;
+	GLuint layer( const int id ) const;
+
+	/* deletes all arrays */
+	void Release();
+
+	size_t no_textures() const;
+	size_t no_arrays() const;
+
+	/* number of textures stored with their finer levels dropped and resampled to the size of another array */
+	size_t no_reduced() const;
+	size_t no_resampled() const;
+
+	/* GPU size of all arrays (bytes) */
+	size_t bytes() const;
+
+private:
+	struct Bucket
+	{
+		int width{ 0 };
+		int height{ 0 };
+		int no_levels{ 0 };
+		BlockFormat format{ BlockFormat::NONE };
+
+		bool operator<( const Bucket & bucket ) const;
+		bool operator==( const Bucket & bucket ) const;
+	};
+
+	struct Entry
+	{
+		Texture * texture{ nullptr };
+		GLuint array{ TEXTURE_ARRAY_NONE };
+		GLuint layer{ 0 };
+		int first_level{ 0 }; // first host level stored in the array
+		bool resampled{ false }; // the levels are resampled to the size of the array
+	};
+
+	struct Array
+	{
+		Bucket bucket;
+		int no_layers{ 0 };
+		GLuint id{ 0 };
+	};
+
+	/* bucket of the host levels first_level, ... of the texture */
+	static Bucket TextureBucket( const Texture * texture, const int first_level );
+
+	/* uploads the levels of the entry into its layer */
+	void Upload( const Entry & entry ) const;
+
+	std::vector<Entry> entries_;
+	std::vector<Array> arrays_;
+	std::vector<GLuint> ids_; // ids of arrays_ in the order of the texture units
+
+	TextureArrays( const TextureArrays & ) = delete;
+	TextureArrays & operator=( const TextureArrays & ) = delete;
+};
+
+#endif
@@ -0,0 +1,875 @@
+#include "pch.h"
+#include "texturebaker.h"
+#include "utils.h"
+#include "mymath.h"
+#include "pixelformat.h"
+#include <algorithm>
+#include <limits>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define TEXTURE_BAKER_SSE2
+#include <emmintrin.h>
+#endif
+
+/* S3TC formats come from EXT_texture_compression_s3tc which is not part of the core profile loader */
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/* number of least squares refinements of the block endpoints */
+static const int kRefinements = 2;
+
+int BlockSize( const BlockFormat format )
+{
+	switch ( format )
+	{
+	case BlockFormat::BC1: return 8;
+	case BlockFormat::BC3: return 16;
+	case BlockFormat::BC7: return 16;
+	default: return 0;
+	}
+}
+
+size_t BlockImageSize( const BlockFormat format, const int width, const int height )
+{
+	return static_cast<size_t>( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * BlockSize( format );
+}
+
+BlockFormat ChooseBlockFormat( const Texture * texture, const bool high_quality )
+{
+	if ( !texture || !texture->data() )
+	{
+		return BlockFormat::NONE;
+	}
+
+	const int pixel_size = texture->pixel_size();
+	if ( ( pixel_size != 1 ) && ( pixel_size != 3 ) && ( pixel_size != 4 ) )
+	{
+		return BlockFormat::NONE;
+	}
+
+	// the immutable compressed storage needs the base level made of whole blocks
+	if ( ( texture->width() % 4 != 0 ) || ( texture->height() % 4 != 0 ) )
+	{
+		return BlockFormat::NONE;
+	}
+
+	if ( high_quality )
+	{
+		return BlockFormat::BC7;
+	}
+
+	// the separate alpha block of BC3 copes better with alpha uncorrelated to the colors than the single line of BC7 mode 6
+	return ( pixel_size == 4 ) ? BlockFormat::BC3 : BlockFormat::BC1;
+}
+
+GLenum BlockInternalFormat( const BlockFormat format )
+{
+	switch ( format )
+	{
+	case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return GL_NONE;
+	}
+}
+
+static void DownsampleRows( const BYTE * src, const int src_width, const int src_height, const int src_scan_width,
+	BYTE * dst, const int dst_width, const int dst_scan_width, const int pixel_size, const int first_row, const int last_row )
+{
+	const float * to_linear = SrgbToLinearTable();
+	const BYTE * to_srgb = LinearToSrgbTable();
+	const float scale = 0.25f * ( LINEAR_TO_SRGB_TABLE_SIZE - 1 );
+	// gray, BGR and BGRA pixels carry sRGB colors, anything else is averaged as is
+	const int srgb_channels = ( ( pixel_size == 1 ) || ( pixel_size == 3 ) || ( pixel_size == 4 ) ) ? min( pixel_size, 3 ) : 0;
+
+	for ( int y = first_row; y < last_row; ++y )
+	{
+		const BYTE * row0 = src + min( 2 * y, src_height - 1 ) * src_scan_width;
+		const BYTE * row1 = src + min( 2 * y + 1, src_height - 1 ) * src_scan_width;
+		BYTE * dst_row = dst + y * dst_scan_width;
+
+		for ( int x = 0; x < dst_width; ++x )
+		{
+			const int x0 = min( 2 * x, src_width - 1 ) * pixel_size;
+			const int x1 = min( 2 * x + 1, src_width - 1 ) * pixel_size;
+
+			for ( int c = 0; c < srgb_channels; ++c )
+			{
+				const float sum = to_linear[row0[x0 + c]] + to_linear[row0[x1 + c]] + to_linear[row1[x0 + c]] + to_linear[row1[x1 + c]];
+				dst_row[x * pixel_size + c] = to_srgb[static_cast<int>( sum * scale + 0.5f )];
+			}
+			for ( int c = srgb_channels; c < pixel_size; ++c )
+			{
+				dst_row[x * pixel_size + c] = static_cast<BYTE>(
+					( row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2 ) / 4 );
+			}
+		}
+	}
+}
+
+void DownsampleSrgb( const BYTE * src, const int src_width, const int src_height, const int src_scan_width,
+	BYTE * dst, const int dst_width, const int dst_height, const int dst_scan_width, const int pixel_size )
+{
+	DownsampleRows( src, src_width, src_height, src_scan_width, dst, dst_width, dst_scan_width, pixel_size, 0, dst_height );
+}
+
+void BuildMipChain( const Texture * texture, std::vector<std::vector<BYTE>> & mips, const int no_threads )
+{
+	mips.clear();
+
+	if ( !texture || !texture->data() )
+	{
+		return;
+	}
+
+	int width = texture->width();
+	int height = texture->height();
+
+	// the base level is converted from gray, BGR or BGRA to RGBA by the SIMD kernels
+	mips.push_back( std::vector<BYTE>( static_cast<size_t>( width ) * height * 4 ) );
+	texture->CopyToRGBA8( mips[0].data() );
+
+	// rows of the smaller levels are downsampled in chunks, tiny levels stay on the calling thread
+	const int rows_per_chunk = 32;
+	while ( ( width > 1 ) || ( height > 1 ) )
+	{
+		const int dst_width = max( 1, width / 2 );
+		const int dst_height = max( 1, height / 2 );
+		std::vector<BYTE> level( static_cast<size_t>( dst_width ) * dst_height * 4 );
+		const BYTE * src = mips.back().data();
+
+		ParallelFor( ( dst_height + rows_per_chunk - 1 ) / rows_per_chunk, no_threads, [&]( const int chunk )
+		{
+			DownsampleRows( src, width, height, width * 4, level.data(), dst_width, dst_width * 4, 4,
+				chunk * rows_per_chunk, min( dst_height, ( chunk + 1 ) * rows_per_chunk ) );
+		} );
+
+		mips.push_back( std::move( level ) );
+		width = dst_width;
+		height = dst_height;
+	}
+}
+
+/* 16 pixels of a single block in SoA layout, channels are r, g, b and a */
+struct alignas( 16 ) BlockPixels
+{
+	float c[4][16];
+};
+
+static void LoadBlock( const BYTE * rgba, const int width, const int height, const int bx, const int by, BlockPixels & block )
+{
+	for ( int i = 0; i < 16; ++i )
+	{
+		const int x = min( bx * 4 + ( i & 3 ), width - 1 );
+		const int y = min( by * 4 + ( i >> 2 ), height - 1 );
+		const BYTE * p = rgba + ( static_cast<size_t>( y ) * width + x ) * 4;
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			block.c[c][i] = p[c];
+		}
+	}
+}
+
+/* index of the nearest palette entry for every pixel comparing the first no_channels channels, returns the total
+squared error of the block, SIMD */
+static float FitIndices( const BlockPixels & block, const float palette[][4], const int palette_size,
+	const int no_channels, int indices[16] )
+{
+	float error = 0.0f;
+
+#ifdef TEXTURE_BAKER_SSE2
+	for ( int i = 0; i < 16; i += 4 )
+	{
+		__m128 best = _mm_set1_ps( std::numeric_limits<float>::max() );
+		__m128i best_index = _mm_setzero_si128();
+
+		for ( int p = 0; p < palette_size; ++p )
+		{
+			__m128 distance = _mm_setzero_ps();
+			for ( int c = 0; c < no_channels; ++c )
+			{
+				const __m128 d = _mm_sub_ps( _mm_load_ps( &block.c[c][i] ), _mm_set1_ps( palette[p][c] ) );
+				distance = _mm_add_ps( distance, _mm_mul_ps( d, d ) );
+			}
+
+			const __m128i closer = _mm_castps_si128( _mm_cmplt_ps( distance, best ) );
+			best = _mm_min_ps( distance, best );
+			best_index = _mm_or_si128( _mm_and_si128( closer, _mm_set1_epi32( p ) ), _mm_andnot_si128( closer, best_index ) );
+		}
+
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( indices + i ), best_index );
+
+		alignas( 16 ) float errors[4];
+		_mm_store_ps( errors, best );
+		error += errors[0] + errors[1] + errors[2] + errors[3];
+	}
+#else
+	for ( int i = 0; i < 16; ++i )
+	{
+		float best = std::numeric_limits<float>::max();
+		indices[i] = 0;
+
+		for ( int p = 0; p < palette_size; ++p )
+		{
+			float distance = 0.0f;
+			for ( int c = 0; c < no_channels; ++c )
+			{
+				distance += sqr( block.c[c][i] - palette[p][c] );
+			}
+
+			if ( distance < best )
+			{
+				best = distance;
+				indices[i] = p;
+			}
+		}
+
+		error += best;
+	}
+#endif
+
+	return error;
+}
+
+/* endpoints spanning the extreme projections of the block onto its principal axis, the unused channels are 255 */
+static void PrincipalEndpoints( const BlockPixels & block, const int no_channels, float e0[4], float e1[4] )
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for ( int c = 0; c < no_channels; ++c )
+	{
+		float lo = block.c[c][0];
+		float hi = block.c[c][0];
+		for ( int i = 0; i < 16; ++i )
+		{
+			mean[c] += block.c[c][i];
+			lo = min( lo, block.c[c][i] );
+			hi = max( hi, block.c[c][i] );
+		}
+		mean[c] /= 16.0f;
+		axis[c] = hi - lo; // the power iteration starts from the diagonal of the bounding box
+	}
+
+	float covariance[4][4] = { { 0.0f } };
+	for ( int i = 0; i < 16; ++i )
+	{
+		for ( int a = 0; a < no_channels; ++a )
+		{
+			for ( int b = 0; b < no_channels; ++b )
+			{
+				covariance[a][b] += ( block.c[a][i] - mean[a] ) * ( block.c[b][i] - mean[b] );
+			}
+		}
+	}
+
+	for ( int iteration = 0; iteration < 8; ++iteration )
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float largest = 0.0f;
+		for ( int a = 0; a < no_channels; ++a )
+		{
+			for ( int b = 0; b < no_channels; ++b )
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			largest = max( largest, fabsf( next[a] ) );
+		}
+
+		if ( largest <= 0.0f )
+		{
+			break;
+		}
+
+		for ( int c = 0; c < no_channels; ++c )
+		{
+			axis[c] = next[c] / largest;
+		}
+	}
+
+	float length2 = 0.0f;
+	for ( int c = 0; c < no_channels; ++c )
+	{
+		length2 += sqr( axis[c] );
+	}
+
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+	if ( length2 > 1e-12f )
+	{
+		t_min = std::numeric_limits<float>::max();
+		t_max = -std::numeric_limits<float>::max();
+		for ( int i = 0; i < 16; ++i )
+		{
+			float t = 0.0f;
+			for ( int c = 0; c < no_channels; ++c )
+			{
+				t += ( block.c[c][i] - mean[c] ) * axis[c];
+			}
+			t /= length2;
+			t_min = min( t_min, t );
+			t_max = max( t_max, t );
+		}
+	}
+
+	for ( int c = 0; c < 4; ++c )
+	{
+		e0[c] = ( c < no_channels ) ? min( 255.0f, max( 0.0f, mean[c] + t_min * axis[c] ) ) : 255.0f;
+		e1[c] = ( c < no_channels ) ? min( 255.0f, max( 0.0f, mean[c] + t_max * axis[c] ) ) : 255.0f;
+	}
+}
+
+/* least squares endpoints for the given indices, weights are the interpolation factors of the palette entries,
+returns false if the indices do not determine the endpoints */
+static bool RefineEndpoints( const BlockPixels & block, const int no_channels, const int indices[16], const float * weights,
+	float e0[4], float e1[4] )
+{
+	float a = 0.0f;
+	float b = 0.0f;
+	float c = 0.0f;
+	float x[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float y[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const float w = weights[indices[i]];
+		a += sqr( 1.0f - w );
+		b += ( 1.0f - w ) * w;
+		c += sqr( w );
+		for ( int ch = 0; ch < no_channels; ++ch )
+		{
+			x[ch] += ( 1.0f - w ) * block.c[ch][i];
+			y[ch] += w * block.c[ch][i];
+		}
+	}
+
+	const float determinant = a * c - b * b;
+	if ( fabsf( determinant ) < 1e-6f )
+	{
+		return false;
+	}
+
+	for ( int ch = 0; ch < no_channels; ++ch )
+	{
+		e0[ch] = min( 255.0f, max( 0.0f, ( c * x[ch] - b * y[ch] ) / determinant ) );
+		e1[ch] = min( 255.0f, max( 0.0f, ( a * y[ch] - b * x[ch] ) / determinant ) );
+	}
+
+	return true;
+}
+
+/* writes count bits of the value at the given bit position of the little endian block, the block has to be zeroed */
+static void PutBits( BYTE * block, int & position, const unsigned int value, const int count )
+{
+	for ( int i = 0; i < count; ++i, ++position )
+	{
+		block[position >> 3] |= static_cast<BYTE>( ( ( value >> i ) & 1 ) << ( position & 7 ) );
+	}
+}
+
+static unsigned int GetBits( const BYTE * block, int & position, const int count )
+{
+	unsigned int value = 0;
+	for ( int i = 0; i < count; ++i, ++position )
+	{
+		value |= ( ( block[position >> 3] >> ( position & 7 ) ) & 1u ) << i;
+	}
+
+	return value;
+}
+
+/* --- BC1 color block, also the second half of BC3 --- */
+
+static unsigned short Pack565( const float color[4] )
+{
+	const int r = static_cast<int>( color[0] * ( 31.0f / 255.0f ) + 0.5f );
+	const int g = static_cast<int>( color[1] * ( 63.0f / 255.0f ) + 0.5f );
+	const int b = static_cast<int>( color[2] * ( 31.0f / 255.0f ) + 0.5f );
+
+	return static_cast<unsigned short>( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static void Unpack565( const unsigned short color, int rgb[3] )
+{
+	const int r = ( color >> 11 ) & 31;
+	const int g = ( color >> 5 ) & 63;
+	const int b = color & 31;
+
+	rgb[0] = ( r << 3 ) | ( r >> 2 );
+	rgb[1] = ( g << 2 ) | ( g >> 4 );
+	rgb[2] = ( b << 3 ) | ( b >> 2 );
+}
+
+/* interpolation factors of the 4-color palette c0, c1, 2/3 c0 + 1/3 c1 and 1/3 c0 + 2/3 c1 */
+static const float kBC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+static void EncodeColorBlock( const BlockPixels & block, BYTE * out )
+{
+	float e0[4], e1[4];
+	PrincipalEndpoints( block, 3, e0, e1 );
+
+	unsigned short best_c0 = 0;
+	unsigned short best_c1 = 0;
+	int best_indices[16] = { 0 };
+	float best_error = std::numeric_limits<float>::max();
+
+	for ( int iteration = 0; iteration <= kRefinements; ++iteration )
+	{
+		unsigned short c0 = Pack565( e0 );
+		unsigned short c1 = Pack565( e1 );
+		// the 4-color mode is selected by c0 > c1, swapped endpoints swap the indices 0 <-> 1 and 2 <-> 3 too
+		if ( c0 < c1 )
+		{
+			std::swap( c0, c1 );
+			std::swap( e0, e1 );
+		}
+
+		int rgb0[3], rgb1[3];
+		Unpack565( c0, rgb0 );
+		Unpack565( c1, rgb1 );
+
+		float palette[4][4];
+		for ( int c = 0; c < 3; ++c )
+		{
+			palette[0][c] = static_cast<float>( rgb0[c] );
+			palette[1][c] = static_cast<float>( rgb1[c] );
+			palette[2][c] = ( 2 * rgb0[c] + rgb1[c] ) / 3.0f;
+			palette[3][c] = ( rgb0[c] + 2 * rgb1[c] ) / 3.0f;
+		}
+
+		int indices[16];
+		// equal endpoints would select the 3-color mode, all pixels use c0 then
+		const float error = FitIndices( block, palette, ( c0 == c1 ) ? 1 : 4, 3, indices );
+
+		if ( error < best_error )
+		{
+			best_error = error;
+			best_c0 = c0;
+			best_c1 = c1;
+			memcpy( best_indices, indices, sizeof( indices ) );
+		}
+
+		if ( ( error == 0.0f ) || ( c0 == c1 ) || !RefineEndpoints( block, 3, indices, kBC1Weights, e0, e1 ) )
+		{
+			break;
+		}
+	}
+
+	unsigned int bits = 0;
+	for ( int i = 0; i < 16; ++i )
+	{
+		bits |= static_cast<unsigned int>( best_indices[i] ) << ( 2 * i );
+	}
+
+	out[0] = static_cast<BYTE>( best_c0 );
+	out[1] = static_cast<BYTE>( best_c0 >> 8 );
+	out[2] = static_cast<BYTE>( best_c1 );
+	out[3] = static_cast<BYTE>( best_c1 >> 8 );
+	for ( int i = 0; i < 4; ++i )
+	{
+		out[4 + i] = static_cast<BYTE>( bits >> ( 8 * i ) );
+	}
+}
+
+static void DecodeColorBlock( const BYTE * in, const bool four_colors_only, BYTE rgba[16][4] )
+{
+	const unsigned short c0 = static_cast<unsigned short>( in[0] | ( in[1] << 8 ) );
+	const unsigned short c1 = static_cast<unsigned short>( in[2] | ( in[3] << 8 ) );
+
+	int palette[4][4];
+	Unpack565( c0, palette[0] );
+	Unpack565( c1, palette[1] );
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		if ( four_colors_only || ( c0 > c1 ) )
+		{
+			palette[2][c] = ( 2 * palette[0][c] + palette[1][c] + 1 ) / 3;
+			palette[3][c] = ( palette[0][c] + 2 * palette[1][c] + 1 ) / 3;
+		}
+		else
+		{
+			palette[2][c] = ( palette[0][c] + palette[1][c] + 1 ) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if ( !four_colors_only && ( c0 <= c1 ) )
+	{
+		palette[3][3] = 0; // transparent black
+	}
+
+	const unsigned int bits = in[4] | ( in[5] << 8 ) | ( in[6] << 16 ) | ( static_cast<unsigned int>( in[7] ) << 24 );
+	for ( int i = 0; i < 16; ++i )
+	{
+		const int index = ( bits >> ( 2 * i ) ) & 3;
+		for ( int c = 0; c < 4; ++c )
+		{
+			rgba[i][c] = static_cast<BYTE>( palette[index][c] );
+		}
+	}
+}
+
+/* --- BC3 alpha block --- */
+
+static void AlphaPalette( const int a0, const int a1, int palette[8] )
+{
+	palette[0] = a0;
+	palette[1] = a1;
+
+	if ( a0 > a1 )
+	{
+		for ( int i = 2; i < 8; ++i )
+		{
+			palette[i] = ( ( 8 - i ) * a0 + ( i - 1 ) * a1 ) / 7;
+		}
+	}
+	else
+	{
+		for ( int i = 2; i < 6; ++i )
+		{
+			palette[i] = ( ( 6 - i ) * a0 + ( i - 1 ) * a1 ) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void EncodeAlphaBlock( const BlockPixels & block, BYTE * out )
+{
+	float lo = block.c[3][0];
+	float hi = block.c[3][0];
+	for ( int i = 1; i < 16; ++i )
+	{
+		lo = min( lo, block.c[3][i] );
+		hi = max( hi, block.c[3][i] );
+	}
+
+	// a0 > a1 selects the 8-value mode, constant blocks use index 0 only
+	const int a0 = static_cast<int>( hi );
+	const int a1 = static_cast<int>( lo );
+	int palette[8];
+	AlphaPalette( a0, a1, palette );
+
+	unsigned long long bits = 0;
+	for ( int i = 0; ( i < 16 ) && ( a0 > a1 ); ++i )
+	{
+		int best = 0;
+		for ( int j = 1; j < 8; ++j )
+		{
+			if ( fabsf( block.c[3][i] - palette[j] ) < fabsf( block.c[3][i] - palette[best] ) )
+			{
+				best = j;
+			}
+		}
+		bits |= static_cast<unsigned long long>( best ) << ( 3 * i );
+	}
+
+	out[0] = static_cast<BYTE>( a0 );
+	out[1] = static_cast<BYTE>( a1 );
+	for ( int i = 0; i < 6; ++i )
+	{
+		out[2 + i] = static_cast<BYTE>( bits >> ( 8 * i ) );
+	}
+}
+
+static void DecodeAlphaBlock( const BYTE * in, BYTE rgba[16][4] )
+{
+	int palette[8];
+	AlphaPalette( in[0], in[1], palette );
+
+	unsigned long long bits = 0;
+	for ( int i = 0; i < 6; ++i )
+	{
+		bits |= static_cast<unsigned long long>( in[2 + i] ) << ( 8 * i );
+	}
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		rgba[i][3] = static_cast<BYTE>( palette[( bits >> ( 3 * i ) ) & 7] );
+	}
+}
+
+/* --- BC7 mode 6 block --- */
+
+static const int kBC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/* rounds the endpoint to 7 bits per channel plus the shared p-bit which is chosen to minimize the error */
+static void QuantizeEndpointBC7( const float endpoint[4], int quantized[4], int & p_bit )
+{
+	float best_error = std::numeric_limits<float>::max();
+
+	for ( int p = 0; p < 2; ++p )
+	{
+		int candidate[4];
+		float error = 0.0f;
+		for ( int c = 0; c < 4; ++c )
+		{
+			candidate[c] = min( 127, max( 0, static_cast<int>( ( endpoint[c] - p ) * 0.5f + 0.5f ) ) ) * 2 + p;
+			error += sqr( candidate[c] - endpoint[c] );
+		}
+
+		if ( error < best_error )
+		{
+			best_error = error;
+			memcpy( quantized, candidate, sizeof( candidate ) );
+			p_bit = p;
+		}
+	}
+}
+
+static void EncodeBC7Block( const BlockPixels & block, BYTE * out )
+{
+	float weights[16];
+	for ( int i = 0; i < 16; ++i )
+	{
+		weights[i] = kBC7Weights[i] / 64.0f;
+	}
+
+	float e0[4], e1[4];
+	PrincipalEndpoints( block, 4, e0, e1 );
+
+	int best_q0[4] = { 0 }, best_q1[4] = { 0 };
+	int best_p0 = 0, best_p1 = 0;
+	int best_indices[16] = { 0 };
+	float best_error = std::numeric_limits<float>::max();
+
+	for ( int iteration = 0; iteration <= kRefinements; ++iteration )
+	{
+		int q0[4], q1[4], p0, p1;
+		QuantizeEndpointBC7( e0, q0, p0 );
+		QuantizeEndpointBC7( e1, q1, p1 );
+
+		float palette[16][4];
+		for ( int i = 0; i < 16; ++i )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				palette[i][c] = static_cast<float>( ( ( 64 - kBC7Weights[i] ) * q0[c] + kBC7Weights[i] * q1[c] + 32 ) >> 6 );
+			}
+		}
+
+		int indices[16];
+		const float error = FitIndices( block, palette, 16, 4, indices );
+
+		if ( error < best_error )
+		{
+			best_error = error;
+			memcpy( best_q0, q0, sizeof( q0 ) );
+			memcpy( best_q1, q1, sizeof( q1 ) );
+			best_p0 = p0;
+			best_p1 = p1;
+			memcpy( best_indices, indices, sizeof( indices ) );
+		}
+
+		if ( ( error == 0.0f ) || !RefineEndpoints( block, 4, indices, weights, e0, e1 ) )
+		{
+			break;
+		}
+	}
+
+	// the most significant bit of the first (anchor) index is implicitly zero
+	if ( best_indices[0] & 8 )
+	{
+		std::swap( best_q0, best_q1 );
+		std::swap( best_p0, best_p1 );
+		for ( int i = 0; i < 16; ++i )
+		{
+			best_indices[i] = 15 - best_indices[i];
+		}
+	}
+
+	memset( out, 0, 16 );
+	int position = 0;
+	PutBits( out, position, 1 << 6, 7 ); // mode 6
+	for ( int c = 0; c < 4; ++c )
+	{
+		PutBits( out, position, best_q0[c] >> 1, 7 );
+		PutBits( out, position, best_q1[c] >> 1, 7 );
+	}
+	PutBits( out, position, best_p0, 1 );
+	PutBits( out, position, best_p1, 1 );
+	for ( int i = 0; i < 16; ++i )
+	{
+		PutBits( out, position, best_indices[i], ( i == 0 ) ? 3 : 4 );
+	}
+}
+
+/* decodes the mode 6 blocks produced by EncodeBC7Block, blocks of the other modes are decoded as transparent black */
+static void DecodeBC7Block( const BYTE * in, BYTE rgba[16][4] )
+{
+	memset( rgba, 0, 16 * 4 );
+
+	int position = 0;
+	if ( GetBits( in, position, 7 ) != ( 1 << 6 ) )
+	{
+		return;
+	}
+
+	int q0[4], q1[4];
+	for ( int c = 0; c < 4; ++c )
+	{
+		q0[c] = GetBits( in, position, 7 ) << 1;
+		q1[c] = GetBits( in, position, 7 ) << 1;
+	}
+	const int p0 = GetBits( in, position, 1 );
+	const int p1 = GetBits( in, position, 1 );
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const int w = kBC7Weights[GetBits( in, position, ( i == 0 ) ? 3 : 4 )];
+		for ( int c = 0; c < 4; ++c )
+		{
+			rgba[i][c] = static_cast<BYTE>( ( ( 64 - w ) * ( q0[c] | p0 ) + w * ( q1[c] | p1 ) + 32 ) >> 6 );
+		}
+	}
+}
+
+static void EncodeBlockRow( const BYTE * rgba, const int width, const int height, const BlockFormat format,
+	const int by, BYTE * blocks )
+{
+	const int blocks_x = ( width + 3 ) / 4;
+	const int block_size = BlockSize( format );
+	BYTE * out = blocks + static_cast<size_t>( by ) * blocks_x * block_size;
+
+	BlockPixels block;
+	for ( int bx = 0; bx < blocks_x; ++bx, out += block_size )
+	{
+		LoadBlock( rgba, width, height, bx, by, block );
+
+		switch ( format )
+		{
+		case BlockFormat::BC1:
+			EncodeColorBlock( block, out );
+			break;
+
+		case BlockFormat::BC3:
+			EncodeAlphaBlock( block, out );
+			EncodeColorBlock( block, out + 8 );
+			break;
+
+		case BlockFormat::BC7:
+			EncodeBC7Block( block, out );
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void EncodeBlocks( const BYTE * rgba, const int width, const int height, const BlockFormat format, BYTE * blocks,
+	const int no_threads )
+{
+	ParallelFor( ( height + 3 ) / 4, no_threads, [&]( const int by )
+	{
+		EncodeBlockRow( rgba, width, height, format, by, blocks );
+	} );
+}
+
+void DecodeBlocks( const BYTE * blocks, const int width, const int height, const BlockFormat format, BYTE * rgba )
+{
+	const int block_size = BlockSize( format );
+	const BYTE * in = blocks;
+
+	for ( int by = 0; by < ( height + 3 ) / 4; ++by )
+	{
+		for ( int bx = 0; bx < ( width + 3 ) / 4; ++bx, in += block_size )
+		{
+			BYTE pixels[16][4];
+
+			switch ( format )
+			{
+			case BlockFormat::BC1:
+				DecodeColorBlock( in, false, pixels );
+				break;
+
+			case BlockFormat::BC3:
+				DecodeColorBlock( in + 8, true, pixels );
+				DecodeAlphaBlock( in, pixels );
+				break;
+
+			case BlockFormat::BC7:
+				DecodeBC7Block( in, pixels );
+				break;
+
+			default:
+				memset( pixels, 0, sizeof( pixels ) );
+				break;
+			}
+
+			// pixels of the edge blocks outside the image are dropped
+			for ( int i = 0; i < 16; ++i )
+			{
+				const int x = bx * 4 + ( i & 3 );
+				const int y = by * 4 + ( i >> 2 );
+				if ( ( x < width ) && ( y < height ) )
+				{
+					memcpy( rgba + ( static_cast<size_t>( y ) * width + x ) * 4, pixels[i], 4 );
+				}
+			}
+		}
+	}
+}
+
+int BakeTexture( const Texture * texture, const BlockFormat format, BakedTexture & baked, const int no_threads )
+{
+	baked.format = BlockFormat::NONE;
+	baked.mips.clear();
+
+	if ( !texture || !texture->data() || ( BlockSize( format ) == 0 ) )
+	{
+		return -1;
+	}
+
+	std::vector<std::vector<BYTE>> levels;
+	BuildMipChain( texture, levels, no_threads );
+
+	baked.format = format;
+	baked.width = texture->width();
+	baked.height = texture->height();
+	baked.mips.resize( levels.size() );
+
+	// rows of blocks of all levels form a single parallel loop so the small levels do not serialize the work
+	std::vector<int> first_rows( levels.size() + 1, 0 );
+	for ( size_t level = 0; level < levels.size(); ++level )
+	{
+		const int width = max( 1, baked.width >> level );
+		const int height = max( 1, baked.height >> level );
+		baked.mips[level].resize( BlockImageSize( format, width, height ) );
+		first_rows[level + 1] = first_rows[level] + ( height + 3 ) / 4;
+	}
+
+	ParallelFor( first_rows.back(), no_threads, [&]( const int row )
+	{
+		const size_t level = static_cast<size_t>( std::upper_bound( first_rows.begin(), first_rows.end(), row ) - first_rows.begin() ) - 1;
+		EncodeBlockRow( levels[level].data(), max( 1, baked.width >> level ), max( 1, baked.height >> level ), format,
+			row - first_rows[level], baked.mips[level].data() );
+	} );
+
+	return 0;
+}
+
+double PSNR( const BYTE * rgba0, const BYTE * rgba1, const size_t no_pixels, const int no_channels )
+{
+	double error = 0.0;
+	for ( size_t i = 0; i < no_pixels; ++i )
+	{
+		for ( int c = 0; c < no_channels; ++c )
+		{
+			error += sqr( static_cast<double>( rgba0[i * 4 + c] ) - rgba1[i * 4 + c] );
+		}
+	}
+
+	if ( error == 0.0 )
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+
+	return 10.0 * log10( sqr( 255.0 ) * no_pixels * no_channels / error );
+}
@@ -0,0 +1,60 @@
+#ifndef TEXTURE_BAKER_H_
+#define TEXTURE_BAKER_H_
+
+#include "texture.h"
+
+/*
+Offline baking of texture mip chains into block compressed formats. The levels are downsampled in linear space
+and stored sRGB encoded again, every 4 x 4 px block is encoded independently so all rows of blocks of all levels
+are processed in parallel. Blocks crossing the edge of levels smaller than 4 px repeat the last row and column.
+
+BC1 stores RGB in 4 bpp, BC3 adds the interpolated alpha block (8 bpp) and BC7 is encoded in its mode 6 only
+(single subset RGBA endpoints with 4-bit indices, 8 bpp) which is the best fit for the smooth color textures.
+*/
+
+/*! \struct BakedTexture
+\brief Block compressed mip chain of a single texture.
+*/
+struct BakedTexture
+{
+	BlockFormat format{ BlockFormat::NONE };
+	int width{ 0 }; // base level size (px)
+	int height{ 0 };
+	std::vector<std::vector<BYTE>> mips; // blocks of the levels 0, 1, ... down to 1 x 1 px
+};
+
+/* size of a single 4 x 4 px block (bytes) */
+int BlockSize( const BlockFormat format );
+
+/* size of all blocks of the level with the given size (bytes) */
+size_t BlockImageSize( const BlockFormat format, const int width, const int height );
+
+/* format baked into the scene cache, BC1 for opaque textures and BC3 for textures with alpha (or BC7 for all of them if
+high_quality is set), NONE for textures which cannot be baked (no data, float pixels or base size not divisible by 4) */
+BlockFormat ChooseBlockFormat( const Texture * texture, const bool high_quality = false );
+
+/* OpenGL internal format of the blocks, the colors stay sRGB encoded exactly like the uncompressed uploads */
+GLenum BlockInternalFormat( const BlockFormat format );
+
+/* sRGB correct 2x2 box filter of a single level, color channels of gray, BGR and BGRA pixels are averaged in linear space
+and the alpha channel as is, other pixel sizes are averaged per byte, the last odd row and column are clamped */
+void DownsampleSrgb( const BYTE * src, const int src_width, const int src_height, const int src_scan_width,
+	BYTE * dst, const int dst_width, const int dst_height, const int dst_scan_width, const int pixel_size );
+
+/* converts the BGR(A) texture into tightly packed RGBA8 levels 0, 1, ... down to 1 x 1 px */
+void BuildMipChain( const Texture * texture, std::vector<std::vector<BYTE>> & mips, const int no_threads = 0 );
+
+/* encodes tightly packed RGBA8 image into blocks, rows of blocks are encoded on no_threads threads (0 means all hardware threads) */
+void EncodeBlocks( const BYTE * rgba, const int width, const int height, const BlockFormat format, BYTE * blocks,
+	const int no_threads = 0 );
+
+/* decodes the blocks produced by EncodeBlocks into tightly packed RGBA8 image */
+void DecodeBlocks( const BYTE * blocks, const int width, const int height, const BlockFormat format, BYTE * rgba );
+
+/* builds the mip chain of the texture and encodes all its levels, returns 0 on success and -1 if it cannot be baked */
+int BakeTexture( const Texture * texture, const BlockFormat format, BakedTexture & baked, const int no_threads = 0 );
+
+/* peak signal to noise ratio of the first no_channels channels of two RGBA8 images (dB), infinity for identical images */
+double PSNR( const BYTE * rgba0, const BYTE * rgba1, const size_t no_pixels, const int no_channels );
+
+#endif
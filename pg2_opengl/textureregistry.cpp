@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "textureregistry.h"
+#include "threadpool.h"
+#include "mappedfile.h"
+#include "mymath.h"
+#include <chrono>
+
+TextureRegistry & TextureRegistry::instance()
+{
+	static TextureRegistry registry;
+
+	return registry;
+}
+
+TextureFuture TextureRegistry::Acquire( const std::string & file_name, ThreadPool * pool )
+{
+	// the key covers the whole file content, unreadable files are keyed by their name so they are reported only once
+	unsigned long long key = 0;
+	unsigned long long file_size = 0;
+	{
+		MappedFile file;
+		if ( file.Open( file_name.c_str() ) == 0 )
+		{
+			file_size = file.size();
+			key = FastHash( reinterpret_cast<const BYTE *>( file.data() ), file.size(), file_size );
+		}
+		else
+		{
+			key = FastHash( reinterpret_cast<const BYTE *>( file_name.c_str() ), file_name.size(), ~0ull );
+		}
+	}
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+
+	Entry & entry = entries_[key];
+	++entry.references;
+
+	if ( entry.references > 1 )
+	{
+		++no_shared_;
+		shared_bytes_ += file_size;
+
+		return entry.texture;
+	}
+
+	if ( pool != nullptr )
+	{
+		entry.texture = pool->Submit( [this, file_name, key, file_size]() { return Decode( file_name, key, file_size ); } ).share();
+
+		return entry.texture;
+	}
+
+	// other threads asking for the same content wait for the future while this one decodes without the lock
+	std::promise<Texture *> decoded;
+	entry.texture = decoded.get_future().share();
+	TextureFuture texture = entry.texture;
+	lock.unlock();
+
+	decoded.set_value( Decode( file_name, key, file_size ) );
+
+	return texture;
+}
+
+Texture * TextureRegistry::Acquire( Texture * texture )
+{
+	if ( texture != nullptr )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		std::unordered_map<const Texture *, unsigned long long>::const_iterator key = keys_.find( texture );
+		if ( key != keys_.end() )
+		{
+			++entries_[key->second].references;
+		}
+		else
+		{
+			++external_[texture];
+		}
+	}
+
+	return texture;
+}
+
+void TextureRegistry::Release( Texture * texture )
+{
+	if ( texture == nullptr )
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		std::unordered_map<const Texture *, unsigned long long>::iterator key = keys_.find( texture );
+		if ( key != keys_.end() )
+		{
+			std::unordered_map<unsigned long long, Entry>::iterator entry = entries_.find( key->second );
+			if ( --entry->second.references > 0 )
+			{
+				return;
+			}
+			entries_.erase( entry );
+			keys_.erase( key );
+		}
+		else
+		{
+			std::unordered_map<const Texture *, int>::iterator external = external_.find( texture );
+			if ( external != external_.end() )
+			{
+				if ( --external->second > 0 )
+				{
+					return;
+				}
+				external_.erase( external );
+			}
+		}
+	}
+
+	delete texture;
+}
+
+size_t TextureRegistry::no_textures() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return entries_.size() + external_.size();
+}
+
+size_t TextureRegistry::no_shared() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return no_shared_;
+}
+
+unsigned long long TextureRegistry::shared_bytes() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return shared_bytes_;
+}
+
+unsigned long long TextureRegistry::decoded_bytes() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return decoded_bytes_;
+}
+
+double TextureRegistry::decode_time() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return decode_time_;
+}
+
+Texture * TextureRegistry::Decode( const std::string & file_name, const unsigned long long key, const unsigned long long file_size )
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	Texture * texture = new Texture( file_name.c_str() );
+	const double t = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	keys_[texture] = key;
+	decoded_bytes_ += file_size;
+	decode_time_ += t;
+
+	return texture;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTURE_REGISTRY_H_
+#define TEXTURE_REGISTRY_H_
+
+#include "material.h"
+#include <mutex>
+#include <unordered_map>
+
+class ThreadPool;
+
+/*! \class TextureRegistry
+\brief Process wide registry of reference counted textures deduplicated by the content of their image files.
+
+Image files with identical bytes are decoded only once no matter how they are named or which MTL library references
+them. Every \a Acquire adds one reference owned by the material the texture is assigned to, \a Material::~Material
+drops it through \a Release and the texture is deleted together with its last reference.
+*/
+class TextureRegistry
+{
+public:
+	static TextureRegistry & instance();
+
+	/* returns the texture decoded from the given image file and adds a reference, decoding runs on the pool if set */
+	TextureFuture Acquire( const std::string & file_name, ThreadPool * pool = nullptr );
+
+	/* adds a reference to the texture created by the caller, e.g. over the scene cache */
+	Texture * Acquire( Texture * texture );
+
+	/* drops a reference, the texture is deleted with the last one, textures unknown to the registry are deleted directly */
+	void Release( Texture * texture );
+
+	/* number of live textures */
+	size_t no_textures() const;
+
+	/* number of file acquisitions served by an already registered texture */
+	size_t no_shared() const;
+
+	/* total size of the image files not decoded again thanks to the sharing (bytes) */
+	unsigned long long shared_bytes() const;
+
+	/* total size of the decoded image files (bytes) and the time spent decoding them (s), i.e. the decoding rate */
+	unsigned long long decoded_bytes() const;
+	double decode_time() const;
+
+private:
+	TextureRegistry() { }
+
+	/* decodes the image file and remembers the key of the new texture */
+	Texture * Decode( const std::string & file_name, const unsigned long long key, const unsigned long long file_size );
+
+	struct Entry
+	{
+		TextureFuture texture;
+		int references{ 0 };
+	};
+
+	std::unordered_map<unsigned long long, Entry> entries_; // textures decoded from files by the content key
+	std::unordered_map<const Texture *, unsigned long long> keys_; // content keys of the decoded textures
+	std::unordered_map<const Texture *, int> external_; // references of the textures created by the callers
+
+	size_t no_shared_{ 0 };
+	unsigned long long shared_bytes_{ 0 };
+	unsigned long long decoded_bytes_{ 0 };
+	double decode_time_{ 0.0 };
+
+	mutable std::mutex mutex_; // guards all the above
+
+	TextureRegistry( const TextureRegistry & ) = delete;
+	TextureRegistry & operator=( const TextureRegistry & ) = delete;
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include "pch.h"
+#include "textureresidency.h"
+#include "texturebaker.h"
+#include "glutils.h"
+#include "mymath.h"
+#include <algorithm>
+
+/* number of levels of the GPU copy, textures without the host mip chain get the full chain generated by the driver */
+static int NoLevels( const Texture * texture )
+{
+	if ( texture->no_mips() > 1 )
+	{
+		return texture->no_mips();
+	}
+
+	int no_levels = 1;
+	while ( ( ( texture->width() >> ( no_levels - 1 ) ) > 1 ) || ( ( texture->height() >> ( no_levels - 1 ) ) > 1 ) )
+	{
+		++no_levels;
+	}
+
+	return no_levels;
+}
+
+/* uploads the host levels first_level, ... of the texture into a new resident texture */
+static void UploadLevels( const Texture * texture, const int first_level, GLuint & id, GLuint64 & handle )
+{
+	const int no_levels = texture->no_mips() - first_level;
+	const int width = max( 1, texture->width() >> first_level );
+	const int height = max( 1, texture->height() >> first_level );
+	std::vector<const GLvoid *> mips( no_levels );
+
+	if ( texture->block_format() != BlockFormat::NONE )
+	{
+		// block compressed mip chain baked into the scene cache
+		const BlockFormat format = texture->block_format();
+		std::vector<GLsizei> mip_sizes( no_levels );
+		for ( int i = 0; i < no_levels; ++i )
+		{
+			mips[i] = texture->block_mip_data( first_level + i );
+			mip_sizes[i] = static_cast<GLsizei>( BlockImageSize( format, max( 1, width >> i ), max( 1, height >> i ) ) );
+		}
+		CreateBindlessTexture( id, handle, width, height, BlockInternalFormat( format ), mips.data(), mip_sizes.data(), no_levels );
+	}
+	else if ( texture->no_mips() > 1 )
+	{
+		// the levels are converted to RGBA8 by the SIMD kernels
+		std::vector<std::vector<BYTE>> rgba( no_levels );
+		for ( int i = 0; i < no_levels; ++i )
+		{
+			rgba[i].resize( static_cast<size_t>( max( 1, width >> i ) ) * max( 1, height >> i ) * 4 );
+			texture->CopyToRGBA8( rgba[i].data(), first_level + i );
+			mips[i] = rgba[i].data();
+		}
+		CreateBindlessTexture( id, handle, width, height, mips.data(), no_levels );
+	}
+	else
+	{
+		std::vector<BYTE> rgba( static_cast<size_t>( width ) * height * 4 );
+		texture->CopyToRGBA8( rgba.data() );
+		CreateBindlessTexture( id, handle, width, height, rgba.data() );
+	}
+}
+
+static void DeleteTexture( GLuint & id, GLuint64 & handle )
+{
+	if ( id != 0 )
+	{
+		glMakeTextureHandleNonResidentARB( handle );
+		glDeleteTextures( 1, &id );
+		id = 0;
+		handle = 0;
+	}
+}
+
+TextureResidency::TextureResidency( const size_t budget ) : budget_( budget )
+{
+}
+
+void TextureResidency::set_budget( const size_t budget )
+{
+	budget_ = budget;
+}
+
+size_t TextureResidency::ChainBytes( const Texture * texture, const int first_level, const BlockFormat format )
+{
+	size_t bytes = 0;
+	for ( int level = first_level; level < NoLevels( texture ); ++level )
+	{
+		const int width = max( 1, texture->width() >> level );
+		const int height = max( 1, texture->height() >> level );
+		bytes += ( format != BlockFormat::NONE ) ? BlockImageSize( format, width, height ) : static_cast<size_t>( width ) * height * 4;
+	}
+
+	return bytes;
+}
+
+int TextureResidency::Add( Texture * texture )
+{
+	// the stand-in is the host mip tail, decoded textures get their chain here
+	texture->GenerateMips();
+
+	Entry entry;
+	entry.texture = texture;
+	entry.full_bytes = ChainBytes( texture, 0, texture->block_format() );
+	while ( ( entry.standin_level + 1 < texture->no_mips() ) &&
+		( max( texture->width(), texture->height() ) >> entry.standin_level ) > RESIDENCY_STANDIN_SIZE )
+	{
+		++entry.standin_level;
+	}
+
+	if ( ( entry.standin_level == 0 ) && ( max( texture->width(), texture->height() ) > RESIDENCY_STANDIN_SIZE ) )
+	{
+		// a large texture without the host mip chain, its stand-in is a single texel
+		const Color3f color = texture->texel( 0.5f, 0.5f, false );
+		const GLubyte data[] = { static_cast<GLubyte>( color.r * 255.0f + 0.5f ), static_cast<GLubyte>( color.g * 255.0f + 0.5f ),
+			static_cast<GLubyte>( color.b * 255.0f + 0.5f ), 255 };
+		CreateBindlessTexture( entry.standin_id, entry.standin_handle, 1, 1, data );
+		entry.standin_level = NoLevels( texture ) - 1;
+		entry.standin_bytes = 4;
+	}
+	else
+	{
+		// the stand-in of small textures is their full chain, which is never evicted then
+		UploadLevels( texture, entry.standin_level, entry.standin_id, entry.standin_handle );
+		entry.standin_bytes = ChainBytes( texture, entry.standin_level, texture->block_format() );
+	}
+	resident_bytes_ += entry.standin_bytes;
+
+	entries_.push_back( entry );
+
+	return static_cast<int>( entries_.size() ) - 1;
+}
+
+void TextureResidency::Touch( const int id, const int frame )
+{
+	entries_[id].last_used = frame;
+}
+
+void TextureResidency::Evict( Entry & entry )
+{
+	DeleteTexture( entry.full_id, entry.full_handle );
+	resident_bytes_ -= entry.full_bytes;
+	entry.evicted = true;
+	++no_evictions_;
+}
+
+void TextureResidency::Restore( Entry & entry )
+{
+	UploadLevels( entry.texture, 0, entry.full_id, entry.full_handle );
+	resident_bytes_ += entry.full_bytes;
+	if ( entry.evicted )
+	{
+		++no_reuploads_;
+		reupload_bytes_ += entry.full_bytes;
+	}
+}
+
+int TextureResidency::Update( const int frame )
+{
+	const size_t budget = ( budget_ > 0 ) ? budget_ : SIZE_MAX;
+
+	// textures used by the frame but held by their stand-ins, in the order they were added
+	std::vector<int> requested;
+	for ( size_t i = 0; i < entries_.size(); ++i )
+	{
+		const Entry & entry = entries_[i];
+		if ( ( entry.standin_level > 0 ) && ( entry.full_id == 0 ) && ( entry.last_used == frame ) )
+		{
+			requested.push_back( static_cast<int>( i ) );
+		}
+	}
+
+	if ( requested.empty() && ( resident_bytes_ <= budget ) )
+	{
+		return 0;
+	}
+
+	// resident chains of the textures not used by the frame, the least recently used first
+	std::vector<int> unused;
+	size_t unused_bytes = 0;
+	for ( size_t i = 0; i < entries_.size(); ++i )
+	{
+		if ( ( entries_[i].full_id != 0 ) && ( entries_[i].last_used < frame ) )
+		{
+			unused.push_back( static_cast<int>( i ) );
+			unused_bytes += entries_[i].full_bytes;
+		}
+	}
+	std::sort( unused.begin(), unused.end(), [this]( const int a, const int b )
+	{
+		return ( entries_[a].last_used != entries_[b].last_used ) ? ( entries_[a].last_used < entries_[b].last_used ) : ( a < b );
+	} );
+
+	int no_changed = 0;
+	size_t next = 0;
+	auto evict_until_fits = [&]( const size_t bytes )
+	{
+		while ( ( resident_bytes_ + bytes > budget ) && ( next < unused.size() ) )
+		{
+			Entry & entry = entries_[unused[next++]];
+			unused_bytes -= entry.full_bytes;
+			Evict( entry );
+			++no_changed;
+		}
+	};
+
+	// the budget may have been lowered
+	evict_until_fits( 0 );
+
+	for ( const int i : requested )
+	{
+		Entry & entry = entries_[i];
+		// chains which would not fit even after all unused ones are evicted stay on their stand-ins
+		if ( resident_bytes_ + entry.full_bytes > budget + unused_bytes )
+		{
+			continue;
+		}
+		evict_until_fits( entry.full_bytes );
+		Restore( entry );
+		++no_changed;
+	}
+
+	return no_changed;
+}
+
+GLuint64 TextureResidency::handle( const int id ) const
+{
+	const Entry & entry = entries_[id];
+
+	return ( entry.full_id != 0 ) ? entry.full_handle : entry.standin_handle;
+}
+
+bool TextureResidency::resident( const int id ) const
+{
+	return ( entries_[id].full_id != 0 ) || ( entries_[id].standin_level == 0 );
+}
+
+void TextureResidency::Release()
+{
+	for ( Entry & entry : entries_ )
+	{
+		DeleteTexture( entry.full_id, entry.full_handle );
+		DeleteTexture( entry.standin_id, entry.standin_handle );
+	}
+	entries_.clear();
+	resident_bytes_ = 0;
+}
+
+size_t TextureResidency::budget() const
+{
+	return budget_;
+}
+
+size_t TextureResidency::no_textures() const
+{
+	return entries_.size();
+}
+
+size_t TextureResidency::resident_bytes() const
+{
+	return resident_bytes_;
+}
+
+size_t TextureResidency::no_evictions() const
+{
+	return no_evictions_;
+}
+
+size_t TextureResidency::no_reuploads() const
+{
+	return no_reuploads_;
+}
+
+size_t TextureResidency::reupload_bytes() const
+{
+	return reupload_bytes_;
+}
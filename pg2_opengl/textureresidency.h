@@ -0,0 +1,95 @@
+#ifndef TEXTURE_RESIDENCY_H_
+#define TEXTURE_RESIDENCY_H_
+
+#include "texture.h"
+
+/*! \def RESIDENCY_STANDIN_SIZE
+\brief Largest side of the mip tail kept resident for every texture (px).
+*/
+#define RESIDENCY_STANDIN_SIZE 64
+
+/*! \class TextureResidency
+\brief Keeps the bindless textures resident within the memory budget.
+
+Every texture gets a small stand-in made of its mip tail (levels up to RESIDENCY_STANDIN_SIZE px) which stays resident
+all the time, so a handle sampled by the shaders is always valid. The full mip chain is uploaded only for the textures
+used by the recent frames and only while it fits into the budget: \a Update evicts the least recently used chains of
+the textures not used by the current frame (their handles are made non-resident and the GL textures deleted) and
+restores the chains of the used ones on demand. Used textures never evict each other, if the working set does not fit
+the rest of it stays on the stand-ins (lower mips) instead of thrashing.
+
+All methods have to be called with the GL context current, \a Release must be called before the context is destroyed.
+*/
+class TextureResidency
+{
+public:
+	/* budget of the resident textures (bytes), 0 means unlimited */
+	explicit TextureResidency( const size_t budget = 0 );
+
+	void set_budget( const size_t budget );
+
+	/* registers the texture and uploads its stand-in, the full chain is uploaded by the first Update after Touch,
+	generates the host mip chain of textures without one, returns the id of the texture */
+	int Add( Texture * texture );
+
+	/* marks the texture as used by the frame */
+	void Touch( const int id, const int frame );
+
+	/* evicts and restores the full chains, returns the number of textures whose handle has changed */
+	int Update( const int frame );
+
+	/* handle of the full chain if it is resident or of the stand-in otherwise */
+	GLuint64 handle( const int id ) const;
+
+	/* true if the full chain of the texture is resident */
+	bool resident( const int id ) const;
+
+	/* deletes all GL textures */
+	void Release();
+
+	size_t budget() const;
+	size_t no_textures() const;
+
+	/* bytes of all resident full chains and stand-ins */
+	size_t resident_bytes() const;
+
+	/* number of full chains made non-resident to stay within the budget */
+	size_t no_evictions() const;
+
+	/* number of evicted full chains uploaded again and their total size (bytes) */
+	size_t no_reuploads() const;
+	size_t reupload_bytes() const;
+
+	/* GPU size of the levels first_level, ... of the texture in the given format (RGBA8 for NONE) down to 1 x 1 px (bytes) */
+	static size_t ChainBytes( const Texture * texture, const int first_level, const BlockFormat format );
+
+private:
+	struct Entry
+	{
+		Texture * texture{ nullptr };
+		int standin_level{ 0 }; // first level of the stand-in, 0 if it is the full chain already
+		GLuint full_id{ 0 }; // 0 while the full chain is not resident
+		GLuint64 full_handle{ 0 };
+		GLuint standin_id{ 0 };
+		GLuint64 standin_handle{ 0 };
+		size_t full_bytes{ 0 };
+		size_t standin_bytes{ 0 };
+		int last_used{ -1 }; // frame
+		bool evicted{ false }; // the full chain was resident before
+	};
+
+	void Evict( Entry & entry );
+	void Restore( Entry & entry );
+
+	std::vector<Entry> entries_;
+	size_t budget_{ 0 };
+	size_t resident_bytes_{ 0 };
+	size_t no_evictions_{ 0 };
+	size_t no_reuploads_{ 0 };
+	size_t reupload_bytes_{ 0 };
+
+	TextureResidency( const TextureResidency & ) = delete;
+	TextureResidency & operator=( const TextureResidency & ) = delete;
+};
+
+#endif
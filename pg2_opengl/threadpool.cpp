@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool( const int no_threads )
+{
+	const int threads = ( no_threads > 0 ) ? no_threads : std::max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+
+	for ( int i = 0; i < threads; ++i )
+	{
+		workers_.push_back( std::thread( &ThreadPool::Worker, this ) );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	condition_.notify_all();
+
+	for ( std::thread & worker : workers_ )
+	{
+		worker.join();
+	}
+}
+
+int ThreadPool::no_threads() const
+{
+	return static_cast<int>( workers_.size() );
+}
+
+size_t ThreadPool::no_pending() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return tasks_.size();
+}
+
+void ThreadPool::Enqueue( std::function<void()> task )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		tasks_.push_back( std::move( task ) );
+	}
+	condition_.notify_one();
+}
+
+void ThreadPool::Worker()
+{
+	for ( ;; )
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			condition_.wait( lock, [this]() { return stop_ || !tasks_.empty(); } );
+
+			// the remaining tasks are finished even when stopping
+			if ( tasks_.empty() )
+			{
+				return;
+			}
+
+			task = std::move( tasks_.front() );
+			tasks_.pop_front();
+		}
+
+		task();
+	}
+}
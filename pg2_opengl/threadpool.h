@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <memory>
+
+/*! \class ThreadPool
+\brief Fixed set of worker threads executing the submitted tasks in the FIFO order.
+
+The destructor finishes all queued tasks before the workers are joined, so the futures returned by \a Submit
+are always satisfied.
+*/
+class ThreadPool
+{
+public:
+	/* starts the workers, 0 means all hardware threads */
+	explicit ThreadPool( const int no_threads = 0 );
+	~ThreadPool();
+
+	/* queues the task and returns the future of its result */
+	template<typename F> auto Submit( F task ) -> std::future<decltype( task() )>
+	{
+		typedef decltype( task() ) R;
+
+		std::shared_ptr<std::packaged_task<R()>> packaged_task = std::make_shared<std::packaged_task<R()>>( std::move( task ) );
+		std::future<R> result = packaged_task->get_future();
+		Enqueue( [packaged_task]() { ( *packaged_task )(); } );
+
+		return result;
+	}
+
+	int no_threads() const;
+
+	/* number of queued tasks not picked up by any worker yet */
+	size_t no_pending() const;
+
+private:
+	void Enqueue( std::function<void()> task );
+	void Worker();
+
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> tasks_; // queued tasks, the oldest at the front
+	mutable std::mutex mutex_; // guards tasks_ and stop_
+	std::condition_variable condition_; // signals new tasks and the shutdown
+	bool stop_{ false };
+
+	ThreadPool( const ThreadPool & ) = delete;
+	ThreadPool & operator=( const ThreadPool & ) = delete;
+};
+
+#endif
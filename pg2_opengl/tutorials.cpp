@@ -4,20 +4,383 @@
 #include "objloader.h"
 #include "Rasterizer.h"
 #include "mymath.h"
+#include "softwarerasterizer.h"
+#include <chrono>
+#include <functional>
+#include <set>
+
+/*! \class RasterizerChecks
+\brief Checks of the optimized paths of Rasterizer against their CPU references.
+
+Each check flies the camera of the initialized rasterizer towards its target, releases the device and returns
+EXIT_SUCCESS if the path agrees with its reference and no GL error occurred.
+*/
+class RasterizerChecks
+{
+public:
+	/* tiles requested by the feedback pass and their streaming */
+	static int CheckVirtualTexturing(Rasterizer & r, const int no_frames);
+
+	/* commands kept by the GPU frustum culling and the image of the occlusion culling of a still camera */
+	static int CheckGpuCulling(Rasterizer & r, const int no_frames);
+
+	/* surfaces found visible by the BVH and the image of each frame, the occlusion culling may change the pixels seen
+	through gaps narrower than a pixel of its buffer */
+	static int CheckCpuCulling(Rasterizer & r, const int no_frames);
+
+	/* image of each frame against SoftwareRasterizer, at most 1 % of the pixels may differ (the resampled textures of
+	the texture arrays differ more) */
+	static int CheckSoftware(Rasterizer & r, const int no_frames);
+
+private:
+	/* moves the camera towards its target in no_frames equal steps and calls step( frame ) after each one */
+	static void Fly(Rasterizer & r, const int no_frames, const std::function<void(const int)> & step);
+};
+
+/* CPU reference of InsideFrustum of culling.comp */
+static bool InsideFrustum(const Matrix4x4 & mvp, const Vector3 & aabb_min, const Vector3 & aabb_max)
+{
+	for (int i = 0; i < 6; ++i) {
+		const float sign = ((i & 1) == 0) ? 1.0f : -1.0f;
+		float plane[4];
+		for (int j = 0; j < 4; ++j) {
+			plane[j] = mvp.get(3, j) + sign * mvp.get(i >> 1, j);
+		}
+		const Vector3 corner((plane[0] > 0.0f) ? aabb_max.x : aabb_min.x, (plane[1] > 0.0f) ? aabb_max.y : aabb_min.y,
+			(plane[2] > 0.0f) ? aabb_max.z : aabb_min.z);
+		if (plane[0] * corner.x + plane[1] * corner.y + plane[2] * corner.z + plane[3] < 0.0f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* RGBA8 pixels of the back buffer of the default framebuffer */
+static std::vector<GLubyte> ReadBackBuffer(const int width, const int height)
+{
+	std::vector<GLubyte> pixels(static_cast<size_t>(width) * height * 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	return pixels;
+}
+
+/* pixels whose RGB differ */
+static size_t CountDifferentPixels(const std::vector<GLubyte> & a, const std::vector<GLubyte> & b)
+{
+	size_t no_different = 0;
+	for (size_t i = 0; i < a.size(); i += 4) {
+		no_different += (memcmp(&a[i], &b[i], 3) != 0) ? 1 : 0;
+	}
+
+	return no_different;
+}
+
+void RasterizerChecks::Fly(Rasterizer & r, const int no_frames, const std::function<void(const int)> & step)
+{
+	glBindVertexArray(r.vao);
+
+	const float distance = (r.camera.view_at() - r.camera.view_from()).L2Norm() / (no_frames + 1);
+	for (int frame = 1; frame <= no_frames; ++frame) {
+		r.camera.MoveForward(distance);
+		r.camera.Update();
+		step(frame);
+	}
+}
+
+int RasterizerChecks::CheckVirtualTexturing(Rasterizer & r, const int no_frames)
+{
+	if (!r.virtual_texturing_) return EXIT_FAILURE;
+
+	VirtualTextureCache & cache = r.virtual_textures_;
+	std::vector<unsigned int> & ids = r.feedback_ids_;
+	std::vector<unsigned int> reference;
+	size_t no_pixels = 0;
+	size_t no_matching = 0;
+	size_t no_gpu_tiles = 0;
+	size_t no_cpu_tiles = 0;
+	size_t no_shared_tiles = 0;
+	Fly(r, no_frames, [&](const int frame) {
+		r.drawFrame(frame);
+
+		// pixels and unique tiles of the feedback pass of this frame against the CPU reference
+		cache.LatestFeedback(ids);
+		cache.ReferenceFeedback(r.surfaces_, r.material_textures_, r.camera.projectionMatrix * r.camera.viewMatrix,
+			cache.feedback_width(), cache.feedback_height(), cache.feedback_lod_bias(), reference);
+		for (size_t i = 0; i < reference.size(); ++i) {
+			if ((reference[i] != VT_NO_TILE) || (ids[i] != VT_NO_TILE)) {
+				++no_pixels;
+				no_matching += (reference[i] == ids[i]) ? 1 : 0;
+			}
+		}
+		std::set<unsigned int> gpu_tiles(ids.begin(), ids.end());
+		std::set<unsigned int> cpu_tiles(reference.begin(), reference.end());
+		gpu_tiles.erase(VT_NO_TILE);
+		cpu_tiles.erase(VT_NO_TILE);
+		no_gpu_tiles += gpu_tiles.size();
+		no_cpu_tiles += cpu_tiles.size();
+		for (const unsigned int tile : gpu_tiles) {
+			no_shared_tiles += cpu_tiles.count(tile);
+		}
+
+		// the next frame sees all requested tiles
+		cache.Flush(frame);
+	});
+
+	// the tiles of the last pose still in the feedback ring are streamed, then none may be missing (unless the cache is too small)
+	cache.ProcessFeedback(ids, no_frames + 1);
+	cache.Flush(no_frames + 1);
+	cache.ProcessFeedback(ids, no_frames + 2);
+	const size_t no_missing = cache.no_pending();
+	cache.Flush(no_frames + 2);
+
+	const double pixel_agreement = (no_pixels > 0) ? no_matching / double(no_pixels) : 1.0;
+	const size_t no_union_tiles = no_gpu_tiles + no_cpu_tiles - no_shared_tiles;
+	const double tile_agreement = (no_union_tiles > 0) ? no_shared_tiles / double(no_union_tiles) : 1.0;
+	const GLenum error = glGetError();
+	printf("Virtual texturing of %d frame(s): feedback agrees with the CPU reference in %0.1f %% of pixels and %0.1f %% of tiles,\n",
+		no_frames, pixel_agreement * 100.0, tile_agreement * 100.0);
+	printf("%zu tile(s) uploaded, %zu evicted, %zu resident, %zu missing after the streaming, GL error 0x%x.\n",
+		cache.no_uploads(), cache.no_evictions(), cache.no_resident_tiles(), no_missing, error);
+
+	r.realeaseDevice();
+
+	return ((pixel_agreement >= 0.9) && (tile_agreement >= 0.9) && (no_missing == 0) && (error == GL_NO_ERROR)) ?
+		EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RasterizerChecks::CheckGpuCulling(Rasterizer & r, const int no_frames)
+{
+	if (!r.use_gpu_culling_) return EXIT_FAILURE;
+
+	const int no_draws = r.no_draws;
+	int no_mismatching_frames = 0;
+	size_t no_frustum_culled = 0;
+	size_t no_occlusion_culled = 0;
+	Fly(r, no_frames, [&](const int frame) {
+		r.drawFrame(frame);
+
+		// the drawn commands are exactly those inside the CPU frustum minus the ones behind the depth pyramid
+		const GpuCulling::Stats stats = r.gpu_culling_.stats();
+		const std::vector<GLuint> visible = r.gpu_culling_.visible_objects();
+		const Matrix4x4 mvp = r.camera.projectionMatrix * r.camera.viewMatrix;
+		std::vector<bool> inside(no_draws);
+		GLuint no_inside = 0;
+		for (int s = 0; s < no_draws; ++s) {
+			inside[s] = InsideFrustum(mvp, r.surfaces_[s]->get_aabb_min(), r.surfaces_[s]->get_aabb_max());
+			no_inside += inside[s] ? 1 : 0;
+		}
+		bool agree = (stats.frustum_culled == no_draws - no_inside) && (stats.draw_count + stats.occlusion_culled == no_inside) &&
+			(std::set<GLuint>(visible.begin(), visible.end()).size() == visible.size());
+		for (const GLuint s : visible) {
+			agree = agree && (s < static_cast<GLuint>(no_draws)) && inside[s];
+		}
+		no_mismatching_frames += agree ? 0 : 1;
+		no_frustum_culled += stats.frustum_culled;
+		no_occlusion_culled += stats.occlusion_culled;
+	});
+
+	// the pyramid of a still camera holds the depth of the very same view, skipping the occluded objects must not
+	// change the image
+	std::vector<std::vector<GLubyte>> culled_images;
+	GLuint no_occluded = 0;
+	for (int frame = no_frames + 1; frame <= no_frames + 2; ++frame) {
+		r.drawFrame(frame);
+		no_occluded += r.gpu_culling_.stats().occlusion_culled;
+		culled_images.push_back(ReadBackBuffer(r.camera.width_, r.camera.height_));
+	}
+	r.use_gpu_culling_ = false;
+	r.drawFrame(no_frames + 3);
+	const std::vector<GLubyte> reference_image = ReadBackBuffer(r.camera.width_, r.camera.height_);
+	r.use_gpu_culling_ = true;
+	size_t no_different_pixels = 0;
+	for (const auto & culled_image : culled_images) {
+		no_different_pixels += CountDifferentPixels(culled_image, reference_image);
+	}
+
+	const GLenum error = glGetError();
+	printf("GPU culling of %d frame(s): %d command(s) per frame, %zu culled by the frustum and %zu by the depth pyramid,\n",
+		no_frames, no_draws, no_frustum_culled, no_occlusion_culled);
+	printf("%d frame(s) disagree with the CPU frustum test, %zu pixel(s) of the still frames differ with %u occluded command(s) skipped, GL error 0x%x.\n",
+		no_mismatching_frames, no_different_pixels, no_occluded, error);
+
+	r.realeaseDevice();
+
+	return ((no_mismatching_frames == 0) && (no_different_pixels == 0) && (error == GL_NO_ERROR)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RasterizerChecks::CheckCpuCulling(Rasterizer & r, const int no_frames)
+{
+	if (!r.use_cpu_culling_) return EXIT_FAILURE;
+
+	const int no_draws = r.no_draws;
+	int no_mismatching_frames = 0;
+	size_t no_culled = 0;
+	size_t no_occluded = 0;
+	size_t no_different_pixels = 0;
+	Fly(r, no_frames, [&](const int frame) {
+		r.drawFrame(2 * frame - 1);
+		const std::vector<GLubyte> culled_image = ReadBackBuffer(r.camera.width_, r.camera.height_);
+
+		// the visible surfaces are exactly those passing the test of their own boxes, but for the occluded ones
+		const Matrix4x4 mvp = r.camera.projectionMatrix * r.camera.viewMatrix;
+		std::vector<bool> visible(no_draws, false);
+		bool agree = true;
+		for (const int s : r.visible_surfaces_) {
+			agree = agree && (s >= 0) && (s < no_draws) && !visible[s];
+			visible[s] = true;
+		}
+		int no_inside = 0;
+		for (int s = 0; s < no_draws; ++s) {
+			const bool inside = InsideFrustum(mvp, r.surfaces_[s]->get_aabb_min(), r.surfaces_[s]->get_aabb_max());
+			agree = agree && (inside || !visible[s]);
+			no_inside += inside ? 1 : 0;
+		}
+		const int no_frame_occluded = r.use_occlusion_culling_ ? r.occlusion_culler_.stats().no_occluded : 0;
+		agree = agree && (r.visible_surfaces_.size() + no_frame_occluded == static_cast<size_t>(no_inside));
+		no_mismatching_frames += agree ? 0 : 1;
+		no_culled += no_draws - no_inside;
+		no_occluded += no_frame_occluded;
+
+		// skipping the surfaces outside the frustum must not change a single pixel
+		r.use_cpu_culling_ = false;
+		r.drawFrame(2 * frame);
+		r.use_cpu_culling_ = true;
+		no_different_pixels += CountDifferentPixels(culled_image, ReadBackBuffer(r.camera.width_, r.camera.height_));
+	});
+
+	const GLenum error = glGetError();
+	printf("CPU culling of %d frame(s): %d surface(s) per frame, %zu culled by the frustum, %zu by the occluders, %d frame(s)\n",
+		no_frames, no_draws, no_culled, no_occluded, no_mismatching_frames);
+	printf("disagree with the test of each box, %zu pixel(s) differ from the draw of all surfaces, GL error 0x%x.\n", no_different_pixels, error);
+
+	r.realeaseDevice();
+
+	// a surface seen only through a gap narrower than a pixel of the occlusion buffer may be culled
+	const size_t max_different_pixels = r.use_occlusion_culling_ ? no_frames * r.camera.width_ * r.camera.height_ / 1000 : 0;
+
+	return ((no_mismatching_frames == 0) && (no_different_pixels <= max_different_pixels) && (error == GL_NO_ERROR)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RasterizerChecks::CheckSoftware(Rasterizer & r, const int no_frames)
+{
+	SoftwareRasterizer software(r.camera.width_, r.camera.height_);
+
+	const int tolerance = 24; // of a channel, the edges of the multisampled image and the texels near their borders differ more
+	size_t no_different_pixels = 0;
+	double difference = 0.0;
+	double software_time = 0.0;
+	Fly(r, no_frames, [&](const int frame) {
+		r.drawFrame(frame);
+		const std::vector<GLubyte> image = ReadBackBuffer(r.camera.width_, r.camera.height_);
+
+		const auto t0 = std::chrono::steady_clock::now();
+		software.Render(r.surfaces_, r.materials_, r.camera);
+		software_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		std::vector<GLubyte> reference(image.size());
+		software.CopyToRGBA8(reference.data());
+
+		for (size_t i = 0; i < image.size(); i += 4) {
+			int max_difference = 0;
+			for (int c = 0; c < 3; ++c) {
+				const int d = abs(int(image[i + c]) - int(reference[i + c]));
+				max_difference = max(max_difference, d);
+				difference += d;
+			}
+			no_different_pixels += (max_difference > tolerance) ? 1 : 0;
+		}
+	});
+
+	const GLenum error = glGetError();
+	const size_t no_pixels = static_cast<size_t>(max(1, no_frames)) * r.camera.width_ * r.camera.height_;
+	const SoftwareRasterizer::Stats stats = software.stats();
+	printf("Software rasterizer: %d frame(s) rendered in %s per frame on %d thread(s), %d of %d triangle(s) set up in the last one.\n",
+		no_frames, TimeToString(software_time / max(1, no_frames)).c_str(), software.no_threads(), stats.no_setup, stats.no_triangles);
+	printf("%0.3f %% of the pixels differ from the GL image by more than %d, the mean difference of a channel is %0.2f, GL error 0x%x.\n",
+		100.0 * no_different_pixels / no_pixels, tolerance, difference / (3.0 * no_pixels), error);
+
+	r.realeaseDevice();
+
+	return ((no_different_pixels * 100 <= no_pixels) && (error == GL_NO_ERROR)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 /* create a window and initialize OpenGL context */
-int tutorial_1( const int width, const int height)
+int tutorial_1( const int width, const int height, const TutorialOptions & options)
 {
 	Rasterizer rasterizer(640, 480, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
+	rasterizer.set_texture_budget(static_cast<size_t>(options.texture_budget) << 20);
+	rasterizer.set_texture_arrays(options.texture_arrays);
+	rasterizer.set_gpu_culling(options.gpu_culling);
+	rasterizer.set_cpu_culling(options.cpu_culling);
+	rasterizer.set_occlusion_culling(options.occlusion_culling);
+	rasterizer.set_profiling(options.profiling);
 	rasterizer.InitDevice();
 	rasterizer.initFrameBuffer();
-	rasterizer.loadScene("../../../data/6887_allied_avenger_gi.obj");
+	rasterizer.loadScene(DEFAULT_SCENE);
 	rasterizer.initMaterials();
 	rasterizer.RenderFrame();
 
 	return S_OK;
 }
 
+int tutorial_vt( const int no_test_frames )
+{
+	Rasterizer rasterizer(640, 480, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
+	rasterizer.set_virtual_texturing(true);
+	rasterizer.InitDevice();
+	if (rasterizer.initFrameBuffer() != S_OK) return EXIT_FAILURE;
+	rasterizer.loadScene(DEFAULT_SCENE);
+	rasterizer.initMaterials();
+
+	return (no_test_frames > 0) ? RasterizerChecks::CheckVirtualTexturing(rasterizer, no_test_frames) : rasterizer.RenderFrame();
+}
+
+int tutorial_culling( const int no_test_frames, const bool cpu_culling, const bool occlusion_culling )
+{
+	Rasterizer rasterizer(640, 480, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
+	rasterizer.set_gpu_culling(!cpu_culling);
+	rasterizer.set_cpu_culling(cpu_culling);
+	rasterizer.set_occlusion_culling(occlusion_culling);
+	rasterizer.InitDevice();
+	if (rasterizer.initFrameBuffer() != S_OK) return EXIT_FAILURE;
+	rasterizer.loadScene(DEFAULT_SCENE);
+	rasterizer.initMaterials();
+
+	return (cpu_culling) ? RasterizerChecks::CheckCpuCulling(rasterizer, no_test_frames) :
+		RasterizerChecks::CheckGpuCulling(rasterizer, no_test_frames);
+}
+
+int tutorial_software( const int no_test_frames )
+{
+	Rasterizer rasterizer(640, 480, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
+	rasterizer.InitDevice();
+	if (rasterizer.initFrameBuffer() != S_OK) return EXIT_FAILURE;
+	rasterizer.loadScene(DEFAULT_SCENE);
+	rasterizer.initMaterials();
+
+	return RasterizerChecks::CheckSoftware(rasterizer, no_test_frames);
+}
+
+int tutorial_headless( const int no_frames, const char * path_file, const int width, const int height,
+	const char * capture_prefix, const CaptureFormat capture_format, const bool capture_depth, const char * scene )
+{
+	CameraPath path;
+	if (path_file && (path.Load(path_file) != 0)) return EXIT_FAILURE;
+
+	Rasterizer rasterizer(width, height, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
+	rasterizer.set_headless(true);
+	if (capture_prefix) rasterizer.set_capture(capture_prefix, capture_format, capture_depth);
+	if (rasterizer.InitDevice() != S_OK) return EXIT_FAILURE;
+	if (rasterizer.initFrameBuffer() != S_OK) return EXIT_FAILURE;
+	rasterizer.loadScene((scene) ? scene : DEFAULT_SCENE);
+	rasterizer.initMaterials();
+
+	return rasterizer.RenderFrames(no_frames, (path_file) ? &path : nullptr);
+}
+
 int tutorial_2(const int width, const int height)
 {
 	glfwSetErrorCallback(glfw_callback);
@@ -1,7 +1,37 @@
 #ifndef TUTORIALS_H_
 #define TUTORIALS_H_
 
-int tutorial_1( const int width = 640, const int height = 480);
+#include "framecapture.h"
+
+/* configuration of the rasterizer of tutorial_1 */
+struct TutorialOptions
+{
+	int texture_budget{ 0 }; // budget of the resident textures (MB), 0 means unlimited
+	bool texture_arrays{ false }; // replaces the bindless textures by the texture arrays even if the driver supports them
+	bool gpu_culling{ true }; // culls the draw commands by the compute shaders
+	bool cpu_culling{ false }; // culls the surfaces by their BVH on the CPU instead
+	bool occlusion_culling{ false }; // adds the software occlusion culling to the CPU culling
+	bool profiling{ false }; // prints the CPU and GPU times of the passes (see GpuProfiler)
+};
+
+int tutorial_1( const int width = 640, const int height = 480, const TutorialOptions & options = TutorialOptions() );
+
+/* the same as tutorial_1 with the virtual textures, no_test_frames > 0 checks the feedback and the streaming
+over that many frames instead of the window loop (see RasterizerChecks in tutorials.cpp) */
+int tutorial_vt( const int no_test_frames = 0 );
+
+/* the same as tutorial_1 checking the GPU (or the CPU) culling over the given number of frames instead of the window loop */
+int tutorial_culling( const int no_test_frames, const bool cpu_culling = false, const bool occlusion_culling = false );
+
+/* the same as tutorial_1 comparing the given number of frames with SoftwareRasterizer instead of the window loop */
+int tutorial_software( const int no_test_frames );
+
+/* the same as tutorial_1 without any window, renders no_frames frames of the scene (an OBJ file, the default one if nullptr) of width x height px
+into a pbuffer and exits, the camera follows the path of the file (see CameraPath) if given, the frames are written to
+the image files capture_prefix + frame number if given (see FrameCapture) */
+int tutorial_headless( const int no_frames, const char * path_file = nullptr, const int width = 640, const int height = 480,
+	const char * capture_prefix = nullptr, const CaptureFormat capture_format = CaptureFormat::PNG, const bool capture_depth = false,
+	const char * scene = nullptr );
 
 int tutorial_2(const int width = 640, const int height = 480);
 #endif
@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "uniformring.h"
+#include <chrono>
+
+UniformRing::UniformRing()
+{
+}
+
+UniformRing::~UniformRing()
+{
+}
+
+int UniformRing::Init( const size_t region_size, const int no_regions )
+{
+	Release();
+
+	GLint alignment = 256;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	block_size_ = region_size;
+	region_size_ = ( region_size + alignment - 1 ) / alignment * alignment;
+	fences_.assign( no_regions, nullptr );
+	current_ = -1;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers( 1, &buffer_ );
+	glNamedBufferStorage( buffer_, region_size_ * no_regions, nullptr, flags );
+	mapped_ = static_cast<BYTE *>( glMapNamedBufferRange( buffer_, 0, region_size_ * no_regions, flags ) );
+
+	return ( mapped_ ) ? 0 : -1;
+}
+
+void * UniformRing::Begin()
+{
+	current_ = ( current_ + 1 ) % static_cast<int>( fences_.size() );
+	GLsync & fence = fences_[current_];
+
+	if ( fence )
+	{
+		// the region is still read by a frame in flight only if the CPU is UNIFORM_RING_SIZE frames ahead
+		GLenum status = glClientWaitSync( fence, 0, 0 );
+		if ( status == GL_TIMEOUT_EXPIRED )
+		{
+			const auto t0 = std::chrono::steady_clock::now();
+			do
+			{
+				status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 ); // 1 ms
+			} while ( status == GL_TIMEOUT_EXPIRED );
+			stall_time_ += std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+			++no_stalls_;
+		}
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+
+	return mapped_ + region_size_ * current_;
+}
+
+void UniformRing::Bind( const GLuint binding ) const
+{
+	glBindBufferRange( GL_UNIFORM_BUFFER, binding, buffer_, region_size_ * current_, block_size_ );
+}
+
+void UniformRing::End()
+{
+	fences_[current_] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+void UniformRing::Release()
+{
+	for ( GLsync & fence : fences_ )
+	{
+		if ( fence )
+		{
+			glDeleteSync( fence );
+			fence = nullptr;
+		}
+	}
+	if ( buffer_ != 0 )
+	{
+		glUnmapNamedBuffer( buffer_ );
+		glDeleteBuffers( 1, &buffer_ );
+		buffer_ = 0;
+	}
+	mapped_ = nullptr;
+}
+
+int UniformRing::current() const
+{
+	return current_;
+}
+
+size_t UniformRing::no_stalls() const
+{
+	return no_stalls_;
+}
+
+double UniformRing::stall_time() const
+{
+	return stall_time_;
+}
@@ -0,0 +1,64 @@
+#ifndef UNIFORM_RING_H_
+#define UNIFORM_RING_H_
+
+/*! \def UNIFORM_RING_SIZE
+\brief Number of regions of the uniform ring, i.e. frames the CPU may write ahead of the GPU.
+*/
+#define UNIFORM_RING_SIZE 3
+
+/*! \class UniformRing
+\brief Persistently mapped uniform buffer split into regions written by the consecutive frames.
+
+The buffer is mapped once for its whole lifetime (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT), so the per-frame data
+are written by plain stores without any driver call. Each frame writes the next region and binds it by
+glBindBufferRange, the region is fenced once the frame is submitted and \a Begin waits for the fence only when the CPU
+wraps around to a region the GPU may still read, which happens only if the CPU gets UNIFORM_RING_SIZE frames ahead.
+
+All methods have to be called with the GL context current (GL 4.4 at least), \a Release must be called before the
+context is destroyed.
+*/
+class UniformRing
+{
+public:
+	UniformRing();
+	~UniformRing();
+
+	/* creates the buffer of no_regions regions of at least region_size bytes each, returns 0 on success */
+	int Init( const size_t region_size, const int no_regions = UNIFORM_RING_SIZE );
+
+	/* moves to the next region, waits until the GPU is done with it and returns its mapped memory */
+	void * Begin();
+
+	/* binds the current region to the given uniform block binding */
+	void Bind( const GLuint binding ) const;
+
+	/* fences the current region after the commands reading it have been issued */
+	void End();
+
+	/* index of the region written by the current frame, other per-frame buffers of no_regions regions may follow the
+	same fences */
+	int current() const;
+
+	/* unmaps and deletes the buffer and all fences */
+	void Release();
+
+	/* number of Begin calls which had to wait for the GPU and their total waiting time (s) */
+	size_t no_stalls() const;
+	double stall_time() const;
+
+private:
+	GLuint buffer_{ 0 };
+	BYTE * mapped_{ nullptr };
+	size_t region_size_{ 0 }; // aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	size_t block_size_{ 0 }; // size bound by Bind
+	int current_{ -1 };
+	std::vector<GLsync> fences_; // one per region, 0 if the region is free
+
+	size_t no_stalls_{ 0 };
+	double stall_time_{ 0.0 };
+
+	UniformRing( const UniformRing & ) = delete;
+	UniformRing & operator=( const UniformRing & ) = delete;
+};
+
+#endif
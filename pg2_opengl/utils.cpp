@@ -1,5 +1,8 @@
 #include "pch.h"
 #include "utils.h"
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 using std::mt19937;
 using std::uniform_real_distribution;
@@ -201,6 +204,70 @@ char * Trim( char * s )
 	return RTrim( LTrim( s ) );
 }
 
+char * NextToken( char * s, const char * delimiters, char ** state )
+{
+	char * token = ( s != NULL ) ? s : *state;
+
+	if ( token == NULL )
+	{
+		return NULL;
+	}
+
+	token += strspn( token, delimiters );
+	if ( *token == 0 )
+	{
+		*state = NULL;
+
+		return NULL;
+	}
+
+	char * token_end = token + strcspn( token, delimiters );
+	if ( *token_end != 0 )
+	{
+		*token_end++ = 0;
+	}
+	*state = token_end;
+
+	return token;
+}
+
+void ParallelFor( const int count, const int no_threads, const std::function<void( const int )> & body )
+{
+	int threads = ( no_threads > 0 ) ? no_threads : static_cast<int>( std::thread::hardware_concurrency() );
+	threads = std::max( 1, std::min( threads, count ) );
+
+	if ( threads == 1 )
+	{
+		for ( int i = 0; i < count; ++i )
+		{
+			body( i );
+		}
+
+		return;
+	}
+
+	std::atomic<int> next_index{ 0 };
+	auto worker = [&]()
+	{
+		for ( int i = next_index++; i < count; i = next_index++ )
+		{
+			body( i );
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for ( int t = 1; t < threads; ++t )
+	{
+		workers.push_back( std::thread( worker ) );
+	}
+	worker(); // the calling thread works too
+
+	for ( std::thread & t : workers )
+	{
+		t.join();
+	}
+}
+
 bool check_gl(const GLenum error)
 {
 	if (error != GL_NO_ERROR)
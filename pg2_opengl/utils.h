@@ -96,6 +96,24 @@ char * RTrim( char * s );
 */
 char * Trim( char *s );
 
+/*! \fn char * NextToken( char * s, const char * delimiters, char ** state )
+\brief Reentrantn nhrada funkce strtok, stav tokenizru je uloen v \a state msto globln promnn.
+\param s etzec pi prvnm voln, NULL pi dalch volnch.
+\param delimiters oddlovae token.
+\param state ukazatel na pozici za poslednm tokenem.
+\return Ukazatel na dal token nebo NULL, pokud u dn nen.
+*/
+char * NextToken( char * s, const char * delimiters, char ** state );
+
+/*! \fn void ParallelFor( const int count, const int no_threads, const std::function<void( const int )> & body )
+\brief Zavol \a body pro vechny indexy z intervalu <0, count) na \a no_threads vlknech.
+Indexy jsou vlknm pidlovny postupn, nerovnomrn prce se tak vyrovn.
+\param count Poet index.
+\param no_threads Poet vlken, 0 znamen vechna hardwarov vlkna.
+\param body Funkce volan pro kad index.
+*/
+void ParallelFor( const int count, const int no_threads, const std::function<void( const int )> & body );
+
 bool check_gl(const GLenum error);
 
 /* glfw callback */
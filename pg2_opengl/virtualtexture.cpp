@@ -0,0 +1,632 @@
+#include "pch.h"
+#include "virtualtexture.h"
+#include "mymath.h"
+#include <algorithm>
+
+#define VT_RESIDENT_BIT 0x80000000u
+
+/* number of tiles of the level in one direction */
+static int TileCount( const int level_size )
+{
+	return ( level_size + VT_TILE_SIZE - 1 ) / VT_TILE_SIZE;
+}
+
+VirtualTextureCache::VirtualTextureCache( const int slots_x, const int slots_y, const int max_uploads ) :
+	slots_x_( slots_x ), slots_y_( slots_y ), max_uploads_( max_uploads )
+{
+}
+
+VirtualTextureCache::~VirtualTextureCache()
+{
+}
+
+int VirtualTextureCache::Init( const int width, const int height, const int feedback_latency )
+{
+	slots_.assign( static_cast<size_t>( slots_x_ ) * slots_y_, Slot() );
+
+	glCreateTextures( GL_TEXTURE_2D, 1, &cache_texture_ );
+	glTextureStorage2D( cache_texture_, 1, GL_RGBA8, slots_x_ * VT_SLOT_SIZE, slots_y_ * VT_SLOT_SIZE );
+	glTextureParameteri( cache_texture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTextureParameteri( cache_texture_, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTextureParameteri( cache_texture_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTextureParameteri( cache_texture_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+	glCreateBuffers( 1, &ssbo_textures_ );
+	glCreateBuffers( 1, &ssbo_page_table_ );
+	tables_dirty_ = true;
+
+	// tile ids of the low resolution feedback pass
+	feedback_width_ = max( 1, width / VT_FEEDBACK_SCALE );
+	feedback_height_ = max( 1, height / VT_FEEDBACK_SCALE );
+	glCreateRenderbuffers( 1, &feedback_color_ );
+	glNamedRenderbufferStorage( feedback_color_, GL_R32UI, feedback_width_, feedback_height_ );
+	glCreateRenderbuffers( 1, &feedback_depth_ );
+	glNamedRenderbufferStorage( feedback_depth_, GL_DEPTH_COMPONENT24, feedback_width_, feedback_height_ );
+	glCreateFramebuffers( 1, &feedback_fbo_ );
+	glNamedFramebufferRenderbuffer( feedback_fbo_, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedback_color_ );
+	glNamedFramebufferRenderbuffer( feedback_fbo_, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth_ );
+	glNamedFramebufferDrawBuffer( feedback_fbo_, GL_COLOR_ATTACHMENT0 );
+	glNamedFramebufferReadBuffer( feedback_fbo_, GL_COLOR_ATTACHMENT0 );
+
+	feedback_latency_ = max( 0, feedback_latency );
+	feedback_slots_.resize( max( 1, feedback_latency_ ) );
+	for ( FeedbackSlot & slot : feedback_slots_ )
+	{
+		glCreateBuffers( 1, &slot.buffer );
+		glNamedBufferStorage( slot.buffer, static_cast<size_t>( feedback_width_ ) * feedback_height_ * sizeof( GLuint ), nullptr,
+			GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT );
+	}
+	next_feedback_ = 0;
+	last_feedback_ = -1;
+
+	return ( glCheckNamedFramebufferStatus( feedback_fbo_, GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE ) ? 0 : -1;
+}
+
+int VirtualTextureCache::Add( Texture * texture )
+{
+	if ( textures_.size() >= ( 1 << 12 ) )
+	{
+		return -1;
+	}
+
+	texture->GenerateMips();
+
+	// paged levels end with the first one fitting into a single tile
+	GLVirtualTexture gl_texture = {};
+	gl_texture.width = texture->width();
+	gl_texture.height = texture->height();
+	gl_texture.no_levels = 1;
+	while ( ( gl_texture.no_levels < min( texture->no_mips(), VT_MAX_LEVELS ) ) &&
+		( ( max( 1, texture->width() >> ( gl_texture.no_levels - 1 ) ) > VT_TILE_SIZE ) ||
+		( max( 1, texture->height() >> ( gl_texture.no_levels - 1 ) ) > VT_TILE_SIZE ) ) )
+	{
+		++gl_texture.no_levels;
+	}
+	for ( int level = 0; level < gl_texture.no_levels; ++level )
+	{
+		gl_texture.level_offsets[level] = static_cast<GLint>( page_table_.size() );
+		page_table_.resize( page_table_.size() + static_cast<size_t>( TileCount( max( 1, texture->width() >> level ) ) ) *
+			TileCount( max( 1, texture->height() >> level ) ), 0 );
+	}
+
+	const int id = static_cast<int>( textures_.size() );
+	textures_.push_back( texture );
+	gl_textures_.push_back( gl_texture );
+	tables_dirty_ = true;
+
+	// the tail tiles are the last resort of every lookup
+	const int tail = gl_texture.no_levels - 1;
+	for ( int y = 0; y < TileCount( max( 1, texture->height() >> tail ) ); ++y )
+	{
+		for ( int x = 0; x < TileCount( max( 1, texture->width() >> tail ) ); ++x )
+		{
+			UploadTile( PackTile( id, tail, x, y ), CutTile( texture, tail, x, y ), 0, true );
+		}
+	}
+
+	return id;
+}
+
+unsigned int VirtualTextureCache::PackTile( const int texture, const int level, const int x, const int y )
+{
+	return ( static_cast<unsigned int>( texture ) << 20 ) | ( static_cast<unsigned int>( level ) << 16 ) |
+		( static_cast<unsigned int>( y ) << 8 ) | static_cast<unsigned int>( x );
+}
+
+void VirtualTextureCache::UnpackTile( const unsigned int id, int & texture, int & level, int & x, int & y )
+{
+	texture = static_cast<int>( id >> 20 );
+	level = static_cast<int>( ( id >> 16 ) & 0xf );
+	y = static_cast<int>( ( id >> 8 ) & 0xff );
+	x = static_cast<int>( id & 0xff );
+}
+
+size_t VirtualTextureCache::PageEntry( const unsigned int tile ) const
+{
+	int texture, level, x, y;
+	UnpackTile( tile, texture, level, x, y );
+	const GLVirtualTexture & gl_texture = gl_textures_[texture];
+
+	return gl_texture.level_offsets[level] + static_cast<size_t>( y ) * TileCount( max( 1, gl_texture.width >> level ) ) + x;
+}
+
+std::vector<BYTE> VirtualTextureCache::CutTile( const Texture * texture, const int level, const int x, const int y )
+{
+	std::vector<BYTE> rgba( VT_SLOT_SIZE * VT_SLOT_SIZE * 4 );
+	texture->CopyRegionToRGBA8( rgba.data(), level, x * VT_TILE_SIZE - VT_TILE_BORDER, y * VT_TILE_SIZE - VT_TILE_BORDER,
+		VT_SLOT_SIZE, VT_SLOT_SIZE );
+
+	return rgba;
+}
+
+bool VirtualTextureCache::UploadTile( const unsigned int tile, const std::vector<BYTE> & rgba, const int frame, const bool pinned )
+{
+	// a free slot or the least recently used one not used by the frame
+	int best = -1;
+	for ( int i = 0; i < static_cast<int>( slots_.size() ); ++i )
+	{
+		const Slot & slot = slots_[i];
+		if ( slot.tile == VT_NO_TILE )
+		{
+			best = i;
+			break;
+		}
+		if ( !slot.pinned && ( slot.last_used < frame ) && ( ( best < 0 ) || ( slot.last_used < slots_[best].last_used ) ) )
+		{
+			best = i;
+		}
+	}
+	if ( best < 0 )
+	{
+		return false;
+	}
+
+	Slot & slot = slots_[best];
+	if ( slot.tile != VT_NO_TILE )
+	{
+		page_table_[PageEntry( slot.tile )] = 0;
+		++no_evictions_;
+	}
+
+	const int slot_x = best % slots_x_;
+	const int slot_y = best / slots_x_;
+	glTextureSubImage2D( cache_texture_, 0, slot_x * VT_SLOT_SIZE, slot_y * VT_SLOT_SIZE, VT_SLOT_SIZE, VT_SLOT_SIZE,
+		GL_RGBA, GL_UNSIGNED_BYTE, rgba.data() );
+
+	page_table_[PageEntry( tile )] = VT_RESIDENT_BIT | ( static_cast<GLuint>( slot_y ) << 16 ) | static_cast<GLuint>( slot_x );
+	slot.tile = tile;
+	slot.last_used = frame;
+	slot.pinned = pinned;
+	tables_dirty_ = true;
+	++no_uploads_;
+
+	return true;
+}
+
+void VirtualTextureCache::BeginFeedback()
+{
+	const GLuint clear_tile[] = { VT_NO_TILE, VT_NO_TILE, VT_NO_TILE, VT_NO_TILE };
+	const GLfloat clear_depth = 1.0f;
+
+	glBindFramebuffer( GL_FRAMEBUFFER, feedback_fbo_ );
+	glViewport( 0, 0, feedback_width_, feedback_height_ );
+	glClearBufferuiv( GL_COLOR, 0, clear_tile );
+	glClearBufferfv( GL_DEPTH, 0, &clear_depth );
+}
+
+bool VirtualTextureCache::EndFeedback( std::vector<unsigned int> & ids )
+{
+	FeedbackSlot & slot = feedback_slots_[next_feedback_];
+	last_feedback_ = next_feedback_;
+	next_feedback_ = ( next_feedback_ + 1 ) % static_cast<int>( feedback_slots_.size() );
+
+	// the feedback read latency frames ago, normally finished long before
+	bool retired = false;
+	if ( slot.fence )
+	{
+		RetireFeedback( slot, ids );
+		retired = true;
+	}
+
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.buffer );
+	glReadPixels( 0, 0, feedback_width_, feedback_height_, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	if ( feedback_latency_ == 0 )
+	{
+		RetireFeedback( slot, ids );
+		retired = true;
+	}
+
+	return retired;
+}
+
+void VirtualTextureCache::LatestFeedback( std::vector<unsigned int> & ids ) const
+{
+	ids.assign( static_cast<size_t>( feedback_width_ ) * feedback_height_, VT_NO_TILE );
+	if ( last_feedback_ >= 0 )
+	{
+		// waits for the read
+		glGetNamedBufferSubData( feedback_slots_[last_feedback_].buffer, 0, ids.size() * sizeof( GLuint ), ids.data() );
+	}
+}
+
+void VirtualTextureCache::RetireFeedback( FeedbackSlot & slot, std::vector<unsigned int> & ids )
+{
+	GLenum status = glClientWaitSync( slot.fence, 0, 0 );
+	while ( status == GL_TIMEOUT_EXPIRED )
+	{
+		status = glClientWaitSync( slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 ); // 1 ms
+	}
+	glDeleteSync( slot.fence );
+	slot.fence = nullptr;
+
+	ids.resize( static_cast<size_t>( feedback_width_ ) * feedback_height_ );
+	const void * mapped = glMapNamedBufferRange( slot.buffer, 0, ids.size() * sizeof( GLuint ), GL_MAP_READ_BIT );
+	if ( mapped )
+	{
+		memcpy( ids.data(), mapped, ids.size() * sizeof( GLuint ) );
+	}
+	else
+	{
+		std::fill( ids.begin(), ids.end(), VT_NO_TILE );
+	}
+	glUnmapNamedBuffer( slot.buffer );
+}
+
+void VirtualTextureCache::ProcessFeedback( const std::vector<unsigned int> & ids, const int frame )
+{
+	std::vector<unsigned int> tiles( ids );
+	std::sort( tiles.begin(), tiles.end() );
+	tiles.erase( std::unique( tiles.begin(), tiles.end() ), tiles.end() );
+
+	std::vector<unsigned int> missing;
+	for ( const unsigned int tile : tiles )
+	{
+		int texture, level, x, y;
+		UnpackTile( tile, texture, level, x, y );
+		if ( ( tile == VT_NO_TILE ) || ( texture >= static_cast<int>( textures_.size() ) ) || ( level >= gl_textures_[texture].no_levels ) ||
+			( x >= TileCount( max( 1, gl_textures_[texture].width >> level ) ) ) ||
+			( y >= TileCount( max( 1, gl_textures_[texture].height >> level ) ) ) )
+		{
+			continue;
+		}
+
+		// the resident tile or the coarser one replacing the missing tile is used by the frame
+		for ( int l = level; l < gl_textures_[texture].no_levels; ++l )
+		{
+			const GLuint page = page_table_[PageEntry( PackTile( texture, l, x >> ( l - level ), y >> ( l - level ) ) )];
+			if ( page & VT_RESIDENT_BIT )
+			{
+				slots_[( ( page >> 16 ) & 0x7fff ) * slots_x_ + ( page & 0xffff )].last_used = frame;
+				break;
+			}
+		}
+		if ( !( page_table_[PageEntry( tile )] & VT_RESIDENT_BIT ) && ( pending_tiles_.count( tile ) == 0 ) )
+		{
+			missing.push_back( tile );
+		}
+	}
+
+	// coarser levels first, there is no point in streaming more tiles than the cache holds
+	std::stable_sort( missing.begin(), missing.end(), []( const unsigned int a, const unsigned int b )
+	{
+		return ( ( a >> 16 ) & 0xf ) > ( ( b >> 16 ) & 0xf );
+	} );
+	for ( const unsigned int tile : missing )
+	{
+		if ( pending_.size() >= slots_.size() )
+		{
+			break;
+		}
+		int texture, level, x, y;
+		UnpackTile( tile, texture, level, x, y );
+		const Texture * source = textures_[texture];
+		pending_.emplace_back( tile, streamer_.Submit( [source, level, x, y]() { return CutTile( source, level, x, y ); } ) );
+		pending_tiles_.insert( tile );
+	}
+}
+
+int VirtualTextureCache::Update( const int frame )
+{
+	int no_uploaded = 0;
+	for ( auto it = pending_.begin(); ( it != pending_.end() ) && ( no_uploaded < max_uploads_ ); )
+	{
+		if ( it->second.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready )
+		{
+			// tiles which do not fit into the cache are requested again by a later feedback
+			no_uploaded += ( UploadTile( it->first, it->second.get(), frame, false ) ) ? 1 : 0;
+			pending_tiles_.erase( it->first );
+			it = pending_.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	return no_uploaded;
+}
+
+int VirtualTextureCache::Flush( const int frame )
+{
+	int no_uploaded = 0;
+	for ( auto & tile : pending_ )
+	{
+		no_uploaded += ( UploadTile( tile.first, tile.second.get(), frame, false ) ) ? 1 : 0;
+	}
+	pending_.clear();
+	pending_tiles_.clear();
+
+	return no_uploaded;
+}
+
+void VirtualTextureCache::Bind( const GLuint texture_unit, const GLuint textures_binding, const GLuint page_table_binding )
+{
+	if ( tables_dirty_ )
+	{
+		// the buffers must not be empty even without any virtual texture
+		const GLVirtualTexture empty_texture = {};
+		const GLuint empty_page = 0;
+		glNamedBufferData( ssbo_textures_, max<size_t>( 1, gl_textures_.size() ) * sizeof( GLVirtualTexture ),
+			( gl_textures_.empty() ) ? &empty_texture : gl_textures_.data(), GL_DYNAMIC_DRAW );
+		if ( gl_page_table_size_ != max<size_t>( 1, page_table_.size() ) )
+		{
+			gl_page_table_size_ = max<size_t>( 1, page_table_.size() );
+			glNamedBufferData( ssbo_page_table_, gl_page_table_size_ * sizeof( GLuint ),
+				( page_table_.empty() ) ? &empty_page : page_table_.data(), GL_DYNAMIC_DRAW );
+		}
+		else
+		{
+			glNamedBufferSubData( ssbo_page_table_, 0, gl_page_table_size_ * sizeof( GLuint ),
+				( page_table_.empty() ) ? &empty_page : page_table_.data() );
+		}
+		tables_dirty_ = false;
+	}
+
+	glBindTextureUnit( texture_unit, cache_texture_ );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, textures_binding, ssbo_textures_ );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, page_table_binding, ssbo_page_table_ );
+}
+
+unsigned int VirtualTextureCache::TileId( const int texture, const float u, const float v, const float dudx, const float dvdx,
+	const float dudy, const float dvdy, const float lod_bias ) const
+{
+	// the same as VirtualLevel, VirtualTexel and VirtualTile of vt_common.glsl
+	const GLVirtualTexture & gl_texture = gl_textures_[texture];
+	const float rho = max( sqrtf( sqr( dudx * gl_texture.width ) + sqr( dvdx * gl_texture.height ) ),
+		sqrtf( sqr( dudy * gl_texture.width ) + sqr( dvdy * gl_texture.height ) ) );
+	const float lod = log2f( max( rho, 1e-8f ) ) + lod_bias;
+	const int level = max( 0, min( gl_texture.no_levels - 1, static_cast<int>( floorf( lod + 0.5f ) ) ) );
+
+	const int level_width = max( 1, gl_texture.width >> level );
+	const int level_height = max( 1, gl_texture.height >> level );
+	const int x = min( static_cast<int>( ( u - floorf( u ) ) * level_width ), level_width - 1 );
+	const int y = min( static_cast<int>( ( v - floorf( v ) ) * level_height ), level_height - 1 );
+
+	return PackTile( texture, level, x / VT_TILE_SIZE, y / VT_TILE_SIZE );
+}
+
+/* vertex of the CPU reference in clip space with its texture coordinates */
+struct ClipVertex
+{
+	float x, y, z, w;
+	float u, v;
+};
+
+void VirtualTextureCache::ReferenceFeedback( const std::vector<Surface *> & surfaces, const std::vector<int> & material_textures,
+	const Matrix4x4 & mvp, const int width, const int height, const float lod_bias, std::vector<unsigned int> & ids ) const
+{
+	ids.assign( static_cast<size_t>( width ) * height, VT_NO_TILE );
+	std::vector<float> depth( ids.size(), 1.0f );
+
+	float m[4][4];
+	for ( int r = 0; r < 4; ++r )
+	{
+		for ( int c = 0; c < 4; ++c )
+		{
+			m[r][c] = mvp.get( r, c );
+		}
+	}
+
+	// rasterizes a triangle in clip space in front of the near plane, pixel centers and the attributes like OpenGL
+	auto rasterize = [&]( const ClipVertex & a, const ClipVertex & b, const ClipVertex & c, const int texture )
+	{
+		const ClipVertex * v[3] = { &a, &b, &c };
+		float sx[3], sy[3], sz[3], iw[3], uw[3], vw[3];
+		for ( int i = 0; i < 3; ++i )
+		{
+			iw[i] = 1.0f / v[i]->w;
+			sx[i] = ( v[i]->x * iw[i] * 0.5f + 0.5f ) * width;
+			sy[i] = ( v[i]->y * iw[i] * 0.5f + 0.5f ) * height;
+			sz[i] = v[i]->z * iw[i];
+			uw[i] = v[i]->u * iw[i];
+			vw[i] = v[i]->v * iw[i];
+		}
+		const float area = ( sx[1] - sx[0] ) * ( sy[2] - sy[0] ) - ( sx[2] - sx[0] ) * ( sy[1] - sy[0] );
+		if ( area == 0.0f )
+		{
+			return;
+		}
+
+		const int x0 = max( 0, static_cast<int>( floorf( min( sx[0], min( sx[1], sx[2] ) ) ) ) );
+		const int x1 = min( width - 1, static_cast<int>( ceilf( max( sx[0], max( sx[1], sx[2] ) ) ) ) );
+		const int y0 = max( 0, static_cast<int>( floorf( min( sy[0], min( sy[1], sy[2] ) ) ) ) );
+		const int y1 = min( height - 1, static_cast<int>( ceilf( max( sy[0], max( sy[1], sy[2] ) ) ) ) );
+
+		// barycentric coordinates of any point of the screen, both orientations are drawn
+		auto barycentric = [&]( const float px, const float py, float w[3] )
+		{
+			w[0] = ( ( sx[1] - px ) * ( sy[2] - py ) - ( sx[2] - px ) * ( sy[1] - py ) ) / area;
+			w[1] = ( ( sx[2] - px ) * ( sy[0] - py ) - ( sx[0] - px ) * ( sy[2] - py ) ) / area;
+			w[2] = 1.0f - w[0] - w[1];
+		};
+		// perspective correct texture coordinates
+		auto texcoord = [&]( const float w[3], float & u, float & t )
+		{
+			const float one_over_w = w[0] * iw[0] + w[1] * iw[1] + w[2] * iw[2];
+			u = ( w[0] * uw[0] + w[1] * uw[1] + w[2] * uw[2] ) / one_over_w;
+			t = ( w[0] * vw[0] + w[1] * vw[1] + w[2] * vw[2] ) / one_over_w;
+		};
+
+		for ( int y = y0; y <= y1; ++y )
+		{
+			for ( int x = x0; x <= x1; ++x )
+			{
+				float w[3];
+				barycentric( x + 0.5f, y + 0.5f, w );
+				if ( ( w[0] < 0.0f ) || ( w[1] < 0.0f ) || ( w[2] < 0.0f ) )
+				{
+					continue;
+				}
+				const float z = w[0] * sz[0] + w[1] * sz[1] + w[2] * sz[2];
+				const size_t pixel = static_cast<size_t>( y ) * width + x;
+				if ( ( z > 1.0f ) || ( z >= depth[pixel] ) )
+				{
+					continue;
+				}
+				depth[pixel] = z;
+
+				if ( texture < 0 )
+				{
+					ids[pixel] = VT_NO_TILE;
+					continue;
+				}
+				// derivatives are the differences to the neighbouring pixels like dFdx and dFdy
+				float u, t, u_x, t_x, u_y, t_y, wx[3], wy[3];
+				texcoord( w, u, t );
+				barycentric( x + 1.5f, y + 0.5f, wx );
+				texcoord( wx, u_x, t_x );
+				barycentric( x + 0.5f, y + 1.5f, wy );
+				texcoord( wy, u_y, t_y );
+				ids[pixel] = TileId( texture, u, t, u_x - u, t_x - t, u_y - u, t_y - t, lod_bias );
+			}
+		}
+	};
+
+	for ( Surface * surface : surfaces )
+	{
+		const Material * material = surface->get_material();
+		const int texture = ( material && ( material->materialIndex < static_cast<int>( material_textures.size() ) ) ) ?
+			material_textures[material->materialIndex] : -1;
+		const Vertex * vertices = surface->get_vertices();
+		const Triangle3ui * indices = surface->get_indices();
+
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			const unsigned int corners[3] = { indices[i].v0, indices[i].v1, indices[i].v2 };
+			ClipVertex clip[3];
+			for ( int j = 0; j < 3; ++j )
+			{
+				const Vertex & vertex = vertices[corners[j]];
+				const float p[4] = { vertex.position.x, vertex.position.y, vertex.position.z, 1.0f };
+				float * q = &clip[j].x;
+				for ( int r = 0; r < 4; ++r )
+				{
+					q[r] = m[r][0] * p[0] + m[r][1] * p[1] + m[r][2] * p[2] + m[r][3] * p[3];
+				}
+				clip[j].u = vertex.texture_coords[0].u;
+				clip[j].v = 1.0f - vertex.texture_coords[0].v; // the same flip as the vertex shader
+			}
+
+			// clipped by the near plane z = -w into a polygon of up to 4 vertices
+			ClipVertex polygon[4];
+			int no_vertices = 0;
+			for ( int j = 0; j < 3; ++j )
+			{
+				const ClipVertex & p = clip[j];
+				const ClipVertex & q = clip[( j + 1 ) % 3];
+				const float dp = p.z + p.w;
+				const float dq = q.z + q.w;
+				if ( dp >= 0.0f )
+				{
+					polygon[no_vertices++] = p;
+				}
+				if ( ( dp >= 0.0f ) != ( dq >= 0.0f ) )
+				{
+					const float t = dp / ( dp - dq );
+					polygon[no_vertices++] = ClipVertex{ p.x + t * ( q.x - p.x ), p.y + t * ( q.y - p.y ), p.z + t * ( q.z - p.z ),
+						p.w + t * ( q.w - p.w ), p.u + t * ( q.u - p.u ), p.v + t * ( q.v - p.v ) };
+				}
+			}
+			for ( int j = 2; j < no_vertices; ++j )
+			{
+				if ( ( polygon[0].w > 0.0f ) && ( polygon[j - 1].w > 0.0f ) && ( polygon[j].w > 0.0f ) )
+				{
+					rasterize( polygon[0], polygon[j - 1], polygon[j], texture );
+				}
+			}
+		}
+	}
+}
+
+void VirtualTextureCache::Release()
+{
+	for ( auto & tile : pending_ )
+	{
+		tile.second.wait();
+	}
+	pending_.clear();
+	pending_tiles_.clear();
+
+	glDeleteTextures( 1, &cache_texture_ );
+	glDeleteBuffers( 1, &ssbo_textures_ );
+	glDeleteBuffers( 1, &ssbo_page_table_ );
+	glDeleteFramebuffers( 1, &feedback_fbo_ );
+	glDeleteRenderbuffers( 1, &feedback_color_ );
+	glDeleteRenderbuffers( 1, &feedback_depth_ );
+	for ( FeedbackSlot & slot : feedback_slots_ )
+	{
+		if ( slot.fence )
+		{
+			glDeleteSync( slot.fence );
+		}
+		glDeleteBuffers( 1, &slot.buffer );
+	}
+	feedback_slots_.clear();
+	last_feedback_ = -1;
+	cache_texture_ = ssbo_textures_ = ssbo_page_table_ = feedback_fbo_ = feedback_color_ = feedback_depth_ = 0;
+	gl_page_table_size_ = 0;
+}
+
+int VirtualTextureCache::feedback_width() const
+{
+	return feedback_width_;
+}
+
+int VirtualTextureCache::feedback_height() const
+{
+	return feedback_height_;
+}
+
+float VirtualTextureCache::feedback_lod_bias() const
+{
+	return -log2f( static_cast<float>( VT_FEEDBACK_SCALE ) );
+}
+
+size_t VirtualTextureCache::no_textures() const
+{
+	return textures_.size();
+}
+
+size_t VirtualTextureCache::no_resident_tiles() const
+{
+	return std::count_if( slots_.begin(), slots_.end(), []( const Slot & slot ) { return slot.tile != VT_NO_TILE; } );
+}
+
+size_t VirtualTextureCache::no_uploads() const
+{
+	return no_uploads_;
+}
+
+size_t VirtualTextureCache::no_evictions() const
+{
+	return no_evictions_;
+}
+
+size_t VirtualTextureCache::no_pending() const
+{
+	return pending_.size();
+}
+
+size_t VirtualTextureCache::cache_bytes() const
+{
+	return static_cast<size_t>( slots_x_ ) * slots_y_ * VT_SLOT_SIZE * VT_SLOT_SIZE * 4;
+}
+
+size_t VirtualTextureCache::full_bytes() const
+{
+	size_t bytes = 0;
+	for ( const Texture * texture : textures_ )
+	{
+		for ( int level = 0; level < texture->no_mips(); ++level )
+		{
+			bytes += static_cast<size_t>( max( 1, texture->width() >> level ) ) * max( 1, texture->height() >> level ) * 4;
+		}
+	}
+
+	return bytes;
+}
@@ -0,0 +1,212 @@
+#ifndef VIRTUAL_TEXTURE_H_
+#define VIRTUAL_TEXTURE_H_
+
+#include "texture.h"
+#include "surface.h"
+#include "matrix4x4.h"
+#include "threadpool.h"
+#include <future>
+#include <deque>
+#include <unordered_set>
+
+/*! \def VT_TILE_SIZE
+\brief Size of the content of a single tile (px), must match vt_common.glsl.
+*/
+#define VT_TILE_SIZE 128
+
+/*! \def VT_TILE_BORDER
+\brief Texels repeated from the neighbouring tiles on each side of a tile for the bilinear filter (px).
+*/
+#define VT_TILE_BORDER 1
+
+/*! \def VT_SLOT_SIZE
+\brief Size of a single tile slot of the physical cache texture (px).
+*/
+#define VT_SLOT_SIZE ( VT_TILE_SIZE + 2 * VT_TILE_BORDER )
+
+/*! \def VT_MAX_LEVELS
+\brief Maximal number of paged mip levels of a single virtual texture, must match vt_common.glsl.
+*/
+#define VT_MAX_LEVELS 16
+
+/*! \def VT_NO_TILE
+\brief Feedback value of the pixels without any virtual texture.
+*/
+#define VT_NO_TILE 0xffffffffu
+
+/*! \def VT_FEEDBACK_SCALE
+\brief The feedback pass is rendered in 1 / VT_FEEDBACK_SCALE of the frame resolution.
+*/
+#define VT_FEEDBACK_SCALE 8
+
+/*! \def VT_FEEDBACK_LATENCY
+\brief Number of frames between the read of the feedback pass into the pixel buffers and its processing.
+*/
+#define VT_FEEDBACK_LATENCY 2
+
+/*! \class VirtualTextureCache
+\brief Virtual texturing of the scene textures through a software page table.
+
+Every texture added is split into VT_TILE_SIZE px tiles on each mip level down to the tail level, the first one
+which fits into a single tile. The fragment shaders sample a single physical cache texture of VT_SLOT_SIZE px slots
+whose assignment to the tiles is held by the page table (a shader storage buffer), a missing tile is replaced by
+the nearest coarser resident one. The tail tiles stay resident all the time so every lookup ends in a valid tile.
+
+The feedback pass renders the scene in a low resolution and writes the id of the tile each pixel needs
+(see vt_feedback.frag), the ids are read into a ring of VT_FEEDBACK_LATENCY fenced pixel buffers and handed out by
+\a EndFeedback that many frames later, so the read never stalls the pipeline. \a ProcessFeedback requests the missing tiles which are cut out of the host mip levels by
+the streaming thread and \a Update uploads them into the least recently used slots. \a ReferenceFeedback computes
+the same ids by the CPU rasterization of the scene, the ids of both are produced by \a TileId.
+
+The page table is emulated in software because the sparse textures are available neither on all drivers nor on
+Mesa llvmpipe. All methods but \a TileId and \a ReferenceFeedback have to be called with the GL context current,
+\a Release must be called before the context is destroyed.
+*/
+class VirtualTextureCache
+{
+public:
+	/* cache of slots_x x slots_y tile slots, at most max_uploads tiles are uploaded by a single Update */
+	VirtualTextureCache( const int slots_x = 16, const int slots_y = 16, const int max_uploads = 32 );
+	~VirtualTextureCache();
+
+	/* creates the physical cache texture, the page table, the feedback framebuffer of the given frame size and the ring
+	of the pixel buffers, latency 0 hands out the feedback of each frame at once (i.e. the naive glReadPixels) */
+	int Init( const int width, const int height, const int feedback_latency = VT_FEEDBACK_LATENCY );
+
+	/* registers the texture and uploads its tail tile, generates the host mip chain of textures without one,
+	returns the id of the virtual texture or -1 if there are too many of them */
+	int Add( Texture * texture );
+
+	/* binds the feedback framebuffer and clears it, the scene is then drawn with the feedback program */
+	void BeginFeedback();
+
+	/* reads the ids written by the feedback pass into the next pixel buffer of the ring, returns true and the ids of the
+	feedback read feedback_latency frames ago (row by row, feedback_width() x feedback_height()) if there is one */
+	bool EndFeedback( std::vector<unsigned int> & ids );
+
+	/* waits for the ids of the last feedback pass, meant for tests only */
+	void LatestFeedback( std::vector<unsigned int> & ids ) const;
+
+	/* requests the missing tiles of the feedback and marks the resident ones as used by the frame, coarser levels first */
+	void ProcessFeedback( const std::vector<unsigned int> & ids, const int frame );
+
+	/* uploads the tiles streamed in since the last call into the free or least recently used slots and updates the
+	page table, returns the number of uploaded tiles */
+	int Update( const int frame );
+
+	/* waits for all requested tiles and uploads them regardless of the upload limit, returns the number of uploaded tiles */
+	int Flush( const int frame );
+
+	/* uploads the changed virtual texture table and page table, binds the cache texture to the given texture unit and
+	both tables to the given shader storage buffer bindings */
+	void Bind( const GLuint texture_unit, const GLuint textures_binding, const GLuint page_table_binding );
+
+	/* id of the tile needed by the sample of the virtual texture with the texture coordinates u, v and their screen space
+	derivatives (the same as the feedback pass computes), lod_bias is added to the mip level */
+	unsigned int TileId( const int texture, const float u, const float v, const float dudx, const float dvdx,
+		const float dudy, const float dvdy, const float lod_bias ) const;
+
+	/* CPU reference of the feedback pass, rasterizes the triangles of the surfaces transformed by mvp into the
+	width x height buffer with the depth test and writes the tile ids of the visible pixels into ids,
+	material_textures maps the material indices to the virtual texture ids (-1 for none) */
+	void ReferenceFeedback( const std::vector<Surface *> & surfaces, const std::vector<int> & material_textures,
+		const Matrix4x4 & mvp, const int width, const int height, const float lod_bias, std::vector<unsigned int> & ids ) const;
+
+	/* deletes all GL objects and waits for the streaming thread */
+	void Release();
+
+	int feedback_width() const;
+	int feedback_height() const;
+
+	/* mip level bias of the feedback pass, its derivatives are VT_FEEDBACK_SCALE times larger than in the frame */
+	float feedback_lod_bias() const;
+
+	size_t no_textures() const;
+	size_t no_resident_tiles() const;
+
+	/* number of tiles uploaded into the cache, evicted from it and currently being streamed */
+	size_t no_uploads() const;
+	size_t no_evictions() const;
+	size_t no_pending() const;
+
+	/* size of the cache texture and of the RGBA8 mip chains of all virtual textures if they were uploaded in full (bytes) */
+	size_t cache_bytes() const;
+	size_t full_bytes() const;
+
+	/* packs and unpacks the tile ids, 12 bits of the texture, 4 bits of the level and 8 bits of each tile coordinate */
+	static unsigned int PackTile( const int texture, const int level, const int x, const int y );
+	static void UnpackTile( const unsigned int id, int & texture, int & level, int & x, int & y );
+
+private:
+	/* GPU record of a single virtual texture, see VirtualTexture in vt_common.glsl */
+	struct GLVirtualTexture
+	{
+		GLint width;
+		GLint height;
+		GLint no_levels; // paged levels including the tail level
+		GLint pad;
+		GLint level_offsets[VT_MAX_LEVELS]; // first page table entry of each level
+	};
+
+	struct Slot
+	{
+		unsigned int tile{ VT_NO_TILE }; // tile held by the slot
+		int last_used{ -1 }; // frame
+		bool pinned{ false }; // tail tiles are never evicted
+	};
+
+	/* index of the page table entry of the tile */
+	size_t PageEntry( const unsigned int tile ) const;
+
+	/* cuts the tile with its border out of the host mip level */
+	static std::vector<BYTE> CutTile( const Texture * texture, const int level, const int x, const int y );
+
+	/* uploads the tile into a free or the least recently used slot not used by the frame, returns false if there is none */
+	bool UploadTile( const unsigned int tile, const std::vector<BYTE> & rgba, const int frame, const bool pinned );
+
+	/* pixel buffer of the feedback of a frame */
+	struct FeedbackSlot
+	{
+		GLuint buffer{ 0 };
+		GLsync fence{ nullptr }; // of the read, nullptr if the slot is free
+	};
+
+	/* waits for the read of the slot and copies its ids out */
+	void RetireFeedback( FeedbackSlot & slot, std::vector<unsigned int> & ids );
+
+	int slots_x_{ 0 };
+	int slots_y_{ 0 };
+	int max_uploads_{ 0 };
+
+	std::vector<Texture *> textures_;
+	std::vector<GLVirtualTexture> gl_textures_;
+	std::vector<GLuint> page_table_; // bit 31 marks resident tiles, bits 0-15 and 16-30 are the coordinates of their slots
+	std::vector<Slot> slots_;
+	bool tables_dirty_{ false }; // gl_textures_ or page_table_ changed since the last Bind
+	size_t gl_page_table_size_{ 0 }; // entries of ssbo_page_table_
+
+	std::deque<std::pair<unsigned int, std::future<std::vector<BYTE>>>> pending_; // tiles being streamed in the order of requests
+	std::unordered_set<unsigned int> pending_tiles_;
+	ThreadPool streamer_{ 1 }; // cuts the requested tiles out of the host mip levels
+
+	GLuint cache_texture_{ 0 };
+	GLuint ssbo_textures_{ 0 };
+	GLuint ssbo_page_table_{ 0 };
+	GLuint feedback_fbo_{ 0 };
+	GLuint feedback_color_{ 0 };
+	GLuint feedback_depth_{ 0 };
+	int feedback_width_{ 0 };
+	int feedback_height_{ 0 };
+	std::vector<FeedbackSlot> feedback_slots_;
+	int next_feedback_{ 0 }; // slot of the next EndFeedback
+	int last_feedback_{ -1 }; // slot of the last EndFeedback
+	int feedback_latency_{ VT_FEEDBACK_LATENCY };
+
+	size_t no_uploads_{ 0 };
+	size_t no_evictions_{ 0 };
+
+	VirtualTextureCache( const VirtualTextureCache & ) = delete;
+	VirtualTextureCache & operator=( const VirtualTextureCache & ) = delete;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#version 450 core
+// shared by vt_shader.frag and vt_feedback.frag, see VirtualTextureCache
+
+// must match VT_TILE_SIZE, VT_TILE_BORDER, VT_MAX_LEVELS and VT_NO_TILE of virtualtexture.h
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 1
+#define VT_SLOT_SIZE ( VT_TILE_SIZE + 2 * VT_TILE_BORDER )
+#define VT_MAX_LEVELS 16
+#define VT_NO_TILE 0xffffffffu
+#define VT_RESIDENT_BIT 0x80000000u
+
+struct Material
+{
+	vec3 diffuse;
+	vec3 specular;
+	vec3 ambient;
+	int shininess;
+	uvec2 tex_diffuse; // id of the virtual texture in x, VT_NO_TILE for none
+};
+
+layout ( std430, binding = 0 ) readonly buffer Materials
+{
+	Material materials[]; // only the last member can be unsized array
+};
+
+struct VirtualTexture
+{
+	ivec2 size; // base level size (px)
+	int no_levels; // paged levels including the tail level
+	int pad;
+	int level_offsets[VT_MAX_LEVELS]; // first page table entry of each level
+};
+
+layout ( std430, binding = 1 ) readonly buffer VirtualTextures
+{
+	VirtualTexture virtual_textures[];
+};
+
+layout ( std430, binding = 2 ) readonly buffer PageTable
+{
+	uint page_table[]; // resident bit and the coordinates of the slot of each tile
+};
+
+layout ( binding = 0 ) uniform sampler2D tile_cache;
+
+// mip level of the sample, the same as VirtualTextureCache::TileId
+int VirtualLevel( uint vt, vec2 duvdx, vec2 duvdy, float lod_bias )
+{
+	vec2 size = vec2( virtual_textures[vt].size );
+	float rho = max( length( duvdx * size ), length( duvdy * size ) );
+	float lod = log2( max( rho, 1e-8f ) ) + lod_bias;
+
+	return clamp( int( floor( lod + 0.5f ) ), 0, virtual_textures[vt].no_levels - 1 );
+}
+
+ivec2 LevelSize( uint vt, int level )
+{
+	return max( virtual_textures[vt].size >> level, ivec2( 1 ) );
+}
+
+// texel of the level addressed with the repeat wrap mode
+ivec2 VirtualTexel( vec2 uv, ivec2 level_size )
+{
+	return min( ivec2( fract( uv ) * vec2( level_size ) ), level_size - 1 );
+}
+
+uint VirtualTile( uint vt, int level, ivec2 tile )
+{
+	return ( vt << 20 ) | ( uint( level ) << 16 ) | ( uint( tile.y ) << 8 ) | uint( tile.x );
+}
+
+// bilinear sample of the finest resident level not finer than the one required by the derivatives
+vec3 VirtualSample( uint vt, vec2 uv, vec2 duvdx, vec2 duvdy )
+{
+	for ( int level = VirtualLevel( vt, duvdx, duvdy, 0.0f ); level < virtual_textures[vt].no_levels; ++level )
+	{
+		ivec2 level_size = LevelSize( vt, level );
+		ivec2 tile = VirtualTexel( uv, level_size ) / VT_TILE_SIZE;
+		int tiles_x = ( level_size.x + VT_TILE_SIZE - 1 ) / VT_TILE_SIZE;
+		uint page = page_table[virtual_textures[vt].level_offsets[level] + tile.y * tiles_x + tile.x];
+
+		if ( ( page & VT_RESIDENT_BIT ) != 0u )
+		{
+			vec2 slot = vec2( page & 0xffffu, ( page >> 16 ) & 0x7fffu );
+			vec2 position = slot * VT_SLOT_SIZE + VT_TILE_BORDER + fract( uv ) * vec2( level_size ) - vec2( tile * VT_TILE_SIZE );
+
+			return textureLod( tile_cache, position / vec2( textureSize( tile_cache, 0 ) ), 0.0f ).rgb;
+		}
+	}
+
+	return vec3( 1.0f ); // without the tail tile
+}
@@ -0,0 +1,25 @@
+// feedback pass of the virtual textures, vt_common.glsl is prepended
+in vec2 texcoord;
+
+flat in int material_index;
+
+uniform float lod_bias; // the feedback framebuffer is smaller than the frame
+
+layout ( location = 0 ) out uint tile_id;
+
+void main( void )
+{
+	vec2 duvdx = dFdx( texcoord );
+	vec2 duvdy = dFdy( texcoord );
+	uint vt = materials[material_index].tex_diffuse.x;
+
+	if ( vt == VT_NO_TILE )
+	{
+		tile_id = VT_NO_TILE;
+	}
+	else
+	{
+		int level = VirtualLevel( vt, duvdx, duvdy, lod_bias );
+		tile_id = VirtualTile( vt, level, VirtualTexel( texcoord, LevelSize( vt, level ) ) / VT_TILE_SIZE );
+	}
+}
@@ -0,0 +1,28 @@
+// virtual texture variant of basic_shader.frag, vt_common.glsl is prepended
+in vec3 unified_normal;
+in vec2 texcoord;
+in float normalLightDot;
+in vec3 lr;
+in vec3 directionVector;
+
+out vec4 FragColor;
+
+flat in int material_index;
+
+void main( void )
+{
+	// derivatives outside of the page table lookup loop
+	vec2 duvdx = dFdx( texcoord );
+	vec2 duvdy = dFdy( texcoord );
+	uint tex_diffuse = materials[material_index].tex_diffuse.x;
+
+	vec3 texel = ( tex_diffuse != VT_NO_TILE ) ? VirtualSample( tex_diffuse, texcoord, duvdx, duvdy ) : vec3( 1.0f );
+
+	vec4 ambientPart = vec4(materials[material_index].ambient.rgb, 1.0f);
+
+	vec4 diffusePart =  vec4(materials[material_index].diffuse.rgb * texel, 1.0f ) * normalLightDot;
+
+	vec4 specularPart =  vec4(materials[material_index].specular.rgb * pow(clamp(dot(-directionVector, lr), 0.0f, 1.0f), materials[material_index].shininess), 1.0f);
+
+	FragColor = ambientPart + diffusePart + specularPart;
+}
@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "workstealingpool.h"
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool( const int no_threads )
+{
+	no_threads_ = ( no_threads > 0 ) ? no_threads : std::max( 1, static_cast<int>( std::thread::hardware_concurrency() ) );
+	ranges_.reset( new Range[no_threads_] );
+
+	for ( int i = 1; i < no_threads_; ++i )
+	{
+		workers_.push_back( std::thread( &WorkStealingPool::Worker, this, i ) );
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	start_.notify_all();
+
+	for ( std::thread & worker : workers_ )
+	{
+		worker.join();
+	}
+}
+
+void WorkStealingPool::Run( const int count, const std::function<void( const int, const int )> & body )
+{
+	if ( ( no_threads_ == 1 ) || ( count < 2 ) )
+	{
+		for ( int i = 0; i < count; ++i )
+		{
+			body( i, 0 );
+		}
+
+		return;
+	}
+
+	// all workers finished the previous loop, nobody touches the ranges
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		body_ = &body;
+		for ( int t = 0; t < no_threads_; ++t )
+		{
+			ranges_[t].begin = static_cast<int>( static_cast<long long>( count ) * t / no_threads_ );
+			ranges_[t].end = static_cast<int>( static_cast<long long>( count ) * ( t + 1 ) / no_threads_ );
+		}
+		no_finished_ = 0;
+		++generation_;
+	}
+	start_.notify_all();
+
+	WorkOn( 0 );
+
+	// every worker takes part in every loop, so none of them may pick up the ranges of the next one late
+	std::unique_lock<std::mutex> lock( mutex_ );
+	done_.wait( lock, [this]() { return no_finished_ == static_cast<int>( workers_.size() ); } );
+	body_ = nullptr;
+}
+
+int WorkStealingPool::no_threads() const
+{
+	return no_threads_;
+}
+
+size_t WorkStealingPool::no_steals() const
+{
+	return no_steals_;
+}
+
+void WorkStealingPool::Worker( const int thread )
+{
+	int generation = 0;
+
+	for ( ;; )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			start_.wait( lock, [&]() { return stop_ || ( generation_ != generation ); } );
+
+			if ( stop_ )
+			{
+				return;
+			}
+			generation = generation_;
+		}
+
+		WorkOn( thread );
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			if ( ++no_finished_ == static_cast<int>( workers_.size() ) )
+			{
+				done_.notify_one();
+			}
+		}
+	}
+}
+
+void WorkStealingPool::WorkOn( const int thread )
+{
+	int index;
+
+	while ( Pop( thread, index ) || ( Steal( thread ) && Pop( thread, index ) ) )
+	{
+		( *body_ )( index, thread );
+	}
+}
+
+bool WorkStealingPool::Pop( const int thread, int & index )
+{
+	Range & range = ranges_[thread];
+	std::lock_guard<std::mutex> lock( range.mutex );
+
+	if ( range.begin >= range.end )
+	{
+		return false;
+	}
+	index = range.begin++;
+
+	return true;
+}
+
+bool WorkStealingPool::Steal( const int thread )
+{
+	for ( int i = 1; i < no_threads_; ++i )
+	{
+		Range & victim = ranges_[( thread + i ) % no_threads_];
+		int begin, end;
+
+		{
+			std::lock_guard<std::mutex> lock( victim.mutex );
+			const int remaining = victim.end - victim.begin;
+			if ( remaining <= 0 )
+			{
+				continue;
+			}
+			// the victim keeps the front it is working on
+			end = victim.end;
+			begin = end - ( remaining + 1 ) / 2;
+			victim.end = begin;
+		}
+
+		{
+			Range & range = ranges_[thread];
+			std::lock_guard<std::mutex> lock( range.mutex );
+			range.begin = begin;
+			range.end = end;
+		}
+		++no_steals_;
+
+		return true;
+	}
+
+	return false;
+}
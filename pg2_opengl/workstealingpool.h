@@ -0,0 +1,73 @@
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+/*! \class WorkStealingPool
+\brief Persistent worker threads running the iterations of parallel loops, an idle thread steals from the busy ones.
+
+\a Run splits the indices into contiguous ranges, one per thread, so the neighbouring iterations (e.g. the tiles of
+the same rows) stay on the same thread. Each thread takes the indices from the front of its own range and once the
+range runs dry it takes the back half of the range of another thread. The calling thread works as one of the threads,
+the workers sleep between the loops so the pool costs nothing while idle.
+*/
+class WorkStealingPool
+{
+public:
+	/* starts no_threads - 1 workers, 0 means all hardware threads */
+	explicit WorkStealingPool( const int no_threads = 0 );
+	~WorkStealingPool();
+
+	/* calls body( index, thread ) for all indices from <0, count) and returns once all of them finished, thread is
+	from <0, no_threads()) and no two calls with the same thread run at once */
+	void Run( const int count, const std::function<void( const int, const int )> & body );
+
+	/* the calling thread included */
+	int no_threads() const;
+
+	/* ranges taken from other threads by all loops so far */
+	size_t no_steals() const;
+
+private:
+	/* indices [begin, end) left to the thread */
+	struct alignas( 64 ) Range
+	{
+		std::mutex mutex;
+		int begin{ 0 };
+		int end{ 0 };
+	};
+
+	void Worker( const int thread );
+
+	/* runs the indices of the own range and of the stolen ones until all ranges are empty */
+	void WorkOn( const int thread );
+
+	/* takes the next index of the own range */
+	bool Pop( const int thread, int & index );
+
+	/* moves the back half of the first nonempty range of the other threads into the own range */
+	bool Steal( const int thread );
+
+	std::vector<std::thread> workers_;
+	std::unique_ptr<Range[]> ranges_; // one per thread, the calling thread is the first one
+	int no_threads_{ 1 };
+	const std::function<void( const int, const int )> * body_{ nullptr }; // of the running loop
+	std::mutex mutex_; // guards generation_, no_finished_ and stop_
+	std::condition_variable start_; // signals a new loop and the shutdown
+	std::condition_variable done_; // signals the last worker finishing the loop
+	int generation_{ 0 }; // number of loops started
+	int no_finished_{ 0 }; // workers done with the running loop
+	bool stop_{ false };
+	std::atomic<size_t> no_steals_{ 0 };
+
+	WorkStealingPool( const WorkStealingPool & ) = delete;
+	WorkStealingPool & operator=( const WorkStealingPool & ) = delete;
+};
+
+#endif